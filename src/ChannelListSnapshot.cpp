@@ -0,0 +1,222 @@
+#include <cstring>
+#include <kodi/AddonBase.h>
+#include <kodi/Filesystem.h>
+#include "ChannelListSnapshot.hpp"
+
+namespace PvrClient {
+
+static const char c_Magic[8] = {'P', 'Z', 'C', 'H', 'L', 'S', 'T', 'S'};
+static const uint32_t c_Version = 1;
+static const uint32_t c_ByteOrderMark = 0x01020304;
+// Protection from garbage sizes, far above real playlists
+static const uint32_t c_MaxItems = 1000000;
+
+#pragma mark - SnapshotWriter/Reader
+
+void SnapshotWriter::String(std::string_view value)
+{
+    U32(static_cast<uint32_t>(value.size()));
+    m_data.append(value.data(), value.size());
+}
+
+bool SnapshotReader::Take(void* dest, size_t size)
+{
+    if(m_data.size() - m_pos < size)
+        return false;
+    memcpy(dest, m_data.data() + m_pos, size);
+    m_pos += size;
+    return true;
+}
+
+bool SnapshotReader::Bool(bool& value)
+{
+    char c;
+    if(!Take(&c, 1))
+        return false;
+    value = c != '\0';
+    return true;
+}
+
+bool SnapshotReader::String(std::string& value)
+{
+    uint32_t size;
+    if(!U32(size) || m_data.size() - m_pos < size)
+        return false;
+    value.assign(m_data.data() + m_pos, size);
+    m_pos += size;
+    return true;
+}
+
+#pragma mark - ChannelListSnapshot
+
+static void WriteChannel(SnapshotWriter& out, const Channel& channel)
+{
+    out.U32(channel.UniqueId);
+    out.U32(channel.EpgId);
+    out.U32(channel.Number);
+    out.String(channel.Name);
+    out.String(channel.IconPath);
+    out.U32(static_cast<uint32_t>(channel.Urls.size()));
+    for(const auto& url : channel.Urls)
+        out.String(url);
+    out.Bool(channel.HasArchive);
+    out.Bool(channel.IsRadio);
+    out.I32(channel.TvgShift);
+    out.I32(channel.PreloadingInterval);
+}
+
+static bool ReadChannel(SnapshotReader& in, Channel& channel)
+{
+    uint32_t urlCount;
+    if(!in.U32(channel.UniqueId) || !in.U32(channel.EpgId) || !in.U32(channel.Number)
+       || !in.String(channel.Name) || !in.String(channel.IconPath) || !in.U32(urlCount) || urlCount > c_MaxItems)
+        return false;
+    channel.Urls.resize(urlCount);
+    for(auto& url : channel.Urls) {
+        if(!in.String(url))
+            return false;
+    }
+    int32_t tvgShift, preloadingInterval;
+    if(!in.Bool(channel.HasArchive) || !in.Bool(channel.IsRadio) || !in.I32(tvgShift) || !in.I32(preloadingInterval))
+        return false;
+    channel.TvgShift = tvgShift;
+    channel.PreloadingInterval = preloadingInterval;
+    return true;
+}
+
+std::string ChannelListSnapshot::Content(const ExtraWriter& writeExtra) const
+{
+    SnapshotWriter out;
+    out.U32(static_cast<uint32_t>(Channels.size()));
+    for(const auto& channel : Channels)
+        WriteChannel(out, channel.second);
+    out.U32(static_cast<uint32_t>(Groups.size()));
+    for(const auto& group : Groups) {
+        out.I32(group.first);
+        out.String(group.second.Name);
+        out.U32(static_cast<uint32_t>(group.second.Channels.size()));
+        for(const auto& member : group.second.Channels) {
+            out.I32(member.first);
+            out.U32(member.second);
+        }
+    }
+    if(writeExtra)
+        writeExtra(out);
+    return out.Data();
+}
+
+bool ChannelListSnapshot::Save(const std::string& path, std::string_view settingsKey, const ExtraWriter& writeExtra) const
+{
+    SnapshotWriter out;
+    out.U32(c_Version);
+    out.U32(c_ByteOrderMark);
+    out.String(settingsKey);
+    out.U64(SourceHash);
+    out.U64(static_cast<uint64_t>(ValidatedAt));
+    std::string data(c_Magic, sizeof(c_Magic));
+    data += out.Data();
+    data += Content(writeExtra);
+
+    const auto dirEnd = path.find_last_of('/');
+    if(dirEnd != std::string::npos)
+        kodi::vfs::CreateDirectory(path.substr(0, dirEnd + 1));
+    const std::string tempPath = path + ".tmp";
+    kodi::vfs::CFile file;
+    if(!file.OpenFileForWrite(tempPath, true)) {
+        kodi::Log(ADDON_LOG_ERROR, "ChannelListSnapshot: failed to create %s", tempPath.c_str());
+        return false;
+    }
+    const bool isOk = file.Write(data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    file.Close();
+    if(!isOk) {
+        kodi::Log(ADDON_LOG_ERROR, "ChannelListSnapshot: failed to write %s", tempPath.c_str());
+        kodi::vfs::DeleteFile(tempPath);
+        return false;
+    }
+    kodi::vfs::DeleteFile(path);
+    if(!kodi::vfs::RenameFile(tempPath, path)) {
+        kodi::Log(ADDON_LOG_ERROR, "ChannelListSnapshot: failed to rename %s", tempPath.c_str());
+        kodi::vfs::DeleteFile(tempPath);
+        return false;
+    }
+    return true;
+}
+
+bool ChannelListSnapshot::Load(const std::string& path, std::string_view settingsKey, const ExtraReader& readExtra)
+{
+    if(!kodi::vfs::FileExists(path, false))
+        return false;
+    kodi::vfs::CFile file;
+    if(!file.OpenFile(path))
+        return false;
+    const int64_t length = file.GetLength();
+    std::string data(length > 0 ? static_cast<size_t>(length) : 0, '\0');
+    const bool isRead = length > 0 && file.Read(&data[0], data.size()) == static_cast<ssize_t>(data.size());
+    file.Close();
+    if(!isRead || data.size() < sizeof(c_Magic) || memcmp(data.data(), c_Magic, sizeof(c_Magic)) != 0)
+        return false;
+
+    SnapshotReader in(std::string_view(data).substr(sizeof(c_Magic)));
+    uint32_t version, byteOrder;
+    std::string storedKey;
+    uint64_t sourceHash, validatedAt;
+    if(!in.U32(version) || version != c_Version || !in.U32(byteOrder) || byteOrder != c_ByteOrderMark
+       || !in.String(storedKey) || storedKey != settingsKey || !in.U64(sourceHash) || !in.U64(validatedAt)) {
+        kodi::Log(ADDON_LOG_DEBUG, "ChannelListSnapshot: %s is outdated, ignored.", path.c_str());
+        return false;
+    }
+
+    ChannelList channels;
+    GroupList groups;
+    uint32_t count;
+    if(!in.U32(count) || count > c_MaxItems)
+        return false;
+    for(uint32_t i = 0; i < count; ++i) {
+        Channel channel;
+        if(!ReadChannel(in, channel))
+            return false;
+        channels.emplace(channel.UniqueId, std::move(channel));
+    }
+    if(!in.U32(count) || count > c_MaxItems)
+        return false;
+    for(uint32_t i = 0; i < count; ++i) {
+        int32_t groupId;
+        uint32_t memberCount;
+        Group group;
+        if(!in.I32(groupId) || !in.String(group.Name) || !in.U32(memberCount) || memberCount > c_MaxItems)
+            return false;
+        for(uint32_t m = 0; m < memberCount; ++m) {
+            int32_t index;
+            uint32_t channelId;
+            if(!in.I32(index) || !in.U32(channelId))
+                return false;
+            group.Channels.emplace(index, channelId);
+        }
+        groups.emplace(groupId, std::move(group));
+    }
+    if(readExtra && !readExtra(in))
+        return false;
+    if(!in.IsEnd()) {
+        kodi::Log(ADDON_LOG_ERROR, "ChannelListSnapshot: %s is corrupted.", path.c_str());
+        return false;
+    }
+
+    SourceHash = sourceHash;
+    ValidatedAt = static_cast<time_t>(validatedAt);
+    Channels.swap(channels);
+    Groups.swap(groups);
+    return true;
+}
+
+uint64_t ChannelListSnapshot::Hash(std::string_view data)
+{
+    // FNV-1a, the file is not protected from intentional collisions
+    uint64_t hash = 14695981039346656037ULL;
+    for(const char c : data) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+} // namespace PvrClient
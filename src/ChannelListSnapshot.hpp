@@ -0,0 +1,80 @@
+#ifndef CHANNEL_LIST_SNAPSHOT_HPP
+#define CHANNEL_LIST_SNAPSHOT_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <string_view>
+#include "pvr_client_types.h"
+
+namespace PvrClient {
+
+// Little endian (native) binary fields of snapshot payload
+class SnapshotWriter
+{
+public:
+    void U32(uint32_t value) { Append(&value, sizeof(value)); }
+    void I32(int32_t value) { Append(&value, sizeof(value)); }
+    void U64(uint64_t value) { Append(&value, sizeof(value)); }
+    void Bool(bool value) { m_data += value ? '\1' : '\0'; }
+    void String(std::string_view value);
+
+    const std::string& Data() const { return m_data; }
+
+private:
+    void Append(const void* data, size_t size) { m_data.append(static_cast<const char*>(data), size); }
+
+    std::string m_data;
+};
+
+// Every getter returns false after the end of data
+class SnapshotReader
+{
+public:
+    explicit SnapshotReader(std::string_view data) : m_data(data) {}
+
+    bool U32(uint32_t& value) { return Take(&value, sizeof(value)); }
+    bool I32(int32_t& value) { return Take(&value, sizeof(value)); }
+    bool U64(uint64_t& value) { return Take(&value, sizeof(value)); }
+    bool Bool(bool& value);
+    bool String(std::string& value);
+
+    bool IsEnd() const { return m_pos == m_data.size(); }
+
+private:
+    bool Take(void* dest, size_t size);
+
+    std::string_view m_data;
+    size_t m_pos = 0;
+};
+
+// Channels and groups as they were resolved last time (playlist parsed,
+// EPG ids matched), kept in a versioned binary file. Startup serves the list
+// from it without network, revalidation compares SourceHash of freshly
+// downloaded data first and resolves the list only when the source has changed.
+// Client specific data (archive templates, LUTs) goes to the extra section.
+struct ChannelListSnapshot
+{
+    typedef std::function<void(SnapshotWriter&)> ExtraWriter;
+    typedef std::function<bool(SnapshotReader&)> ExtraReader;
+
+    uint64_t SourceHash = 0;
+    // When the source was downloaded and compared last time
+    time_t ValidatedAt = 0;
+    ChannelList Channels;
+    GroupList Groups;
+
+    // settingsKey identifies settings the list was resolved with (URLs etc.),
+    // file of other settings, version or byte order is ignored
+    bool Load(const std::string& path, std::string_view settingsKey, const ExtraReader& readExtra);
+    bool Save(const std::string& path, std::string_view settingsKey, const ExtraWriter& writeExtra) const;
+    // Everything but SourceHash and ValidatedAt, equal for equal lists
+    std::string Content(const ExtraWriter& writeExtra) const;
+
+    static uint64_t Hash(std::string_view data);
+};
+
+} // namespace PvrClient
+
+#endif // CHANNEL_LIST_SNAPSHOT_HPP
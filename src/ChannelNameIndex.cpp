@@ -0,0 +1,122 @@
+#include <cstdint>
+#include "ChannelNameIndex.hpp"
+
+namespace Helpers {
+
+// Simple (1:1) lower case mapping of the scripts used in channel names
+static uint32_t FoldCase(uint32_t cp)
+{
+    if(cp < 0x80)
+        return (cp >= 'A' && cp <= 'Z') ? cp + 32 : cp;
+    // Latin-1 Supplement, except multiplication sign
+    if(cp >= 0xC0 && cp <= 0xDE && cp != 0xD7)
+        return cp + 32;
+    // Latin Extended-A: pairs starting at even or odd code points
+    if((cp >= 0x100 && cp <= 0x137 && cp != 0x130) || (cp >= 0x14A && cp <= 0x177))
+        return cp | 1;
+    if((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E))
+        return (cp & 1) ? cp + 1 : cp;
+    // Its lower case is in Latin-1
+    if(cp == 0x178)
+        return 0xFF; // Ÿ -> ÿ
+    // Greek
+    if(cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2)
+        return cp + 32;
+    // Cyrillic
+    if(cp == 0x401 || cp == 0x451)
+        return 0x435; // Ё, ё -> е
+    if(cp >= 0x400 && cp <= 0x40F)
+        return cp + 80;
+    if(cp >= 0x410 && cp <= 0x42F)
+        return cp + 32;
+    if((cp >= 0x460 && cp <= 0x481) || (cp >= 0x48A && cp <= 0x4BF))
+        return cp | 1;
+    return cp;
+}
+
+static bool IsSpace(uint32_t cp)
+{
+    return cp == ' ' || cp == '\t' || cp == '\n' || cp == '\r' || cp == 0xA0;
+}
+
+static void AppendUtf8(std::string& out, uint32_t cp)
+{
+    if(cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if(cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if(cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Decodes one code point at pos, advances pos.
+// Malformed sequence yields false and its first byte in cp.
+static bool NextCodePoint(std::string_view str, size_t& pos, uint32_t& cp)
+{
+    const uint8_t lead = static_cast<uint8_t>(str[pos]);
+    size_t length = 1;
+    cp = lead;
+    if(lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        cp = lead & 0x1F;
+    } else if(lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        cp = lead & 0x0F;
+    } else if(lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        cp = lead & 0x07;
+    }
+    if(length == 1 || pos + length > str.size()) {
+        ++pos;
+        cp = lead;
+        return lead < 0x80;
+    }
+    for(size_t i = 1; i < length; ++i) {
+        const uint8_t next = static_cast<uint8_t>(str[pos + i]);
+        if((next & 0xC0) != 0x80) {
+            ++pos;
+            cp = lead;
+            return false;
+        }
+        cp = (cp << 6) | (next & 0x3F);
+    }
+    pos += length;
+    return true;
+}
+
+std::string NormalizeChannelName(std::string_view name)
+{
+    std::string result;
+    result.reserve(name.size());
+    bool pendingSpace = false;
+    size_t pos = 0;
+    while(pos < name.size()) {
+        uint32_t cp;
+        const bool isValid = NextCodePoint(name, pos, cp);
+        if(isValid && IsSpace(cp)) {
+            pendingSpace = !result.empty();
+            continue;
+        }
+        if(pendingSpace) {
+            result += ' ';
+            pendingSpace = false;
+        }
+        // Malformed byte is kept, not taken for a Latin-1 character
+        if(isValid)
+            AppendUtf8(result, FoldCase(cp));
+        else
+            result += static_cast<char>(cp);
+    }
+    return result;
+}
+
+} // namespace Helpers
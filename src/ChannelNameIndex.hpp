@@ -0,0 +1,51 @@
+#ifndef CHANNEL_NAME_INDEX_HPP
+#define CHANNEL_NAME_INDEX_HPP
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace Helpers {
+
+// Key for channel name matching: UTF-8 lower case (Latin, Greek, Cyrillic),
+// 'ё' folded to 'е', runs of white space (NBSP too) collapsed to one space, trimmed.
+// Bytes of malformed UTF-8 are kept as they are.
+std::string NormalizeChannelName(std::string_view name);
+
+// Hash lookup of playlist channels by EPG display name.
+// Built once per playlist, lookup is one normalization and one hash probe.
+template<class TValue>
+class ChannelNameIndex
+{
+public:
+    // The first value added under a name wins, like with map::emplace
+    bool Add(std::string_view name, TValue value) {
+        return m_index.emplace(NormalizeChannelName(name), std::move(value)).second;
+    }
+
+    // Known alternative spelling of a name already added,
+    // e.g. from a precomputed alias table. Fuzzy matching is not done on lookup.
+    bool AddAlias(std::string_view alias, std::string_view name) {
+        auto it = m_index.find(NormalizeChannelName(name));
+        if(it == m_index.end())
+            return false;
+        return m_index.emplace(NormalizeChannelName(alias), it->second).second;
+    }
+
+    TValue* Find(std::string_view name) {
+        auto it = m_index.find(NormalizeChannelName(name));
+        return it == m_index.end() ? nullptr : &it->second;
+    }
+
+    bool IsEmpty() const { return m_index.empty(); }
+    size_t Size() const { return m_index.size(); }
+    void Clear() { m_index.clear(); }
+
+private:
+    std::unordered_map<std::string, TValue> m_index;
+};
+
+} // namespace Helpers
+
+#endif // CHANNEL_NAME_INDEX_HPP
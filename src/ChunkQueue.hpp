@@ -0,0 +1,87 @@
+#ifndef CHUNK_QUEUE_HPP
+#define CHUNK_QUEUE_HPP
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
+namespace Helpers {
+
+// Bounded single-producer/single-consumer hand-off of data chunks
+// between a downloader and a parser running on different threads.
+// Push() blocks while the queue is full, so the amount of buffered
+// data never exceeds capacity * chunk size.
+class ChunkQueue {
+public:
+    explicit ChunkQueue(size_t capacity = 16)
+        : m_capacity(capacity ? capacity : 1) {}
+
+    ChunkQueue(const ChunkQueue&) = delete;
+    ChunkQueue& operator=(const ChunkQueue&) = delete;
+
+    // Returns false when consumer has gone (queue aborted).
+    bool Push(const char* data, size_t size) {
+        if (size == 0)
+            return !IsAborted();
+        return Push(std::string(data, size));
+    }
+
+    bool Push(std::string chunk) {
+        std::unique_lock lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_aborted || m_chunks.size() < m_capacity; });
+        if (m_aborted || m_closed)
+            return false;
+        m_chunks.push_back(std::move(chunk));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks until a chunk is available.
+    // Returns false on end of data (closed and drained) or abort.
+    bool Pop(std::string& chunk) {
+        std::unique_lock lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_aborted || m_closed || !m_chunks.empty(); });
+        if (m_aborted || m_chunks.empty())
+            return false;
+        chunk = std::move(m_chunks.front());
+        m_chunks.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // Producer is done. Consumer drains remaining chunks.
+    void Close() {
+        std::lock_guard lock(m_mutex);
+        m_closed = true;
+        m_notEmpty.notify_all();
+    }
+
+    // Either side gives up. Pending chunks are dropped.
+    void Abort() {
+        std::lock_guard lock(m_mutex);
+        m_aborted = true;
+        m_chunks.clear();
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    bool IsAborted() const {
+        std::lock_guard lock(m_mutex);
+        return m_aborted;
+    }
+
+private:
+    const size_t m_capacity;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::deque<std::string> m_chunks;
+    bool m_closed = false;
+    bool m_aborted = false;
+};
+
+} // namespace Helpers
+
+#endif // CHUNK_QUEUE_HPP
@@ -0,0 +1,414 @@
+#include "CurlMultiplexer.hpp"
+
+#ifdef IPTV_USE_SYSTEM_CURL
+
+#include <curl/curl.h>
+#include <cctype>
+#include <cstdlib>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace {
+    // Transfer is paused when consumer falls behind by this amount
+    const size_t c_maxBufferedBytes = 1024 * 1024;
+
+    struct TransferState
+    {
+        std::mutex mutex;
+        std::condition_variable event;
+        std::deque<std::string> chunks;
+        size_t bufferedBytes = 0;
+        bool paused = false;
+        bool done = false;
+        bool abandoned = false;
+        bool stopRequested = false;
+        CURLcode code = CURLE_OK;
+        CurlMultiplexer::Result info;
+
+        // Owned by the loop thread once added
+        CURL* easy = nullptr;
+        curl_slist* headers = nullptr;
+        char errorBuffer[CURL_ERROR_SIZE] = {0};
+    };
+
+    typedef std::shared_ptr<TransferState> TransferStatePtr;
+}
+
+struct CurlMultiplexer::Impl
+{
+    Impl()
+    {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        multi = curl_multi_init();
+        // Multiplex transfers to the same host over one HTTP/2 connection
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        loop = std::jthread([this](std::stop_token st) { Loop(st); });
+    }
+
+    ~Impl()
+    {
+        loop.request_stop();
+        curl_multi_wakeup(multi);
+        if(loop.joinable())
+            loop.join();
+        curl_multi_cleanup(multi);
+    }
+
+    void Post(std::function<void()> command)
+    {
+        {
+            std::lock_guard<std::mutex> lock(commandsMutex);
+            commands.push_back(std::move(command));
+        }
+        curl_multi_wakeup(multi);
+    }
+
+    // Loop thread only
+    void Add(const TransferStatePtr& state)
+    {
+        bool abandoned;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            abandoned = state->abandoned;
+        }
+        if(abandoned) {
+            Release(state);
+            return;
+        }
+        active[state->easy] = state;
+        curl_multi_add_handle(multi, state->easy);
+    }
+
+    // Loop thread only
+    void Remove(const TransferStatePtr& state)
+    {
+        auto it = active.find(state->easy);
+        if(it == active.end())
+            return;
+        curl_multi_remove_handle(multi, state->easy);
+        active.erase(it);
+        Release(state);
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->done = true;
+        state->code = CURLE_ABORTED_BY_CALLBACK;
+        state->info.Cancelled = true;
+        state->event.notify_all();
+    }
+
+    // Loop thread only
+    void Resume(const TransferStatePtr& state)
+    {
+        if(active.count(state->easy) != 0)
+            curl_easy_pause(state->easy, CURLPAUSE_CONT);
+    }
+
+    static int64_t Microseconds(CURL* easy, CURLINFO info)
+    {
+        curl_off_t value = -1;
+        if(CURLE_OK != curl_easy_getinfo(easy, info, &value))
+            return -1;
+        return value;
+    }
+
+    // Loop thread only
+    void Finish(CURL* easy, CURLcode code)
+    {
+        auto it = active.find(easy);
+        if(it == active.end())
+            return;
+        auto state = it->second;
+        curl_multi_remove_handle(multi, easy);
+        active.erase(it);
+
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            auto& info = state->info;
+            state->code = code;
+            curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &info.HttpStatus);
+            char* effectiveUrl = nullptr;
+            if(CURLE_OK == curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &effectiveUrl) && effectiveUrl)
+                info.EffectiveUrl = effectiveUrl;
+            long httpVersion = 0;
+            curl_easy_getinfo(easy, CURLINFO_HTTP_VERSION, &httpVersion);
+            info.IsHttp2 = httpVersion == CURL_HTTP_VERSION_2_0;
+            info.DnsUs = Microseconds(easy, CURLINFO_NAMELOOKUP_TIME_T);
+            info.ConnectUs = Microseconds(easy, CURLINFO_CONNECT_TIME_T);
+            info.TlsUs = Microseconds(easy, CURLINFO_APPCONNECT_TIME_T);
+            info.FirstByteUs = Microseconds(easy, CURLINFO_STARTTRANSFER_TIME_T);
+            info.TotalUs = Microseconds(easy, CURLINFO_TOTAL_TIME_T);
+            if(CURLE_OK != code)
+                info.Error = state->errorBuffer[0] ? state->errorBuffer : curl_easy_strerror(code);
+            state->done = true;
+            state->event.notify_all();
+        }
+        Release(state);
+    }
+
+    static void Release(const TransferStatePtr& state)
+    {
+        if(state->easy) {
+            curl_easy_cleanup(state->easy);
+            state->easy = nullptr;
+        }
+        if(state->headers) {
+            curl_slist_free_all(state->headers);
+            state->headers = nullptr;
+        }
+    }
+
+    static size_t Write(char* ptr, size_t size, size_t nmemb, void* userdata)
+    {
+        auto state = static_cast<TransferState*>(userdata);
+        const size_t bytes = size * nmemb;
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if(state->abandoned)
+            return 0; // aborts transfer
+        if(state->bufferedBytes >= c_maxBufferedBytes) {
+            // Consumer is behind. Same data will be delivered again on resume.
+            state->paused = true;
+            return CURL_WRITEFUNC_PAUSE;
+        }
+        if(state->info.ContentType.empty()) {
+            char* contentType = nullptr;
+            if(CURLE_OK == curl_easy_getinfo(state->easy, CURLINFO_CONTENT_TYPE, &contentType) && contentType)
+                state->info.ContentType = contentType;
+            curl_easy_getinfo(state->easy, CURLINFO_RESPONSE_CODE, &state->info.HttpStatus);
+        }
+        state->info.WireBytes += bytes;
+        state->chunks.emplace_back(ptr, bytes);
+        state->bufferedBytes += bytes;
+        state->event.notify_one();
+        return bytes;
+    }
+
+    static size_t Header(char* buffer, size_t size, size_t nitems, void* userdata)
+    {
+        auto state = static_cast<TransferState*>(userdata);
+        const size_t bytes = size * nitems;
+        std::string line(buffer, bytes);
+        while(!line.empty() && (line.back() == '\r' || line.back() == '\n' || line.back() == ' '))
+            line.pop_back();
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if(line.compare(0, 5, "HTTP/") == 0) {
+            // New response (e.g. after redirect)
+            state->info.ContentEncoding.clear();
+            return bytes;
+        }
+        const auto colon = line.find(':');
+        if(colon == std::string::npos)
+            return bytes;
+        std::string name = line.substr(0, colon);
+        for(auto& c : name)
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if(name == "content-encoding") {
+            const auto valueStart = line.find_first_not_of(' ', colon + 1);
+            state->info.ContentEncoding = valueStart == std::string::npos ? std::string() : line.substr(valueStart);
+        }
+        return bytes;
+    }
+
+    void Loop(std::stop_token stopToken)
+    {
+        while(!stopToken.stop_requested()) {
+            std::vector<std::function<void()>> pending;
+            {
+                std::lock_guard<std::mutex> lock(commandsMutex);
+                pending.swap(commands);
+            }
+            for(auto& command : pending)
+                command();
+
+            int running = 0;
+            curl_multi_perform(multi, &running);
+
+            CURLMsg* msg = nullptr;
+            int left = 0;
+            while((msg = curl_multi_info_read(multi, &left)) != nullptr) {
+                if(CURLMSG_DONE == msg->msg)
+                    Finish(msg->easy_handle, msg->data.result);
+            }
+
+            curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+        }
+
+        // Shutting down: release everything still in flight
+        auto transfers = active;
+        for(auto& transfer : transfers)
+            Remove(transfer.second);
+    }
+
+    CURLM* multi = nullptr;
+    std::mutex commandsMutex;
+    std::vector<std::function<void()>> commands;
+    std::map<CURL*, TransferStatePtr> active;
+    std::jthread loop;
+};
+
+bool CurlMultiplexer::IsAvailable()
+{
+    return true;
+}
+
+CurlMultiplexer::CurlMultiplexer()
+: m_impl(new Impl())
+{
+}
+
+CurlMultiplexer::~CurlMultiplexer()
+{
+}
+
+CurlMultiplexer& CurlMultiplexer::Instance()
+{
+    static CurlMultiplexer s_instance;
+    return s_instance;
+}
+
+bool CurlMultiplexer::Perform(const Transfer& transfer, const TChunkHandler& onChunk, Result& result)
+{
+    auto state = std::make_shared<TransferState>();
+    CURL* easy = state->easy = curl_easy_init();
+    if(nullptr == easy) {
+        result.Error = "curl_easy_init() failed";
+        return false;
+    }
+
+    curl_easy_setopt(easy, CURLOPT_URL, transfer.Url.c_str());
+    // h2 over TLS when server supports it, HTTP/1.1 otherwise
+    curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    // Prefer waiting for an existing connection to multiplex over opening a new one
+    curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(easy, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, transfer.TimeoutSec);
+    // Stalled transfer timeout, like Kodi's curl file does
+    curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, transfer.TimeoutSec);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, &Impl::Write);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, state.get());
+    curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, &Impl::Header);
+    curl_easy_setopt(easy, CURLOPT_HEADERDATA, state.get());
+    curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, state->errorBuffer);
+    // Private CA (e.g. local test server), same variable curl tool reads
+    if(const char* caBundle = std::getenv("CURL_CA_BUNDLE"))
+        curl_easy_setopt(easy, CURLOPT_CAINFO, caBundle);
+    for(const auto& header : transfer.Headers)
+        state->headers = curl_slist_append(state->headers, header.c_str());
+    if(state->headers)
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, state->headers);
+    if(!transfer.Cookie.empty())
+        curl_easy_setopt(easy, CURLOPT_COOKIE, transfer.Cookie.c_str());
+    if(!transfer.PostData.empty()) {
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, (long)transfer.PostData.size());
+        curl_easy_setopt(easy, CURLOPT_COPYPOSTFIELDS, transfer.PostData.c_str());
+    }
+
+    auto impl = m_impl.get();
+    impl->Post([impl, state] { impl->Add(state); });
+
+    std::stop_callback onStop(transfer.StopToken, [state] {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopRequested = true;
+        state->event.notify_all();
+    });
+
+    bool firstChunk = true;
+    bool abandon = false;
+    std::exception_ptr error;
+    bool done = false;
+    while(!abandon && !done) {
+        std::string chunk;
+        bool resume = false;
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->event.wait(lock, [&state] {
+                return !state->chunks.empty() || state->done || state->stopRequested;
+            });
+            if(state->stopRequested) {
+                abandon = true;
+                result.Cancelled = true;
+                break;
+            }
+            if(state->chunks.empty()) {
+                done = state->done;
+                continue;
+            }
+            chunk = std::move(state->chunks.front());
+            state->chunks.pop_front();
+            state->bufferedBytes -= chunk.size();
+            if(state->paused && state->bufferedBytes < c_maxBufferedBytes / 2) {
+                state->paused = false;
+                resume = true;
+            }
+            if(firstChunk) {
+                result.HttpStatus = state->info.HttpStatus;
+                result.ContentType = state->info.ContentType;
+                result.ContentEncoding = state->info.ContentEncoding;
+                firstChunk = false;
+            }
+        }
+        if(resume)
+            impl->Post([impl, state] { impl->Resume(state); });
+        try {
+            if(!onChunk(chunk.data(), chunk.size()))
+                abandon = true;
+        } catch(...) {
+            // Consumer failed, drop the transfer and let the caller deal with it
+            error = std::current_exception();
+            abandon = true;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if(abandon && !state->done) {
+            state->abandoned = true;
+            impl->Post([impl, state] { impl->Remove(state); });
+        }
+        const bool cancelled = result.Cancelled;
+        result = state->info;
+        result.Cancelled = cancelled;
+        done = done && CURLE_OK == state->code;
+    }
+    if(error)
+        std::rethrow_exception(error);
+    return done;
+}
+
+#else // IPTV_USE_SYSTEM_CURL
+
+struct CurlMultiplexer::Impl
+{
+};
+
+bool CurlMultiplexer::IsAvailable()
+{
+    return false;
+}
+
+CurlMultiplexer::CurlMultiplexer()
+{
+}
+
+CurlMultiplexer::~CurlMultiplexer()
+{
+}
+
+CurlMultiplexer& CurlMultiplexer::Instance()
+{
+    static CurlMultiplexer s_instance;
+    return s_instance;
+}
+
+bool CurlMultiplexer::Perform(const Transfer&, const TChunkHandler&, Result& result)
+{
+    result.Error = "HTTP transport is not available, built with Kodi's curl";
+    return false;
+}
+
+#endif // IPTV_USE_SYSTEM_CURL
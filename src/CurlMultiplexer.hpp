@@ -0,0 +1,73 @@
+#ifndef CURL_MULTIPLEXER_HPP
+#define CURL_MULTIPLEXER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+// HTTP transport sharing connections between concurrent requests.
+// All transfers run on one libcurl multi handle with HTTP/2 multiplexing enabled,
+// so API calls and HLS segment loaders talking to the same host share a single
+// connection (and its congestion window) when the server speaks h2 over TLS.
+// Servers without h2 are negotiated down to HTTP/1.1 by ALPN.
+//
+// Available only when built against system libcurl (USE_KODI_FOR_CURL=OFF),
+// otherwise IsAvailable() returns false and callers stay on Kodi VFS.
+class CurlMultiplexer
+{
+public:
+    using TChunkHandler = std::function<bool(const char* data, size_t size)>;
+
+    struct Transfer
+    {
+        std::string Url;
+        std::string PostData;
+        std::vector<std::string> Headers; // "Name: value"
+        std::string Cookie;
+        long TimeoutSec = 15;
+        std::stop_token StopToken;
+    };
+
+    // Negative timings = not available. Timings are from start of the transfer.
+    struct Result
+    {
+        long HttpStatus = 0;
+        std::string ContentType;    // known before the first chunk is delivered
+        std::string ContentEncoding; // ditto, body is delivered as is (not decoded)
+        std::string EffectiveUrl;
+        std::string Error;
+        bool IsHttp2 = false;
+        bool Cancelled = false;
+        int64_t DnsUs = -1;
+        int64_t ConnectUs = -1;
+        int64_t TlsUs = -1;
+        int64_t FirstByteUs = -1;
+        int64_t TotalUs = -1;
+        uint64_t WireBytes = 0;
+    };
+
+    static bool IsAvailable();
+    static CurlMultiplexer& Instance();
+
+    // Runs the transfer and blocks until it is done, cancelled via StopToken
+    // or refused by onChunk. Body chunks are delivered on the calling thread.
+    // Returns false on transport error (see Result::Error) or cancellation.
+    // HTTP level errors are reported by Result::HttpStatus.
+    // Exception thrown by onChunk cancels the transfer and is rethrown.
+    bool Perform(const Transfer& transfer, const TChunkHandler& onChunk, Result& result);
+
+    ~CurlMultiplexer();
+
+private:
+    CurlMultiplexer();
+    CurlMultiplexer(const CurlMultiplexer&) = delete;
+    CurlMultiplexer& operator=(const CurlMultiplexer&) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+#endif // CURL_MULTIPLEXER_HPP
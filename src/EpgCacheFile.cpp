@@ -0,0 +1,612 @@
+#if (defined(_WIN32) || defined(__WIN32__))
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <vector>
+#include <kodi/AddonBase.h>
+#include <kodi/Filesystem.h>
+#include "EpgCacheFile.hpp"
+
+namespace PvrClient {
+
+static const char c_Magic[8] = {'P', 'Z', 'E', 'P', 'G', 'C', 'A', 'C'};
+static const uint32_t c_Version = 2;
+static const uint32_t c_ByteOrderMark = 0x01020304;
+// uint32 columns per entry: start, end, max end, id, title, description, icon, program id, category
+static const size_t c_NumOfColumns = 9;
+
+struct MappedEpgCache::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    int64_t expiration;
+    uint32_t channelCount;
+    uint32_t entryCount;
+    uint32_t stringCount;
+    uint32_t reserved;
+    uint64_t channelsOffset;
+    uint64_t idsOffset;
+    uint64_t stringOffsetsOffset;
+    uint64_t stringDataOffset;
+    uint64_t stringDataSize;
+};
+
+struct MappedEpgCache::ChannelRecord
+{
+    uint32_t channelId;
+    uint32_t entryCount;
+    uint64_t offset;
+};
+
+struct MappedEpgCache::IdRecord
+{
+    uint32_t id;
+    uint32_t channel;
+    uint32_t row;
+};
+
+struct MappedEpgCache::Section
+{
+    uint32_t size = 0;
+    const uint32_t* startTime = nullptr;
+    const uint32_t* endTime = nullptr;
+    const uint32_t* maxEndTime = nullptr;
+    const uint32_t* id = nullptr;
+    const uint32_t* title = nullptr;
+    const uint32_t* description = nullptr;
+    const uint32_t* iconPath = nullptr;
+    const uint32_t* programId = nullptr;
+    const uint32_t* category = nullptr;
+    const uint8_t* hasArchive = nullptr;
+};
+
+static uint64_t Align(uint64_t offset)
+{
+    return (offset + 7) & ~uint64_t(7);
+}
+
+static uint64_t SectionBytes(uint64_t numOfEntries)
+{
+    return Align(numOfEntries * (c_NumOfColumns * sizeof(uint32_t) + sizeof(uint8_t)));
+}
+
+// Generation files of path (path.1, path.2, ...), newest first
+static std::vector<std::pair<uint64_t, std::string>> Generations(const std::string& path)
+{
+    std::vector<std::pair<uint64_t, std::string>> generations;
+    const std::filesystem::path nativePath(kodi::vfs::TranslateSpecialProtocol(path));
+    const std::string prefix = nativePath.filename().string() + '.';
+    std::error_code error;
+    for(const auto& file : std::filesystem::directory_iterator(nativePath.parent_path(), error)) {
+        const std::string name = file.path().filename().string();
+        if(name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0
+           || name.find_first_not_of("0123456789", prefix.size()) != std::string::npos)
+            continue;
+        const uint64_t generation = std::strtoull(name.c_str() + prefix.size(), nullptr, 10);
+        generations.emplace_back(generation, path + '.' + std::to_string(generation));
+    }
+    std::sort(generations.begin(), generations.end(), std::greater<std::pair<uint64_t, std::string>>());
+    return generations;
+}
+
+#pragma mark - Writer
+
+// Sequential buffered output with running offset
+class EpgCacheWriter::FileWriter
+{
+public:
+    bool Open(const std::string& path) { return m_file.OpenFileForWrite(path, true); }
+
+    template<class T>
+    void Put(const T* data, size_t count) { Put(reinterpret_cast<const char*>(data), count * sizeof(T)); }
+    void Put(const char* data, size_t size) {
+        m_offset += size;
+        if(m_buffer.size() + size > c_BufferSize)
+            Flush();
+        if(size >= c_BufferSize)
+            m_isOk = m_isOk && m_file.Write(data, size) == static_cast<ssize_t>(size);
+        else
+            m_buffer.insert(m_buffer.end(), data, data + size);
+    }
+    void PadTo(uint64_t offset) {
+        static const char zeros[8] = {};
+        if(offset > m_offset)
+            Put(zeros, static_cast<size_t>(offset - m_offset));
+    }
+    // Overwrites the beginning of the file, e.g. header once sizes are known
+    void PutAtStart(const char* data, size_t size) {
+        Flush();
+        m_isOk = m_isOk && m_file.Seek(0, SEEK_SET) == 0 && m_file.Write(data, size) == static_cast<ssize_t>(size);
+    }
+    uint64_t Offset() const { return m_offset; }
+    bool Close() {
+        Flush();
+        m_file.Close();
+        return m_isOk;
+    }
+
+private:
+    static const size_t c_BufferSize = 256 * 1024;
+
+    void Flush() {
+        if(m_buffer.empty())
+            return;
+        m_isOk = m_isOk && m_file.Write(m_buffer.data(), m_buffer.size()) == static_cast<ssize_t>(m_buffer.size());
+        m_buffer.clear();
+    }
+
+    kodi::vfs::CFile m_file;
+    std::vector<char> m_buffer;
+    uint64_t m_offset = 0;
+    bool m_isOk = true;
+};
+
+EpgCacheWriter::EpgCacheWriter() = default;
+
+EpgCacheWriter::~EpgCacheWriter()
+{
+    Discard();
+}
+
+void EpgCacheWriter::Discard()
+{
+    if(!m_out)
+        return;
+    m_out->Close();
+    m_out.reset();
+    kodi::vfs::DeleteFile(m_tempPath);
+}
+
+bool EpgCacheWriter::Open(const std::string& path, time_t expiration)
+{
+    Discard();
+    // Next generation, the current one may be mapped
+    const auto generations = Generations(path);
+    m_path = path + '.' + std::to_string(generations.empty() ? 1 : generations.front().first + 1);
+    m_tempPath = m_path + ".tmp";
+    m_expiration = expiration;
+    m_channels.clear();
+    m_ids.clear();
+    m_strings.assign(1, std::string_view());
+    m_stringRefs.clear();
+    m_stringBytes = 0;
+    m_out.reset(new FileWriter());
+    if(!m_out->Open(m_tempPath)) {
+        kodi::Log(ADDON_LOG_ERROR, "EpgCacheWriter: failed to create %s", m_tempPath.c_str());
+        m_out.reset();
+        return m_isOk = false;
+    }
+    // Header is not known yet, zeros fail validation until Finish() writes it
+    m_out->PadTo(Align(sizeof(MappedEpgCache::Header)));
+    return m_isOk = true;
+}
+
+uint32_t EpgCacheWriter::Intern(std::string_view value)
+{
+    if(value.empty())
+        return 0;
+    auto it = m_stringRefs.find(value);
+    if(it != m_stringRefs.end())
+        return it->second;
+    const uint32_t ref = static_cast<uint32_t>(m_strings.size());
+    m_strings.push_back(value);
+    m_stringRefs.emplace(value, ref);
+    m_stringBytes += value.size();
+    return ref;
+}
+
+void EpgCacheWriter::AddChannel(ChannelId channelId, std::vector<Row>& rows)
+{
+    if(!m_out || !m_isOk || rows.empty())
+        return;
+    if(!m_channels.empty() && m_channels.back().channelId >= static_cast<uint32_t>(channelId)) {
+        kodi::Log(ADDON_LOG_ERROR, "EpgCacheWriter: channel %u is out of order.", (unsigned int)channelId);
+        m_isOk = false;
+        return;
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+        return a.startTime < b.startTime || (a.startTime == b.startTime && a.id < b.id);
+    });
+
+    const uint32_t size = static_cast<uint32_t>(rows.size());
+    const uint32_t channel = static_cast<uint32_t>(m_channels.size());
+    m_channels.push_back(MappedEpgCache::ChannelRecord{static_cast<uint32_t>(channelId), size, m_out->Offset()});
+    for(uint32_t row = 0; row < size; ++row)
+        m_ids.push_back(MappedEpgCache::IdRecord{rows[row].id, channel, row});
+
+    std::vector<uint32_t> column(size);
+    auto putColumn = [this, &rows, &column](auto value) {
+        for(size_t row = 0; row < rows.size(); ++row)
+            column[row] = value(rows[row]);
+        m_out->Put(column.data(), column.size());
+    };
+    putColumn([](const Row& row) { return row.startTime; });
+    putColumn([](const Row& row) { return row.endTime; });
+    uint32_t maxEndTime = 0;
+    putColumn([&maxEndTime](const Row& row) { return maxEndTime = std::max(maxEndTime, row.endTime); });
+    putColumn([](const Row& row) { return static_cast<uint32_t>(row.id); });
+    putColumn([this](const Row& row) { return Intern(row.title); });
+    putColumn([this](const Row& row) { return Intern(row.description); });
+    putColumn([this](const Row& row) { return Intern(row.iconPath); });
+    putColumn([this](const Row& row) { return Intern(row.programId); });
+    putColumn([this](const Row& row) { return Intern(row.category); });
+    std::vector<uint8_t> hasArchive(size);
+    for(uint32_t row = 0; row < size; ++row)
+        hasArchive[row] = rows[row].hasArchive ? 1 : 0;
+    m_out->Put(hasArchive.data(), hasArchive.size());
+    m_out->PadTo(Align(m_out->Offset()));
+}
+
+bool EpgCacheWriter::Finish()
+{
+    typedef MappedEpgCache::Header Header;
+    typedef MappedEpgCache::IdRecord IdRecord;
+
+    if(!m_out)
+        return false;
+    if(!m_isOk || m_stringBytes > UINT32_MAX) {
+        if(m_stringBytes > UINT32_MAX)
+            kodi::Log(ADDON_LOG_ERROR, "EpgCacheWriter: string data is too large (%llu bytes).", (unsigned long long)m_stringBytes);
+        Discard();
+        return false;
+    }
+
+    Header header{};
+    memcpy(header.magic, c_Magic, sizeof(c_Magic));
+    header.version = c_Version;
+    header.byteOrder = c_ByteOrderMark;
+    header.expiration = m_expiration;
+    header.channelCount = static_cast<uint32_t>(m_channels.size());
+    header.entryCount = static_cast<uint32_t>(m_ids.size());
+    header.stringCount = static_cast<uint32_t>(m_strings.size());
+
+    header.channelsOffset = m_out->Offset();
+    m_out->Put(m_channels.data(), m_channels.size());
+    header.idsOffset = Align(m_out->Offset());
+    m_out->PadTo(header.idsOffset);
+    std::sort(m_ids.begin(), m_ids.end(), [](const IdRecord& a, const IdRecord& b) { return a.id < b.id; });
+    m_out->Put(m_ids.data(), m_ids.size());
+
+    header.stringOffsetsOffset = Align(m_out->Offset());
+    m_out->PadTo(header.stringOffsetsOffset);
+    uint32_t stringOffset = 0;
+    for(const auto& value : m_strings) {
+        m_out->Put(&stringOffset, 1);
+        stringOffset += static_cast<uint32_t>(value.size());
+    }
+    m_out->Put(&stringOffset, 1);
+    header.stringDataOffset = Align(m_out->Offset());
+    header.stringDataSize = m_stringBytes;
+    m_out->PadTo(header.stringDataOffset);
+    for(const auto& value : m_strings)
+        m_out->Put(value.data(), value.size());
+    header.fileSize = header.stringDataOffset + header.stringDataSize;
+
+    const bool isWritten = m_out->Offset() == header.fileSize;
+    m_out->PutAtStart(reinterpret_cast<const char*>(&header), sizeof(header));
+    const bool isClosed = m_out->Close();
+    m_out.reset();
+    if(!isClosed || !isWritten) {
+        kodi::Log(ADDON_LOG_ERROR, "EpgCacheWriter: failed to write %s", m_tempPath.c_str());
+        kodi::vfs::DeleteFile(m_tempPath);
+        return false;
+    }
+    if(!kodi::vfs::RenameFile(m_tempPath, m_path)) {
+        kodi::Log(ADDON_LOG_ERROR, "EpgCacheWriter: failed to rename %s", m_tempPath.c_str());
+        kodi::vfs::DeleteFile(m_tempPath);
+        return false;
+    }
+    return true;
+}
+
+void EpgCacheWriter::CollectRows(const EpgStore& store, ChannelId channelId, std::vector<Row>& rows)
+{
+    auto slot = store.m_channelSlots.find(channelId);
+    if(slot == store.m_channelSlots.end())
+        return;
+    const auto& columns = store.m_channels[slot->second];
+    const auto& strings = store.m_strings;
+    for(size_t row = 0; row < columns.Size(); ++row) {
+        rows.push_back(Row{columns.id[row], columns.startTime[row], columns.endTime[row],
+            strings.Get(columns.title[row]), strings.Get(columns.description[row]), strings.Get(columns.iconPath[row]),
+            strings.Get(columns.programId[row]), strings.Get(columns.category[row]), columns.hasArchive[row] != 0});
+    }
+}
+
+void EpgCacheWriter::CollectRows(const MappedEpgCache& cache, ChannelId channelId, std::vector<Row>& rows)
+{
+    const MappedEpgCache::ChannelRecord* channel = cache.FindChannel(channelId);
+    if(channel == nullptr)
+        return;
+    const MappedEpgCache::Section section = cache.SectionOf(*channel);
+    for(uint32_t row = 0; row < section.size; ++row) {
+        rows.push_back(Row{section.id[row], section.startTime[row], section.endTime[row],
+            cache.StringAt(section.title[row]), cache.StringAt(section.description[row]), cache.StringAt(section.iconPath[row]),
+            cache.StringAt(section.programId[row]), cache.StringAt(section.category[row]), section.hasArchive[row] != 0});
+    }
+}
+
+#pragma mark - Mapping
+
+std::unique_ptr<MappedEpgCache> MappedEpgCache::Open(const std::string& path)
+{
+    std::unique_ptr<MappedEpgCache> cache;
+    for(const auto& generation : Generations(path)) {
+        if(!cache)
+            cache = OpenGeneration(generation.second);
+        // Stale file, a mapped one goes with the mapping
+        if(!cache || cache->m_path != generation.second)
+            kodi::vfs::DeleteFile(generation.second);
+    }
+    return cache;
+}
+
+std::unique_ptr<MappedEpgCache> MappedEpgCache::OpenGeneration(const std::string& file)
+{
+    if(!kodi::vfs::FileExists(file, false))
+        return nullptr;
+    std::unique_ptr<MappedEpgCache> cache(new MappedEpgCache());
+    if(!cache->Map(kodi::vfs::TranslateSpecialProtocol(file)))
+        return nullptr;
+    if(!cache->Validate()) {
+        kodi::Log(ADDON_LOG_INFO, "MappedEpgCache: %s is invalid or of other version.", file.c_str());
+        return nullptr;
+    }
+    if(cache->Expiration() < time(nullptr)) {
+        kodi::Log(ADDON_LOG_INFO, "MappedEpgCache: %s is expired.", file.c_str());
+        return nullptr;
+    }
+    cache->m_path = file;
+    return cache;
+}
+
+MappedEpgCache::~MappedEpgCache()
+{
+    Unmap();
+    if(m_isRemovedOnRelease)
+        kodi::vfs::DeleteFile(m_path);
+}
+
+#if (defined(_WIN32) || defined(__WIN32__))
+
+bool MappedEpgCache::Map(const std::string& nativePath)
+{
+    HANDLE file = CreateFileA(nativePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(Header)) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(mapping == NULL)
+        return false;
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(view == NULL) {
+        CloseHandle(mapping);
+        return false;
+    }
+    m_mapping = mapping;
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedEpgCache::Unmap()
+{
+    if(m_data != nullptr)
+        UnmapViewOfFile(m_data);
+    if(m_mapping != nullptr)
+        CloseHandle(m_mapping);
+}
+
+#else
+
+bool MappedEpgCache::Map(const std::string& nativePath)
+{
+    const int fd = open(nativePath.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // Mapping holds own reference to the file
+    close(fd);
+    if(data == MAP_FAILED)
+        return false;
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedEpgCache::Unmap()
+{
+    if(m_data != nullptr)
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+#endif
+
+// Checks the tables fit into the file.
+// Offsets inside tables (rows, string refs) are checked on access.
+bool MappedEpgCache::Validate()
+{
+    m_header = reinterpret_cast<const Header*>(m_data);
+    const Header& h = *m_header;
+    if(memcmp(h.magic, c_Magic, sizeof(c_Magic)) != 0 || h.version != c_Version || h.byteOrder != c_ByteOrderMark)
+        return false;
+    if(h.fileSize != m_size)
+        return false;
+    auto fits = [this](uint64_t offset, uint64_t bytes) {
+        return offset % 8 == 0 && offset <= m_size && bytes <= m_size - offset;
+    };
+    if(!fits(h.channelsOffset, uint64_t(h.channelCount) * sizeof(ChannelRecord))
+       || !fits(h.idsOffset, uint64_t(h.entryCount) * sizeof(IdRecord))
+       || !fits(h.stringOffsetsOffset, (uint64_t(h.stringCount) + 1) * sizeof(uint32_t))
+       || !fits(h.stringDataOffset, h.stringDataSize))
+        return false;
+
+    m_channels = reinterpret_cast<const ChannelRecord*>(m_data + h.channelsOffset);
+    m_ids = reinterpret_cast<const IdRecord*>(m_data + h.idsOffset);
+    m_stringOffsets = reinterpret_cast<const uint32_t*>(m_data + h.stringOffsetsOffset);
+    m_stringData = reinterpret_cast<const char*>(m_data + h.stringDataOffset);
+    if(m_stringOffsets[h.stringCount] != h.stringDataSize)
+        return false;
+
+    uint64_t numOfEntries = 0;
+    for(uint32_t index = 0; index < h.channelCount; ++index) {
+        const auto& channel = m_channels[index];
+        if(!fits(channel.offset, SectionBytes(channel.entryCount)))
+            return false;
+        if(index > 0 && m_channels[index - 1].channelId >= channel.channelId)
+            return false;
+        numOfEntries += channel.entryCount;
+    }
+    return numOfEntries == h.entryCount;
+}
+
+#pragma mark - Queries
+
+size_t MappedEpgCache::Size() const
+{
+    return m_header->entryCount;
+}
+
+time_t MappedEpgCache::Expiration() const
+{
+    return static_cast<time_t>(m_header->expiration);
+}
+
+const MappedEpgCache::ChannelRecord* MappedEpgCache::FindChannel(ChannelId channelId) const
+{
+    const ChannelRecord* end = m_channels + m_header->channelCount;
+    const ChannelRecord* it = std::lower_bound(m_channels, end, channelId, [](const ChannelRecord& r, ChannelId id) {
+        return r.channelId < id;
+    });
+    return (it != end && it->channelId == channelId) ? it : nullptr;
+}
+
+const MappedEpgCache::IdRecord* MappedEpgCache::FindId(UniqueBroadcastIdType id) const
+{
+    const IdRecord* end = m_ids + m_header->entryCount;
+    const IdRecord* it = std::lower_bound(m_ids, end, id, [](const IdRecord& r, UniqueBroadcastIdType id) {
+        return r.id < id;
+    });
+    if(it == end || it->id != id)
+        return nullptr;
+    if(it->channel >= m_header->channelCount || it->row >= m_channels[it->channel].entryCount)
+        return nullptr;
+    return it;
+}
+
+MappedEpgCache::Section MappedEpgCache::SectionOf(const ChannelRecord& channel) const
+{
+    Section section;
+    section.size = channel.entryCount;
+    const uint32_t* column = reinterpret_cast<const uint32_t*>(m_data + channel.offset);
+    section.startTime = column;
+    section.endTime = column += section.size;
+    section.maxEndTime = column += section.size;
+    section.id = column += section.size;
+    section.title = column += section.size;
+    section.description = column += section.size;
+    section.iconPath = column += section.size;
+    section.programId = column += section.size;
+    section.category = column += section.size;
+    section.hasArchive = reinterpret_cast<const uint8_t*>(column + section.size);
+    return section;
+}
+
+std::string_view MappedEpgCache::StringAt(uint32_t ref) const
+{
+    if(ref >= m_header->stringCount)
+        return std::string_view();
+    const uint32_t begin = m_stringOffsets[ref];
+    const uint32_t end = m_stringOffsets[ref + 1];
+    if(begin > end || end > m_header->stringDataSize)
+        return std::string_view();
+    return std::string_view(m_stringData + begin, end - begin);
+}
+
+void MappedEpgCache::Materialize(ChannelId channelId, const Section& section, uint32_t row, EpgEntry& entry) const
+{
+    entry.UniqueChannelId = channelId;
+    entry.StartTime = section.startTime[row];
+    entry.EndTime = section.endTime[row];
+    entry.Title = StringAt(section.title[row]);
+    entry.Description = StringAt(section.description[row]);
+    entry.IconPath = StringAt(section.iconPath[row]);
+    entry.ProgramId = StringAt(section.programId[row]);
+    entry.Category = StringAt(section.category[row]);
+    entry.HasArchive = section.hasArchive[row] != 0;
+}
+
+bool MappedEpgCache::Invoke(ChannelId channelId, const Section& section, uint32_t row, const EntryAction& action) const
+{
+    EpgEntryList::value_type value(section.id[row], EpgEntry());
+    Materialize(channelId, section, row, value.second);
+    return action(value);
+}
+
+bool MappedEpgCache::Get(UniqueBroadcastIdType id, EpgEntry& entry) const
+{
+    const IdRecord* record = FindId(id);
+    if(record == nullptr)
+        return false;
+    const auto& channel = m_channels[record->channel];
+    Materialize(channel.channelId, SectionOf(channel), record->row, entry);
+    return true;
+}
+
+void MappedEpgCache::ForEachInRange(ChannelId channelId, time_t startTime, time_t endTime, const EntryAction& action) const
+{
+    const ChannelRecord* channel = FindChannel(channelId);
+    if(channel == nullptr || startTime >= endTime)
+        return;
+    const Section section = SectionOf(*channel);
+    uint32_t row = static_cast<uint32_t>(std::upper_bound(section.maxEndTime, section.maxEndTime + section.size, startTime) - section.maxEndTime);
+    for(; row < section.size && section.startTime[row] < endTime; ++row) {
+        if(section.endTime[row] > startTime && !Invoke(channelId, section, row, action))
+            return;
+    }
+}
+
+std::vector<ChannelId> MappedEpgCache::Channels() const
+{
+    std::vector<ChannelId> channels;
+    channels.reserve(m_header->channelCount);
+    for(uint32_t index = 0; index < m_header->channelCount; ++index)
+        channels.push_back(m_channels[index].channelId);
+    return channels;
+}
+
+void MappedEpgCache::ForEach(const EntryAction& action) const
+{
+    for(uint32_t index = 0; index < m_header->channelCount; ++index) {
+        const auto& channel = m_channels[index];
+        const Section section = SectionOf(channel);
+        for(uint32_t row = 0; row < section.size; ++row) {
+            if(!Invoke(channel.channelId, section, row, action))
+                return;
+        }
+    }
+}
+
+} // namespace PvrClient
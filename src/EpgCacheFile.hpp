@@ -0,0 +1,155 @@
+#ifndef EPG_CACHE_FILE_HPP
+#define EPG_CACHE_FILE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "EpgStore.hpp"
+
+namespace PvrClient {
+
+// Binary EPG cache, mapped into memory and queried in place.
+//
+// File layout, native byte order, every section 8-byte aligned:
+//   Header                         written last, so a truncated file is rejected
+//   channel sections               uint32 columns (start, end, max end, id, title,
+//                                  description, icon, program id, category)
+//                                  followed by uint8 archive flags
+//   ChannelRecord[channelCount]    sorted by channel id
+//   IdRecord[entryCount]           sorted by broadcast id
+//   uint32 stringOffsets[stringCount + 1]
+//   string bytes                   text columns are indexes into stringOffsets
+//
+// Loading costs a header check, nothing is parsed or copied.
+//
+// Cache of a path is a series of generation files path.1, path.2, ...:
+// a mapped file can't be replaced on Windows, so the next one is written
+// beside it and the old one is removed when its last mapping is released.
+class MappedEpgCache
+{
+public:
+    typedef EpgStore::EntryAction EntryAction;
+
+    // Newest generation of path, other ones are removed.
+    // nullptr when there is none, or it is corrupted, of other version or expired.
+    static std::unique_ptr<MappedEpgCache> Open(const std::string& path);
+    // Just this generation file, e.g. one written by EpgCacheWriter
+    static std::unique_ptr<MappedEpgCache> OpenGeneration(const std::string& file);
+    ~MappedEpgCache();
+
+    // File is superseded by a newer generation, remove it with the mapping
+    void RemoveOnRelease() const { m_isRemovedOnRelease = true; }
+
+    MappedEpgCache(const MappedEpgCache&) = delete;
+    MappedEpgCache& operator=(const MappedEpgCache&) = delete;
+
+    bool Get(UniqueBroadcastIdType id, EpgEntry& entry) const;
+    bool Contains(UniqueBroadcastIdType id) const { return FindId(id) != nullptr; }
+    // Same contract as EpgStore::ForEachInRange()
+    void ForEachInRange(ChannelId channelId, time_t startTime, time_t endTime, const EntryAction& action) const;
+    void ForEach(const EntryAction& action) const;
+    std::vector<ChannelId> Channels() const;
+
+    size_t Size() const;
+    time_t Expiration() const;
+    size_t MappedBytes() const { return m_size; }
+
+    struct Header;
+    struct ChannelRecord;
+    struct IdRecord;
+
+private:
+    friend class EpgCacheWriter;
+    struct Section;
+
+    MappedEpgCache() = default;
+    bool Map(const std::string& nativePath);
+    void Unmap();
+    bool Validate();
+
+    const ChannelRecord* FindChannel(ChannelId channelId) const;
+    const IdRecord* FindId(UniqueBroadcastIdType id) const;
+    Section SectionOf(const ChannelRecord& channel) const;
+    std::string_view StringAt(uint32_t ref) const;
+    void Materialize(ChannelId channelId, const Section& section, uint32_t row, EpgEntry& entry) const;
+    bool Invoke(ChannelId channelId, const Section& section, uint32_t row, const EntryAction& action) const;
+
+    std::string m_path;
+    mutable std::atomic<bool> m_isRemovedOnRelease{false};
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    void* m_mapping = nullptr;
+
+    const Header* m_header = nullptr;
+    const ChannelRecord* m_channels = nullptr;
+    const IdRecord* m_ids = nullptr;
+    const uint32_t* m_stringOffsets = nullptr;
+    const char* m_stringData = nullptr;
+};
+
+// Streams EPG to the cache file channel by channel. Only ids and distinct strings
+// (as views, text is not copied) are kept until the file is complete.
+// Written to a temporary file, so a reader never maps a partially written cache.
+class EpgCacheWriter
+{
+public:
+    // Programme to write. Text must stay valid until Finish().
+    struct Row
+    {
+        UniqueBroadcastIdType id;
+        uint32_t startTime;
+        uint32_t endTime;
+        std::string_view title;
+        std::string_view description;
+        std::string_view iconPath;
+        std::string_view programId;
+        std::string_view category;
+        bool hasArchive;
+    };
+
+    EpgCacheWriter();
+    // Unfinished file is removed
+    ~EpgCacheWriter();
+
+    EpgCacheWriter(const EpgCacheWriter&) = delete;
+    EpgCacheWriter& operator=(const EpgCacheWriter&) = delete;
+
+    // Starts the next generation of path
+    bool Open(const std::string& path, time_t expiration);
+    // Channels go in ascending id order, rows in any order (sorted here)
+    void AddChannel(ChannelId channelId, std::vector<Row>& rows);
+    // Completes the file, it is the newest generation from now on
+    bool Finish();
+    // Generation file being written
+    const std::string& File() const { return m_path; }
+
+    // Append rows of the channel, text refers to the source
+    static void CollectRows(const EpgStore& store, ChannelId channelId, std::vector<Row>& rows);
+    static void CollectRows(const MappedEpgCache& cache, ChannelId channelId, std::vector<Row>& rows);
+
+private:
+    class FileWriter;
+
+    uint32_t Intern(std::string_view value);
+    void Discard();
+
+    std::string m_path;
+    std::string m_tempPath;
+    time_t m_expiration = 0;
+    std::unique_ptr<FileWriter> m_out;
+    std::vector<MappedEpgCache::ChannelRecord> m_channels;
+    std::vector<MappedEpgCache::IdRecord> m_ids;
+    std::vector<std::string_view> m_strings;
+    std::unordered_map<std::string_view, uint32_t> m_stringRefs;
+    uint64_t m_stringBytes = 0;
+    bool m_isOk = false;
+};
+
+} // namespace PvrClient
+
+#endif // EPG_CACHE_FILE_HPP
@@ -0,0 +1,555 @@
+#include "EpgStore.hpp"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace PvrClient {
+
+// Rough per-node cost of std::unordered_map: node with value and next pointer, plus hash cache
+template<class TMap>
+static size_t HashMapMemoryUsage(const TMap& map)
+{
+    return map.size() * (sizeof(typename TMap::value_type) + 2 * sizeof(void*)) + map.bucket_count() * sizeof(void*);
+}
+
+template<class T>
+static size_t VectorMemoryUsage(const std::vector<T>& v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+// FNV-1a
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+static uint64_t HashString(uint64_t hash, std::string_view value)
+{
+    const uint32_t size = static_cast<uint32_t>(value.size());
+    hash = HashBytes(hash, &size, sizeof(size));
+    return HashBytes(hash, value.data(), value.size());
+}
+
+static uint64_t RowHash(uint32_t startTime, uint32_t endTime, std::string_view title, std::string_view description,
+                        std::string_view iconPath, std::string_view programId, std::string_view category)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    hash = HashBytes(hash, &startTime, sizeof(startTime));
+    hash = HashBytes(hash, &endTime, sizeof(endTime));
+    hash = HashString(hash, title);
+    hash = HashString(hash, description);
+    hash = HashString(hash, iconPath);
+    hash = HashString(hash, programId);
+    return HashString(hash, category);
+}
+
+static uint64_t RowHash(const EpgEntry& entry)
+{
+    return RowHash(entry.StartTime, entry.EndTime, entry.Title, entry.Description, entry.IconPath, entry.ProgramId, entry.Category);
+}
+
+#pragma mark - StringPool
+
+StringPool::StringPool()
+{
+    // Ref 0 is the empty string
+    m_values.emplace_back();
+}
+
+StringPool::StringPool(const StringPool& other)
+    : m_blocks(other.m_blocks)
+    , m_blocksCapacity(other.m_blocksCapacity)
+    , m_blockUsed(c_BlockSize)
+    , m_bytes(other.m_bytes)
+    , m_values(other.m_values)
+    , m_index(other.m_index)
+{
+}
+
+StringPool& StringPool::operator=(const StringPool& other)
+{
+    if(this != &other) {
+        m_blocks = other.m_blocks;
+        m_blocksCapacity = other.m_blocksCapacity;
+        m_blockUsed = c_BlockSize;
+        m_bytes = other.m_bytes;
+        m_values = other.m_values;
+        m_index = other.m_index;
+    }
+    return *this;
+}
+
+StringPool::Ref StringPool::Intern(std::string_view value)
+{
+    if(value.empty())
+        return c_Empty;
+    auto it = m_index.find(value);
+    if(it != m_index.end())
+        return it->second;
+
+    char* dest;
+    if(value.size() > c_BlockSize / 4) {
+        // Large string gets own block, current block stays open
+        m_blocks.emplace_front(new char[value.size()]);
+        m_blocksCapacity += value.size();
+        dest = m_blocks.front().get();
+    } else {
+        if(m_blockUsed + value.size() > c_BlockSize) {
+            m_blocks.emplace_back(new char[c_BlockSize]);
+            m_blocksCapacity += c_BlockSize;
+            m_blockUsed = 0;
+        }
+        dest = m_blocks.back().get() + m_blockUsed;
+        m_blockUsed += value.size();
+    }
+    memcpy(dest, value.data(), value.size());
+    m_bytes += value.size();
+
+    const Ref ref = static_cast<Ref>(m_values.size());
+    const std::string_view stored(dest, value.size());
+    m_values.push_back(stored);
+    m_index.emplace(stored, ref);
+    return ref;
+}
+
+size_t StringPool::MemoryUsage() const
+{
+    return m_blocksCapacity + VectorMemoryUsage(m_values) + HashMapMemoryUsage(m_index);
+}
+
+void StringPool::Clear()
+{
+    m_index.clear();
+    m_values.clear();
+    m_values.emplace_back();
+    m_blocks.clear();
+    m_blocksCapacity = 0;
+    m_blockUsed = c_BlockSize;
+    m_bytes = 0;
+}
+
+#pragma mark - EpgStore
+
+size_t EpgStore::ChannelColumns::MemoryUsage() const
+{
+    return VectorMemoryUsage(startTime) + VectorMemoryUsage(endTime) + VectorMemoryUsage(maxEndTime) + VectorMemoryUsage(id)
+        + VectorMemoryUsage(title) + VectorMemoryUsage(description) + VectorMemoryUsage(iconPath)
+        + VectorMemoryUsage(programId) + VectorMemoryUsage(category) + VectorMemoryUsage(hasArchive)
+        + VectorMemoryUsage(rowHash);
+}
+
+template<class T>
+static void ApplyOrder(std::vector<T>& column, const std::vector<uint32_t>& order)
+{
+    std::vector<T> reordered;
+    reordered.reserve(order.size());
+    for(auto row : order)
+        reordered.push_back(column[row]);
+    column.swap(reordered);
+}
+
+void EpgStore::ChannelColumns::Reorder(const std::vector<uint32_t>& order)
+{
+    ApplyOrder(startTime, order);
+    ApplyOrder(endTime, order);
+    ApplyOrder(id, order);
+    ApplyOrder(title, order);
+    ApplyOrder(description, order);
+    ApplyOrder(iconPath, order);
+    ApplyOrder(programId, order);
+    ApplyOrder(category, order);
+    ApplyOrder(hasArchive, order);
+    ApplyOrder(rowHash, order);
+}
+
+void EpgStore::ChannelColumns::RebuildMaxEndTime()
+{
+    maxEndTime.resize(endTime.size());
+    uint32_t maxEnd = 0;
+    for(size_t row = 0; row < endTime.size(); ++row) {
+        maxEnd = std::max(maxEnd, endTime[row]);
+        maxEndTime[row] = maxEnd;
+    }
+}
+
+EpgStore::ChannelColumns& EpgStore::ColumnsFor(ChannelId channelId, uint32_t& slot)
+{
+    auto it = m_channelSlots.find(channelId);
+    if(it == m_channelSlots.end()) {
+        slot = static_cast<uint32_t>(m_channels.size());
+        m_channelSlots.emplace(channelId, slot);
+        m_channels.emplace_back();
+        m_channels.back().channelId = channelId;
+    } else {
+        slot = it->second;
+    }
+    return m_channels[slot];
+}
+
+UniqueBroadcastIdType EpgStore::FreeId(UniqueBroadcastIdType preferredId) const
+{
+    UniqueBroadcastIdType id = preferredId;
+    while(m_idIndex.count(id) != 0 || id == c_UniqueBroadcastIdUnknown)
+        ++id;
+    return id;
+}
+
+void EpgStore::Append(ChannelColumns& columns, UniqueBroadcastIdType id, const EpgEntry& entry, uint64_t hash)
+{
+    const size_t row = columns.Size();
+    if(row > 0 && columns.startTime.back() > entry.StartTime)
+        columns.isIndexed = false;
+    if(columns.isIndexed) {
+        // In order append, extend the index in place
+        const uint32_t maxEnd = row > 0 ? columns.maxEndTime.back() : 0;
+        columns.maxEndTime.push_back(std::max(maxEnd, entry.EndTime));
+    }
+
+    columns.startTime.push_back(entry.StartTime);
+    columns.endTime.push_back(entry.EndTime);
+    columns.id.push_back(id);
+    columns.title.push_back(m_strings.Intern(entry.Title));
+    columns.description.push_back(m_strings.Intern(entry.Description));
+    columns.iconPath.push_back(m_strings.Intern(entry.IconPath));
+    columns.programId.push_back(m_strings.Intern(entry.ProgramId));
+    columns.category.push_back(m_strings.Intern(entry.Category));
+    columns.hasArchive.push_back(entry.HasArchive ? 1 : 0);
+    columns.rowHash.push_back(hash);
+}
+
+UniqueBroadcastIdType EpgStore::Add(UniqueBroadcastIdType preferredId, const EpgEntry& entry)
+{
+    const UniqueBroadcastIdType id = FreeId(preferredId);
+    uint32_t slot;
+    auto& columns = ColumnsFor(entry.UniqueChannelId, slot);
+    const uint32_t row = static_cast<uint32_t>(columns.Size());
+    Append(columns, id, entry, RowHash(entry));
+    m_idIndex.emplace(id, Location{slot, row});
+    return id;
+}
+
+bool EpgStore::Update(UniqueBroadcastIdType id, const EpgEntry& entry)
+{
+    auto it = m_idIndex.find(id);
+    if(it == m_idIndex.end())
+        return false;
+    auto& columns = m_channels[it->second.channel];
+    if(columns.channelId != entry.UniqueChannelId)
+        return false;
+    const uint32_t row = it->second.row;
+    if(columns.startTime[row] != entry.StartTime || columns.endTime[row] != entry.EndTime)
+        columns.isIndexed = false;
+    columns.startTime[row] = entry.StartTime;
+    columns.endTime[row] = entry.EndTime;
+    columns.title[row] = m_strings.Intern(entry.Title);
+    columns.description[row] = m_strings.Intern(entry.Description);
+    columns.iconPath[row] = m_strings.Intern(entry.IconPath);
+    columns.programId[row] = m_strings.Intern(entry.ProgramId);
+    columns.category[row] = m_strings.Intern(entry.Category);
+    columns.hasArchive[row] = entry.HasArchive ? 1 : 0;
+    columns.rowHash[row] = RowHash(entry);
+    return true;
+}
+
+void EpgStore::IndexChannel(uint32_t slot)
+{
+    auto& columns = m_channels[slot];
+    if(!columns.isIndexed) {
+        std::vector<uint32_t> order(columns.Size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&columns](uint32_t a, uint32_t b) {
+            return columns.startTime[a] < columns.startTime[b];
+        });
+        columns.Reorder(order);
+        columns.RebuildMaxEndTime();
+        columns.isIndexed = true;
+    }
+    for(uint32_t row = 0; row < columns.Size(); ++row)
+        m_idIndex[columns.id[row]] = Location{slot, row};
+}
+
+void EpgStore::Finalize()
+{
+    for(uint32_t slot = 0; slot < m_channels.size(); ++slot) {
+        if(!m_channels[slot].isIndexed)
+            IndexChannel(slot);
+    }
+}
+
+#pragma mark - Incremental update
+
+std::vector<ChannelId> EpgStore::Apply(ChannelUpdates& updates)
+{
+    Finalize();
+    std::vector<ChannelId> changedChannels;
+    for(auto& channel : updates.m_channels) {
+        if(ApplyToChannel(channel.first, channel.second))
+            changedChannels.push_back(channel.first);
+    }
+    updates.Clear();
+    return changedChannels;
+}
+
+bool EpgStore::ApplyToChannel(ChannelId channelId, std::vector<EpgEntry>& entries)
+{
+    if(entries.empty())
+        return false;
+    std::stable_sort(entries.begin(), entries.end(), [](const EpgEntry& a, const EpgEntry& b) {
+        return a.StartTime < b.StartTime;
+    });
+    std::vector<uint64_t> hashes;
+    hashes.reserve(entries.size());
+    uint64_t updateHash = 0;
+    for(const auto& entry : entries) {
+        hashes.push_back(RowHash(entry));
+        updateHash += hashes.back();
+    }
+
+    uint32_t slot;
+    auto& columns = ColumnsFor(channelId, slot);
+    // Stored rows within start time span of the update, the rest (e.g. old archive) is kept
+    const auto& starts = columns.startTime;
+    const size_t begin = std::lower_bound(starts.begin(), starts.end(), entries.front().StartTime) - starts.begin();
+    const size_t end = std::upper_bound(starts.begin(), starts.end(), entries.back().StartTime) - starts.begin();
+
+    uint64_t storedHash = 0;
+    for(size_t row = begin; row < end; ++row)
+        storedHash += columns.rowHash[row];
+    if(storedHash == updateHash && end - begin == entries.size()) {
+        // Same programmes, archive flags are not hashed and may still differ
+        bool isSame = true;
+        for(size_t i = 0; i < entries.size() && isSame; ++i)
+            isSame = columns.rowHash[begin + i] == hashes[i];
+        if(isSame) {
+            bool isArchiveChanged = false;
+            for(size_t i = 0; i < entries.size(); ++i) {
+                const uint8_t hasArchive = entries[i].HasArchive ? 1 : 0;
+                if(columns.hasArchive[begin + i] != hasArchive) {
+                    columns.hasArchive[begin + i] = hasArchive;
+                    isArchiveChanged = true;
+                }
+            }
+            return isArchiveChanged;
+        }
+    }
+
+    std::unordered_multimap<uint64_t, uint32_t> stored;
+    for(size_t row = begin; row < end; ++row)
+        stored.emplace(columns.rowHash[row], static_cast<uint32_t>(row));
+    std::vector<int64_t> matchedRows(entries.size(), -1);
+    for(size_t i = 0; i < entries.size(); ++i) {
+        auto it = stored.find(hashes[i]);
+        if(it != stored.end()) {
+            matchedRows[i] = it->second;
+            stored.erase(it);
+        }
+    }
+    for(const auto& removed : stored)
+        m_idIndex.erase(columns.id[removed.second]);
+
+    ChannelColumns rebuilt;
+    rebuilt.channelId = channelId;
+    // Index is rebuilt once at the end
+    rebuilt.isIndexed = false;
+    auto copyRow = [&columns, &rebuilt](size_t row, bool hasArchive) {
+        rebuilt.startTime.push_back(columns.startTime[row]);
+        rebuilt.endTime.push_back(columns.endTime[row]);
+        rebuilt.id.push_back(columns.id[row]);
+        rebuilt.title.push_back(columns.title[row]);
+        rebuilt.description.push_back(columns.description[row]);
+        rebuilt.iconPath.push_back(columns.iconPath[row]);
+        rebuilt.programId.push_back(columns.programId[row]);
+        rebuilt.category.push_back(columns.category[row]);
+        rebuilt.hasArchive.push_back(hasArchive ? 1 : 0);
+        rebuilt.rowHash.push_back(columns.rowHash[row]);
+    };
+    for(size_t row = 0; row < begin; ++row)
+        copyRow(row, columns.hasArchive[row] != 0);
+    for(size_t i = 0; i < entries.size(); ++i) {
+        if(matchedRows[i] >= 0) {
+            copyRow(static_cast<size_t>(matchedRows[i]), entries[i].HasArchive);
+        } else {
+            const UniqueBroadcastIdType id = FreeId(entries[i].StartTime);
+            // Reserve the id, row is fixed by IndexChannel()
+            m_idIndex[id] = Location{slot, 0};
+            Append(rebuilt, id, entries[i], hashes[i]);
+        }
+    }
+    for(size_t row = end; row < columns.Size(); ++row)
+        copyRow(row, columns.hasArchive[row] != 0);
+
+    columns = std::move(rebuilt);
+    IndexChannel(slot);
+    return true;
+}
+
+void EpgStore::Materialize(const ChannelColumns& columns, uint32_t row, EpgEntry& entry) const
+{
+    entry.UniqueChannelId = columns.channelId;
+    entry.StartTime = columns.startTime[row];
+    entry.EndTime = columns.endTime[row];
+    entry.Title = m_strings.Get(columns.title[row]);
+    entry.Description = m_strings.Get(columns.description[row]);
+    entry.IconPath = m_strings.Get(columns.iconPath[row]);
+    entry.ProgramId = m_strings.Get(columns.programId[row]);
+    entry.Category = m_strings.Get(columns.category[row]);
+    entry.HasArchive = columns.hasArchive[row] != 0;
+}
+
+bool EpgStore::Invoke(const ChannelColumns& columns, uint32_t row, const EntryAction& action) const
+{
+    EpgEntryList::value_type value(columns.id[row], EpgEntry());
+    Materialize(columns, row, value.second);
+    return action(value);
+}
+
+bool EpgStore::Get(UniqueBroadcastIdType id, EpgEntry& entry) const
+{
+    auto it = m_idIndex.find(id);
+    if(it == m_idIndex.end())
+        return false;
+    Materialize(m_channels[it->second.channel], it->second.row, entry);
+    return true;
+}
+
+void EpgStore::ForEachInRange(ChannelId channelId, time_t startTime, time_t endTime, const EntryAction& action) const
+{
+    auto it = m_channelSlots.find(channelId);
+    if(it == m_channelSlots.end() || startTime >= endTime)
+        return;
+    const auto& columns = m_channels[it->second];
+    const uint32_t size = static_cast<uint32_t>(columns.Size());
+
+    if(!columns.isIndexed) {
+        // Not finalized yet, fall back to full scan
+        for(uint32_t row = 0; row < size; ++row) {
+            if(columns.startTime[row] < endTime && columns.endTime[row] > startTime && !Invoke(columns, row, action))
+                return;
+        }
+        return;
+    }
+
+    // First row that may still be running at startTime.
+    // Everything before it has ended, regardless of overlaps in the schedule.
+    const auto& maxEnd = columns.maxEndTime;
+    uint32_t row = static_cast<uint32_t>(std::upper_bound(maxEnd.begin(), maxEnd.end(), startTime) - maxEnd.begin());
+    for(; row < size && columns.startTime[row] < endTime; ++row) {
+        if(columns.endTime[row] > startTime && !Invoke(columns, row, action))
+            return;
+    }
+}
+
+void EpgStore::ForEach(const EntryAction& action) const
+{
+    for(const auto& columns : m_channels) {
+        for(uint32_t row = 0; row < columns.Size(); ++row) {
+            if(!Invoke(columns, row, action))
+                return;
+        }
+    }
+}
+
+size_t EpgStore::EraseIf(const ErasePredicate& predicate)
+{
+    size_t erased = 0;
+    for(uint32_t slot = 0; slot < m_channels.size(); ++slot) {
+        auto& columns = m_channels[slot];
+        std::vector<uint32_t> kept;
+        kept.reserve(columns.Size());
+        for(uint32_t row = 0; row < columns.Size(); ++row) {
+            if(predicate(columns.id[row], columns.startTime[row], columns.endTime[row]))
+                m_idIndex.erase(columns.id[row]);
+            else
+                kept.push_back(row);
+        }
+        if(kept.size() == columns.Size())
+            continue;
+        erased += columns.Size() - kept.size();
+        columns.Reorder(kept);
+        if(columns.isIndexed)
+            columns.RebuildMaxEndTime();
+        else
+            columns.maxEndTime.clear();
+        for(uint32_t row = 0; row < columns.Size(); ++row)
+            m_idIndex[columns.id[row]] = Location{slot, row};
+    }
+    return erased;
+}
+
+bool EpgStore::CompactStrings()
+{
+    std::vector<uint8_t> isUsed(m_strings.Count() + 1, 0);
+    size_t usedBytes = 0;
+    auto forEachRefColumn = [this](const std::function<void(std::vector<StringPool::Ref>&)>& action) {
+        for(auto& columns : m_channels) {
+            action(columns.title);
+            action(columns.description);
+            action(columns.iconPath);
+            action(columns.programId);
+            action(columns.category);
+        }
+    };
+    forEachRefColumn([this, &isUsed, &usedBytes](std::vector<StringPool::Ref>& refs) {
+        for(const auto ref : refs) {
+            if(isUsed[ref])
+                continue;
+            isUsed[ref] = 1;
+            usedBytes += m_strings.Get(ref).size();
+        }
+    });
+    const size_t garbage = m_strings.Bytes() - usedBytes;
+    if(garbage == 0 || garbage < m_strings.Bytes() / 4)
+        return false;
+
+    StringPool strings;
+    std::vector<StringPool::Ref> remap(isUsed.size(), StringPool::c_Empty);
+    for(StringPool::Ref ref = 1; ref < isUsed.size(); ++ref) {
+        if(isUsed[ref])
+            remap[ref] = strings.Intern(m_strings.Get(ref));
+    }
+    forEachRefColumn([&remap](std::vector<StringPool::Ref>& refs) {
+        for(auto& ref : refs)
+            ref = remap[ref];
+    });
+    m_strings = std::move(strings);
+    return true;
+}
+
+std::vector<ChannelId> EpgStore::Channels() const
+{
+    std::vector<ChannelId> channels;
+    for(const auto& columns : m_channels) {
+        if(columns.Size() > 0)
+            channels.push_back(columns.channelId);
+    }
+    return channels;
+}
+
+void EpgStore::Clear()
+{
+    m_idIndex.clear();
+    m_channelSlots.clear();
+    m_channels.clear();
+    m_strings.Clear();
+}
+
+EpgStore::MemoryReport EpgStore::Memory() const
+{
+    MemoryReport report;
+    report.Entries = m_idIndex.size();
+    report.Channels = m_channels.size();
+    report.Strings = m_strings.Count();
+    report.StringBytes = m_strings.MemoryUsage();
+    for(const auto& columns : m_channels)
+        report.ColumnBytes += columns.MemoryUsage();
+    report.IndexBytes = HashMapMemoryUsage(m_idIndex) + HashMapMemoryUsage(m_channelSlots) + VectorMemoryUsage(m_channels);
+    return report;
+}
+
+} // namespace PvrClient
@@ -0,0 +1,182 @@
+#ifndef EPG_STORE_HPP
+#define EPG_STORE_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "pvr_client_types.h"
+
+namespace PvrClient {
+
+// Deduplicated storage of immutable strings.
+// Titles, icons and categories repeat a lot in EPG, every distinct value is stored once.
+// Strings live in fixed blocks, so views returned by Get() stay valid until Clear().
+// Strings are never removed one by one, EpgStore::CompactStrings() rebuilds the pool.
+class StringPool
+{
+public:
+    typedef uint32_t Ref;
+    static const Ref c_Empty = 0;
+
+    StringPool();
+    // Copy shares the string blocks, they are never written again
+    // once a string is there. New strings of the copy go to a new block.
+    StringPool(const StringPool& other);
+    StringPool& operator=(const StringPool& other);
+    StringPool(StringPool&&) = default;
+    StringPool& operator=(StringPool&&) = default;
+
+    Ref Intern(std::string_view value);
+    std::string_view Get(Ref ref) const { return m_values[ref]; }
+
+    size_t Count() const { return m_values.size() - 1; }
+    // Bytes of the strings themselves
+    size_t Bytes() const { return m_bytes; }
+    size_t MemoryUsage() const;
+    void Clear();
+
+private:
+    static const size_t c_BlockSize = 64 * 1024;
+
+    std::deque<std::shared_ptr<char[]>> m_blocks;
+    size_t m_blocksCapacity = 0;
+    size_t m_blockUsed = c_BlockSize;
+    size_t m_bytes = 0;
+    std::vector<std::string_view> m_values;
+    std::unordered_map<std::string_view, Ref> m_index;
+};
+
+// Columnar EPG storage.
+// Entries are kept per channel in parallel arrays sorted by start time,
+// text fields are references into a shared StringPool.
+// Typical use is bulk load: Add() many entries, then Finalize() once
+// before queries. Not thread safe, owner serializes access.
+// Copy is a full independent version (string blocks are shared).
+class EpgStore
+{
+public:
+    typedef IClientCore::EpgEntryAction EntryAction;
+
+    struct MemoryReport
+    {
+        size_t Entries = 0;
+        size_t Channels = 0;
+        size_t Strings = 0;
+        size_t StringBytes = 0;
+        size_t ColumnBytes = 0;
+        size_t IndexBytes = 0;
+        size_t Total() const { return StringBytes + ColumnBytes + IndexBytes; }
+    };
+
+    // Fresh EPG of some channels, e.g. one XMLTV download, to be applied with Apply().
+    class ChannelUpdates
+    {
+    public:
+        void Add(const EpgEntry& entry) { m_channels[entry.UniqueChannelId].push_back(entry); }
+        bool IsEmpty() const { return m_channels.empty(); }
+        void Clear() { m_channels.clear(); }
+        const std::unordered_map<ChannelId, std::vector<EpgEntry>>& Channels() const { return m_channels; }
+
+    private:
+        friend class EpgStore;
+        std::unordered_map<ChannelId, std::vector<EpgEntry>> m_channels;
+    };
+
+    // Stores entry under the first free id starting from preferredId.
+    // Returns the id used.
+    UniqueBroadcastIdType Add(UniqueBroadcastIdType preferredId, const EpgEntry& entry);
+    // Updates mutable fields of existing entry (archive flag, details loaded later).
+    bool Update(UniqueBroadcastIdType id, const EpgEntry& entry);
+    // Sorts and reindexes channels changed by Add()/Update(). Cheap when nothing changed.
+    void Finalize();
+    // Merges updates channel by channel, within the start time span of each channel update.
+    // When hash of its entries in the span matches the update only archive flags are updated.
+    // Otherwise only missing entries are removed and new ones added (under id = start time
+    // or the next free one), unchanged entries keep their ids.
+    // Returns channels whose EPG has changed.
+    std::vector<ChannelId> Apply(ChannelUpdates& updates);
+
+    bool Get(UniqueBroadcastIdType id, EpgEntry& entry) const;
+    bool Contains(UniqueBroadcastIdType id) const { return m_idIndex.count(id) != 0; }
+
+    // Entries of channel intersecting [startTime, endTime), in start time order.
+    // O(log n + k) after Finalize(), linear scan for a channel changed since then.
+    // Stops when action returns false.
+    void ForEachInRange(ChannelId channelId, time_t startTime, time_t endTime, const EntryAction& action) const;
+    // All entries, channel by channel. Stops when action returns false.
+    void ForEach(const EntryAction& action) const;
+
+    // Removes entries matching predicate(id, startTime, endTime), returns their number.
+    // Strings stay in the pool until CompactStrings() or Clear().
+    typedef std::function<bool(UniqueBroadcastIdType, time_t, time_t)> ErasePredicate;
+    size_t EraseIf(const ErasePredicate& predicate);
+    // Rebuilds the string pool from strings of stored entries when at least a quarter
+    // of its bytes is left by erased or changed entries. Returns true when rebuilt.
+    // Blocks of the old pool are freed with the last copy sharing them.
+    bool CompactStrings();
+    // Channels having entries
+    std::vector<ChannelId> Channels() const;
+
+    size_t Size() const { return m_idIndex.size(); }
+    bool IsEmpty() const { return m_idIndex.empty(); }
+    void Clear();
+
+    MemoryReport Memory() const;
+
+private:
+    friend class EpgCacheWriter;
+
+    struct Location
+    {
+        uint32_t channel;
+        uint32_t row;
+    };
+
+    struct ChannelColumns
+    {
+        ChannelId channelId = UnknownChannelId;
+        // Rows are sorted by start time and maxEndTime is valid
+        bool isIndexed = true;
+        std::vector<uint32_t> startTime;
+        std::vector<uint32_t> endTime;
+        // Max end time of rows [0, i], non-decreasing.
+        // Rows before the first maxEndTime > t can't overlap t.
+        std::vector<uint32_t> maxEndTime;
+        std::vector<UniqueBroadcastIdType> id;
+        std::vector<StringPool::Ref> title;
+        std::vector<StringPool::Ref> description;
+        std::vector<StringPool::Ref> iconPath;
+        std::vector<StringPool::Ref> programId;
+        std::vector<StringPool::Ref> category;
+        std::vector<uint8_t> hasArchive;
+        // Hash of times and texts, used to diff updates. HasArchive is not included.
+        std::vector<uint64_t> rowHash;
+
+        size_t Size() const { return id.size(); }
+        size_t MemoryUsage() const;
+        void Reorder(const std::vector<uint32_t>& order);
+        void RebuildMaxEndTime();
+    };
+
+    ChannelColumns& ColumnsFor(ChannelId channelId, uint32_t& slot);
+    void IndexChannel(uint32_t slot);
+    UniqueBroadcastIdType FreeId(UniqueBroadcastIdType preferredId) const;
+    void Append(ChannelColumns& columns, UniqueBroadcastIdType id, const EpgEntry& entry, uint64_t hash);
+    bool ApplyToChannel(ChannelId channelId, std::vector<EpgEntry>& entries);
+    void Materialize(const ChannelColumns& columns, uint32_t row, EpgEntry& entry) const;
+    bool Invoke(const ChannelColumns& columns, uint32_t row, const EntryAction& action) const;
+
+    StringPool m_strings;
+    std::vector<ChannelColumns> m_channels;
+    std::unordered_map<ChannelId, uint32_t> m_channelSlots;
+    std::unordered_map<UniqueBroadcastIdType, Location> m_idIndex;
+};
+
+} // namespace PvrClient
+
+#endif // EPG_STORE_HPP
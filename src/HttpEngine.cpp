@@ -1,4 +1,10 @@
 #include "HttpEngine.hpp"
+#include "HttpStats.hpp"
+#include "CurlMultiplexer.hpp"
+#include "Inflator.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cctype>
 #include <thread>
 #include <chrono>
 #include <kodi/Filesystem.h>
@@ -18,6 +24,7 @@ HttpEngine::HttpEngine()
     m_apiCalls->Start();
     m_apiCallCompletions->Start();
     m_apiHiPriorityCallCompletions->Start();
+    m_retryThread = std::jthread([this](std::stop_token st) { RetryLoop(st); });
 }
 
 // Метод для работы с архивом
@@ -63,61 +70,466 @@ bool HttpEngine::CheckInternetConnection(long timeoutSec)
 
 void HttpEngine::DoCurl(const Request& request, const TCookies& cookies,
                        std::string* response, uint64_t requestId,
-                       std::string* effectiveUrl)
+                       std::string* effectiveUrl, TimePoint queuedAt)
 {
+    DoCurl(request, cookies, [response](const char* data, size_t size) {
+        response->append(data, size);
+        return true;
+    }, requestId, effectiveUrl, queuedAt);
+}
+
+// Fills request trace and pushes it to HttpStats on any exit from DoCurl
+struct TransferTrace
+{
+    TransferTrace(const std::string& url, uint64_t requestId, HttpEngine::TimePoint queuedAt)
+    : id(requestId)
+    , startTime(HttpStats::Sample::Clock::now())
+    {
+        sample.Url = url;
+        if(queuedAt != HttpEngine::TimePoint())
+            sample.QueueWaitUs = std::chrono::duration_cast<std::chrono::microseconds>(startTime - queuedAt).count();
+    }
+    
+    ~TransferTrace()
+    {
+        sample.TotalUs = HttpStats::MicrosecondsSince(startTime);
+        HttpStats::Instance().Record(sample);
+        kodi::Log(ADDON_LOG_DEBUG, "HttpEngine: #%llu %s status=%d%s%s queue=%.1fms open=%.1fms ttfb=%.1fms total=%.1fms wire=%llu bytes=%llu",
+                  static_cast<unsigned long long>(id), sample.Url.c_str(), sample.HttpStatus,
+                  sample.Failed ? " FAILED" : "", sample.Cancelled ? " CANCELLED" : "",
+                  sample.QueueWaitUs / 1000.0, sample.OpenUs / 1000.0, sample.FirstByteUs / 1000.0, sample.TotalUs / 1000.0,
+                  static_cast<unsigned long long>(sample.WireBytes), static_cast<unsigned long long>(sample.Bytes));
+    }
+    
+    void Opened(kodi::vfs::CFile& curl)
+    {
+        sample.OpenUs = HttpStats::MicrosecondsSince(startTime);
+        // Status line, e.g. "HTTP/1.1 200 OK"
+        const std::string protocol = curl.GetPropertyValue(ADDON_FILE_PROPERTY_RESPONSE_PROTOCOL, "");
+        const auto pos = protocol.find(' ');
+        if(pos != std::string::npos)
+            sample.HttpStatus = std::atoi(protocol.c_str() + pos + 1);
+    }
+    
+    // Body bytes as received from the network (maybe compressed)
+    void Received(size_t bytes)
+    {
+        if(sample.FirstByteUs < 0)
+            sample.FirstByteUs = HttpStats::MicrosecondsSince(startTime);
+        sample.WireBytes += bytes;
+    }
+    
+    // Decoded body bytes passed to the consumer
+    void Delivered(size_t bytes)
+    {
+        sample.Bytes += bytes;
+    }
+    
+    void Completed(const CurlMultiplexer::Result& result)
+    {
+        sample.HttpStatus = static_cast<int>(result.HttpStatus);
+        sample.DnsUs = result.DnsUs;
+        sample.ConnectUs = result.ConnectUs;
+        // Headers are in when the first byte arrives
+        sample.OpenUs = result.FirstByteUs;
+        sample.WireBytes = result.WireBytes;
+    }
+    
+    const uint64_t id;
+    const HttpStats::Sample::Clock::time_point startTime;
+    HttpStats::Sample sample;
+};
+
+// Undoes Content-Encoding of response body on the fly
+class ContentDecoder
+{
+public:
+    ContentDecoder(const HttpEngine::TChunkHandler& onChunk, TransferTrace& trace)
+    : m_onChunk(onChunk)
+    , m_trace(trace)
+    {}
+    
+    // Call once response headers are known
+    void SetEncoding(const std::string& contentEncoding)
+    {
+        m_encoding = contentEncoding;
+    }
+    
+    // Returns false when consumer refused data or body can't be decoded
+    bool Write(const char* data, size_t size)
+    {
+        m_trace.Received(size);
+        if(!m_encoding.empty()) {
+            // gzip body without gzip magic was decoded by transport already
+            const bool isGzip = m_encoding == "gzip" || m_encoding == "x-gzip";
+            if(isGzip) {
+                // Magic may be split between chunks
+                m_head.append(data, size);
+                if(m_head.size() < Helpers::Inflator::c_gzipMagicSize)
+                    return true;
+            }
+            if(Helpers::Inflator::IsSupportedEncoding(m_encoding) && (!isGzip || Helpers::Inflator::IsGzipData(m_head.data(), m_head.size()))) {
+                m_inflator = std::make_unique<Helpers::Inflator>([this](const char* decoded, size_t decodedSize) {
+                    return Deliver(decoded, decodedSize);
+                });
+            }
+            m_encoding.clear();
+            if(!m_head.empty()) {
+                std::string head;
+                head.swap(m_head);
+                return Decode(head.data(), head.size());
+            }
+        }
+        return Decode(data, size);
+    }
+    
+    // Call at the end of body. Delivers body shorter than gzip magic.
+    bool Finish()
+    {
+        m_encoding.clear();
+        if(m_head.empty())
+            return true;
+        std::string head;
+        head.swap(m_head);
+        return Deliver(head.data(), head.size());
+    }
+    
+    bool IsCorrupted() const { return m_isCorrupted; }
+    
+private:
+    bool Decode(const char* data, size_t size)
+    {
+        if(!m_inflator)
+            return Deliver(data, size);
+        if(m_inflator->Process(data, size))
+            return true;
+        m_isCorrupted = !m_isRefused;
+        return false;
+    }
+    
+    bool Deliver(const char* data, size_t size)
+    {
+        m_trace.Delivered(size);
+        if(m_onChunk(data, size))
+            return true;
+        kodi::Log(ADDON_LOG_DEBUG, "HttpEngine: request #%llu aborted by consumer after %llu bytes",
+                  static_cast<unsigned long long>(m_trace.id), static_cast<unsigned long long>(m_trace.sample.Bytes));
+        m_isRefused = true;
+        return false;
+    }
+    
+    const HttpEngine::TChunkHandler& m_onChunk;
+    TransferTrace& m_trace;
+    std::string m_encoding;
+    // Start of body until encoding is known
+    std::string m_head;
+    std::unique_ptr<Helpers::Inflator> m_inflator;
+    bool m_isRefused = false;
+    bool m_isCorrupted = false;
+};
+
+// Advertises supported compression unless the caller has chosen encoding already
+static std::vector<std::string> HeadersWithAcceptEncoding(const std::vector<std::string>& headers)
+{
+    const auto hasAcceptEncoding = std::any_of(headers.begin(), headers.end(), [](const std::string& header) {
+        static const std::string name = "accept-encoding:";
+        return header.size() >= name.size() && std::equal(name.begin(), name.end(), header.begin(), [](char a, char b) {
+            return a == std::tolower(static_cast<unsigned char>(b));
+        });
+    });
+    std::vector<std::string> result = headers;
+    if(!hasAcceptEncoding)
+        result.push_back("Accept-Encoding: gzip, deflate");
+    return result;
+}
+
+static std::string CookieHeaderOf(const HttpEngine::TCookies& cookies)
+{
+    std::string cookieStr;
+    for (const auto& [name, value] : cookies) {
+        cookieStr += name + "=" + value + "; ";
+    }
+    return cookieStr;
+}
+
+// Transfer over shared (HTTP/2 when possible) connection
+static void DoMultiplexedCurl(const HttpEngine::Request& request, const HttpEngine::TCookies& cookies,
+                              const HttpEngine::TChunkHandler& onChunk, std::string* effectiveUrl,
+                              long timeoutSec, TransferTrace& trace)
+{
+    CurlMultiplexer::Transfer transfer;
+    transfer.Url = httplib::detail::encode_url(request.Url);
+    transfer.PostData = request.PostData;
+    transfer.Headers = HeadersWithAcceptEncoding(request.Headers);
+    transfer.Cookie = CookieHeaderOf(cookies);
+    transfer.TimeoutSec = timeoutSec;
+    transfer.StopToken = request.StopToken;
+
+    CurlMultiplexer::Result result;
+    ContentDecoder decoder(onChunk, trace);
+    bool isFirstChunk = true;
+    bool aborted = false;
+    const bool succeeded = CurlMultiplexer::Instance().Perform(transfer, [&](const char* data, size_t size) {
+        if(isFirstChunk) {
+            decoder.SetEncoding(result.ContentEncoding);
+            isFirstChunk = false;
+        }
+        aborted = !decoder.Write(data, size);
+        return !aborted;
+    }, result);
+    if(succeeded && !aborted)
+        aborted = !decoder.Finish();
+    trace.Completed(result);
+
+    if(result.Cancelled) {
+        trace.sample.Cancelled = true;
+        return;
+    }
+    if(decoder.IsCorrupted()) {
+        trace.sample.Failed = true;
+        throw CurlErrorException((std::string("Failed to decode ") + result.ContentEncoding + " response of " + request.Url).c_str());
+    }
+    if(aborted)
+        return;
+    if(!succeeded || result.HttpStatus >= 400) {
+        trace.sample.Failed = true;
+        const std::string reason = succeeded ? ("HTTP " + std::to_string(result.HttpStatus)) : result.Error;
+        throw CurlErrorException((std::string("Failed to open ") + request.Url + ": " + reason).c_str());
+    }
+    if(effectiveUrl) {
+        *effectiveUrl = result.EffectiveUrl;
+    }
+}
+
+void HttpEngine::DoCurl(const Request& request, const TCookies& cookies,
+                       const TChunkHandler& onChunk, uint64_t requestId,
+                       std::string* effectiveUrl, TimePoint queuedAt)
+{
+    const auto& stopToken = request.StopToken;
+    if (stopToken.stop_requested())
+        return;
+
+    TransferTrace trace(request.Url, requestId, queuedAt);
     kodi::vfs::CFile curl;
-    const auto startTime = std::chrono::steady_clock::now();
     
     try {
+        if(CurlMultiplexer::IsAvailable()) {
+            DoMultiplexedCurl(request, cookies, onChunk, effectiveUrl, c_CurlTimeout, trace);
+            return;
+        }
+
         // Базовая настройка CURL
         curl.CURLCreate(httplib::detail::encode_url(request.Url));
         curl.SetTimeout(c_CurlTimeout);
 
         // Заголовки и куки
-        for (const auto& header : request.Headers) {
+        for (const auto& header : HeadersWithAcceptEncoding(request.Headers)) {
             size_t pos = header.find(':');
             if(pos != std::string::npos) {
                 curl.AddHeader(header.substr(0, pos), header.substr(pos+1));
             }
         }
 
-        std::string cookieStr;
-        for (const auto& [name, value] : cookies) {
-            cookieStr += name + "=" + value + "; ";
-        }
+        const std::string cookieStr = CookieHeaderOf(cookies);
         if (!cookieStr.empty()) {
             curl.AddHeader("Cookie", cookieStr);
         }
 
         // Выполнение запроса
-        if(curl.CURLOpen(request.IsPost() ? ADDON_WRITE_NO_CACHE : ADDON_READ_NO_CACHE)) 
-        {
-            // Чтение ответа
+        // Chunked read returns as soon as any data is available,
+        // so stop request is noticed without waiting for a full buffer.
+        const unsigned int openFlags = request.IsPost() ? ADDON_WRITE_NO_CACHE : (ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED);
+        if(stopToken.stop_requested()) {
+            trace.sample.Cancelled = true;
+        } else if(curl.CURLOpen(openFlags)) {
+            trace.Opened(curl);
+            // Body is compressed when server accepted our Accept-Encoding
+            const std::string contentEncoding = curl.GetPropertyValue(ADDON_FILE_PROPERTY_RESPONSE_HEADER, "Content-Encoding");
+            ContentDecoder decoder(onChunk, trace);
+            decoder.SetEncoding(contentEncoding);
+            // Отдаём данные потребителю по мере поступления
             char buffer[32*1024];
-            ssize_t bytesRead;
-            while ((bytesRead = curl.Read(buffer, sizeof(buffer))) > 0) {
-                response->append(buffer, bytesRead);
+            ssize_t bytesRead = 0;
+            while (!stopToken.stop_requested() && (bytesRead = curl.Read(buffer, sizeof(buffer))) > 0) {
+                if (stopToken.stop_requested())
+                    break;
+                if(!decoder.Write(buffer, bytesRead))
+                    break;
+            }
+            if(!stopToken.stop_requested() && bytesRead == 0)
+                decoder.Finish();
+            if(decoder.IsCorrupted()) {
+                trace.sample.Failed = true;
+                throw CurlErrorException((std::string("Failed to decode ") + contentEncoding + " response of " + request.Url).c_str());
+            }
+
+            if (stopToken.stop_requested()) {
+                trace.sample.Cancelled = true;
+                // Drop connection now to free bandwidth for the next request
+                curl.Close();
+                return;
             }
 
             // Для архива: сохранение эффективного URL
             if(effectiveUrl) {
                 *effectiveUrl = curl.GetEffectiveURL();
             }
+        } else {
+            trace.sample.Failed = true;
+            throw CurlErrorException((std::string("Failed to open ") + request.Url).c_str());
         }
-
-        // Логирование времени выполнения (важно для архива)
-        auto duration = std::chrono::steady_clock::now() - startTime;
-        kodi::Log(ADDON_LOG_DEBUG, "Archive request took %lldms", 
-                 std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+    }
+    catch (const CurlErrorException& e) {
+        kodi::Log(ADDON_LOG_ERROR, "HttpEngine: request #%llu error: %s", static_cast<unsigned long long>(requestId), e.what());
+        throw;
     }
     catch (const std::exception& e) {
-        kodi::Log(ADDON_LOG_ERROR, "Archive error: %s", e.what());
+        trace.sample.Failed = true;
+        kodi::Log(ADDON_LOG_ERROR, "HttpEngine: request #%llu error: %s", static_cast<unsigned long long>(requestId), e.what());
         throw;
     }
 }
 
+#pragma mark - Retries
+
+std::string HttpEngine::HostOf(const std::string& url)
+{
+    auto start = url.find("://");
+    start = (start == std::string::npos) ? 0 : start + 3;
+    const auto end = url.find_first_of("/?#", start);
+    return url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+bool HttpEngine::CheckCircuit(const std::string& url)
+{
+    const auto host = HostOf(url);
+    std::lock_guard<std::mutex> lock(m_circuitsMutex);
+    auto it = m_circuits.find(host);
+    if (it == m_circuits.end())
+        return false;
+    if (!it->second.AllowRequest()) {
+        throw CircuitOpenException((std::string("Circuit is open for ") + host).c_str());
+    }
+    return it->second.IsHalfOpen();
+}
+
+void HttpEngine::CancelProbe(const std::string& url)
+{
+    const auto host = HostOf(url);
+    std::lock_guard<std::mutex> lock(m_circuitsMutex);
+    auto it = m_circuits.find(host);
+    if (it != m_circuits.end())
+        it->second.OnProbeCancelled();
+}
+
+void HttpEngine::ReportOutcome(const std::string& url, bool succeeded)
+{
+    if (succeeded)
+        m_retryBudget.OnSuccess();
+
+    const auto host = HostOf(url);
+    std::lock_guard<std::mutex> lock(m_circuitsMutex);
+    auto& circuit = m_circuits[host];
+    if (succeeded) {
+        circuit.OnSuccess();
+    } else {
+        circuit.OnFailure();
+        if (circuit.IsOpen())
+            kodi::Log(ADDON_LOG_NOTICE, "HttpEngine: too many failures, circuit is open for %s", host.c_str());
+    }
+}
+
+bool HttpEngine::ScheduleRetry(const Request& request, int attempt, std::function<void()> retry,
+                               std::function<void()> fail, std::function<void()> cancel)
+{
+    if (!request.Retry.CanRetry(attempt))
+        return false;
+    if (request.StopToken.stop_requested() || m_stopSource.stop_requested())
+        return false;
+    if (!m_retryBudget.TryWithdraw()) {
+        kodi::Log(ADDON_LOG_NOTICE, "HttpEngine: retry budget exhausted, giving up on %s", request.Url.c_str());
+        return false;
+    }
+
+    // Registered before the lock is taken: it runs at once when the request is already cancelled.
+    // Cancellation between here and queueing is seen by the retry thread on notify below.
+    auto onStop = std::make_unique<PendingRetry::StopCallback>(request.StopToken, std::function<void()>([this] {
+        { std::lock_guard<std::mutex> lock(m_retryMutex); }
+        m_retryCondition.notify_all();
+    }));
+    std::lock_guard<std::mutex> lock(m_retryMutex);
+    const auto delay = request.Retry.DelayAfter(attempt, m_retryRandom);
+    kodi::Log(ADDON_LOG_DEBUG, "HttpEngine: retry #%d of %s in %lld ms",
+              attempt + 1, request.Url.c_str(), static_cast<long long>(delay.count()));
+    m_pendingRetries.emplace(std::chrono::steady_clock::now() + delay,
+                             PendingRetry{retry, fail, cancel, request.StopToken, std::move(onStop)});
+    m_retryCondition.notify_one();
+    return true;
+}
+
+std::multimap<HttpEngine::TimePoint, HttpEngine::PendingRetry>::iterator HttpEngine::FindCancelledRetry()
+{
+    return std::find_if(m_pendingRetries.begin(), m_pendingRetries.end(), [](const auto& pending) {
+        return pending.second.stopToken.stop_requested();
+    });
+}
+
+void HttpEngine::RetryLoop(std::stop_token stopToken)
+{
+    std::unique_lock<std::mutex> lock(m_retryMutex);
+    while (!stopToken.stop_requested()) {
+        if (m_pendingRetries.empty()) {
+            m_retryCondition.wait(lock, stopToken, [this] { return !m_pendingRetries.empty(); });
+            continue;
+        }
+        // Request cancelled during backoff doesn't wait for its turn
+        auto next = FindCancelledRetry();
+        const bool isCancelled = next != m_pendingRetries.end();
+        if (!isCancelled) {
+            next = m_pendingRetries.begin();
+            const auto dueAt = next->first;
+            if (std::chrono::steady_clock::now() < dueAt) {
+                // Re-evaluate when an earlier retry is scheduled or a request is cancelled
+                m_retryCondition.wait_until(lock, stopToken, dueAt, [this, dueAt] {
+                    return m_pendingRetries.empty() || m_pendingRetries.begin()->first < dueAt
+                        || FindCancelledRetry() != m_pendingRetries.end();
+                });
+                continue;
+            }
+        }
+        auto pending = std::move(next->second);
+        m_pendingRetries.erase(next);
+        lock.unlock();
+        pending.onStop.reset();
+        try {
+            if (isCancelled)
+                pending.cancel();
+            else
+                pending.retry();
+        } catch (...) {
+            pending.fail();
+        }
+        lock.lock();
+    }
+
+    // Engine is going down, nobody will run pending retries
+    auto pendingRetries = std::move(m_pendingRetries);
+    m_pendingRetries.clear();
+    lock.unlock();
+    for (auto& pending : pendingRetries)
+        pending.second.fail();
+}
+
+#pragma mark - Control
+
 void HttpEngine::CancelAllRequests()
 {
+    // Abort transfers in progress first, then stop the queues
+    m_stopSource.request_stop();
+    if (m_retryThread.joinable()) {
+        m_retryThread.request_stop();
+        m_retryThread.join();
+    }
     m_apiCalls->StopThread();
     m_apiCallCompletions->StopThread();
     m_apiHiPriorityCallCompletions->StopThread();
@@ -9,7 +9,14 @@
 #include <memory>
 #include <chrono>
 #include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <thread>
+#include <stop_token>
 #include "ActionQueue.hpp"
+#include "RetryPolicy.hpp"
 #include "globals.hpp"
 
 class QueueNotRunningException : public std::exception
@@ -28,16 +35,32 @@ public:
     explicit CurlErrorException(const char* r = "") : reason(r) {}
 };
 
+class CircuitOpenException : public CurlErrorException
+{
+public:
+    explicit CircuitOpenException(const char* r = "") : CurlErrorException(r) {}
+};
+
 class HttpEngine
 {
 public:
     enum RequestPriority { RequestPriority_Hi, RequestPriority_Low };
     using TCookies = std::map<std::string, std::string>;
+    // Receives response body as it arrives from the network.
+    // Return false to abort the transfer.
+    using TChunkHandler = std::function<bool(const char* data, size_t size)>;
+    using TimePoint = std::chrono::steady_clock::time_point;
 
     struct Request {
         std::string Url;
         std::string PostData;
         std::vector<std::string> Headers;
+        // Transfer is aborted between reads once stop is requested.
+        // Completion is called with ActionStatus::Cancelled right away.
+        std::stop_token StopToken;
+        // Failed transfers (CurlErrorException) are retried asynchronously
+        // according to this policy. No retries by default.
+        RetryPolicy Retry;
 
         explicit Request(std::string url, 
                         std::string postData = {}, 
@@ -61,22 +84,134 @@ public:
         if (!m_apiCalls->IsRunning())
             throw QueueNotRunningException("API request queue not running");
 
+        SubmitApiCall(request, parser, CompletionOnce(completion), priority, 0);
+    }
+
+    // Streaming variant of CallApiAsync.
+    // Response body is passed to onChunk on the API thread while the transfer
+    // is still running, so the caller may parse it incrementally instead of
+    // waiting for the whole body to be buffered.
+    // Completion is called once transfer is done (or onChunk refused data).
+    // Failed transfer is retried only when nothing was delivered to onChunk yet.
+    template <typename TCompletion>
+    void CallApiStreamAsync(const Request& request,
+                            TChunkHandler onChunk,
+                            TCompletion completion,
+                            RequestPriority priority = RequestPriority_Low)
+    {
+        if (!m_apiCalls->IsRunning())
+            throw QueueNotRunningException("API request queue not running");
+
+        SubmitStreamCall(request, onChunk, CompletionOnce(completion), priority, 0);
+    }
+
+    void RunOnCompletion(ActionQueue::TAction action, RequestPriority priority) {
+        auto handler = [action](const ActionQueue::ActionResult&) { action(); };
+        
+        if (priority == RequestPriority_Hi) {
+            m_apiHiPriorityCallCompletions->PerformAsync(action, handler);
+        } else {
+            m_apiCallCompletions->PerformAsync(action, handler);
+        }
+    }
+
+    void CancelAllRequests();
+    static void SetCurlTimeout(long timeout);
+    static bool CheckInternetConnection(long timeout = 10);
+    TCookies m_sessionCookie;
+
+private:
+    // Stop token of a single transfer: stops when either the request
+    // owner or the engine (CancelAllRequests) requests stop.
+    class StopLink {
+    public:
+        StopLink(std::stop_token requestToken, std::stop_token engineToken)
+            : m_onRequestStop(requestToken, Forward{&m_source})
+            , m_onEngineStop(engineToken, Forward{&m_source})
+        {}
+        std::stop_token Token() const noexcept { return m_source.get_token(); }
+
+    private:
+        struct Forward {
+            std::stop_source* source;
+            void operator()() const noexcept { source->request_stop(); }
+        };
+        std::stop_source m_source;
+        std::stop_callback<Forward> m_onRequestStop;
+        std::stop_callback<Forward> m_onEngineStop;
+    };
+
+    // Completion may race between the transfer and the stop callback.
+    // Only the first one is delivered.
+    template <typename TCompletion>
+    static auto CompletionOnce(TCompletion completion) {
+        auto called = std::make_shared<std::atomic_bool>(false);
+        return [called, completion](const ActionQueue::ActionResult& result) {
+            if (!called->exchange(true))
+                completion(result);
+        };
+    }
+
+    // Outcome of a request for its host's circuit. Probe of half-open circuit
+    // is released on every exit path without outcome (cancellation, unexpected error),
+    // otherwise the host would stay blocked.
+    class CircuitProbe {
+    public:
+        CircuitProbe(HttpEngine& engine, const std::string& url) : m_engine(engine), m_url(url) {}
+        ~CircuitProbe() {
+            if (m_isProbe)
+                m_engine.CancelProbe(m_url);
+        }
+        // Throws CircuitOpenException
+        void Admit() { m_isProbe = m_engine.CheckCircuit(m_url); }
+        void Report(bool succeeded) {
+            m_isProbe = false;
+            m_engine.ReportOutcome(m_url, succeeded);
+        }
+
+    private:
+        HttpEngine& m_engine;
+        const std::string& m_url;
+        bool m_isProbe = false;
+    };
+
+    template <typename TCompletion>
+    struct CancelledCompletion {
+        TCompletion completion;
+        void operator()() const {
+            completion(ActionQueue::ActionResult(ActionQueue::ActionStatus::Cancelled));
+        }
+    };
+
+    template <typename TParser, typename TCompletion>
+    void SubmitApiCall(const Request& request, TParser parser, TCompletion completeOnce,
+                       RequestPriority priority, int attempt)
+    {
         auto shared_this = shared_from_this();
-        auto request_copy = request; // Copy for lambda capture
+        const auto queuedAt = std::chrono::steady_clock::now();
         
-        ActionQueue::TAction action = [shared_this, request_copy, parser, completion, priority]() {
+        ActionQueue::TAction action = [shared_this, request, parser, completeOnce, priority, queuedAt, attempt]() {
+            StopLink stop(request.StopToken, shared_this->m_stopSource.get_token());
+            std::stop_callback onStop(stop.Token(), CancelledCompletion<decltype(completeOnce)>{completeOnce});
+            CircuitProbe circuit(*shared_this, request.Url);
             try {
                 std::string response;
                 std::string effectiveUrl;
                 const auto requestId = shared_this->m_DebugRequestId.fetch_add(1);
+                Request linkedRequest(request);
+                linkedRequest.StopToken = stop.Token();
                 
                 // Archive-specific processing
-                if (request_copy.Url.find("archive") != std::string::npos) {
+                if (request.Url.find("archive") != std::string::npos) {
                     kodi::Log(ADDON_LOG_DEBUG, "Processing archive request: %s", 
-                             request_copy.Url.c_str());
+                             request.Url.c_str());
                 }
                 
-                DoCurl(request_copy, shared_this->m_sessionCookie, &response, requestId, &effectiveUrl);
+                circuit.Admit();
+                DoCurl(linkedRequest, shared_this->m_sessionCookie, &response, requestId, &effectiveUrl, queuedAt);
+                if (stop.Token().stop_requested())
+                    return; // Cancelled completion is already sent
+                circuit.Report(true);
                 
                 // Archive data handling
                 if (!response.empty() && priority == RequestPriority_Hi) {
@@ -86,23 +221,110 @@ public:
                 shared_this->RunOnCompletion([=]() {
                     try {
                         parser(response);
-                        completion(ActionQueue::ActionResult(ActionQueue::ActionStatus::Completed));
+                        completeOnce(ActionQueue::ActionResult(ActionQueue::ActionStatus::Completed));
                     } catch (...) {
-                        completion(ActionQueue::ActionResult(
+                        completeOnce(ActionQueue::ActionResult(
                             ActionQueue::ActionStatus::Failed, 
                             std::current_exception()
                         ));
                     }
                 }, priority);
                 
+            } catch (const CircuitOpenException&) {
+                completeOnce(ActionQueue::ActionResult(ActionQueue::ActionStatus::Failed, std::current_exception()));
+            } catch (const CurlErrorException&) {
+                circuit.Report(false);
+                auto error = std::current_exception();
+                auto retry = [shared_this, request, parser, completeOnce, priority, attempt]() {
+                    shared_this->SubmitApiCall(request, parser, completeOnce, priority, attempt + 1);
+                };
+                auto fail = [completeOnce, error]() {
+                    completeOnce(ActionQueue::ActionResult(ActionQueue::ActionStatus::Failed, error));
+                };
+                CancelledCompletion<decltype(completeOnce)> cancel{completeOnce};
+                if (!shared_this->ScheduleRetry(request, attempt, retry, fail, cancel))
+                    fail();
             } catch (...) {
-                completion(ActionQueue::ActionResult(
+                completeOnce(ActionQueue::ActionResult(
                     ActionQueue::ActionStatus::Failed, 
                     std::current_exception()
                 ));
             }
         };
 
+        EnqueueApiCall(action, completeOnce, priority);
+    }
+
+    template <typename TCompletion>
+    void SubmitStreamCall(const Request& request, TChunkHandler onChunk, TCompletion completeOnce,
+                          RequestPriority priority, int attempt)
+    {
+        auto shared_this = shared_from_this();
+        const auto queuedAt = std::chrono::steady_clock::now();
+
+        ActionQueue::TAction action = [shared_this, request, onChunk, completeOnce, priority, queuedAt, attempt]() {
+            StopLink stop(request.StopToken, shared_this->m_stopSource.get_token());
+            std::stop_callback onStop(stop.Token(), CancelledCompletion<decltype(completeOnce)>{completeOnce});
+            CircuitProbe circuit(*shared_this, request.Url);
+            bool delivered = false;
+            try {
+                const auto requestId = shared_this->m_DebugRequestId.fetch_add(1);
+                Request linkedRequest(request);
+                linkedRequest.StopToken = stop.Token();
+                circuit.Admit();
+                DoCurl(linkedRequest, shared_this->m_sessionCookie, [&delivered, &onChunk](const char* data, size_t size) {
+                    delivered = true;
+                    return onChunk(data, size);
+                }, requestId, nullptr, queuedAt);
+                if (stop.Token().stop_requested())
+                    return;
+                circuit.Report(true);
+                shared_this->RunOnCompletion([completeOnce]() {
+                    completeOnce(ActionQueue::ActionResult(ActionQueue::ActionStatus::Completed));
+                }, priority);
+            } catch (const CircuitOpenException&) {
+                completeOnce(ActionQueue::ActionResult(ActionQueue::ActionStatus::Failed, std::current_exception()));
+            } catch (const CurlErrorException&) {
+                circuit.Report(false);
+                auto error = std::current_exception();
+                auto retry = [shared_this, request, onChunk, completeOnce, priority, attempt]() {
+                    shared_this->SubmitStreamCall(request, onChunk, completeOnce, priority, attempt + 1);
+                };
+                auto fail = [completeOnce, error]() {
+                    completeOnce(ActionQueue::ActionResult(ActionQueue::ActionStatus::Failed, error));
+                };
+                CancelledCompletion<decltype(completeOnce)> cancel{completeOnce};
+                // Partial body can't be taken back from consumer
+                if (delivered || !shared_this->ScheduleRetry(request, attempt, retry, fail, cancel))
+                    fail();
+            } catch (...) {
+                completeOnce(ActionQueue::ActionResult(
+                    ActionQueue::ActionStatus::Failed,
+                    std::current_exception()
+                ));
+            }
+        };
+
+        EnqueueApiCall(action, completeOnce, priority);
+    }
+
+    // Throws CircuitOpenException when host of the url is considered down.
+    // Returns true when the request is the probe of half-open circuit.
+    bool CheckCircuit(const std::string& url);
+    void ReportOutcome(const std::string& url, bool succeeded);
+    // Lets the next request probe the host
+    void CancelProbe(const std::string& url);
+    // Queues retry after backoff delay. Returns false when policy, retry budget
+    // or cancellation don't allow another attempt.
+    // Request cancelled during backoff completes with cancel() at once.
+    bool ScheduleRetry(const Request& request, int attempt, std::function<void()> retry,
+                       std::function<void()> fail, std::function<void()> cancel);
+    void RetryLoop(std::stop_token stopToken);
+    static std::string HostOf(const std::string& url);
+
+    template <typename TCompletion>
+    void EnqueueApiCall(ActionQueue::TAction action, TCompletion completion, RequestPriority priority)
+    {
         if (priority == RequestPriority_Hi) {
             m_apiCalls->PerformHiPriority(action, [completion](const auto& result) {
                 if (result.status != ActionQueue::ActionStatus::Completed) {
@@ -118,22 +340,6 @@ public:
         }
     }
 
-    void RunOnCompletion(ActionQueue::TAction action, RequestPriority priority) {
-        auto handler = [action](const ActionQueue::ActionResult&) { action(); };
-        
-        if (priority == RequestPriority_Hi) {
-            m_apiHiPriorityCallCompletions->PerformAsync(action, handler);
-        } else {
-            m_apiCallCompletions->PerformAsync(action, handler);
-        }
-    }
-
-    void CancelAllRequests();
-    static void SetCurlTimeout(long timeout);
-    static bool CheckInternetConnection(long timeout = 10);
-    TCookies m_sessionCookie;
-
-private:
     void ProcessArchiveResponse(const std::string& response) {
         try {
             // Archive processing logic
@@ -154,13 +360,43 @@ private:
                       const TCookies& cookie, 
                       std::string* response, 
                       uint64_t requestId = 0, 
-                      std::string* effectiveUrl = nullptr);
+                      std::string* effectiveUrl = nullptr,
+                      TimePoint queuedAt = TimePoint());
+
+    static void DoCurl(const Request& request,
+                      const TCookies& cookie,
+                      const TChunkHandler& onChunk,
+                      uint64_t requestId = 0,
+                      std::string* effectiveUrl = nullptr,
+                      TimePoint queuedAt = TimePoint());
 
     std::shared_ptr<ActionQueue::CActionQueue> m_apiCalls;
     std::shared_ptr<ActionQueue::CActionQueue> m_apiCallCompletions;
     std::shared_ptr<ActionQueue::CActionQueue> m_apiHiPriorityCallCompletions;
     
     std::atomic<uint64_t> m_DebugRequestId{1};
+    std::stop_source m_stopSource;
+
+    struct PendingRetry {
+        typedef std::stop_callback<std::function<void()>> StopCallback;
+        std::function<void()> retry;
+        std::function<void()> fail;
+        std::function<void()> cancel;
+        std::stop_token stopToken;
+        // Wakes the retry thread on cancellation. Must not be destroyed under m_retryMutex:
+        // destructor waits for a running callback, which takes the mutex.
+        std::unique_ptr<StopCallback> onStop;
+    };
+    // Requires m_retryMutex
+    std::multimap<TimePoint, PendingRetry>::iterator FindCancelledRetry();
+    std::mutex m_retryMutex;
+    std::condition_variable_any m_retryCondition;
+    std::multimap<TimePoint, PendingRetry> m_pendingRetries;
+    std::mt19937 m_retryRandom{std::random_device{}()};
+    RetryBudget m_retryBudget;
+    std::mutex m_circuitsMutex;
+    std::map<std::string, CircuitBreaker> m_circuits;
+    std::jthread m_retryThread;
     static std::atomic<long> c_CurlTimeout;
 };
 
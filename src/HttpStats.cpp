@@ -0,0 +1,192 @@
+#include "HttpStats.hpp"
+#include <algorithm>
+#include <cctype>
+#include <kodi/Filesystem.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+#include "globals.hpp"
+
+using namespace Globals;
+
+#pragma mark - Histogram
+
+int HttpStats::Histogram::IndexOf(int64_t value)
+{
+    if(value < c_subBuckets)
+        return static_cast<int>(std::max<int64_t>(value, 0));
+    int msb = 63;
+    while(0 == (value & (int64_t(1) << msb)))
+        --msb;
+    const int shift = msb - c_subBucketBits;
+    const int subBucket = static_cast<int>(value >> shift) - c_subBuckets;
+    return (shift + 1) * c_subBuckets + subBucket;
+}
+
+int64_t HttpStats::Histogram::UpperBoundOf(int index)
+{
+    if(index < c_subBuckets)
+        return index;
+    const int shift = index / c_subBuckets - 1;
+    const int64_t subBucket = index % c_subBuckets;
+    const int64_t lower = (c_subBuckets + subBucket) << shift;
+    return lower + (int64_t(1) << shift) - 1;
+}
+
+void HttpStats::Histogram::Record(int64_t valueUs)
+{
+    if(valueUs < 0)
+        return;
+    ++m_buckets[IndexOf(valueUs)];
+    if(0 == m_count++) {
+        m_min = m_max = valueUs;
+    } else {
+        m_min = std::min(m_min, valueUs);
+        m_max = std::max(m_max, valueUs);
+    }
+    m_sum += valueUs;
+}
+
+int64_t HttpStats::Histogram::Percentile(double percentile) const
+{
+    if(0 == m_count)
+        return 0;
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0 * m_count + 0.5));
+    uint64_t seen = 0;
+    for(int i = 0; i < c_bucketCount; ++i) {
+        seen += m_buckets[i];
+        if(seen >= rank)
+            return std::min(UpperBoundOf(i), m_max);
+    }
+    return m_max;
+}
+
+#pragma mark - HttpStats
+
+HttpStats& HttpStats::Instance()
+{
+    static HttpStats s_instance;
+    return s_instance;
+}
+
+std::string HttpStats::EndpointOf(const std::string& url)
+{
+    std::string endpoint = url;
+    auto pos = endpoint.find("://");
+    if(pos != std::string::npos)
+        endpoint.erase(0, pos + 3);
+    pos = endpoint.find_first_of("?#");
+    if(pos != std::string::npos)
+        endpoint.erase(pos);
+
+    // Collapse id-like path segments, so per-channel calls share one endpoint
+    std::string result;
+    size_t start = 0;
+    while(start <= endpoint.size()) {
+        size_t end = endpoint.find('/', start);
+        if(end == std::string::npos)
+            end = endpoint.size();
+        const std::string segment = endpoint.substr(start, end - start);
+        const bool isFirst = start == 0;
+        const bool isId = !isFirst && segment.size() >= 4 &&
+            std::all_of(segment.begin(), segment.end(), [](unsigned char c) { return std::isxdigit(c) || c == '-'; });
+        if(!isFirst)
+            result += '/';
+        result += isId ? ":id" : segment;
+        start = end + 1;
+    }
+    return result;
+}
+
+void HttpStats::Record(const Sample& sample)
+{
+    const std::string endpoint = EndpointOf(sample.Url);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& stats = m_endpoints[endpoint];
+    ++stats.Requests;
+    if(sample.Failed)
+        ++stats.Failures;
+    if(sample.Cancelled)
+        ++stats.Cancellations;
+    stats.WireBytes += sample.WireBytes;
+    stats.Bytes += sample.Bytes;
+    if(sample.HttpStatus != 0)
+        ++stats.StatusCodes[sample.HttpStatus];
+    stats.QueueWait.Record(sample.QueueWaitUs);
+    stats.Dns.Record(sample.DnsUs);
+    stats.Connect.Record(sample.ConnectUs);
+    stats.Open.Record(sample.OpenUs);
+    stats.FirstByte.Record(sample.FirstByteUs);
+    stats.Total.Record(sample.TotalUs);
+}
+
+void HttpStats::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_endpoints.clear();
+}
+
+template<class TWriter>
+static void WriteHistogram(TWriter& writer, const char* name, const HttpStats::Histogram& h)
+{
+    if(0 == h.Count())
+        return;
+    writer.Key(name);
+    writer.StartObject();
+    writer.Key("count"); writer.Uint64(h.Count());
+    writer.Key("min_ms"); writer.Double(h.Min() / 1000.0);
+    writer.Key("mean_ms"); writer.Double(h.Mean() / 1000.0);
+    writer.Key("p50_ms"); writer.Double(h.Percentile(50) / 1000.0);
+    writer.Key("p90_ms"); writer.Double(h.Percentile(90) / 1000.0);
+    writer.Key("p99_ms"); writer.Double(h.Percentile(99) / 1000.0);
+    writer.Key("max_ms"); writer.Double(h.Max() / 1000.0);
+    writer.EndObject();
+}
+
+std::string HttpStats::ToJson() const
+{
+    rapidjson::StringBuffer sb;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(sb);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    writer.StartObject();
+    for(const auto& [endpoint, stats] : m_endpoints) {
+        writer.Key(endpoint.c_str());
+        writer.StartObject();
+        writer.Key("requests"); writer.Uint64(stats.Requests);
+        writer.Key("failures"); writer.Uint64(stats.Failures);
+        writer.Key("cancellations"); writer.Uint64(stats.Cancellations);
+        writer.Key("wire_bytes"); writer.Uint64(stats.WireBytes);
+        writer.Key("bytes"); writer.Uint64(stats.Bytes);
+        if(!stats.StatusCodes.empty()) {
+            writer.Key("status");
+            writer.StartObject();
+            for(const auto& [code, count] : stats.StatusCodes) {
+                writer.Key(std::to_string(code).c_str());
+                writer.Uint64(count);
+            }
+            writer.EndObject();
+        }
+        WriteHistogram(writer, "queue_wait", stats.QueueWait);
+        WriteHistogram(writer, "dns", stats.Dns);
+        WriteHistogram(writer, "connect", stats.Connect);
+        WriteHistogram(writer, "open", stats.Open);
+        WriteHistogram(writer, "first_byte", stats.FirstByte);
+        WriteHistogram(writer, "total", stats.Total);
+        writer.EndObject();
+    }
+    writer.EndObject();
+    return sb.GetString();
+}
+
+bool HttpStats::DumpToFile(const std::string& path) const
+{
+    const std::string json = ToJson();
+    kodi::vfs::CFile file;
+    if(!file.OpenFileForWrite(path, true)) {
+        LogError("HttpStats: failed to open %s for write.", path.c_str());
+        return false;
+    }
+    const bool succeeded = file.Write(json.c_str(), json.size()) == static_cast<ssize_t>(json.size());
+    file.Close();
+    return succeeded;
+}
@@ -0,0 +1,101 @@
+#ifndef HTTP_STATS_HPP
+#define HTTP_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Request level instrumentation of HttpEngine.
+// Keeps per-endpoint latency histograms, transferred bytes and error counters.
+// Endpoint is host + path with query and id-like path segments stripped,
+// i.e. "server:8185/cache_url/:id/json".
+class HttpStats
+{
+public:
+    // Log-linear histogram of durations in microseconds (HDR-style).
+    // 16 linear sub-buckets per power of two, i.e. ~6% relative precision.
+    class Histogram
+    {
+    public:
+        void Record(int64_t valueUs);
+        uint64_t Count() const { return m_count; }
+        int64_t Min() const { return m_count ? m_min : 0; }
+        int64_t Max() const { return m_max; }
+        double Mean() const { return m_count ? double(m_sum) / m_count : 0.0; }
+        // Upper bound of the bucket holding given percentile (0..100)
+        int64_t Percentile(double percentile) const;
+
+    private:
+        static const int c_subBucketBits = 4;
+        static const int c_subBuckets = 1 << c_subBucketBits;
+        static const int c_bucketCount = (64 - c_subBucketBits) * c_subBuckets;
+        static int IndexOf(int64_t value);
+        static int64_t UpperBoundOf(int index);
+
+        std::array<uint64_t, c_bucketCount> m_buckets{};
+        uint64_t m_count = 0;
+        int64_t m_sum = 0;
+        int64_t m_min = 0;
+        int64_t m_max = 0;
+    };
+
+    // Timings of a single transfer. Negative value = not available.
+    struct Sample
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::string Url;
+        int64_t QueueWaitUs = -1;
+        int64_t DnsUs = -1;
+        int64_t ConnectUs = -1;
+        int64_t OpenUs = -1;       // request sent, response headers received
+        int64_t FirstByteUs = -1;  // first body chunk delivered
+        int64_t TotalUs = -1;
+        uint64_t WireBytes = 0;    // as received from network
+        uint64_t Bytes = 0;        // as delivered to consumer (decoded)
+        int HttpStatus = 0;        // 0 = unknown
+        bool Failed = false;
+        bool Cancelled = false;
+    };
+
+    struct EndpointStats
+    {
+        Histogram QueueWait;
+        Histogram Dns;
+        Histogram Connect;
+        Histogram Open;
+        Histogram FirstByte;
+        Histogram Total;
+        uint64_t Requests = 0;
+        uint64_t Failures = 0;
+        uint64_t Cancellations = 0;
+        uint64_t WireBytes = 0;
+        uint64_t Bytes = 0;
+        std::map<int, uint64_t> StatusCodes;
+    };
+
+    static HttpStats& Instance();
+
+    void Record(const Sample& sample);
+    void Reset();
+    std::string ToJson() const;
+    bool DumpToFile(const std::string& path) const;
+
+    static std::string EndpointOf(const std::string& url);
+    static int64_t MicrosecondsSince(Sample::Clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Sample::Clock::now() - start).count();
+    }
+
+private:
+    HttpStats() = default;
+    HttpStats(const HttpStats&) = delete;
+    HttpStats& operator=(const HttpStats&) = delete;
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, EndpointStats> m_endpoints;
+};
+
+#endif // HTTP_STATS_HPP
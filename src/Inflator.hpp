@@ -0,0 +1,151 @@
+#ifndef INFLATOR_HPP
+#define INFLATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <zlib.h>
+
+namespace Helpers {
+
+// Streaming zlib decoder for gzip, zlib and raw deflate data.
+// Input may be split at any byte, decoded output is passed to the writer
+// in blocks of up to c_outputChunkSize bytes as soon as it is available.
+class Inflator {
+public:
+    // Returns false to stop decoding.
+    using TWriter = std::function<bool(const char* data, size_t size)>;
+
+    static const size_t c_outputChunkSize = 16384;
+
+    explicit Inflator(TWriter writer)
+        : m_writer(std::move(writer))
+    {
+        // 32 + MAX_WBITS: detect gzip or zlib header automatically
+        m_isValid = Z_OK == inflateInit2(&m_stream, 32 + MAX_WBITS);
+    }
+
+    Inflator(const Inflator&) = delete;
+    Inflator& operator=(const Inflator&) = delete;
+
+    ~Inflator() {
+        if (m_isValid)
+            inflateEnd(&m_stream);
+    }
+
+    // HTTP Content-Encoding values handled by Inflator
+    static bool IsSupportedEncoding(const std::string& contentEncoding) {
+        return contentEncoding == "gzip" || contentEncoding == "x-gzip" || contentEncoding == "deflate";
+    }
+
+    // Bytes IsGzipData() needs, shorter data is never taken for gzip
+    static const size_t c_gzipMagicSize = 3;
+
+    static bool IsGzipData(const char* data, size_t size) {
+        return size >= c_gzipMagicSize && data[0] == '\x1F' && data[1] == '\x8B' && data[2] == '\x08';
+    }
+
+    // Returns false on corrupted input or when writer refused the data.
+    // Data after the last gzip member (e.g. zero padding) is ignored.
+    bool Process(const char* data, size_t size) {
+        if (!m_isValid)
+            return false;
+        if (m_isTrailing)
+            return true;
+        if (m_hasInput && !m_isFinished)
+            return Inflate(data, size);
+
+        // Start of the stream or of the next gzip member
+        m_head.append(data, size);
+        if (m_head.size() < c_gzipMagicSize)
+            return true;
+        std::string head;
+        head.swap(m_head);
+        const bool isGzip = IsGzipData(head.data(), head.size());
+        if (m_isFinished) {
+            // Only gzip members may be concatenated
+            if (!m_isGzip || !isGzip) {
+                m_isTrailing = true;
+                return true;
+            }
+            inflateReset(&m_stream);
+            m_isFinished = false;
+        }
+        m_isGzip = isGzip;
+        return Inflate(head.data(), head.size());
+    }
+
+    // True when the end of compressed stream has been reached.
+    bool IsFinished() const { return m_isFinished; }
+    uint64_t TotalIn() const { return m_stream.total_in; }
+    uint64_t TotalOut() const { return m_totalOut; }
+
+private:
+    bool Inflate(const char* data, size_t size) {
+        const bool isFirstInput = !m_hasInput;
+        m_hasInput = true;
+        m_stream.avail_in = static_cast<uInt>(size);
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+
+        while (m_stream.avail_in > 0) {
+            char output[c_outputChunkSize];
+            m_stream.avail_out = c_outputChunkSize;
+            m_stream.next_out = reinterpret_cast<Bytef*>(output);
+
+            int ret = inflate(&m_stream, Z_NO_FLUSH);
+            // Some servers send "deflate" without zlib header.
+            // Input is replayed as raw deflate, possible only before any output was delivered.
+            if (ret == Z_DATA_ERROR && isFirstInput && m_totalOut == 0 && !m_isGzip && !m_isRawDeflate) {
+                if (!SwitchToRawDeflate(data, size))
+                    return false;
+                continue;
+            }
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                return false;
+
+            const size_t have = c_outputChunkSize - m_stream.avail_out;
+            m_totalOut += have;
+            if (have > 0 && !m_writer(output, have))
+                return false;
+
+            if (ret == Z_STREAM_END) {
+                m_isFinished = true;
+                // Next gzip member or trailing data
+                if (m_stream.avail_in > 0)
+                    return Process(reinterpret_cast<const char*>(m_stream.next_in), m_stream.avail_in);
+                break;
+            } else if (have == 0 && ret == Z_BUF_ERROR) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool SwitchToRawDeflate(const char* data, size_t size) {
+        inflateEnd(&m_stream);
+        m_stream = z_stream{};
+        m_isRawDeflate = true;
+        m_isValid = Z_OK == inflateInit2(&m_stream, -MAX_WBITS);
+        // Restart from the beginning of current input
+        m_stream.avail_in = static_cast<uInt>(size);
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        return m_isValid;
+    }
+
+    z_stream m_stream{};
+    TWriter m_writer;
+    std::string m_head;
+    uint64_t m_totalOut = 0;
+    bool m_isValid = false;
+    bool m_hasInput = false;
+    bool m_isGzip = false;
+    bool m_isRawDeflate = false;
+    bool m_isFinished = false;
+    // Rest of input after the last member is skipped
+    bool m_isTrailing = false;
+};
+
+} // namespace Helpers
+
+#endif // INFLATOR_HPP
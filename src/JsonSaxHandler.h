@@ -11,6 +11,8 @@
 #include <set>
 #include <vector>
 #include <functional>
+#include <thread>
+#include "ChunkQueue.hpp"
 
 namespace Helpers {
 namespace Json {
@@ -165,6 +167,98 @@ bool ParseJsonStream(const char* json,
     return true;
 }
 
+// rapidjson input stream over a ChunkQueue.
+// Blocks in Peek()/Take() until the next chunk arrives.
+class ChunkQueueReadStream {
+public:
+    typedef char Ch;
+
+    explicit ChunkQueueReadStream(ChunkQueue& queue) : m_queue(queue) {}
+
+    Ch Peek() { return Fill() ? m_chunk[m_pos] : '\0'; }
+    Ch Take() {
+        if (!Fill())
+            return '\0';
+        ++m_count;
+        return m_chunk[m_pos++];
+    }
+    size_t Tell() const { return m_count; }
+
+    Ch* PutBegin() { RAPIDJSON_ASSERT(false); return nullptr; }
+    void Put(Ch) { RAPIDJSON_ASSERT(false); }
+    void Flush() { RAPIDJSON_ASSERT(false); }
+    size_t PutEnd(Ch*) { RAPIDJSON_ASSERT(false); return 0; }
+
+private:
+    bool Fill() {
+        while (m_pos >= m_chunk.size()) {
+            if (!m_queue.Pop(m_chunk))
+                return false;
+            m_pos = 0;
+        }
+        return true;
+    }
+
+    ChunkQueue& m_queue;
+    std::string m_chunk;
+    size_t m_pos = 0;
+    size_t m_count = 0;
+};
+
+// Incremental SAX parsing of a document delivered in chunks
+// (e.g. by HttpEngine::CallApiStreamAsync).
+// Reader runs on its own thread and consumes chunks as they arrive,
+// so parsing overlaps with the download and only a bounded amount
+// of raw JSON is kept in memory.
+template<class THandler>
+class StreamingJsonParser {
+public:
+    explicit StreamingJsonParser(THandler& handler, size_t maxQueuedChunks = 16)
+        : m_queue(maxQueuedChunks)
+    {
+        m_parser = std::jthread([this, &handler] {
+            ChunkQueueReadStream stream(m_queue);
+            Reader reader;
+            if (!reader.Parse(stream, handler)) {
+                m_errorCode = reader.GetParseErrorCode();
+                m_errorOffset = reader.GetErrorOffset();
+            }
+            // Unblock producer when parser stopped early.
+            m_queue.Abort();
+        });
+    }
+
+    ~StreamingJsonParser() {
+        m_queue.Abort();
+    }
+
+    StreamingJsonParser(const StreamingJsonParser&) = delete;
+    StreamingJsonParser& operator=(const StreamingJsonParser&) = delete;
+
+    // Returns false when parser has stopped (error or document complete).
+    bool Push(const char* data, size_t size) { return m_queue.Push(data, size); }
+
+    // Signals end of input and waits for parser.
+    bool Finish(std::string* errorMessage) {
+        m_queue.Close();
+        if (m_parser.joinable())
+            m_parser.join();
+        if (m_errorCode == rapidjson::kParseErrorNone)
+            return true;
+        if (errorMessage) {
+            *errorMessage = GetParseError_En(m_errorCode);
+            *errorMessage += " at offset " + std::to_string(m_errorOffset);
+        }
+        return false;
+    }
+
+private:
+    ChunkQueue m_queue;
+    ParseErrorCode m_errorCode = rapidjson::kParseErrorNone;
+    size_t m_errorOffset = 0;
+    std::jthread m_parser;
+};
+
 }} // namespace Helpers::Json
 
 #endif // JSON_SAX_HANDLER_H
@@ -0,0 +1,194 @@
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include "M3uTokenizer.hpp"
+
+namespace Helpers {
+
+static const std::string_view c_M3U = "#EXTM3U";
+static const std::string_view c_INF = "#EXTINF:";
+static const std::string_view c_GROUP = "#EXTGRP:";
+
+static bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static std::string_view TrimRight(std::string_view str)
+{
+    size_t size = str.size();
+    while(size > 0 && IsBlank(str[size - 1]))
+        --size;
+    return str.substr(0, size);
+}
+
+static bool StartsWith(std::string_view str, std::string_view prefix)
+{
+    return str.size() >= prefix.size() && str.compare(0, prefix.size(), prefix) == 0;
+}
+
+#pragma mark - M3uAttributes
+
+void M3uAttributes::Parse(std::string_view line)
+{
+    m_attributes.clear();
+    m_title = std::string_view();
+    m_hasTitle = false;
+
+    const char* data = line.data();
+    const size_t size = line.size();
+    size_t pos = 0;
+    while(pos < size) {
+        const char c = data[pos];
+        if(c == ' ' || c == '\t') {
+            ++pos;
+            continue;
+        }
+        if(c == ',') {
+            m_title = TrimRight(line.substr(pos + 1));
+            m_hasTitle = true;
+            return;
+        }
+        if(c == '"') {
+            // Stray quoted token, skip it as a whole
+            const void* quote = memchr(data + pos + 1, '"', size - pos - 1);
+            pos = (nullptr == quote) ? size : static_cast<const char*>(quote) - data + 1;
+            continue;
+        }
+        const size_t keyStart = pos;
+        while(pos < size && data[pos] != '=' && data[pos] != ',' && data[pos] != '"' && data[pos] != ' ' && data[pos] != '\t')
+            ++pos;
+        if(pos == size || data[pos] != '=') {
+            // Bare token, e.g. duration
+            continue;
+        }
+        const std::string_view key = line.substr(keyStart, pos - keyStart);
+        ++pos;
+        // Tolerate "key==value"
+        if(pos < size && data[pos] == '=')
+            ++pos;
+        size_t valueStart = pos;
+        size_t valueEnd;
+        if(pos < size && data[pos] == '"') {
+            valueStart = ++pos;
+            const void* quote = memchr(data + pos, '"', size - pos);
+            valueEnd = (nullptr == quote) ? size : static_cast<const char*>(quote) - data;
+            pos = (valueEnd == size) ? size : valueEnd + 1;
+        } else {
+            while(pos < size && data[pos] != ' ' && data[pos] != '\t' && data[pos] != ',')
+                ++pos;
+            valueEnd = pos;
+        }
+        if(!key.empty())
+            m_attributes.push_back(Attribute{key, line.substr(valueStart, valueEnd - valueStart)});
+    }
+}
+
+std::string_view M3uAttributes::Get(std::string_view key) const
+{
+    // A dozen attributes per line, linear search is the fastest
+    for(const auto& attribute : m_attributes) {
+        if(attribute.key == key)
+            return attribute.value;
+    }
+    return std::string_view();
+}
+
+bool M3uAttributes::Has(std::string_view key) const
+{
+    for(const auto& attribute : m_attributes) {
+        if(attribute.key == key)
+            return true;
+    }
+    return false;
+}
+
+bool M3uAttributes::TryGetUnsigned(std::string_view key, unsigned long& value) const
+{
+    const std::string_view str = Get(key);
+    unsigned long result = 0;
+    const auto parsed = std::from_chars(str.data(), str.data() + str.size(), result);
+    if(parsed.ec != std::errc() || parsed.ptr == str.data())
+        return false;
+    value = result;
+    return true;
+}
+
+double M3uAttributes::GetDouble(std::string_view key, double fallback) const
+{
+    const std::string value(Get(key));
+    if(value.empty())
+        return fallback;
+    // strtod: floating point from_chars is not available on all platforms
+    char* end = nullptr;
+    const double result = strtod(value.c_str(), &end);
+    return (end == value.c_str()) ? fallback : result;
+}
+
+#pragma mark - M3uReader
+
+M3uReader::M3uReader(std::string_view data)
+    : m_data(data)
+{
+    const size_t pos = m_data.find(c_M3U);
+    if(std::string_view::npos == pos) {
+        m_pos = m_data.size();
+        return;
+    }
+    m_isValid = true;
+    m_pos = pos + c_M3U.size();
+    std::string_view line;
+    NextLine(line);
+    m_header.Parse(line);
+}
+
+bool M3uReader::NextLine(std::string_view& line)
+{
+    if(m_pos >= m_data.size())
+        return false;
+    const char* data = m_data.data();
+    const void* eol = memchr(data + m_pos, '\n', m_data.size() - m_pos);
+    const size_t end = (nullptr == eol) ? m_data.size() : static_cast<const char*>(eol) - data;
+    size_t start = m_pos;
+    while(start < end && IsBlank(data[start]))
+        ++start;
+    line = TrimRight(m_data.substr(start, end - start));
+    m_pos = (end == m_data.size()) ? end : end + 1;
+    return true;
+}
+
+bool M3uReader::Next(M3uEntry& entry)
+{
+    std::string_view line;
+    do {
+        if(!NextLine(line))
+            return false;
+    } while(!StartsWith(line, c_INF));
+
+    entry.attributes.Parse(line.substr(c_INF.size()));
+    entry.group = std::string_view();
+    entry.url = std::string_view();
+
+    size_t lineStart = m_pos;
+    while(NextLine(line)) {
+        if(line.empty()) {
+            lineStart = m_pos;
+            continue;
+        }
+        if(StartsWith(line, c_INF)) {
+            // Entry without URL, next one starts here
+            m_pos = lineStart;
+            break;
+        }
+        if(StartsWith(line, c_GROUP)) {
+            entry.group = line.substr(c_GROUP.size());
+        } else if(line[0] != '#') {
+            entry.url = line;
+            break;
+        }
+        lineStart = m_pos;
+    }
+    return true;
+}
+
+} // namespace Helpers
@@ -0,0 +1,85 @@
+#ifndef M3U_TOKENIZER_HPP
+#define M3U_TOKENIZER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Helpers {
+
+// Attributes of one M3U tag line, e.g.
+// #EXTINF:0 tvg-id="1147" group-title="Base" catchup="default",Channel name
+// The line is scanned once, views point into the playlist text.
+// Missing attributes are not errors: getters return empty view or fallback.
+class M3uAttributes
+{
+public:
+    // Text after the tag ("#EXTINF:", "#EXTM3U") up to the end of line
+    void Parse(std::string_view line);
+
+    // Keys are case sensitive, the first one wins
+    std::string_view Get(std::string_view key) const;
+    bool Has(std::string_view key) const;
+    std::string GetString(std::string_view key) const { return std::string(Get(key)); }
+    // False when missing or not a number
+    bool TryGetUnsigned(std::string_view key, unsigned long& value) const;
+    unsigned long GetUnsigned(std::string_view key, unsigned long fallback) const {
+        unsigned long value;
+        return TryGetUnsigned(key, value) ? value : fallback;
+    }
+    double GetDouble(std::string_view key, double fallback) const;
+
+    // After the first comma outside of quotes. Right trimmed only:
+    // channel ids are hashed from the name as it is in playlist.
+    std::string_view Title() const { return m_title; }
+    bool HasTitle() const { return m_hasTitle; }
+
+    size_t Size() const { return m_attributes.size(); }
+
+private:
+    struct Attribute
+    {
+        std::string_view key;
+        std::string_view value;
+    };
+    std::vector<Attribute> m_attributes;
+    std::string_view m_title;
+    bool m_hasTitle = false;
+};
+
+struct M3uEntry
+{
+    // Of #EXTINF line
+    M3uAttributes attributes;
+    // From #EXTGRP line, empty when missing
+    std::string_view group;
+    // Empty when next #EXTINF or end of data comes first
+    std::string_view url;
+};
+
+// Forward only reader of channel entries.
+// Unknown tag lines between #EXTINF and URL are skipped.
+class M3uReader
+{
+public:
+    explicit M3uReader(std::string_view data);
+
+    // False when there is no #EXTM3U tag
+    bool IsValid() const { return m_isValid; }
+    const M3uAttributes& Header() const { return m_header; }
+
+    // Entry is reused between calls to keep its buffers
+    bool Next(M3uEntry& entry);
+
+private:
+    bool NextLine(std::string_view& line);
+
+    std::string_view m_data;
+    size_t m_pos = 0;
+    bool m_isValid = false;
+    M3uAttributes m_header;
+};
+
+} // namespace Helpers
+
+#endif // M3U_TOKENIZER_HPP
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <atomic>
+#include <kodi/AddonBase.h>
+#include "RecordingEngine.hpp"
+#include "timeshift_buffer.h"
+#include "file_cache_buffer.hpp"
+#include "Speedometer.h"
+
+namespace Engines {
+
+using namespace Buffers;
+using namespace PvrClient;
+
+// Same as local recordings always had
+static const uint8_t c_RecordingCacheSizeFactor = 255;
+
+#pragma mark - Meter
+
+// Written by pipeline's writer thread, read by stats
+struct RecordingEngine::Meter
+{
+    Meter() : Speed(8 * 1024 * 1024) { Speed.StartMeasurement(); }
+
+    std::atomic<bool> IsLive{false};
+    mutable std::mutex Mutex;
+    Helpers::Speedometer Speed;
+    uint64_t BytesWritten = 0;
+};
+
+#pragma mark - RecordingEngine
+
+RecordingEngine::RecordingEngine(InputFactory createInput)
+: m_createInput(std::move(createInput))
+{
+}
+
+RecordingEngine::~RecordingEngine()
+{
+    StopAll();
+}
+
+void RecordingEngine::SetLimits(size_t maxRecordings, uint64_t ioBudget)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxRecordings = maxRecordings;
+    if(m_ioBudget == ioBudget)
+        return;
+    m_ioBudget = ioBudget;
+    const double written = BudgetedBytesPerSecond();
+    if(ioBudget > 0 && written > ioBudget) {
+        kodi::Log(ADDON_LOG_WARNING, "RecordingEngine: IO budget %llu KB/s is below %.1f KB/s written by running recordings. They go on, new ones are not started.",
+                  (unsigned long long) ioBudget / 1024, written / 1024);
+    }
+}
+
+bool RecordingEngine::IsFull() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_maxRecordings > 0 && m_pipelines.size() >= m_maxRecordings;
+}
+
+bool RecordingEngine::Add(RecordingId id, ChannelId channelId, TimeshiftBuffer* buffer, bool isLive)
+{
+    auto meter = std::make_shared<Meter>();
+    meter->IsLive = isLive;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_pipelines.count(id) != 0) {
+            kodi::Log(ADDON_LOG_ERROR, "RecordingEngine: recording %u is running already.", id);
+            return false;
+        }
+        if(m_maxRecordings > 0 && m_pipelines.size() >= m_maxRecordings) {
+            kodi::Log(ADDON_LOG_ERROR, "RecordingEngine: limit of %zu recordings reached, %u is not started.", m_maxRecordings, id);
+            return false;
+        }
+        // Live buffer writes anyway, recording it adds no stream
+        const double written = isLive ? 0.0 : BudgetedBytesPerSecond();
+        if(m_ioBudget > 0 && written >= m_ioBudget) {
+            kodi::Log(ADDON_LOG_ERROR, "RecordingEngine: recordings write %.1f KB/s of %llu KB/s IO budget, %u is not started.",
+                      written / 1024, (unsigned long long) m_ioBudget / 1024, id);
+            return false;
+        }
+        m_pipelines[id] = Pipeline{channelId, time(nullptr), buffer, meter};
+    }
+    buffer->SetWriteObserver([meter](size_t bytes) {
+        std::lock_guard<std::mutex> lock(meter->Mutex);
+        meter->Speed.FinishMeasurement(bytes);
+        meter->BytesWritten += bytes;
+    });
+    kodi::Log(ADDON_LOG_INFO, "RecordingEngine: recording %u of channel %u started%s.", id, channelId, isLive ? " from live stream" : "");
+    return true;
+}
+
+bool RecordingEngine::Start(RecordingId id, ChannelId channelId, const std::string& url, const std::string& recordingDir)
+{
+    if(url.empty()) {
+        kodi::Log(ADDON_LOG_ERROR, "RecordingEngine: no stream for recording %u.", id);
+        return false;
+    }
+    if(IsFull()) {
+        kodi::Log(ADDON_LOG_ERROR, "RecordingEngine: limit of recordings reached, %u is not started.", id);
+        return false;
+    }
+    TimeshiftBuffer* buffer = nullptr;
+    try {
+        buffer = new TimeshiftBuffer(m_createInput(url), new FileCacheBuffer(recordingDir, c_RecordingCacheSizeFactor, false));
+    } catch (std::exception& ex) {
+        kodi::Log(ADDON_LOG_ERROR, "RecordingEngine: failed to open stream of recording %u. Exception: %s", id, ex.what());
+        return false;
+    }
+    if(!Add(id, channelId, buffer, false)) {
+        delete buffer;
+        return false;
+    }
+    return true;
+}
+
+bool RecordingEngine::StartFromLive(RecordingId id, ChannelId channelId, TimeshiftBuffer* liveBuffer, const std::string& recordingDir)
+{
+    if(nullptr == liveBuffer || IsRecording(liveBuffer))
+        return false;
+    if(!Add(id, channelId, liveBuffer, true))
+        return false;
+    liveBuffer->SwapCache(new FileCacheBuffer(recordingDir, c_RecordingCacheSizeFactor, false));
+    return true;
+}
+
+TimeshiftBuffer* RecordingEngine::Release(RecordingId id)
+{
+    Pipeline pipeline;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_pipelines.find(id);
+        if(found == m_pipelines.end())
+            return nullptr;
+        pipeline = found->second;
+        m_pipelines.erase(found);
+    }
+    pipeline.Buffer->SetWriteObserver(nullptr);
+    const Stats stats = StatsOf(id, pipeline);
+    kodi::Log(ADDON_LOG_INFO, "RecordingEngine: recording %u stopped. Written %llu KB, %.1f KB/s.",
+              id, (unsigned long long) stats.BytesWritten / 1024, stats.BytesPerSecond / 1024);
+    return pipeline.Buffer;
+}
+
+void RecordingEngine::StopAll()
+{
+    std::vector<RecordingId> ids;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(const auto& pipeline : m_pipelines)
+            ids.push_back(pipeline.first);
+    }
+    for(const auto id : ids)
+        delete Release(id);
+}
+
+TimeshiftBuffer* RecordingEngine::JoinLive(ChannelId channelId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto& pipeline : m_pipelines) {
+        if(pipeline.second.ChannelId != channelId)
+            continue;
+        // Player's stream is not counted against IO budget
+        pipeline.second.Measurements->IsLive = true;
+        return pipeline.second.Buffer;
+    }
+    return nullptr;
+}
+
+void RecordingEngine::LeaveLive(const TimeshiftBuffer* buffer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto& pipeline : m_pipelines) {
+        if(pipeline.second.Buffer == buffer)
+            pipeline.second.Measurements->IsLive = false;
+    }
+}
+
+bool RecordingEngine::IsRecording(const TimeshiftBuffer* buffer) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::any_of(m_pipelines.begin(), m_pipelines.end(), [buffer](const auto& pipeline) {
+        return pipeline.second.Buffer == buffer;
+    });
+}
+
+RecordingEngine::Stats RecordingEngine::StatsOf(RecordingId id, const Pipeline& pipeline) const
+{
+    const Meter& meter = *pipeline.Measurements;
+    std::lock_guard<std::mutex> lock(meter.Mutex);
+    return Stats{id, pipeline.ChannelId, meter.IsLive, pipeline.StartedAt, meter.BytesWritten, meter.Speed.GetBps()};
+}
+
+double RecordingEngine::BudgetedBytesPerSecond() const
+{
+    double result = 0.0;
+    for(const auto& pipeline : m_pipelines) {
+        const Meter& meter = *pipeline.second.Measurements;
+        if(meter.IsLive)
+            continue;
+        std::lock_guard<std::mutex> lock(meter.Mutex);
+        result += meter.Speed.GetBps();
+    }
+    return result;
+}
+
+std::vector<RecordingEngine::Stats> RecordingEngine::GetStats() const
+{
+    std::vector<Stats> result;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto& pipeline : m_pipelines)
+        result.push_back(StatsOf(pipeline.first, pipeline.second));
+    return result;
+}
+
+void RecordingEngine::LogStats() const
+{
+    for(const auto& stats : GetStats()) {
+        kodi::Log(ADDON_LOG_INFO, "RecordingEngine: recording %u of channel %u%s, running %lld s. Written %llu KB, %.1f KB/s.",
+                  stats.Id, stats.ChannelId, stats.IsLive ? " (live)" : "", (long long) (time(nullptr) - stats.StartedAt),
+                  (unsigned long long) stats.BytesWritten / 1024, stats.BytesPerSecond / 1024);
+    }
+}
+
+} // namespace Engines
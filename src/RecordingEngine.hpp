@@ -0,0 +1,98 @@
+#ifndef RECORDING_ENGINE_HPP
+#define RECORDING_ENGINE_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "pvr_client_types.h"
+
+namespace Buffers {
+    class InputBuffer;
+    class TimeshiftBuffer;
+}
+
+namespace Engines {
+
+// Local recordings, any number at a time. Every recording is a pipeline:
+// input stream -> TimeshiftBuffer -> FileCacheBuffer chunks in the recording
+// directory (sequential writes, read back by local recording playback).
+// Recording of the live channel takes the player's buffer over, so both share
+// one connection. Other pipelines share the disk IO budget: a recording is not
+// started while their measured write rate reaches it. Writers are never
+// throttled, a stalled input loses data (HLS segments expire, servers drop
+// slow clients). Pipelines the player reads from are not counted.
+// Thread safe.
+class RecordingEngine
+{
+public:
+    // EPG UID of recorded program, names the recording directory
+    typedef unsigned int RecordingId;
+    typedef std::function<Buffers::InputBuffer*(const std::string& url)> InputFactory;
+
+    struct Stats
+    {
+        RecordingId Id;
+        PvrClient::ChannelId ChannelId;
+        bool IsLive;
+        time_t StartedAt;
+        uint64_t BytesWritten;
+        double BytesPerSecond;
+    };
+
+    explicit RecordingEngine(InputFactory createInput);
+    ~RecordingEngine();
+
+    RecordingEngine(const RecordingEngine&) = delete;
+    RecordingEngine& operator=(const RecordingEngine&) = delete;
+
+    // 0 - unlimited. ioBudget is bytes per second.
+    void SetLimits(size_t maxRecordings, uint64_t ioBudget);
+    bool IsFull() const;
+
+    // Opens the stream itself
+    bool Start(RecordingId id, PvrClient::ChannelId channelId, const std::string& url, const std::string& recordingDir);
+    // Live buffer switches to recording cache, the engine owns it since then
+    bool StartFromLive(RecordingId id, PvrClient::ChannelId channelId, Buffers::TimeshiftBuffer* liveBuffer, const std::string& recordingDir);
+    // Pipeline is gone, caller owns the buffer (still running). nullptr for unknown ID.
+    Buffers::TimeshiftBuffer* Release(RecordingId id);
+    void StopAll();
+
+    // Buffer of running recording of the channel for the player, nullptr when there is none
+    Buffers::TimeshiftBuffer* JoinLive(PvrClient::ChannelId channelId);
+    // Player has left the buffer, its recording counts against IO budget again
+    void LeaveLive(const Buffers::TimeshiftBuffer* buffer);
+    bool IsRecording(const Buffers::TimeshiftBuffer* buffer) const;
+
+    std::vector<Stats> GetStats() const;
+    void LogStats() const;
+
+private:
+    struct Meter;
+    struct Pipeline
+    {
+        PvrClient::ChannelId ChannelId;
+        time_t StartedAt;
+        Buffers::TimeshiftBuffer* Buffer;
+        std::shared_ptr<Meter> Measurements;
+    };
+
+    bool Add(RecordingId id, PvrClient::ChannelId channelId, Buffers::TimeshiftBuffer* buffer, bool isLive);
+    Stats StatsOf(RecordingId id, const Pipeline& pipeline) const;
+    // Of pipelines the player doesn't read from. Call under m_mutex.
+    double BudgetedBytesPerSecond() const;
+
+    InputFactory m_createInput;
+    mutable std::mutex m_mutex;
+    std::map<RecordingId, Pipeline> m_pipelines;
+    size_t m_maxRecordings = 0;
+    uint64_t m_ioBudget = 0;
+};
+
+} // namespace Engines
+
+#endif // RECORDING_ENGINE_HPP
@@ -0,0 +1,111 @@
+#include <string_view>
+#include <kodi/AddonBase.h>
+#include "RecordingsIndex.hpp"
+
+namespace PvrClient {
+
+// FNV-1a over the fields a recording tag is built from
+static void HashBytes(uint64_t& hash, const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+static void HashString(uint64_t& hash, std::string_view value)
+{
+    const uint32_t size = static_cast<uint32_t>(value.size());
+    HashBytes(hash, &size, sizeof(size));
+    HashBytes(hash, value.data(), value.size());
+}
+
+uint64_t RecordingsIndex::Fingerprint(const EpgEntry& entry)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    HashBytes(hash, &entry.UniqueChannelId, sizeof(entry.UniqueChannelId));
+    HashBytes(hash, &entry.StartTime, sizeof(entry.StartTime));
+    HashBytes(hash, &entry.EndTime, sizeof(entry.EndTime));
+    HashString(hash, entry.Title);
+    HashString(hash, entry.Description);
+    HashString(hash, entry.IconPath);
+    return hash;
+}
+
+bool RecordingsIndex::Refresh(const IClientCore& core, const FillAction& fill)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint32_t generation = ++m_generation;
+    size_t added = 0, updated = 0;
+
+    IClientCore::EpgEntryAction predicate = [](const EpgEntryList::value_type& epgEntry) {
+        return epgEntry.second.HasArchive;
+    };
+    IClientCore::EpgEntryAction action = [&](const EpgEntryList::value_type& epgEntry) {
+        const uint64_t fingerprint = Fingerprint(epgEntry.second);
+        auto it = m_items.find(epgEntry.first);
+        if(it != m_items.end() && it->second.fingerprint == fingerprint) {
+            it->second.generation = generation;
+            return true;
+        }
+        try {
+            kodi::addon::PVRRecording tag;
+            fill(epgEntry, tag);
+            if(it == m_items.end()) {
+                m_items.emplace(epgEntry.first, Item{std::move(tag), fingerprint, generation});
+                ++added;
+            } else {
+                it->second = Item{std::move(tag), fingerprint, generation};
+                ++updated;
+            }
+        }
+        catch (std::exception& ex) {
+            kodi::Log(ADDON_LOG_ERROR, "RecordingsIndex: failed to fill recording %u. Exception: %s.", epgEntry.first, ex.what());
+        }
+        catch (...) {
+            kodi::Log(ADDON_LOG_ERROR, "RecordingsIndex: failed to fill recording %u. Unknown exception.", epgEntry.first);
+        }
+        // Problematic entry is skipped, enumeration continues
+        return true;
+    };
+    core.ForEachEpgUnlocked(predicate, action);
+
+    size_t removed = 0;
+    for(auto it = m_items.begin(); it != m_items.end();) {
+        if(it->second.generation != generation) {
+            it = m_items.erase(it);
+            ++removed;
+        } else {
+            ++it;
+        }
+    }
+    const bool isChanged = added + updated + removed > 0;
+    if(isChanged) {
+        kodi::Log(ADDON_LOG_DEBUG, "RecordingsIndex: %zu added, %zu updated, %zu removed, %zu total.",
+                  added, updated, removed, m_items.size());
+    }
+    return isChanged;
+}
+
+size_t RecordingsIndex::ForEach(const TagAction& action) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto& item : m_items)
+        action(item.second.tag);
+    return m_items.size();
+}
+
+size_t RecordingsIndex::Size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_items.size();
+}
+
+void RecordingsIndex::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_items.clear();
+}
+
+} // namespace PvrClient
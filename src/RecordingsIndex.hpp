@@ -0,0 +1,49 @@
+#ifndef RECORDINGS_INDEX_HPP
+#define RECORDINGS_INDEX_HPP
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <kodi/addon-instance/PVR.h>
+#include "pvr_client_types.h"
+
+namespace PvrClient {
+
+// Remote recordings (archived EPG entries) as ready Kodi tags.
+// Refresh() walks the archive and fills tags of new and changed entries only,
+// entries which left the archive are dropped. Unchanged entries are not touched,
+// so a periodic refresh costs one pass over EPG without building tags.
+// Thread safe.
+class RecordingsIndex
+{
+public:
+    typedef std::function<void(const EpgEntryList::value_type&, kodi::addon::PVRRecording&)> FillAction;
+    typedef std::function<void(const kodi::addon::PVRRecording&)> TagAction;
+
+    // Returns true when recordings changed since previous refresh
+    bool Refresh(const IClientCore& core, const FillAction& fill);
+    // Returns number of tags passed to action
+    size_t ForEach(const TagAction& action) const;
+    size_t Size() const;
+    // Next Refresh() fills all tags again, e.g. after channel list changed
+    void Clear();
+
+private:
+    struct Item
+    {
+        kodi::addon::PVRRecording tag;
+        uint64_t fingerprint;
+        uint32_t generation;
+    };
+
+    static uint64_t Fingerprint(const EpgEntry& entry);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<UniqueBroadcastIdType, Item> m_items;
+    uint32_t m_generation = 0;
+};
+
+} // namespace PvrClient
+
+#endif // RECORDINGS_INDEX_HPP
@@ -0,0 +1,143 @@
+#ifndef RETRY_POLICY_HPP
+#define RETRY_POLICY_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <random>
+
+// Per-request retry rules for HttpEngine.
+// Delay before attempt N (1-based retry) is uniformly distributed in
+// [0, min(MaxDelay, BaseDelay * Multiplier^(N-1))] ("full jitter"),
+// so clients failing together don't retry together.
+struct RetryPolicy
+{
+    using Duration = std::chrono::milliseconds;
+
+    int MaxAttempts = 1; // including the first one, 1 = no retries
+    Duration BaseDelay{500};
+    Duration MaxDelay{8000};
+    double Multiplier = 2.0;
+
+    static RetryPolicy None() { return RetryPolicy(); }
+    static RetryPolicy Exponential(int maxAttempts, Duration baseDelay = Duration(500), Duration maxDelay = Duration(8000)) {
+        RetryPolicy policy;
+        policy.MaxAttempts = std::max(maxAttempts, 1);
+        policy.BaseDelay = baseDelay;
+        policy.MaxDelay = maxDelay;
+        return policy;
+    }
+
+    bool CanRetry(int attempt) const { return attempt + 1 < MaxAttempts; }
+
+    // attempt: 0-based index of the attempt that just failed
+    template<class TRandom>
+    Duration DelayAfter(int attempt, TRandom& random) const {
+        const double ceiling = std::min<double>(MaxDelay.count(), BaseDelay.count() * std::pow(Multiplier, attempt));
+        std::uniform_real_distribution<double> jitter(0.0, std::max(ceiling, 0.0));
+        return Duration(static_cast<Duration::rep>(jitter(random)));
+    }
+};
+
+// Token bucket limiting retries to a fraction of successful requests,
+// so a failing server is not hammered by retry storms.
+// Every success deposits RetryRatio tokens, every retry withdraws one.
+class RetryBudget
+{
+public:
+    explicit RetryBudget(double retryRatio = 0.2, double maxTokens = 10.0)
+    : m_retryRatio(retryRatio)
+    , m_maxTokens(maxTokens)
+    , m_tokens(maxTokens)
+    {}
+
+    void OnSuccess() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tokens = std::min(m_maxTokens, m_tokens + m_retryRatio);
+    }
+
+    bool TryWithdraw() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_tokens < 1.0)
+            return false;
+        m_tokens -= 1.0;
+        return true;
+    }
+
+private:
+    std::mutex m_mutex;
+    const double m_retryRatio;
+    const double m_maxTokens;
+    double m_tokens;
+};
+
+// Per-host circuit breaker.
+// After FailureThreshold consecutive failures requests fail fast for OpenInterval,
+// then a single probe request is let through (half-open). Its outcome closes
+// or re-opens the circuit.
+class CircuitBreaker
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit CircuitBreaker(int failureThreshold = 5, std::chrono::seconds openInterval = std::chrono::seconds(30))
+    : m_failureThreshold(failureThreshold)
+    , m_openInterval(openInterval)
+    {}
+
+    bool AllowRequest(Clock::time_point now = Clock::now()) {
+        switch(m_state) {
+            case k_Closed:
+                return true;
+            case k_Open:
+                if(now - m_openedAt < m_openInterval)
+                    return false;
+                m_state = k_HalfOpen;
+                m_probeInFlight = true;
+                return true;
+            case k_HalfOpen:
+                if(m_probeInFlight)
+                    return false;
+                m_probeInFlight = true;
+                return true;
+        }
+        return true;
+    }
+
+    void OnSuccess() {
+        m_state = k_Closed;
+        m_failures = 0;
+        m_probeInFlight = false;
+    }
+
+    void OnFailure(Clock::time_point now = Clock::now()) {
+        m_probeInFlight = false;
+        if(m_state == k_HalfOpen || ++m_failures >= m_failureThreshold) {
+            m_state = k_Open;
+            m_openedAt = now;
+        }
+    }
+
+    // Probe ended without outcome (cancelled, unexpected error), next request probes instead
+    void OnProbeCancelled() {
+        if(m_state == k_HalfOpen)
+            m_probeInFlight = false;
+    }
+
+    bool IsOpen() const { return m_state == k_Open; }
+    // Request allowed in this state is the probe
+    bool IsHalfOpen() const { return m_state == k_HalfOpen; }
+
+private:
+    enum State { k_Closed, k_Open, k_HalfOpen };
+
+    const int m_failureThreshold;
+    const Clock::duration m_openInterval;
+    State m_state = k_Closed;
+    int m_failures = 0;
+    bool m_probeInFlight = false;
+    Clock::time_point m_openedAt;
+};
+
+#endif // RETRY_POLICY_HPP
@@ -0,0 +1,137 @@
+#include "StreamHealth.hpp"
+#include <algorithm>
+#include <utility>
+
+// Weight of the newest sample
+static const double c_Alpha = 0.3;
+// Guess for URLs never opened: slower than a good stream, faster than a failing one
+static const double c_PriorFirstByteSec = 2.0;
+// Failed open costs reload timeout before the next candidate is tried
+static const double c_FailurePenaltySec = 15.0;
+// Enough data for playback to start
+static const double c_StartBytes = 1024.0 * 1024.0;
+// Live URLs often carry session tokens, keep the registry bounded
+static const size_t c_MaxStreams = 2048;
+
+static double Ewma(double average, double sample, bool isFirst)
+{
+    return isFirst ? sample : average + c_Alpha * (sample - average);
+}
+
+StreamHealth& StreamHealth::Instance()
+{
+    static StreamHealth instance;
+    return instance;
+}
+
+StreamHealth::Stats& StreamHealth::StatsFor(const std::string& url)
+{
+    auto found = m_streams.find(url);
+    if(found != m_streams.end())
+        return found->second;
+
+    if(m_streams.size() >= c_MaxStreams) {
+        auto oldest = std::min_element(m_streams.begin(), m_streams.end(), [](const auto& left, const auto& right) {
+            return left.second.UpdatedAt < right.second.UpdatedAt;
+        });
+        m_streams.erase(oldest);
+    }
+    return m_streams[url];
+}
+
+void StreamHealth::RecordOpen(const std::string& url, std::chrono::milliseconds timeToFirstByte)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats& stats = StatsFor(url);
+    stats.FirstByteSec = Ewma(stats.FirstByteSec, timeToFirstByte.count() / 1000.0, 0 == stats.Opens);
+    stats.FailureRate = Ewma(stats.FailureRate, 0.0, 0 == stats.Opens + stats.Failures);
+    ++stats.Opens;
+    stats.UpdatedAt = std::chrono::steady_clock::now();
+}
+
+void StreamHealth::RecordFailure(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats& stats = StatsFor(url);
+    stats.FailureRate = Ewma(stats.FailureRate, 1.0, 0 == stats.Opens + stats.Failures);
+    ++stats.Failures;
+    stats.UpdatedAt = std::chrono::steady_clock::now();
+}
+
+void StreamHealth::RecordThroughput(const std::string& url, double bytesPerSecond)
+{
+    if(bytesPerSecond <= 0.0)
+        return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats& stats = StatsFor(url);
+    stats.BytesPerSecond = Ewma(stats.BytesPerSecond, bytesPerSecond, stats.BytesPerSecond <= 0.0);
+    stats.UpdatedAt = std::chrono::steady_clock::now();
+}
+
+double StreamHealth::LatencyOf(const Stats& stats) const
+{
+    double startSec = stats.Opens > 0 ? stats.FirstByteSec : c_PriorFirstByteSec;
+    if(stats.BytesPerSecond > 0.0)
+        startSec += c_StartBytes / stats.BytesPerSecond;
+    return (1.0 - stats.FailureRate) * startSec + stats.FailureRate * c_FailurePenaltySec;
+}
+
+double StreamHealth::ExpectedStartLatency(const std::string& url) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_streams.find(url);
+    return LatencyOf(found != m_streams.end() ? found->second : Stats());
+}
+
+double StreamHealth::Throughput(const std::string& url) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_streams.find(url);
+    return found != m_streams.end() ? found->second.BytesPerSecond : 0.0;
+}
+
+void StreamHealth::Order(std::vector<std::string>& urls) const
+{
+    if(urls.size() < 2)
+        return;
+    std::vector<std::pair<double, std::string>> scored;
+    scored.reserve(urls.size());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(auto& url : urls) {
+            auto found = m_streams.find(url);
+            scored.emplace_back(LatencyOf(found != m_streams.end() ? found->second : Stats()), std::move(url));
+        }
+    }
+    std::stable_sort(scored.begin(), scored.end(), [](const auto& left, const auto& right) {
+        return left.first < right.first;
+    });
+    for(size_t i = 0; i < urls.size(); ++i)
+        urls[i] = std::move(scored[i].second);
+}
+
+const std::string& StreamHealth::Best(const std::vector<std::string>& urls) const
+{
+    static const std::string c_None;
+    if(urls.empty())
+        return c_None;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t best = 0;
+    double bestLatency = 0.0;
+    for(size_t i = 0; i < urls.size(); ++i) {
+        auto found = m_streams.find(urls[i]);
+        const double latency = LatencyOf(found != m_streams.end() ? found->second : Stats());
+        // First of equals wins
+        if(0 == i || latency < bestLatency) {
+            best = i;
+            bestLatency = latency;
+        }
+    }
+    return urls[best];
+}
+
+void StreamHealth::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_streams.clear();
+}
@@ -0,0 +1,59 @@
+#ifndef STREAM_HEALTH_HPP
+#define STREAM_HEALTH_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Rolling health of live stream URLs.
+// Time to first byte and failure rate come from stream opening (PVRClientBase),
+// throughput from TimeshiftBuffer writes. All values are EWMA, so a stream
+// recovers its score after a few good opens.
+// Candidates are ordered by expected start latency: time to first byte plus
+// time to download c_StartBytes, with failures costing c_FailurePenalty.
+class StreamHealth
+{
+public:
+    static StreamHealth& Instance();
+
+    void RecordOpen(const std::string& url, std::chrono::milliseconds timeToFirstByte);
+    void RecordFailure(const std::string& url);
+    void RecordThroughput(const std::string& url, double bytesPerSecond);
+
+    // Seconds. URLs without measurements get a neutral prior.
+    double ExpectedStartLatency(const std::string& url) const;
+    // Bytes per second, 0 when not measured yet
+    double Throughput(const std::string& url) const;
+    // Stable: equal latencies (e.g. unknown URLs) keep provider's order
+    void Order(std::vector<std::string>& urls) const;
+    const std::string& Best(const std::vector<std::string>& urls) const;
+
+    void Reset();
+
+private:
+    struct Stats
+    {
+        double FirstByteSec = 0.0;
+        double FailureRate = 0.0;
+        // 0 = not measured yet
+        double BytesPerSecond = 0.0;
+        uint32_t Opens = 0;
+        uint32_t Failures = 0;
+        std::chrono::steady_clock::time_point UpdatedAt;
+    };
+
+    StreamHealth() = default;
+    StreamHealth(const StreamHealth&) = delete;
+    StreamHealth& operator=(const StreamHealth&) = delete;
+
+    Stats& StatsFor(const std::string& url);
+    double LatencyOf(const Stats& stats) const;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Stats> m_streams;
+};
+
+#endif // STREAM_HEALTH_HPP
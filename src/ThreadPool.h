@@ -2,20 +2,215 @@
 #define THREAD_POOL_H
 
 #include <vector>
-#include <queue>
 #include <memory>
 #include <thread>
 #include <atomic>
 #include <mutex>
-#include <condition_variable>
 #include <future>
 #include <functional>
+#include <optional>
+#include <random>
 #include <type_traits>
 #include <stop_token>
+#include <stdexcept>
 #include <cassert>
+#include <cstdint>
 
 namespace modern {
 
+namespace detail {
+
+// Chase-Lev work-stealing deque
+// (Le, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models").
+// Owner thread pushes and pops at the bottom, other threads steal from the top.
+// Retired arrays are kept until destruction, since a thief may still be reading one.
+template<class T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque holds trivially copyable items (pointers)");
+
+    struct Array {
+        explicit Array(int64_t c)
+            : capacity(c), mask(c - 1), slots(new std::atomic<T>[static_cast<size_t>(c)]) {}
+
+        T get(int64_t i) const noexcept { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T item) noexcept { slots[i & mask].store(item, std::memory_order_relaxed); }
+
+        Array* grow(int64_t bottom, int64_t top) const {
+            auto bigger = new Array(capacity * 2);
+            for (int64_t i = top; i != bottom; ++i)
+                bigger->put(i, get(i));
+            return bigger;
+        }
+
+        const int64_t capacity;
+        const int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+    };
+
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256)
+        : array_(new Array(capacity)) {}
+
+    ~WorkStealingDeque() { delete array_.load(std::memory_order_relaxed); }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only
+    void push(T item) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed);
+        const int64_t t = top_.load(std::memory_order_acquire);
+        Array* a = array_.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            Array* bigger = a->grow(b, t);
+            retired_.emplace_back(a);
+            array_.store(bigger, std::memory_order_release);
+            a = bigger;
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only
+    std::optional<T> pop() {
+        const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        T item = a->get(b);
+        if (t == b) {
+            // Last item: race against thieves
+            const bool won = top_.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            if (!won)
+                return std::nullopt;
+        }
+        return item;
+    }
+
+    // Any thread
+    std::optional<T> steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b)
+            return std::nullopt;
+
+        Array* a = array_.load(std::memory_order_acquire);
+        T item = a->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed))
+            return std::nullopt;
+        return item;
+    }
+
+    bool empty() const noexcept {
+        return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    alignas(64) std::atomic<Array*> array_;
+    std::vector<std::unique_ptr<Array>> retired_;
+};
+
+// Bounded lock-free MPMC queue (D. Vyukov).
+// Used as injection queue for tasks submitted from outside of the pool.
+template<class T>
+class BoundedMpmcQueue {
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+public:
+    explicit BoundedMpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+    BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
+
+    bool try_push(T item) {
+        Cell* cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& item) {
+        Cell* cell;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->data);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+};
+
+// Identifies pool and worker slot of the current thread
+struct WorkerContext {
+    const void* pool = nullptr;
+    size_t index = 0;
+};
+
+} // namespace detail
+
+// Work-stealing thread pool.
+// Every worker owns a Chase-Lev deque. Tasks submitted by a worker go to its own deque,
+// tasks from other threads go through a lock-free injection queue.
+// Idle workers steal from each other before going to sleep.
+// Backpressure (set_queue_limit) blocks submitter on an atomic wait, no lock is held.
+// Submissions from pool tasks are not limited.
+// Tasks may observe pool shutdown via get_stop_token(). Tasks that never started
+// when the pool is destroyed are dropped, their futures get broken_promise.
 class ThreadPool {
 public:
     explicit ThreadPool(size_t threads = std::max(2u, std::thread::hardware_concurrency()));
@@ -26,141 +221,279 @@ public:
         -> std::future<std::invoke_result_t<F, Args...>>;
 
     void wait_idle() noexcept;
+    // Must not be called from a pool task.
     void resize(size_t new_size);
     void set_queue_limit(size_t limit) noexcept;
 
+    std::stop_token get_stop_token() const noexcept { return stop_source_.get_token(); }
+    size_t size() const noexcept { return worker_count_.load(std::memory_order_acquire); }
+
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
 
 private:
-    struct Task {
-        std::function<void()> func;
-        std::stop_token stop_token;
-    };
+    using Task = std::function<void()>;
+    using TaskDeque = detail::WorkStealingDeque<Task*>;
+
+    using WorkerContext = detail::WorkerContext;
+
+    static constexpr size_t c_injectionQueueCapacity = 4096;
 
-    void worker_main(std::stop_token st);
+    void start_workers(size_t count);
+    void stop_workers();
+    void worker_main(std::stop_token st, size_t index);
+    Task* find_task(size_t index, std::minstd_rand& rng);
+    void submit(Task* task);
+    void signal_work(bool all = false) noexcept;
+    void signal_space() noexcept;
+    void run(Task* task) noexcept;
+    void drop(Task* task) noexcept;
 
+    inline static thread_local WorkerContext tls_worker_{};
+
+    std::vector<std::unique_ptr<TaskDeque>> deques_;
     std::vector<std::jthread> workers_;
-    std::queue<Task> tasks_;
-    std::mutex queue_mutex_;
-    std::condition_variable_any queue_cv_;
-    
+    std::atomic<size_t> worker_count_{0};
+    std::mutex resize_mutex_;
+
+    detail::BoundedMpmcQueue<Task*> injection_{c_injectionQueueCapacity};
+
+    // Submitted but not started yet. Bounded by queue_limit_, except nested submissions.
+    std::atomic<size_t> queued_{0};
+    // Bumped whenever queue space may have become available, blocked submitters wait on it.
+    std::atomic<uint64_t> space_epoch_{0};
+    std::atomic<size_t> submit_waiters_{0};
+    std::atomic<size_t> queue_limit_{100'000};
+
+    // Submitted but not finished yet.
     std::atomic<size_t> tasks_in_flight_{0};
-    std::condition_variable done_cv_;
-    
-    size_t queue_limit_ = 100'000;
-    std::atomic_bool stop_{false};
+
+    // Bumped on every submission, idle workers wait on it.
+    std::atomic<uint64_t> work_epoch_{0};
+    std::atomic<size_t> sleepers_{0};
+
+    std::stop_source stop_source_;
 };
 
 // Implementation
 
 inline ThreadPool::ThreadPool(size_t threads) {
-    workers_.reserve(threads);
-    while (workers_.size() < threads) {
-        workers_.emplace_back([this](std::stop_token st) { worker_main(st); });
-    }
+    start_workers(std::max(threads, size_t{1}));
 }
 
 inline ThreadPool::~ThreadPool() {
-    stop_.store(true, std::memory_order_release);
-    queue_cv_.notify_all();
+    stop_source_.request_stop();
+    // Unblock submitters waiting for queue space
+    space_epoch_.fetch_add(1, std::memory_order_seq_cst);
+    space_epoch_.notify_all();
+
+    std::scoped_lock lock(resize_mutex_);
+    stop_workers();
+
+    // Drop tasks that never started
+    for (auto& deque : deques_) {
+        while (auto task = deque->pop())
+            drop(*task);
+    }
+    Task* task = nullptr;
+    while (injection_.try_pop(task))
+        drop(task);
 }
 
 template<class F, class... Args>
 auto ThreadPool::enqueue(F&& f, Args&&... args)
-    -> std::future<std::invoke_result_t<F, Args...>> 
+    -> std::future<std::invoke_result_t<F, Args...>>
 {
     using return_type = std::invoke_result_t<F, Args...>;
-    
-    if (stop_.load(std::memory_order_acquire)) {
+
+    if (stop_source_.stop_requested()) {
         throw std::runtime_error("enqueue on stopped ThreadPool");
     }
 
+    // Reserve a queue slot. Wait outside of any lock when the queue is full.
+    // Pool threads never wait: only they make space, all of them blocked is a deadlock.
+    const bool is_nested = tls_worker_.pool == this;
+    for (;;) {
+        const uint64_t epoch = space_epoch_.load(std::memory_order_seq_cst);
+        if (stop_source_.stop_requested())
+            throw std::runtime_error("enqueue on stopped ThreadPool");
+        size_t queued = queued_.load(std::memory_order_seq_cst);
+        if (is_nested || queued < queue_limit_.load(std::memory_order_relaxed)) {
+            if (queued_.compare_exchange_weak(queued, queued + 1, std::memory_order_seq_cst))
+                break;
+            continue;
+        }
+        submit_waiters_.fetch_add(1, std::memory_order_seq_cst);
+        space_epoch_.wait(epoch, std::memory_order_seq_cst);
+        submit_waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
     auto task = std::make_shared<std::packaged_task<return_type()>>(
         std::bind(std::forward<F>(f), std::forward<Args>(args)...)
     );
-
     std::future<return_type> res = task->get_future();
-    
-    {
-        std::scoped_lock lock(queue_mutex_);
-        
-        if (tasks_.size() >= queue_limit_) {
-            queue_cv_.wait(lock, [this] {
-                return tasks_.size() < queue_limit_ || stop_;
-            });
-        }
 
-        if (stop_) return res;
+    tasks_in_flight_.fetch_add(1, std::memory_order_relaxed);
+    submit(new Task([task]() { (*task)(); }));
+    return res;
+}
 
-        tasks_.emplace(Task{
-            [task](){ (*task)(); }, 
-            workers_.front().get_stop_token()
-        });
-        
-        tasks_in_flight_.fetch_add(1, std::memory_order_relaxed);
+inline void ThreadPool::submit(Task* task) {
+    const WorkerContext& ctx = tls_worker_;
+    if (ctx.pool == this) {
+        // Nested submission: keep it local, others will steal if idle
+        deques_[ctx.index]->push(task);
+    } else {
+        while (!injection_.try_push(task)) {
+            // Injection queue is full while queue limit is higher than its capacity.
+            // Workers are draining it, so just let them run.
+            std::this_thread::yield();
+        }
     }
+    signal_work();
+}
 
-    queue_cv_.notify_one();
-    return res;
+inline void ThreadPool::signal_work(bool all) noexcept {
+    work_epoch_.fetch_add(1, std::memory_order_seq_cst);
+    if (all)
+        work_epoch_.notify_all();
+    else if (sleepers_.load(std::memory_order_seq_cst) > 0)
+        work_epoch_.notify_one();
 }
 
-inline void ThreadPool::worker_main(std::stop_token st) {
-    while (!st.stop_requested()) {
-        Task task;
-        
-        {
-            std::unique_lock lock(queue_mutex_);
-            queue_cv_.wait(lock, [this, &st] {
-                return !tasks_.empty() || st.stop_requested();
-            });
-
-            if (st.stop_requested() || tasks_.empty()) break;
-
-            task = std::move(tasks_.front());
-            tasks_.pop();
-        }
+inline void ThreadPool::signal_space() noexcept {
+    space_epoch_.fetch_add(1, std::memory_order_seq_cst);
+    if (submit_waiters_.load(std::memory_order_seq_cst) > 0)
+        space_epoch_.notify_all();
+}
+
+inline ThreadPool::Task* ThreadPool::find_task(size_t index, std::minstd_rand& rng) {
+    if (auto task = deques_[index]->pop())
+        return *task;
 
-        try {
-            task.func();
-        } catch (...) {
-            // Log exception here if needed
+    Task* task = nullptr;
+    if (injection_.try_pop(task))
+        return task;
+
+    const size_t count = deques_.size();
+    if (count > 1) {
+        const size_t start = rng() % count;
+        for (size_t i = 0; i < count; ++i) {
+            const size_t victim = (start + i) % count;
+            if (victim == index)
+                continue;
+            if (auto stolen = deques_[victim]->steal())
+                return *stolen;
         }
+    }
+    return nullptr;
+}
 
-        if (tasks_in_flight_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
-            done_cv_.notify_all();
+inline void ThreadPool::worker_main(std::stop_token st, size_t index) {
+    tls_worker_ = WorkerContext{this, index};
+    std::minstd_rand rng(static_cast<unsigned>(index + 1));
+
+    while (!st.stop_requested()) {
+        Task* task = find_task(index, rng);
+        if (nullptr == task) {
+            // Re-check after taking epoch snapshot, so submission can't slip in unnoticed
+            const uint64_t epoch = work_epoch_.load(std::memory_order_seq_cst);
+            task = find_task(index, rng);
+            if (nullptr == task) {
+                if (st.stop_requested())
+                    break;
+                sleepers_.fetch_add(1, std::memory_order_seq_cst);
+                work_epoch_.wait(epoch, std::memory_order_seq_cst);
+                sleepers_.fetch_sub(1, std::memory_order_relaxed);
+                continue;
+            }
         }
+        run(task);
+    }
+
+    tls_worker_ = WorkerContext{};
+}
+
+inline void ThreadPool::run(Task* task) noexcept {
+    queued_.fetch_sub(1, std::memory_order_seq_cst);
+    signal_space();
+
+    try {
+        (*task)();
+    } catch (...) {
+        // packaged_task stores exception in the future
+    }
+    delete task;
+
+    if (tasks_in_flight_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        tasks_in_flight_.notify_all();
+}
+
+inline void ThreadPool::drop(Task* task) noexcept {
+    // Destroying the packaged_task breaks its promise
+    delete task;
+    queued_.fetch_sub(1, std::memory_order_seq_cst);
+    signal_space();
+    if (tasks_in_flight_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        tasks_in_flight_.notify_all();
+}
+
+inline void ThreadPool::start_workers(size_t count) {
+    while (deques_.size() < count)
+        deques_.emplace_back(std::make_unique<TaskDeque>());
+    workers_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        workers_.emplace_back([this, i](std::stop_token st) { worker_main(st, i); });
     }
+    worker_count_.store(count, std::memory_order_release);
+}
+
+inline void ThreadPool::stop_workers() {
+    for (auto& worker : workers_)
+        worker.request_stop();
+    signal_work(true);
+    workers_.clear(); // joins
+    worker_count_.store(0, std::memory_order_release);
 }
 
 inline void ThreadPool::wait_idle() noexcept {
-    std::unique_lock lock(queue_mutex_);
-    done_cv_.wait(lock, [this] {
-        return tasks_in_flight_.load(std::memory_order_acquire) == 0;
-    });
+    size_t inFlight = tasks_in_flight_.load(std::memory_order_acquire);
+    while (inFlight != 0) {
+        tasks_in_flight_.wait(inFlight, std::memory_order_acquire);
+        inFlight = tasks_in_flight_.load(std::memory_order_acquire);
+    }
 }
 
 inline void ThreadPool::resize(size_t new_size) {
     if (new_size < 1) new_size = 1;
-    
-    std::scoped_lock lock(queue_mutex_);
-    const size_t current = workers_.size();
-    
-    if (new_size > current) {
-        workers_.reserve(new_size);
-        while (workers_.size() < new_size) {
-            workers_.emplace_back([this](std::stop_token st) { worker_main(st); });
-        }
-    } else if (new_size < current) {
-        for (size_t i = 0; i < current - new_size; ++i) {
-            workers_[i].request_stop();
+
+    std::scoped_lock lock(resize_mutex_);
+    if (stop_source_.stop_requested() || new_size == workers_.size())
+        return;
+
+    // Quiesce: running tasks finish, queued ones stay in the deques.
+    stop_workers();
+
+    // Re-distribute pending local tasks over the new set of deques.
+    std::vector<std::unique_ptr<TaskDeque>> old;
+    old.swap(deques_);
+    for (size_t i = 0; i < new_size; ++i)
+        deques_.emplace_back(std::make_unique<TaskDeque>());
+    size_t target = 0;
+    for (auto& deque : old) {
+        while (auto task = deque->pop()) {
+            deques_[target]->push(*task);
+            target = (target + 1) % new_size;
         }
-        queue_cv_.notify_all();
     }
+
+    start_workers(new_size);
 }
 
 inline void ThreadPool::set_queue_limit(size_t limit) noexcept {
-    queue_limit_ = std::max(limit, size_t{1});
+    queue_limit_.store(std::max(limit, size_t{1}), std::memory_order_relaxed);
+    // Wake waiters to re-check the new limit
+    signal_space();
 }
 
 } // namespace modern
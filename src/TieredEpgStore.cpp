@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <unordered_set>
+#include <kodi/AddonBase.h>
+#include "TieredEpgStore.hpp"
+
+namespace PvrClient {
+
+using namespace std::chrono;
+
+#pragma mark - Snapshot
+
+bool TieredEpgStore::Snapshot::IsExpired(time_t endTime) const
+{
+    return endTime < time(nullptr) - m_archiveDepth.count();
+}
+
+const TieredEpgStore::Snapshot::Spans* TieredEpgStore::Snapshot::CoveredSpansOf(ChannelId channelId) const
+{
+    if(!m_covered)
+        return nullptr;
+    auto it = m_covered->find(channelId);
+    return it == m_covered->end() ? nullptr : &it->second;
+}
+
+bool TieredEpgStore::Snapshot::IsCovered(const Spans* spans, time_t startTime)
+{
+    if(spans == nullptr)
+        return false;
+    // First span ending at or after startTime
+    auto it = std::lower_bound(spans->begin(), spans->end(), startTime, [](const Spans::value_type& span, time_t time) {
+        return span.second < time;
+    });
+    return it != spans->end() && it->first <= startTime;
+}
+
+bool TieredEpgStore::Snapshot::IsCacheRowVisible(const Spans* spans, UniqueBroadcastIdType id, time_t startTime, time_t endTime) const
+{
+    return !m_store->Contains(id) && !IsExpired(endTime) && !IsCovered(spans, startTime);
+}
+
+bool TieredEpgStore::Snapshot::Get(UniqueBroadcastIdType id, EpgEntry& entry) const
+{
+    if(m_store->Get(id, entry))
+        return true;
+    return m_cache && m_cache->Get(id, entry) && !IsExpired(entry.EndTime)
+        && !IsCovered(CoveredSpansOf(entry.UniqueChannelId), entry.StartTime);
+}
+
+void TieredEpgStore::Snapshot::ForEachInRange(ChannelId channelId, time_t startTime, time_t endTime, const EntryAction& action) const
+{
+    bool isStopped = false;
+    m_store->ForEachInRange(channelId, startTime, endTime, [&action, &isStopped](const EpgEntryList::value_type& entry) {
+        isStopped = !action(entry);
+        return !isStopped;
+    });
+    if(isStopped || !m_cache)
+        return;
+    const Spans* spans = CoveredSpansOf(channelId);
+    m_cache->ForEachInRange(channelId, startTime, endTime, [this, spans, &action](const EpgEntryList::value_type& entry) {
+        return !IsCacheRowVisible(spans, entry) || action(entry);
+    });
+}
+
+void TieredEpgStore::Snapshot::ForEach(const EntryAction& action) const
+{
+    bool isStopped = false;
+    m_store->ForEach([&action, &isStopped](const EpgEntryList::value_type& entry) {
+        isStopped = !action(entry);
+        return !isStopped;
+    });
+    if(isStopped || !m_cache)
+        return;
+    // Cache iterates channel by channel
+    ChannelId channelId = UnknownChannelId;
+    const Spans* spans = nullptr;
+    m_cache->ForEach([this, &channelId, &spans, &action](const EpgEntryList::value_type& entry) {
+        if(entry.second.UniqueChannelId != channelId) {
+            channelId = entry.second.UniqueChannelId;
+            spans = CoveredSpansOf(channelId);
+        }
+        return !IsCacheRowVisible(spans, entry) || action(entry);
+    });
+}
+
+#pragma mark - TieredEpgStore
+
+static bool IsSameProgramme(const EpgEntry& a, const EpgEntry& b)
+{
+    return a.UniqueChannelId == b.UniqueChannelId && a.StartTime == b.StartTime && a.EndTime == b.EndTime
+        && a.HasArchive == b.HasArchive && a.Title == b.Title && a.Description == b.Description
+        && a.IconPath == b.IconPath && a.ProgramId == b.ProgramId && a.Category == b.Category;
+}
+
+TieredEpgStore::TieredEpgStore()
+    : m_current(std::make_shared<const Snapshot>())
+{
+}
+
+EpgStore& TieredEpgStore::MutableStore(Snapshot& next)
+{
+    auto store = std::make_shared<EpgStore>(*next.m_store);
+    next.m_store = store;
+    return *store;
+}
+
+void TieredEpgStore::SetHotWindow(seconds back, seconds ahead)
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    m_hotBack = back;
+    m_hotAhead = ahead;
+}
+
+void TieredEpgStore::SetArchiveDepth(seconds depth)
+{
+    // Set on every channel list rebuild, mostly the same
+    if(Current()->m_archiveDepth == depth)
+        return;
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    auto next = std::make_shared<Snapshot>(*Current());
+    next->m_archiveDepth = depth;
+    Publish(std::move(next));
+}
+
+void TieredEpgStore::AttachCache(std::unique_ptr<MappedEpgCache> cache)
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    auto next = std::make_shared<Snapshot>(*Current());
+    next->m_cache = std::move(cache);
+    next->m_covered.reset();
+    Publish(std::move(next));
+}
+
+bool TieredEpgStore::SaveCache(const std::string& path, time_t expiration)
+{
+    // Held until the new file is mapped: covered spans are reset with it,
+    // so no Apply() may happen in between
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    const SnapshotPtr current = Current();
+    const EpgStore& store = *current->m_store;
+    const MappedEpgCache* cold = current->m_cache.get();
+
+    std::vector<ChannelId> channels = store.Channels();
+    if(cold != nullptr) {
+        const auto cached = cold->Channels();
+        channels.insert(channels.end(), cached.begin(), cached.end());
+    }
+    std::sort(channels.begin(), channels.end());
+    channels.erase(std::unique(channels.begin(), channels.end()), channels.end());
+
+    // One channel at a time: rows of memory and visible rows of the cache.
+    // Their text stays where it is, the current version is held until the file is done.
+    EpgCacheWriter writer;
+    if(!writer.Open(path, expiration))
+        return false;
+    std::vector<EpgCacheWriter::Row> rows;
+    for(const ChannelId channelId : channels) {
+        rows.clear();
+        EpgCacheWriter::CollectRows(store, channelId, rows);
+        if(cold != nullptr) {
+            const size_t numOfStored = rows.size();
+            EpgCacheWriter::CollectRows(*cold, channelId, rows);
+            const Snapshot::Spans* spans = current->CoveredSpansOf(channelId);
+            rows.erase(std::remove_if(rows.begin() + numOfStored, rows.end(), [&current, spans](const EpgCacheWriter::Row& row) {
+                return !current->IsCacheRowVisible(spans, row.id, row.startTime, row.endTime);
+            }), rows.end());
+        }
+        writer.AddChannel(channelId, rows);
+    }
+    if(!writer.Finish())
+        return false;
+    auto cache = MappedEpgCache::OpenGeneration(writer.File());
+    if(!cache)
+        return false;
+    // Old mapping stays valid until its last reader leaves, its file goes with it
+    if(cold != nullptr)
+        cold->RemoveOnRelease();
+    auto next = std::make_shared<Snapshot>(*Current());
+    next->m_cache = std::move(cache);
+    next->m_covered.reset();
+    Publish(std::move(next));
+    return true;
+}
+
+// Adds [first, last] to sorted disjoint spans, merging overlaps
+static void AddSpan(std::vector<std::pair<time_t, time_t>>& spans, time_t first, time_t last)
+{
+    auto it = std::lower_bound(spans.begin(), spans.end(), first, [](const std::pair<time_t, time_t>& span, time_t time) {
+        return span.second < time;
+    });
+    auto mergedEnd = it;
+    while(mergedEnd != spans.end() && mergedEnd->first <= last) {
+        first = std::min(first, mergedEnd->first);
+        last = std::max(last, mergedEnd->second);
+        ++mergedEnd;
+    }
+    it = spans.erase(it, mergedEnd);
+    spans.insert(it, std::make_pair(first, last));
+}
+
+std::vector<ChannelId> TieredEpgStore::Apply(EpgStore::ChannelUpdates& updates)
+{
+    auto update = BeginUpdate();
+    return update.Apply(updates);
+}
+
+#pragma mark - Update
+
+TieredEpgStore::Update::Update(TieredEpgStore& owner)
+    : m_owner(&owner)
+    , m_lock(owner.m_writeMutex)
+    , m_next(std::make_shared<Snapshot>(*owner.Current()))
+    , m_store(&MutableStore(*m_next))
+{
+    if(m_next->m_cache) {
+        m_covered = m_next->m_covered ? std::make_shared<Snapshot::CoveredSpans>(*m_next->m_covered)
+                                      : std::make_shared<Snapshot::CoveredSpans>();
+        // Version is private, spans are visible to its queries at once
+        m_next->m_covered = m_covered;
+    }
+}
+
+std::vector<ChannelId> TieredEpgStore::Update::Apply(EpgStore::ChannelUpdates& updates)
+{
+    if(!m_lock.owns_lock())
+        return {};
+    if(m_next->m_cache) {
+        // Update is diffed against memory, bring visible cold entries of its span back first.
+        // The span is covered from now on: cache rows removed by the update must not show up again.
+        for(const auto& channel : updates.Channels()) {
+            if(channel.second.empty())
+                continue;
+            time_t first = channel.second.front().StartTime, last = first;
+            for(const auto& entry : channel.second) {
+                first = std::min<time_t>(first, entry.StartTime);
+                last = std::max<time_t>(last, entry.StartTime);
+            }
+            const Snapshot::Spans* spans = m_next->CoveredSpansOf(channel.first);
+            EpgStore& store = *m_store;
+            const Snapshot& next = *m_next;
+            m_next->m_cache->ForEachInRange(channel.first, first, last + 1, [&next, spans, &store](const EpgEntryList::value_type& entry) {
+                if(next.IsCacheRowVisible(spans, entry))
+                    store.Add(entry.first, entry.second);
+                return true;
+            });
+            AddSpan((*m_covered)[channel.first], first, last);
+        }
+    }
+    auto changed = m_store->Apply(updates);
+    m_isChanged = m_isChanged || !changed.empty();
+    return changed;
+}
+
+void TieredEpgStore::Update::Commit()
+{
+    if(!m_lock.owns_lock())
+        return;
+    if(m_isChanged)
+        m_owner->Publish(std::move(m_next));
+    m_next.reset();
+    m_lock.unlock();
+}
+
+#pragma mark - Janitor
+
+size_t TieredEpgStore::Prune()
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    return PruneLocked();
+}
+
+size_t TieredEpgStore::PruneLocked()
+{
+    auto next = std::make_shared<Snapshot>(*Current());
+    const time_t now = time(nullptr);
+    const time_t hotFrom = now - m_hotBack.count();
+    const time_t hotTo = now + m_hotAhead.count();
+    const time_t archiveFrom = now - next->m_archiveDepth.count();
+    const MappedEpgCache* cache = next->m_cache.get();
+
+    // Cold entry leaves memory only when the cache serves the same programme,
+    // otherwise changes made since the cache was written would be lost
+    std::unordered_set<UniqueBroadcastIdType> served;
+    if(cache != nullptr) {
+        next->m_store->ForEach([&next, cache, hotFrom, hotTo, &served](const EpgEntryList::value_type& entry) {
+            const EpgEntry& stored = entry.second;
+            if(static_cast<time_t>(stored.EndTime) > hotFrom && static_cast<time_t>(stored.StartTime) < hotTo)
+                return true;
+            EpgEntry cached;
+            if(cache->Get(entry.first, cached) && IsSameProgramme(stored, cached)
+               && !next->IsCovered(next->CoveredSpansOf(cached.UniqueChannelId), cached.StartTime)) {
+                served.insert(entry.first);
+            }
+            return true;
+        });
+    }
+
+    EpgStore& store = MutableStore(*next);
+    const size_t erased = store.EraseIf([&served, archiveFrom](UniqueBroadcastIdType id, time_t, time_t end) {
+        return end < archiveFrom || served.count(id) != 0;
+    });
+    // Strings of dropped and replaced entries are garbage otherwise,
+    // the old pool goes away with the last reader of older versions
+    const bool isCompacted = store.CompactStrings();
+    if(erased > 0 || isCompacted) {
+        const auto memory = store.Memory();
+        Publish(std::move(next));
+        kodi::Log(ADDON_LOG_DEBUG, "TieredEpgStore: dropped %zu entries%s, %zu left in memory (%zu KB).",
+                  erased, isCompacted ? ", strings compacted" : "", memory.Entries, memory.Total() / 1024);
+    }
+    return erased;
+}
+
+void TieredEpgStore::StartJanitor(seconds interval)
+{
+    StopJanitor();
+    m_janitor = std::jthread([this, interval](std::stop_token stopToken) {
+        std::unique_lock<std::mutex> lock(m_janitorMutex);
+        while(!stopToken.stop_requested()) {
+            lock.unlock();
+            {
+                // Running refresh may take minutes, window moves on the next pass
+                std::unique_lock<std::mutex> writeLock(m_writeMutex, std::try_to_lock);
+                if(writeLock.owns_lock())
+                    PruneLocked();
+            }
+            lock.lock();
+            m_janitorWakeup.wait_for(lock, stopToken, interval, [] { return false; });
+        }
+    });
+}
+
+void TieredEpgStore::StopJanitor()
+{
+    if(!m_janitor.joinable())
+        return;
+    m_janitor.request_stop();
+    m_janitor.join();
+}
+
+void TieredEpgStore::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    auto next = std::make_shared<Snapshot>();
+    next->m_archiveDepth = Current()->m_archiveDepth;
+    Publish(std::move(next));
+}
+
+} // namespace PvrClient
@@ -0,0 +1,164 @@
+#ifndef TIERED_EPG_STORE_HPP
+#define TIERED_EPG_STORE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "EpgStore.hpp"
+#include "EpgCacheFile.hpp"
+
+namespace PvrClient {
+
+// EPG in two tiers: programmes around now in EpgStore (memory),
+// everything else in the mapped cache file, read by the OS on demand.
+// Queries merge both, entries of the store win. Apply() takes a channel's
+// time span over from the cache: cache rows starting within it are hidden,
+// memory holds every programme of the span that still exists.
+// A janitor thread moves the hot window with time: programmes outside it
+// are dropped from memory when the cache file has them, programmes
+// older than archive depth are dropped from both, strings left by them are compacted.
+//
+// Readers never lock: they take the current immutable Snapshot and iterate it.
+// Writers are serialized, change a copy and publish it atomically.
+// An old version (and the cache file mapping it uses) goes away with its last reader.
+class TieredEpgStore
+{
+public:
+    typedef EpgStore::EntryAction EntryAction;
+
+    class Snapshot
+    {
+    public:
+        bool Get(UniqueBroadcastIdType id, EpgEntry& entry) const;
+        // Same contract as EpgStore::ForEachInRange(), except order between tiers
+        void ForEachInRange(ChannelId channelId, time_t startTime, time_t endTime, const EntryAction& action) const;
+        void ForEach(const EntryAction& action) const;
+
+        bool HasCache() const { return m_cache != nullptr; }
+        const EpgStore& Store() const { return *m_store; }
+
+    private:
+        friend class TieredEpgStore;
+        // Start time spans [first, last] of a channel, sorted and disjoint
+        typedef std::vector<std::pair<time_t, time_t>> Spans;
+        typedef std::unordered_map<ChannelId, Spans> CoveredSpans;
+
+        bool IsExpired(time_t endTime) const;
+        const Spans* CoveredSpansOf(ChannelId channelId) const;
+        static bool IsCovered(const Spans* spans, time_t startTime);
+        // Cache row is served unless memory has taken it over or it is expired
+        bool IsCacheRowVisible(const Spans* spans, UniqueBroadcastIdType id, time_t startTime, time_t endTime) const;
+        bool IsCacheRowVisible(const Spans* spans, const EpgEntryList::value_type& entry) const {
+            return IsCacheRowVisible(spans, entry.first, entry.second.StartTime, entry.second.EndTime);
+        }
+
+        // Unchanged tier is shared between versions
+        std::shared_ptr<const EpgStore> m_store = std::make_shared<EpgStore>();
+        std::shared_ptr<const MappedEpgCache> m_cache;
+        // Spans of m_cache overridden by memory, reset when the cache is replaced
+        std::shared_ptr<const CoveredSpans> m_covered;
+        std::chrono::seconds m_archiveDepth = std::chrono::hours(7 * 24);
+    };
+    typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+
+    // Refresh merged block by block, e.g. channel by channel while the feed is parsed,
+    // so the feed is never held in memory at once. Blocks go to one private version,
+    // readers see them all on Commit() (or destruction). Other writers wait meanwhile,
+    // the janitor skips its pass.
+    class Update
+    {
+    public:
+        Update(Update&&) = default;
+        ~Update() { Commit(); }
+
+        // Same as TieredEpgStore::Apply()
+        std::vector<ChannelId> Apply(EpgStore::ChannelUpdates& updates);
+        void Commit();
+
+    private:
+        friend class TieredEpgStore;
+        explicit Update(TieredEpgStore& owner);
+
+        TieredEpgStore* m_owner;
+        std::unique_lock<std::mutex> m_lock;
+        std::shared_ptr<Snapshot> m_next;
+        EpgStore* m_store = nullptr;
+        std::shared_ptr<Snapshot::CoveredSpans> m_covered;
+        bool m_isChanged = false;
+    };
+
+    TieredEpgStore();
+    ~TieredEpgStore() { StopJanitor(); }
+
+    TieredEpgStore(const TieredEpgStore&) = delete;
+    TieredEpgStore& operator=(const TieredEpgStore&) = delete;
+
+    // Defaults: 1 day back, 2 days ahead, 7 days of archive.
+    // Archive depth is the provider's, cores set it once channels are resolved.
+    void SetHotWindow(std::chrono::seconds back, std::chrono::seconds ahead);
+    void SetArchiveDepth(std::chrono::seconds depth);
+
+    // Replaces cold tier, nullptr detaches it
+    void AttachCache(std::unique_ptr<MappedEpgCache> cache);
+    bool HasCache() const { return Current()->HasCache(); }
+    // Writes visible entries of both tiers to binary cache file channel by channel
+    // and maps it as the new cold tier
+    bool SaveCache(const std::string& path, time_t expiration);
+
+    std::vector<ChannelId> Apply(EpgStore::ChannelUpdates& updates);
+    Update BeginUpdate() { return Update(*this); }
+    // Bulk changes, action(EpgStore&) works on a new version
+    // which readers see once the action returns
+    template<class TAction>
+    void Modify(TAction&& action) {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        auto next = std::make_shared<Snapshot>(*Current());
+        action(MutableStore(*next));
+        Publish(std::move(next));
+    }
+
+    // Stable version for a series of queries
+    SnapshotPtr Current() const { return m_current.load(std::memory_order_acquire); }
+
+    bool Get(UniqueBroadcastIdType id, EpgEntry& entry) const { return Current()->Get(id, entry); }
+    void ForEachInRange(ChannelId channelId, time_t startTime, time_t endTime, const EntryAction& action) const {
+        Current()->ForEachInRange(channelId, startTime, endTime, action);
+    }
+    void ForEach(const EntryAction& action) const { Current()->ForEach(action); }
+
+    // Moves hot window to now and expires old programmes. Entries outside the window
+    // leave memory when the cache serves the same programme. Returns number of dropped entries.
+    size_t Prune();
+    void StartJanitor(std::chrono::seconds interval = std::chrono::minutes(30));
+    void StopJanitor();
+
+    void Clear();
+    EpgStore::MemoryReport Memory() const { return Current()->Store().Memory(); }
+
+private:
+    // Require m_writeMutex
+    static EpgStore& MutableStore(Snapshot& next);
+    size_t PruneLocked();
+    void Publish(SnapshotPtr next) { m_current.store(std::move(next), std::memory_order_release); }
+
+    std::atomic<SnapshotPtr> m_current;
+    std::mutex m_writeMutex;
+    std::chrono::seconds m_hotBack = std::chrono::hours(24);
+    std::chrono::seconds m_hotAhead = std::chrono::hours(48);
+
+    std::mutex m_janitorMutex;
+    std::condition_variable_any m_janitorWakeup;
+    std::jthread m_janitor;
+};
+
+} // namespace PvrClient
+
+#endif // TIERED_EPG_STORE_HPP
@@ -1,14 +1,22 @@
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <future>
 #include <memory>
+#include <thread>
 #include <vector>
-#include <zlib.h>
 #include <kodi/AddonBase.h>
 #include <kodi/Filesystem.h>
-#include <kodi/addon/pvr/EPG.h>
-#include <rapidxml/rapidxml.hpp>
-#include "helpers.h"
+#include "XMLTV_loader.hpp"
 #include "XmlSaxHandler.h"
+#include "ChunkQueue.hpp"
+#include "Inflator.hpp"
+#include "ThreadPool.h"
 
 namespace fs = std::filesystem;
 using namespace std::chrono;
@@ -17,178 +25,720 @@ namespace XMLTV {
     constexpr auto CACHE_DIR = "special://temp/pvr-puzzle-tv/XmlTvCache/";
     constexpr auto CHUNK_SIZE = 16384;
     constexpr auto CACHE_TTL = 12h;
+    // Chunks in flight between pipeline stages (per queue)
+    constexpr size_t PIPELINE_DEPTH = 32;
+    // Decompressed XML per parallel parsing task
+    constexpr size_t SHARD_SIZE = 4 * 1024 * 1024;
 
-    class Inflator {
+    static int s_numberOfParserThreads = static_cast<int>(std::min(4u, std::max(1u, std::thread::hardware_concurrency())));
+
+    int SetNumberOfParserThreads(int numOfThreads) {
+        const int numOfCpu = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        return s_numberOfParserThreads = std::clamp(numOfThreads, 1, numOfCpu);
+    }
+
+    using ContentSink = std::function<bool(const char*, size_t)>;
+
+    std::string GetCachePath(const std::string& url) {
+        const size_t hash = std::hash<std::string>{}(url);
+        return (fs::path(CACHE_DIR) / std::to_string(hash)).string();
+    }
+
+    bool IsCacheFresh(const std::string& cached_path) {
+        if (!kodi::vfs::FileExists(cached_path, false)) return false;
+
+        kodi::vfs::FileStatus status;
+        if (!kodi::vfs::StatFile(cached_path, status)) return false;
+        const auto cache_time = system_clock::from_time_t(status.GetModificationTime());
+        return system_clock::now() - cache_time < CACHE_TTL;
+    }
+
+    // Three stage pipeline:
+    //   reader thread:   source file/url        -> raw queue
+    //   inflater thread: raw queue -> [cache]   -> content queue (gunzip when needed)
+    //   caller thread:   content queue          -> sink (XML parser)
+    // Every stage works as soon as data arrives, so total time is bound by
+    // the slowest stage rather than by download + inflate + parse.
+    // When cache_path is set, raw data is written there on the way and the file
+    // is committed only after the whole source has been read.
+    class ContentPipeline {
     public:
-        explicit Inflator(std::function<size_t(const char*, size_t)> writer)
-            : writer_(std::move(writer)) 
-        {
-            strm_.zalloc = Z_NULL;
-            strm_.zfree = Z_NULL;
-            strm_.opaque = Z_NULL;
-            inflateInit2(&strm_, 16 + MAX_WBITS);
+        ContentPipeline(const std::string& source, const std::string& cache_path)
+            : source_(source)
+            , cache_path_(cache_path)
+            , raw_(PIPELINE_DEPTH)
+            , content_(PIPELINE_DEPTH)
+        {}
+
+        // Returns true when source was read completely and sink accepted all of it.
+        bool Run(const ContentSink& sink) {
+            std::jthread reader([this] { ReadSource(); });
+            std::jthread inflater([this] { Inflate(); });
+
+            bool sink_ok = true;
+            std::string chunk;
+            while (content_.Pop(chunk)) {
+                if (!sink(chunk.data(), chunk.size())) {
+                    sink_ok = false;
+                    break;
+                }
+                delivered_ += chunk.size();
+            }
+            // Stop upstream stages when consumer has gone
+            raw_.Abort();
+            content_.Abort();
+            reader.join();
+            inflater.join();
+
+            const bool completed = sink_ok && read_ok_ && inflate_ok_;
+            if (!cache_path_.empty())
+                CommitCache(completed);
+            return completed;
         }
 
-        bool Process(const char* data, size_t size) {
-            strm_.avail_in = static_cast<uInt>(size);
-            strm_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        uint64_t Delivered() const { return delivered_; }
 
-            do {
-                char output[CHUNK_SIZE];
-                strm_.avail_out = CHUNK_SIZE;
-                strm_.next_out = reinterpret_cast<Bytef*>(output);
+    private:
+        void ReadSource() {
+            kodi::vfs::CFile file;
+            if (!file.OpenFile(source_, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED)) {
+                kodi::Log(ADDON_LOG_ERROR, "XMLTV: failed to open %s", source_.c_str());
+                raw_.Close();
+                return;
+            }
+            char buffer[CHUNK_SIZE];
+            ssize_t read;
+            while ((read = file.Read(buffer, sizeof(buffer))) > 0) {
+                if (!raw_.Push(buffer, read)) {
+                    file.Close();
+                    return;
+                }
+            }
+            file.Close();
+            read_ok_ = read == 0;
+            raw_.Close();
+        }
 
-                const int ret = inflate(&strm_, Z_NO_FLUSH);
-                if (ret == Z_STREAM_ERROR) return false;
+        void Inflate() {
+            std::unique_ptr<kodi::vfs::CFile> cache;
+            if (!cache_path_.empty()) {
+                cache = std::make_unique<kodi::vfs::CFile>();
+                if (!cache->OpenFileForWrite(TempCachePath(), true)) {
+                    kodi::Log(ADDON_LOG_ERROR, "XMLTV: failed to create cache file %s", TempCachePath().c_str());
+                    cache_failed_ = true;
+                    cache.reset();
+                }
+            }
 
-                const size_t have = CHUNK_SIZE - strm_.avail_out;
-                if (writer_(output, have) != have) return false;
+            Helpers::Inflator inflator([this](const char* data, size_t size) {
+                return content_.Push(data, size);
+            });
+            bool is_first = true;
+            bool is_compressed = false;
+            bool ok = true;
+            // gzip magic may be split between first chunks
+            std::string head;
+            std::string chunk;
+            while (ok && raw_.Pop(chunk)) {
+                // Side stream: cache keeps data as downloaded
+                if (cache && cache->Write(chunk.data(), chunk.size()) != static_cast<ssize_t>(chunk.size())) {
+                    kodi::Log(ADDON_LOG_ERROR, "XMLTV: failed to write cache file %s", TempCachePath().c_str());
+                    cache_failed_ = true;
+                    cache.reset();
+                }
+                if (is_first) {
+                    head += chunk;
+                    if (head.size() < Helpers::Inflator::c_gzipMagicSize)
+                        continue;
+                    is_compressed = Helpers::Inflator::IsGzipData(head.data(), head.size());
+                    is_first = false;
+                    chunk.swap(head);
+                }
+                ok = is_compressed ? inflator.Process(chunk.data(), chunk.size()) : content_.Push(chunk.data(), chunk.size());
+            }
+            // Content shorter than gzip magic
+            if (ok && is_first && !head.empty())
+                ok = content_.Push(head.data(), head.size());
+            if (cache)
+                cache->Close();
+            if (!ok && !content_.IsAborted())
+                kodi::Log(ADDON_LOG_ERROR, "XMLTV: corrupted compressed data from %s", source_.c_str());
+            inflate_ok_ = ok && !raw_.IsAborted();
+            if (inflate_ok_)
+                content_.Close();
+            else
+                content_.Abort();
+        }
 
-            } while (strm_.avail_out == 0);
+        std::string TempCachePath() const { return cache_path_ + ".tmp"; }
 
-            return true;
+        void CommitCache(bool completed) {
+            const auto temp_path = TempCachePath();
+            if (completed && !cache_failed_) {
+                kodi::vfs::DeleteFile(cache_path_);
+                if (kodi::vfs::RenameFile(temp_path, cache_path_))
+                    return;
+                kodi::Log(ADDON_LOG_ERROR, "XMLTV: failed to commit cache file %s", cache_path_.c_str());
+            }
+            kodi::vfs::DeleteFile(temp_path);
         }
 
-        ~Inflator() {
-            inflateEnd(&strm_);
+        const std::string source_;
+        const std::string cache_path_;
+        Helpers::ChunkQueue raw_;
+        Helpers::ChunkQueue content_;
+        bool read_ok_ = false;
+        bool inflate_ok_ = false;
+        bool cache_failed_ = false;
+        uint64_t delivered_ = 0;
+    };
+
+    // Streams decompressed content of url to sink, from fresh cache or from network.
+    bool StreamContents(const std::string& url, const ContentSink& sink, bool force_reload = false) {
+        const auto cached_path = GetCachePath(url);
+        if (!force_reload && IsCacheFresh(cached_path)) {
+            ContentPipeline pipeline(cached_path, std::string());
+            if (pipeline.Run(sink) || pipeline.Delivered() > 0)
+                return true;
+            kodi::Log(ADDON_LOG_INFO, "XMLTV: cache of %s is unreadable, reloading", url.c_str());
         }
 
-    private:
-        z_stream strm_{};
-        std::function<size_t(const char*, size_t)> writer_;
-    };
+        kodi::vfs::CreateDirectory(CACHE_DIR);
+        ContentPipeline pipeline(url, cached_path);
+        if (pipeline.Run(sink))
+            return true;
 
-    std::string GetCachePath(const std::string& url) {
-        const size_t hash = std::hash<std::string>{}(url);
-        return (fs::path(CACHE_DIR) / std::to_string(hash)).string();
+        // Nothing reached the consumer: outdated data is better than none
+        if (pipeline.Delivered() == 0 && kodi::vfs::FileExists(cached_path, false)) {
+            kodi::Log(ADDON_LOG_INFO, "XMLTV: failed to load %s, using outdated cache", url.c_str());
+            return ContentPipeline(cached_path, std::string()).Run(sink);
+        }
+        return false;
     }
 
-    bool LoadData(const std::string& path, std::function<bool(const char*, size_t)> processor) {
-        auto file = kodi::vfs::CFile(path);
-        if (!file.Open()) return false;
+    bool GetCachedFileContents(const std::string& url, const DataWriter& writer, bool forceReload) {
+        return StreamContents(url, [&writer](const char* data, size_t size) {
+            return writer(data, static_cast<unsigned int>(size)) == size;
+        }, forceReload);
+    }
 
-        std::vector<char> buffer(CHUNK_SIZE);
-        while (true) {
-            const ssize_t read = file.Read(buffer.data(), CHUNK_SIZE);
-            if (read <= 0) break;
-            if (!processor(buffer.data(), read)) return false;
-        }
-        return true;
+    long LocalTimeOffset() {
+        const time_t now = time(nullptr);
+        struct tm local_tm;
+#ifdef TARGET_WINDOWS
+        localtime_s(&local_tm, &now);
+        long offset = 0;
+        _get_timezone(&offset);
+        if (local_tm.tm_isdst > 0)
+            offset -= 3600;
+        return offset;
+#else
+        localtime_r(&now, &local_tm);
+        return -local_tm.tm_gmtoff;
+#endif
     }
 
-    bool ShouldReloadCache(const fs::path& cached, const fs::path& source) {
-        if (!kodi::vfs::FileExists(cached, false)) return true;
+    // Days since 1970-01-01 of proleptic Gregorian date (H. Hinnant's days_from_civil)
+    static constexpr int64_t DaysFromCivil(int64_t year, unsigned month, unsigned day) {
+        year -= month <= 2;
+        const int64_t era = (year >= 0 ? year : year - 399) / 400;
+        const unsigned yoe = static_cast<unsigned>(year - era * 400);
+        const unsigned doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + static_cast<int64_t>(doe) - 719468;
+    }
+    static_assert(DaysFromCivil(1970, 1, 1) == 0 && DaysFromCivil(2000, 3, 1) == 11017, "days_from_civil");
+
+    // Value of a digit, anything above 9 for other chars
+    static inline unsigned DigitValue(char c) {
+        return static_cast<unsigned>(static_cast<unsigned char>(c) - '0');
+    }
 
-        const auto now = system_clock::now();
-        const auto cache_time = kodi::vfs::FileStatus(cached).GetModificationTime();
-        if (now - cache_time > CACHE_TTL) return true;
+    // Called twice per programme, so no sscanf/mktime:
+    // mktime takes the global time zone lock and normalizes through local time.
+    time_t ParseDateTime(std::string_view str) {
+        if (str.size() < 14)
+            throw std::invalid_argument("Invalid datetime format");
+        unsigned digits[14];
+        unsigned invalid = 0;
+        for (size_t i = 0; i < 14; ++i) {
+            digits[i] = DigitValue(str[i]);
+            invalid |= digits[i] > 9;
+        }
+        const int year = digits[0] * 1000 + digits[1] * 100 + digits[2] * 10 + digits[3];
+        const unsigned month = digits[4] * 10 + digits[5];
+        const unsigned day = digits[6] * 10 + digits[7];
+        const int hour = digits[8] * 10 + digits[9];
+        const int minute = digits[10] * 10 + digits[11];
+        const int second = digits[12] * 10 + digits[13];
+        if (invalid || month < 1 || month > 12)
+            throw std::invalid_argument("Invalid datetime format");
 
-        return kodi::vfs::FileStatus(source).GetSize() != kodi::vfs::FileStatus(cached).GetSize();
+        // Fields are wall clock of the zone given by the suffix (UTC without it)
+        long zone_offset = 0;
+        size_t pos = 14;
+        while (pos < str.size() && str[pos] == ' ')
+            ++pos;
+        if (pos + 5 <= str.size() && (str[pos] == '+' || str[pos] == '-')) {
+            const unsigned h1 = DigitValue(str[pos + 1]), h2 = DigitValue(str[pos + 2]);
+            const unsigned m1 = DigitValue(str[pos + 3]), m2 = DigitValue(str[pos + 4]);
+            if (std::max({h1, h2, m1, m2}) <= 9) {
+                zone_offset = (h1 * 10 + h2) * 3600 + (m1 * 10 + m2) * 60;
+                if (str[pos] == '-')
+                    zone_offset = -zone_offset;
+            }
+        }
+        const int64_t days = DaysFromCivil(year, month, day);
+        return static_cast<time_t>(days * 86400 + hour * 3600 + minute * 60 + second - zone_offset);
     }
 
-    bool UpdateCache(const std::string& url, const std::string& cached_path) {
-        try {
-            kodi::vfs::CreateDirectory(CACHE_DIR);
+    KodiChannelId ChannelIdForChannelName(const std::string& channelName) {
+        const int id = static_cast<int>(std::hash<std::string>{}(channelName));
+        // Kodi rejects negative channel IDs
+        return std::abs(id);
+    }
 
-            auto writer = [&](const char* data, size_t size) {
-                static kodi::vfs::CFile file(cached_path, ADDON_WRITE_TRUNCATED);
-                return file.Write(data, size) ? size : 0;
-            };
+    KodiChannelId EpgChannelIdForXmlEpgId(const char* strId) {
+        char* end = nullptr;
+        const long numeric = std::strtol(strId, &end, 10);
+        if (end != strId && *end == '\0' && numeric >= 0)
+            return static_cast<KodiChannelId>(numeric);
+        return ChannelIdForChannelName(strId);
+    }
 
-            bool is_compressed = false;
-            Inflator inflator(writer);
+    static const char* FindAttribute(const XML_Char** attrs, const char* name) {
+        for (int i = 0; attrs[i]; i += 2) {
+            if (0 == strcmp(attrs[i], name))
+                return attrs[i + 1];
+        }
+        return nullptr;
+    }
 
-            return LoadData(url, [&](const char* data, size_t size) {
-                if (!is_compressed) {
-                    is_compressed = (size >= 3 && data[0] == '\x1F' && data[1] == '\x8B' && data[2] == '\x08');
-                }
-                return is_compressed ? inflator.Process(data, size) : writer(data, size);
-            });
+    // Collects text content of selected child elements
+    class XmlTvHandler : public XmlSaxHandler<> {
+    protected:
+        bool ElementData(const XML_Char* data, int length) override {
+            if (text_target_)
+                text_target_->append(data, length);
+            return true;
         }
-        catch (const std::exception& e) {
-            kodi::Log(ADDON_LOG_ERROR, "Cache update failed: %s", e.what());
-            return false;
+
+        void CollectText(std::string* target) {
+            text_target_ = target;
+            if (text_target_)
+                text_target_->clear();
         }
-    }
 
-    time_t ParseDateTime(std::string_view str) {
-        tm tm = {};
-        const auto parse_result = std::sscanf(str.data(), 
-            "%4d%2d%2d%2d%2d%2d",
-            &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
-            &tm.tm_hour, &tm.tm_min, &tm.tm_sec
-        );
-
-        if (parse_result != 6) {
-            throw std::invalid_argument("Invalid datetime format");
+        std::string* text_target_ = nullptr;
+    };
+
+    class ChannelHandler : public XmlTvHandler {
+    public:
+        explicit ChannelHandler(const ChannelCallback& callback) : callback_(callback) {}
+
+        // Channels precede programmes in XMLTV
+        bool IsDone() const { return done_; }
+
+    protected:
+        bool Element(const XML_Char* name, const XML_Char** attrs) override {
+            if (0 == strcmp(name, "programme")) {
+                done_ = true;
+                return false;
+            }
+            if (0 == strcmp(name, "channel")) {
+                channel_ = EpgChannel();
+                const char* id = FindAttribute(attrs, "id");
+                in_channel_ = id != nullptr;
+                if (in_channel_)
+                    channel_.id = EpgChannelIdForXmlEpgId(id);
+            } else if (in_channel_ && 0 == strcmp(name, "display-name")) {
+                CollectText(&display_name_);
+            } else if (in_channel_ && 0 == strcmp(name, "icon")) {
+                if (const char* src = FindAttribute(attrs, "src"))
+                    channel_.strIcon = src;
+            }
+            return true;
         }
 
-        tm.tm_year -= 1900;
-        tm.tm_mon -= 1;
-        tm.tm_isdst = -1;
+        bool ElementEnd(const XML_Char* name) override {
+            if (in_channel_ && 0 == strcmp(name, "display-name")) {
+                if (!display_name_.empty())
+                    channel_.displayNames.push_back(display_name_);
+                CollectText(nullptr);
+            } else if (in_channel_ && 0 == strcmp(name, "channel")) {
+                callback_(channel_);
+                in_channel_ = false;
+            }
+            return true;
+        }
 
-        const auto tp = system_clock::from_time_t(std::mktime(&tm));
-        return system_clock::to_time_t(tp);
-    }
+    private:
+        const ChannelCallback& callback_;
+        EpgChannel channel_;
+        std::string display_name_;
+        bool in_channel_ = false;
+        bool done_ = false;
+    };
 
-    template<typename T>
-    class XmlHandler : public XmlSaxHandler {
+    class ProgrammeHandler : public XmlTvHandler {
     public:
-        using Callback = std::function<void(const T&)>;
-        
-        explicit XmlHandler(Callback cb) : callback_(std::move(cb)) {}
+        ProgrammeHandler(const EpgEntryCallback& callback, const ChannelFilter& filter)
+            : callback_(callback)
+            , filter_(filter)
+        {}
+
+        bool IsCancelled() const { return cancelled_; }
 
     protected:
-        Callback callback_;
-        T current_entry_;
-        bool in_target_tag_ = false;
+        bool Element(const XML_Char* name, const XML_Char** attrs) override {
+            if (0 == strcmp(name, "programme")) {
+                entry_ = EpgEntry();
+                in_programme_ = ParseProgrammeAttributes(attrs);
+            } else if (!in_programme_) {
+                return true;
+            } else if (0 == strcmp(name, "title")) {
+                // Keep the first title, others are translations
+                if (entry_.strTitle.empty())
+                    CollectText(&entry_.strTitle);
+            } else if (0 == strcmp(name, "desc")) {
+                if (entry_.strPlot.empty())
+                    CollectText(&entry_.strPlot);
+            } else if (0 == strcmp(name, "category")) {
+                CollectText(&category_);
+            } else if (0 == strcmp(name, "icon")) {
+                if (const char* src = FindAttribute(attrs, "src"))
+                    entry_.iconPath = src;
+            }
+            return true;
+        }
+
+        bool ElementEnd(const XML_Char* name) override {
+            if (!in_programme_)
+                return true;
+            if (0 == strcmp(name, "programme")) {
+                in_programme_ = false;
+                CollectText(nullptr);
+                if (!callback_(entry_)) {
+                    cancelled_ = true;
+                    return false;
+                }
+                return true;
+            }
+            if (0 == strcmp(name, "category") && !category_.empty()) {
+                if (!entry_.strGenreString.empty())
+                    entry_.strGenreString += '/';
+                entry_.strGenreString += category_;
+            }
+            text_target_ = nullptr;
+            return true;
+        }
+
+    private:
+        // False for broken or filtered out programme, its content is skipped then
+        bool ParseProgrammeAttributes(const XML_Char** attrs) {
+            const char* channel = FindAttribute(attrs, "channel");
+            if (!channel || !IsChannelWanted(channel))
+                return false;
+            const char* start = FindAttribute(attrs, "start");
+            const char* stop = FindAttribute(attrs, "stop");
+            if (!start || !stop)
+                return false;
+            try {
+                entry_.startTime = ParseDateTime(start);
+                entry_.endTime = ParseDateTime(stop);
+            } catch (const std::invalid_argument&) {
+                return false;
+            }
+            entry_.EpgId = last_channel_id_;
+            return true;
+        }
+
+        // Programmes come grouped by channel, remember the last decision
+        bool IsChannelWanted(const char* channel) {
+            if (last_channel_ != channel) {
+                last_channel_ = channel;
+                last_channel_id_ = EpgChannelIdForXmlEpgId(channel);
+                last_channel_wanted_ = !filter_ || filter_(last_channel_id_);
+            }
+            return last_channel_wanted_;
+        }
+
+        const EpgEntryCallback& callback_;
+        const ChannelFilter& filter_;
+        std::string last_channel_;
+        KodiChannelId last_channel_id_ = 0;
+        bool last_channel_wanted_ = false;
+        EpgEntry entry_;
+        std::string category_;
+        bool in_programme_ = false;
+        bool cancelled_ = false;
     };
 
-    class ChannelHandler : public XmlHandler<EpgChannel> {
+    // Cuts decompressed XMLTV into shards of whole <programme> elements and parses
+    // them on a thread pool. Every shard gets own expat parser with the document's
+    // XML declaration (for encoding) and a synthetic <tv> root.
+    // Parsed entries are reported on the caller thread in document order.
+    class ShardedProgrammeParser {
     public:
-        using XmlHandler::XmlHandler;
-
-        bool StartElement(const std::string& name, const AttributeList& attrs) override {
-            if (name == "channel") {
-                current_entry_ = EpgChannel();
-                if (const auto it = std::find_if(attrs.begin(), attrs.end(),
-                    [](const auto& p) { return p.first == "id"; }); it != attrs.end()) 
-                {
-                    current_entry_.id = std::hash<std::string>{}(it->second);
-                    in_target_tag_ = true;
+        ShardedProgrammeParser(const EpgEntryCallback& callback, const ChannelFilter& filter, int threads)
+            : callback_(callback)
+            , filter_(filter)
+            , max_pending_(threads * 2)
+            , pool_(threads)
+        {}
+
+        ~ShardedProgrammeParser() {
+            // Shard tasks reference prolog_
+            pool_.wait_idle();
+        }
+
+        bool IsCancelled() const { return cancelled_; }
+
+        // Returns false when consumer cancelled parsing or XML is broken
+        bool Push(const char* data, size_t size) {
+            buffer_.append(data, size);
+            if (!started_ && !Start())
+                return true;
+            if (buffer_.size() < SHARD_SIZE)
+                return true;
+            const size_t boundary = FindLastBoundary();
+            if (boundary == 0 || boundary == std::string::npos)
+                return true;
+            Dispatch(buffer_.substr(0, boundary));
+            buffer_.erase(0, boundary);
+            return Deliver(false);
+        }
+
+        bool Finish() {
+            if (started_) {
+                // Trailing "</tv>" belongs to the real root
+                const size_t end = buffer_.rfind("</tv>");
+                if (end != std::string::npos)
+                    buffer_.resize(end);
+                Dispatch(std::move(buffer_));
+                buffer_.clear();
+            }
+            return Deliver(true);
+        }
+
+    private:
+        struct Shard {
+            bool ok = true;
+            std::vector<EpgEntry> entries;
+        };
+
+        static bool IsBoundaryAt(const std::string& text, size_t pos) {
+            static const size_t tag_len = strlen("<programme");
+            if (pos + tag_len >= text.size())
+                return false;
+            const char next = text[pos + tag_len];
+            return next == ' ' || next == '\t' || next == '\r' || next == '\n' || next == '>';
+        }
+
+        static size_t FindBoundary(const std::string& text, size_t from) {
+            for (size_t pos = text.find("<programme", from); pos != std::string::npos; pos = text.find("<programme", pos + 1)) {
+                if (IsBoundaryAt(text, pos))
+                    return pos;
+            }
+            return std::string::npos;
+        }
+
+        // Only "</programme> <programme" is a safe cut, the tag text may appear in CDATA or comments
+        static bool FollowsProgramme(const std::string& text, size_t pos) {
+            static const std::string end_tag = "</programme>";
+            while (pos > 0 && std::isspace(static_cast<unsigned char>(text[pos - 1])))
+                --pos;
+            return pos >= end_tag.size() && 0 == text.compare(pos - end_tag.size(), end_tag.size(), end_tag);
+        }
+
+        size_t FindLastBoundary() const {
+            for (size_t pos = buffer_.rfind("<programme"); pos != std::string::npos && pos > 0; pos = buffer_.rfind("<programme", pos - 1)) {
+                if (IsBoundaryAt(buffer_, pos) && FollowsProgramme(buffer_, pos))
+                    return pos;
+            }
+            return std::string::npos;
+        }
+
+        // Value of channel="..." within the start tag [begin, end).
+        // False when missing or escaped, i.e. can't be compared without XML parser.
+        static bool FindChannelAttribute(const std::string& text, size_t begin, size_t end, std::string_view& value) {
+            static const std::string attr = " channel=";
+            const size_t pos = text.find(attr, begin);
+            if (pos == std::string::npos || pos + attr.size() + 1 >= end)
+                return false;
+            const char quote = text[pos + attr.size()];
+            if (quote != '"' && quote != '\'')
+                return false;
+            const size_t from = pos + attr.size() + 1;
+            const size_t to = text.find(quote, from);
+            if (to == std::string::npos || to >= end)
+                return false;
+            value = std::string_view(text).substr(from, to - from);
+            return value.find('&') == std::string_view::npos;
+        }
+
+        // Removes <programme> elements of filtered out channels before they reach expat,
+        // tokenizing is most of parsing time. Element is removed only when it starts
+        // right after previous one and is followed by white space and the next one (or the end),
+        // otherwise it is left to the XML parser.
+        static std::string DropFilteredProgrammes(std::string text, const ChannelFilter& filter) {
+            static const std::string end_tag = "</programme>";
+            std::string result;
+            size_t copied = 0;
+            std::string last_channel;
+            bool last_wanted = true;
+            size_t pos = FindBoundary(text, 0);
+            bool is_reliable = pos == 0;
+            while (pos != std::string::npos) {
+                const size_t tag_end = text.find('>', pos);
+                const size_t end = text.find(end_tag, pos);
+                if (tag_end == std::string::npos || end == std::string::npos)
+                    break;
+                size_t after = end + end_tag.size();
+                while (after < text.size() && std::isspace(static_cast<unsigned char>(text[after])))
+                    ++after;
+                const size_t next = FindBoundary(text, end + end_tag.size());
+                is_reliable = is_reliable && (after == text.size() || after == next);
+                std::string_view channel;
+                if (is_reliable && FindChannelAttribute(text, pos, tag_end, channel)) {
+                    if (channel != last_channel) {
+                        last_channel = channel;
+                        last_wanted = filter(EpgChannelIdForXmlEpgId(last_channel.c_str()));
+                    }
+                    if (!last_wanted) {
+                        result.append(text, copied, pos - copied);
+                        copied = after;
+                    }
                 }
+                pos = next;
             }
+            if (copied == 0)
+                return text;
+            result.append(text, copied, std::string::npos);
+            return result;
+        }
+
+        // Drops everything before the first programme (channels), keeps XML declaration
+        bool Start() {
+            const size_t first = FindBoundary(buffer_, 0);
+            if (first == std::string::npos)
+                return false;
+            const size_t decl = buffer_.find("<?xml");
+            if (decl != std::string::npos && decl < first) {
+                const size_t declEnd = buffer_.find("?>", decl);
+                if (declEnd != std::string::npos && declEnd < first)
+                    prolog_ = buffer_.substr(decl, declEnd + 2 - decl);
+            }
+            buffer_.erase(0, first);
+            started_ = true;
             return true;
         }
 
-        bool EndElement(const std::string& name) override {
-            if (name == "channel" && in_target_tag_) {
-                callback_(current_entry_);
-                in_target_tag_ = false;
+        void Dispatch(std::string body) {
+            pending_.push_back(pool_.enqueue([this](std::string text) {
+                Shard shard;
+                EpgEntryCallback collect = [&shard](const EpgEntry& entry) {
+                    shard.entries.push_back(entry);
+                    return true;
+                };
+                ProgrammeHandler handler(collect, filter_);
+                if (filter_)
+                    text = DropFilteredProgrammes(std::move(text), filter_);
+                const std::string head = prolog_ + "<tv>";
+                shard.ok = handler.Parse(head.data(), head.size(), false) &&
+                           handler.Parse(text.data(), text.size(), false) &&
+                           handler.Parse("</tv>", 5, true);
+                return shard;
+            }, std::move(body)));
+        }
+
+        // Reports finished shards in order. Blocks while too many shards are pending.
+        bool Deliver(bool all) {
+            while (!pending_.empty()) {
+                auto& front = pending_.front();
+                const bool must_wait = all || pending_.size() > max_pending_;
+                if (!must_wait && front.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                    break;
+                Shard shard = front.get();
+                pending_.pop_front();
+                for (const auto& entry : shard.entries) {
+                    if (!callback_(entry)) {
+                        cancelled_ = true;
+                        return false;
+                    }
+                }
+                if (!shard.ok)
+                    return false;
             }
             return true;
         }
+
+        const EpgEntryCallback& callback_;
+        const ChannelFilter& filter_;
+        const size_t max_pending_;
+        std::string prolog_;
+        std::string buffer_;
+        bool started_ = false;
+        bool cancelled_ = false;
+        std::deque<std::future<Shard>> pending_;
+        modern::ThreadPool pool_;
     };
 
-    bool LoadEPG(const std::string& url, std::function<void(const EpgEntry&)> callback) {
-        const auto cached_path = GetCachePath(url);
-        
-        if (ShouldReloadCache(cached_path, url) && !UpdateCache(url, cached_path)) {
-            kodi::Log(ADDON_LOG_ERROR, "Failed to update EPG cache");
+    bool ParseChannels(const std::string& url, const ChannelCallback& onChannelFound) {
+        try {
+            ChannelHandler handler(onChannelFound);
+            const bool completed = StreamContents(url, [&handler](const char* data, size_t size) {
+                return handler.Parse(data, size, false);
+            });
+            if (handler.IsDone())
+                return true;
+            if (!completed || !handler.Parse(nullptr, 0, true)) {
+                kodi::Log(ADDON_LOG_ERROR, "XMLTV: failed to load channels from %s", url.c_str());
+                return false;
+            }
+            return true;
+        }
+        catch (const std::exception& e) {
+            kodi::Log(ADDON_LOG_ERROR, "XMLTV: channels parsing failed: %s", e.what());
+            return false;
+        }
+    }
+
+    static bool ParseEpgInParallel(const std::string& url, const EpgEntryCallback& onEpgEntry, const ChannelFilter& filter, int threads) {
+        ShardedProgrammeParser parser(onEpgEntry, filter, threads);
+        const bool completed = StreamContents(url, [&parser](const char* data, size_t size) {
+            return parser.Push(data, size);
+        });
+        if (parser.IsCancelled())
+            return false;
+        if (!completed || !parser.Finish()) {
+            if (!parser.IsCancelled())
+                kodi::Log(ADDON_LOG_ERROR, "XMLTV: failed to load EPG from %s", url.c_str());
             return false;
         }
+        return true;
+    }
 
+    bool ParseEpg(const std::string& url, const EpgEntryCallback& onEpgEntry, const ChannelFilter& filter) {
         try {
-            ChannelHandler handler([&](const auto& channel) {
-                // Process channel
-            });
+            // Filtering works on shards, so it goes through the shard parser even with one thread
+            if (s_numberOfParserThreads > 1 || filter)
+                return ParseEpgInParallel(url, onEpgEntry, filter, s_numberOfParserThreads);
 
-            return LoadData(cached_path, [&](const char* data, size_t size) {
-                return handler.Parse(data, size);
+            ProgrammeHandler handler(onEpgEntry, filter);
+            const bool completed = StreamContents(url, [&handler](const char* data, size_t size) {
+                return handler.Parse(data, size, false);
             });
+            if (handler.IsCancelled())
+                return false;
+            if (!completed || !handler.Parse(nullptr, 0, true)) {
+                kodi::Log(ADDON_LOG_ERROR, "XMLTV: failed to load EPG from %s", url.c_str());
+                return false;
+            }
+            return true;
         }
         catch (const std::exception& e) {
-            kodi::Log(ADDON_LOG_ERROR, "EPG parsing failed: %s", e.what());
+            kodi::Log(ADDON_LOG_ERROR, "XMLTV: EPG parsing failed: %s", e.what());
             return false;
         }
     }
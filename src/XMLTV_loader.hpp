@@ -2,77 +2,62 @@
 #define XMLTV_LOADER_HPP
 
 #include <string>
-#include <vector>
+#include <string_view>
+#include <list>
 #include <functional>
-#include <chrono>
-#include <filesystem>
-#include <memory>
-#include <kodi/AddonBase.h>
-#include <kodi/Filesystem.h>
-#include <kodi/addon/pvr/EPG.h>
+#include <ctime>
+#include "pvr_client_types.h"
 
 namespace XMLTV {
-    namespace fs = std::filesystem;
-    using namespace std::chrono;
+    using PvrClient::KodiChannelId;
 
     struct EpgChannel {
-        EpgChannel() = default;
-        
-        kodi::addon::PVRChannelIdentifier id = KODI_INVALID_CHANNEL_ID;
-        std::vector<std::string> displayNames;
-        std::string iconPath;
+        KodiChannelId id = 0;
+        std::list<std::string> displayNames;
+        std::string strIcon;
     };
 
     struct EpgEntry {
-        kodi::addon::PVRChannelIdentifier channelId = KODI_INVALID_CHANNEL_ID;
-        time_point<system_clock> startTime;
-        time_point<system_clock> endTime;
-        std::string title;
-        std::string plot;
-        std::string genre;
+        KodiChannelId EpgId = 0;
+        time_t startTime = 0;
+        time_t endTime = 0;
+        std::string strTitle;
+        std::string strPlot;
+        std::string strGenreString;
         std::string iconPath;
     };
 
-    using ChannelHandler = std::function<void(const EpgChannel&)>;
-    using EpgEntryHandler = std::function<bool(const EpgEntry&)>;
-
-    class XmlTvLoader {
-    public:
-        explicit XmlTvLoader(std::string cacheDir = "special://temp/pvr-xmltv/")
-            : m_cacheDir(std::move(cacheDir)) 
-        {
-            kodi::vfs::CreateDirectory(m_cacheDir);
-        }
-
-        bool LoadChannels(const std::string& source, ChannelHandler handler);
-        bool LoadPrograms(const std::string& source, EpgEntryHandler handler);
-
-        static time_point<system_clock> ParseXmlDateTime(std::string_view dtStr);
-
-    private:
-        struct CacheInfo {
-            fs::path path;
-            bool valid = false;
-            system_clock::time_point expiration;
-        };
-
-        fs::path m_cacheDir;
-        
-        CacheInfo GetCachedData(const std::string& source);
-        bool UpdateCache(const std::string& source, const fs::path& cachePath);
-        bool ProcessXml(const fs::path& xmlPath, ChannelHandler* channelHandler, EpgEntryHandler* programHandler);
-    };
-
-    // Хэш-функция для идентификаторов каналов
-    struct ChannelIdHash {
-        size_t operator()(const std::string& id) const {
-            return std::hash<std::string>{}(id);
-        }
-    };
-
-    // Вспомогательные функции времени
-    system_clock::time_point LocalTimeToUTC(const tm& localTime);
-    time_t LocalTimeOffset();
+    // Return false to stop parsing.
+    using EpgEntryCallback = std::function<bool(const EpgEntry&)>;
+    using ChannelCallback = std::function<void(const EpgChannel&)>;
+    // Return false to skip programmes of the channel without parsing their content.
+    // Called from parser threads, see SetNumberOfParserThreads().
+    using ChannelFilter = std::function<bool(KodiChannelId)>;
+    // Returns number of bytes consumed, anything but size stops loading.
+    using DataWriter = std::function<size_t(const char* buffer, unsigned int size)>;
+
+    // XMLTV file (plain or gzipped) is downloaded, inflated and parsed concurrently,
+    // the downloaded data is stored to local cache on the way.
+    // Cached copy is used while it is fresh.
+    bool ParseEpg(const std::string& url, const EpgEntryCallback& onEpgEntry, const ChannelFilter& filter = nullptr);
+    // Stops at the first <programme>, i.e. doesn't download the whole EPG for channels.
+    bool ParseChannels(const std::string& url, const ChannelCallback& onChannelFound);
+
+    // Large files are split at <programme> boundaries and parsed on this many threads,
+    // entries are still reported in file order. 1 parses on the loading thread.
+    // Returns the number actually used.
+    int SetNumberOfParserThreads(int numOfThreads);
+
+    // Decompressed content of url through the same cache.
+    bool GetCachedFileContents(const std::string& url, const DataWriter& writer, bool forceReload = false);
+
+    KodiChannelId ChannelIdForChannelName(const std::string& channelName);
+    KodiChannelId EpgChannelIdForXmlEpgId(const char* strId);
+
+    // XMLTV time, e.g. "20240131235959 +0300", to UTC
+    time_t ParseDateTime(std::string_view str);
+    // Seconds to add to local time to get UTC
+    long LocalTimeOffset();
 }
 
 #endif // XMLTV_LOADER_HPP
@@ -21,7 +21,7 @@ public:
     >;
 
     XmlSaxHandler()
-        : m_parser(XML_ParserCreate(nullptr), &XML_ParserFree)
+        : m_parser(XML_ParserCreate(nullptr))
     {
         XML_SetElementHandler(m_parser.get(), StartElement, EndElement);
         XML_SetCharacterDataHandler(m_parser.get(), CharacterDataHandler);
@@ -33,7 +33,10 @@ public:
         if (XML_Parse(m_parser.get(), buffer, static_cast<int>(size), isFinal ? XML_TRUE : XML_FALSE) 
             == XML_STATUS_ERROR)
         {
-            LogError(XML_GetErrorCode(m_parser.get()));
+            // Stopped by handler is not an error
+            const auto errorCode = XML_GetErrorCode(m_parser.get());
+            if (errorCode != XML_ERROR_ABORTED)
+                LogError(errorCode);
             return false;
         }
         return true;
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <utility>
+#include <kodi/AddonBase.h>
+#include "ZapAccelerator.hpp"
+#include "timeshift_buffer.h"
+#include "simple_cyclic_buffer.hpp"
+#include "StreamHealth.hpp"
+
+namespace Buffers {
+
+// Stream is older than that when handed over, more only delays the picture
+static const std::chrono::seconds c_PrebufferDuration(5);
+static const uint64_t c_MinPrebufferSize = 1024 * 1024;
+// Bandwidth guess for streams never played (SD/HD TS)
+static const double c_UnknownStreamBps = 4.0 * 1024 * 1024 / 8;
+// Kodi closes the stream before opening the next one on zap
+static const std::chrono::seconds c_IdleTimeout(10);
+
+ZapAccelerator::ZapAccelerator(InputFactory createInput)
+: m_createInput(std::move(createInput))
+{
+    m_housekeeper = std::jthread([this](std::stop_token stopToken) {
+        Housekeeping(stopToken);
+    });
+}
+
+ZapAccelerator::~ZapAccelerator()
+{
+    m_housekeeper.request_stop();
+    if(m_housekeeper.joinable())
+        m_housekeeper.join();
+    for(auto& running : m_running)
+        delete running.second;
+    for(auto buffer : m_disposed)
+        delete buffer;
+}
+
+void ZapAccelerator::Prebuffer(const std::vector<std::string>& urls, uint64_t memoryLimit, uint64_t bandwidthLimit)
+{
+    // URL -> measured throughput
+    std::vector<std::pair<std::string, double>> accepted;
+    const size_t maxCount = memoryLimit / c_MinPrebufferSize;
+    double bandwidth = 0.0;
+    for(const auto& url : urls) {
+        if(accepted.size() >= maxCount)
+            break;
+        if(std::any_of(accepted.begin(), accepted.end(), [&url](const auto& candidate) { return candidate.first == url; }))
+            continue;
+        const double throughput = StreamHealth::Instance().Throughput(url);
+        const double expected = throughput > 0.0 ? throughput : c_UnknownStreamBps;
+        if(bandwidthLimit > 0 && bandwidth + expected > bandwidthLimit) {
+            kodi::Log(ADDON_LOG_DEBUG, "ZapAccelerator: %s exceeds bandwidth limit.", url.c_str());
+            continue;
+        }
+        bandwidth += expected;
+        accepted.emplace_back(url, throughput);
+    }
+
+    std::map<std::string, uint64_t> wanted;
+    for(const auto& candidate : accepted) {
+        uint64_t size = memoryLimit / accepted.size();
+        if(candidate.second > 0.0)
+            size = std::min(size, static_cast<uint64_t>(candidate.second * c_PrebufferDuration.count()));
+        wanted[candidate.first] = std::max(size, c_MinPrebufferSize) / SimpleCyclicBuffer::CHUNK_SIZE_LIMIT;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wanted.swap(wanted);
+    m_isSuspended = false;
+    m_isChanged = true;
+    m_wakeUp.notify_one();
+}
+
+TimeshiftBuffer* ZapAccelerator::Take(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Also cancels connecting in progress, the caller opens the stream itself
+    m_wanted.erase(url);
+    auto found = m_running.find(url);
+    if(found == m_running.end())
+        return nullptr;
+    TimeshiftBuffer* buffer = found->second;
+    m_running.erase(found);
+    // Writer thread exits on input error
+    if(!buffer->IsRunning()) {
+        kodi::Log(ADDON_LOG_DEBUG, "ZapAccelerator: pre-buffer of %s is broken.", url.c_str());
+        m_disposed.push_back(buffer);
+        m_wakeUp.notify_one();
+        return nullptr;
+    }
+    return buffer;
+}
+
+void ZapAccelerator::Suspend()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_isSuspended = true;
+    m_expiresAt = std::chrono::steady_clock::now() + c_IdleTimeout;
+    // Housekeeper switches to waiting for expiration
+    m_isChanged = true;
+    m_wakeUp.notify_one();
+}
+
+void ZapAccelerator::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wanted.clear();
+    m_isSuspended = false;
+    m_isChanged = true;
+    m_wakeUp.notify_one();
+}
+
+void ZapAccelerator::Housekeeping(std::stop_token stopToken)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!stopToken.stop_requested()) {
+        const auto isWorkToDo = [this] { return m_isChanged || !m_disposed.empty(); };
+        if(m_isSuspended)
+            m_wakeUp.wait_until(lock, stopToken, m_expiresAt, isWorkToDo);
+        else
+            m_wakeUp.wait(lock, stopToken, isWorkToDo);
+        if(stopToken.stop_requested())
+            break;
+
+        if(m_isSuspended && std::chrono::steady_clock::now() >= m_expiresAt) {
+            kodi::Log(ADDON_LOG_DEBUG, "ZapAccelerator: live playback has stopped, pre-buffers expired.");
+            m_wanted.clear();
+            m_isSuspended = false;
+        }
+        m_isChanged = false;
+
+        std::vector<TimeshiftBuffer*> disposed;
+        disposed.swap(m_disposed);
+        for(auto it = m_running.begin(); it != m_running.end();) {
+            if(m_wanted.count(it->first) == 0) {
+                disposed.push_back(it->second);
+                it = m_running.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        std::vector<std::pair<std::string, uint64_t>> toStart;
+        for(const auto& wanted : m_wanted) {
+            if(m_running.count(wanted.first) == 0)
+                toStart.push_back(wanted);
+        }
+        lock.unlock();
+
+        // Both may block for network timeout
+        for(auto buffer : disposed)
+            delete buffer;
+        for(const auto& wanted : toStart) {
+            if(stopToken.stop_requested())
+                break;
+            TimeshiftBuffer* buffer = nullptr;
+            try {
+                InputBuffer* input = m_createInput(wanted.first);
+                buffer = new TimeshiftBuffer(input, new SimpleCyclicBuffer(wanted.second, true));
+            } catch (std::exception& ex) {
+                kodi::Log(ADDON_LOG_NOTICE, "ZapAccelerator: failed to pre-buffer %s. Exception: %s", wanted.first.c_str(), ex.what());
+            }
+            lock.lock();
+            const bool isWanted = m_wanted.count(wanted.first) != 0;
+            if(nullptr != buffer && isWanted && m_running.count(wanted.first) == 0) {
+                kodi::Log(ADDON_LOG_DEBUG, "ZapAccelerator: pre-buffering %s (%llu KB).", wanted.first.c_str(),
+                          (unsigned long long) wanted.second * SimpleCyclicBuffer::CHUNK_SIZE_LIMIT / 1024);
+                m_running[wanted.first] = buffer;
+                buffer = nullptr;
+            } else if(nullptr == buffer && isWanted) {
+                // Do not retry until asked again
+                m_wanted.erase(wanted.first);
+            }
+            lock.unlock();
+            delete buffer;
+        }
+        lock.lock();
+    }
+}
+
+} // namespace Buffers
@@ -0,0 +1,64 @@
+#ifndef ZAP_ACCELERATOR_HPP
+#define ZAP_ACCELERATOR_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Buffers {
+
+class InputBuffer;
+class TimeshiftBuffer;
+
+// Keeps live streams of adjacent channels running, so zapping to them starts
+// from data downloaded already.
+// Every pre-buffer is a TimeshiftBuffer on drop-oldest SimpleCyclicBuffer
+// holding the newest seconds of the stream. Take() hands it over with
+// connection and data, the player swaps the cache to its own (SwapCache()).
+// Connecting, stopping and destroying of streams is done on background thread,
+// Kodi's thread is never blocked by network.
+class ZapAccelerator
+{
+public:
+    typedef std::function<InputBuffer*(const std::string& url)> InputFactory;
+
+    explicit ZapAccelerator(InputFactory createInput);
+    ~ZapAccelerator();
+
+    // Nearest channels first. URLs are taken while both limits allow,
+    // pre-buffers of other URLs are stopped.
+    // bandwidthLimit is bytes per second, 0 - unlimited.
+    void Prebuffer(const std::vector<std::string>& urls, uint64_t memoryLimit, uint64_t bandwidthLimit);
+    // Running pre-buffer of the URL or nullptr. Caller owns the result.
+    TimeshiftBuffer* Take(const std::string& url);
+    // Live playback has stopped. Pre-buffers expire unless Prebuffer() is called soon,
+    // i.e. this was a zap, not the end of watching.
+    void Suspend();
+    void Clear();
+
+private:
+    void Housekeeping(std::stop_token stopToken);
+
+    InputFactory m_createInput;
+    std::mutex m_mutex;
+    std::condition_variable_any m_wakeUp;
+    // URL -> size in units of SimpleCyclicBuffer
+    std::map<std::string, uint64_t> m_wanted;
+    std::map<std::string, TimeshiftBuffer*> m_running;
+    std::vector<TimeshiftBuffer*> m_disposed;
+    bool m_isChanged = false;
+    bool m_isSuspended = false;
+    std::chrono::steady_clock::time_point m_expiresAt;
+    std::jthread m_housekeeper;
+};
+
+} // namespace Buffers
+
+#endif // ZAP_ACCELERATOR_HPP
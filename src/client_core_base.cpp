@@ -1,15 +1,14 @@
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <filesystem>
 #include <memory>
 #include <mutex>
 #include <thread>
-#include <vector>
-#include <optional>
-#include <span>
 #include <kodi/AddonBase.h>
 #include <kodi/Filesystem.h>
-#include <rapidjson/document.h>
-#include <rapidjson/error/en.h>
+#include "client_core_base.hpp"
+#include "EpgCacheFile.hpp"
 
 namespace fs = std::filesystem;
 using namespace std::chrono;
@@ -18,16 +17,39 @@ namespace PvrClient {
 
 namespace {
     constexpr auto EPG_CACHE_DIR = "special://temp/pvr-puzzle-tv";
-    constexpr auto EPG_CACHE_TTL = 7 * 24h;
+
+    std::string EpgCachePath(std::string_view cache_file) {
+        return (fs::path(EPG_CACHE_DIR) / cache_file).string();
+    }
+
+    void ClearEpgCache() {
+        const auto cacheDir = kodi::vfs::TranslateSpecialProtocol(EPG_CACHE_DIR);
+        std::error_code error;
+        for (const auto& entry : fs::directory_iterator(cacheDir, error)) {
+            if (entry.is_regular_file()) {
+                kodi::vfs::DeleteFile(entry.path().string());
+            }
+        }
+    }
 }
 
 class ClientPhase : public IClientCore::IPhase {
 public:
     ClientPhase() = default;
-    
-    [[nodiscard]] bool Wait(milliseconds timeout = 0ms) override {
+
+    // Timeout 0 waits until done
+    bool Wait(uint32_t timeout = 0) override {
         std::unique_lock lock(m_mutex);
-        return m_cv.wait_for(lock, timeout, [this] { return m_done; });
+        if (timeout == 0) {
+            m_cv.wait(lock, [this] { return m_done; });
+            return true;
+        }
+        return m_cv.wait_for(lock, milliseconds(timeout), [this] { return m_done; });
+    }
+
+    bool IsDone() override {
+        std::lock_guard lock(m_mutex);
+        return m_done;
     }
 
     void Broadcast() override {
@@ -38,12 +60,14 @@ public:
         m_cv.notify_all();
     }
 
-    void RunAsync(std::function<void()> action) {
-        m_thread = std::jthread([this, action](std::stop_token st) {
+    void RunAsync(std::function<void(std::stop_token)> action) {
+        m_thread = std::jthread([this, action = std::move(action)](std::stop_token stop_token) {
             try {
-                action();
+                action(stop_token);
+            } catch (std::exception& ex) {
+                kodi::Log(ADDON_LOG_ERROR, "ClientPhase: thread error. Exception: %s", ex.what());
             } catch (...) {
-                kodi::Log(ADDON_LOG_ERROR, "ClientPhase thread error");
+                kodi::Log(ADDON_LOG_ERROR, "ClientPhase: thread error");
             }
             Broadcast();
         });
@@ -56,88 +80,152 @@ private:
     bool m_done = false;
 };
 
-class ClientCoreBase : public IClientCore {
-public:
-    explicit ClientCoreBase(RecordingsDelegate recordingsDelegate)
-        : m_recordingsDelegate(std::move(recordingsDelegate)) 
-    {
-        m_phases.try_emplace(Phase::Init, std::make_unique<ClientPhase>());
-        // Инициализация остальных фаз
+ClientCoreBase::ClientCoreBase(RecordingsDelegate recordings_delegate)
+    : m_recordings_delegate(std::move(recordings_delegate))
+{
+    for (auto phase : {k_ChannelsLoadingPhase, k_ChannelsIdCreatingPhase, k_EpgCacheLoadingPhase,
+                       k_RecordingsInitialLoadingPhase, k_InitPhase, k_EpgLoadingPhase}) {
+        m_phases[phase].phase = std::make_shared<ClientPhase>();
     }
+}
 
-    void InitAsync(bool clearEpgCache, bool updateRecordings) override {
-        GetPhase(Phase::Init)->RunAsync([=] {
-            InitializeComponents(clearEpgCache);
-            ScheduleEpgUpdate();
-        });
-    }
+void ClientCoreBase::InitAsync(bool clear_epg_cache, bool update_recordings) {
+    // Moves EPG hot window with time and expires programmes older than archive depth
+    m_epg.StartJanitor();
+    m_phases[k_InitPhase].phase->RunAsync([this, clear_epg_cache](std::stop_token) {
+        InitializeComponents(clear_epg_cache);
+        ScheduleEpgUpdate();
+    });
+}
 
-    const ChannelList& GetChannelList() override {
-        auto phase = GetPhase(Phase::ChannelsLoading);
-        phase->Wait();
-        return m_channels;
-    }
+std::shared_ptr<IClientCore::IPhase> ClientCoreBase::GetPhase(Phase phase) {
+    auto it = m_phases.find(phase);
+    if (it == m_phases.end())
+        return nullptr;
+    std::shared_lock lock(it->second.mutex);
+    return it->second.phase;
+}
 
-    void ReloadRecordings() override {
-        std::scoped_lock lock(m_epgMutex);
-        UpdateRecordingsInternal();
-    }
+const ChannelList& ClientCoreBase::GetChannelList() {
+    GetPhase(k_ChannelsLoadingPhase)->Wait();
+    return m_channels;
+}
 
-private:
-    struct EpgEntry {
-        std::chrono::system_clock::time_point start;
-        std::chrono::system_clock::time_point end;
-        std::string title;
-        std::string description;
-    };
-
-    void InitializeComponents(bool clearEpgCache) {
-        if (clearEpgCache) {
-            ClearEpgCache();
-        }
-        LoadChannelsAndGroups();
-    }
+bool ClientCoreBase::GetEpgEntry(UniqueBroadcastIdType id, EpgEntry& entry) {
+    return m_epg.Get(id, entry);
+}
 
-    void ScheduleEpgUpdate() {
-        auto now = system_clock::now();
-        auto start = now - 7 * 24h;
-        auto end = now + 7 * 24h;
-        
-        m_phases[Phase::EpgLoading]->RunAsync([=] {
-            UpdateEpg(start, end);
+void ClientCoreBase::ReloadRecordings() {
+    const int count = UpdateArchiveInfoAndCount();
+    kodi::Log(ADDON_LOG_DEBUG, "ClientCoreBase: %d programme(s) in archive.", count);
+    if (m_recordings_delegate)
+        m_recordings_delegate();
+}
+
+int ClientCoreBase::UpdateArchiveInfoAndCount() {
+    // Flags change around now, i.e. in the hot window. Cold entries keep the flags
+    // of the cache file, those older than archive depth are hidden by the store.
+    m_epg.Modify([this](EpgStore& store) {
+        std::vector<EpgEntryList::value_type> changed;
+        store.ForEach([this, &changed](const EpgEntryList::value_type& stored) {
+            EpgEntry entry = stored.second;
+            UpdateHasArchive(entry);
+            if (entry.HasArchive != stored.second.HasArchive)
+                changed.emplace_back(stored.first, std::move(entry));
+            return true;
         });
-    }
+        for (const auto& entry : changed)
+            store.Update(entry.first, entry.second);
+    });
+    int count = 0;
+    m_epg.ForEach([&count](const EpgEntryList::value_type& entry) {
+        if (entry.second.HasArchive)
+            ++count;
+        return true;
+    });
+    return count;
+}
 
-    void UpdateEpg(system_clock::time_point start, system_clock::time_point end) {
-        std::vector<EpgEntry> entries;
-        // Загрузка EPG данных
-        std::scoped_lock lock(m_epgMutex);
-        m_epgEntries.insert(entries.begin(), entries.end());
+void ClientCoreBase::GetEpg(ChannelId channel_id, time_t start_time, time_t end_time, EpgEntryAction& on_epg_entry) {
+    // Kodi asks every channel on each guide refresh: interval index of the channel
+    // answers in O(log n + k) instead of filtering the whole EPG
+    m_epg.ForEachInRange(channel_id, start_time, end_time, on_epg_entry);
+}
+
+void ClientCoreBase::LoadEpgCache(std::string_view cache_file) {
+    const auto path = EpgCachePath(cache_file);
+    auto cache = MappedEpgCache::Open(path);
+    if (!cache) {
+        kodi::Log(ADDON_LOG_INFO, "ClientCoreBase: no valid EPG cache in %s", path.c_str());
+        return;
     }
+    kodi::Log(ADDON_LOG_DEBUG, "ClientCoreBase: mapped EPG cache %s, %zu entries.", path.c_str(), cache->Size());
+    m_epg.AttachCache(std::move(cache));
+}
 
-    void ClearEpgCache() {
-        const auto cacheDir = kodi::vfs::TranslateSpecialProtocol(EPG_CACHE_DIR);
-        for (const auto& entry : fs::directory_iterator(cacheDir)) {
-            if (entry.is_regular_file()) {
-                kodi::vfs::DeleteFile(entry.path().string());
-            }
-        }
+void ClientCoreBase::SaveEpgCache(std::string_view cache_file, chrono::hours ttl) {
+    const auto path = EpgCachePath(cache_file);
+    kodi::vfs::CreateDirectory(EPG_CACHE_DIR);
+    // Both tiers go to the file, it replaces the mapped one
+    const time_t expiration = system_clock::to_time_t(system_clock::now() + ttl);
+    if (!m_epg.SaveCache(path, expiration))
+        kodi::Log(ADDON_LOG_ERROR, "ClientCoreBase: failed to save EPG cache %s", path.c_str());
+}
+
+void ClientCoreBase::ApplyEpgUpdates(EpgStore::ChannelUpdates& updates) {
+    if (updates.IsEmpty())
+        return;
+    if (m_epg_update) {
+        // Readers see the refresh when it ends
+        const auto changed_channels = m_epg_update->Apply(updates);
+        m_epg_update_changed.insert(m_epg_update_changed.end(), changed_channels.begin(), changed_channels.end());
+        return;
     }
+    const auto changed_channels = m_epg.Apply(updates);
+    kodi::Log(ADDON_LOG_DEBUG, "ClientCoreBase: EPG of %zu channel(s) changed.", changed_channels.size());
+    if (!m_epg_changed_delegate)
+        return;
+    for (const auto channel_id : changed_channels)
+        m_epg_changed_delegate(channel_id);
+}
 
-    std::shared_ptr<IPhase> GetPhase(Phase phase) const {
-        std::shared_lock lock(m_phasesMutex);
-        if (auto it = m_phases.find(phase); it != m_phases.end()) {
-            return it->second;
-        }
-        return nullptr;
+void ClientCoreBase::BeginEpgRefresh() {
+    EndEpgRefresh();
+    m_epg_update.emplace(m_epg.BeginUpdate());
+}
+
+void ClientCoreBase::EndEpgRefresh() {
+    if (!m_epg_update)
+        return;
+    m_epg_update->Commit();
+    m_epg_update.reset();
+    // Same channel may come in a few blocks
+    auto changed_channels = std::move(m_epg_update_changed);
+    m_epg_update_changed.clear();
+    std::sort(changed_channels.begin(), changed_channels.end());
+    changed_channels.erase(std::unique(changed_channels.begin(), changed_channels.end()), changed_channels.end());
+    kodi::Log(ADDON_LOG_DEBUG, "ClientCoreBase: EPG of %zu channel(s) changed.", changed_channels.size());
+    if (!m_epg_changed_delegate)
+        return;
+    for (const auto channel_id : changed_channels)
+        m_epg_changed_delegate(channel_id);
+}
+
+void ClientCoreBase::InitializeComponents(bool clear_epg_cache) {
+    if (clear_epg_cache) {
+        ClearEpgCache();
     }
+    RebuildChannelAndGroupList();
+}
+
+void ClientCoreBase::ScheduleEpgUpdate() {
+    const auto now = system_clock::now();
+    const auto start = now - 7 * 24h;
+    const auto end = now + 7 * 24h;
+
+    m_phases[k_EpgLoadingPhase].phase->RunAsync([this, start, end](std::stop_token stop_token) {
+        UpdateEpgForAllChannels(start, end, stop_token);
+    });
+}
 
-    // Данные
-    std::unordered_map<Phase, std::unique_ptr<ClientPhase>> m_phases;
-    std::shared_mutex m_phasesMutex;
-    ChannelList m_channels;
-    std::mutex m_epgMutex;
-    std::unordered_map<int64_t, EpgEntry> m_epgEntries;
-    RecordingsDelegate m_recordingsDelegate;
-};
 } // namespace PvrClient
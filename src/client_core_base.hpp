@@ -9,16 +9,22 @@
 #include <shared_mutex>
 #include <span>
 #include <optional>
+#include <vector>
+#include <stop_token>
+#include <thread>
 #include <kodi/AddonBase.h>
 #include <rapidjson/document.h>
 #include "pvr_client_types.h"
 #include "ActionQueueTypes.hpp"
+#include "TieredEpgStore.hpp"
 
 namespace PvrClient {
 
 namespace chrono = std::chrono;
 using namespace std::chrono_literals;
 
+class ClientPhase;
+
 class ClientCoreBase : public IClientCore {
 public:
     explicit ClientCoreBase(RecordingsDelegate recordings_delegate = nullptr);
@@ -36,8 +42,25 @@ public:
 
     // EPG management
     bool GetEpgEntry(UniqueBroadcastIdType id, EpgEntry& entry) override;
-    void GetEpg(ChannelId channel_id, chrono::system_clock::time_point start, 
-               chrono::system_clock::time_point end, EpgEntryAction& on_epg_entry) override;
+    // Range query on the channel's interval index
+    void GetEpg(ChannelId channel_id, time_t start_time, time_t end_time, EpgEntryAction& on_epg_entry) override;
+
+    // Both walk a snapshot of EPG, updates are not blocked meanwhile
+    void ForEachEpgLocked(const EpgEntryAction& action) const override { m_epg.ForEach(action); }
+    void ForEachEpgUnlocked(const EpgEntryAction& predicate, const EpgEntryAction& action) const override {
+        m_epg.ForEach([&](const EpgEntryList::value_type& entry) { return !predicate(entry) || action(entry); });
+    }
+    void SetEpgChangedDelegate(EpgChangedDelegate delegate) override { m_epg_changed_delegate = std::move(delegate); }
+    void SetChannelsChangedDelegate(ChannelsChangedDelegate delegate) override { m_channels_changed_delegate = std::move(delegate); }
+    // Archive flags of EPG follow time: programmes become recordings when they end
+    // and leave the archive after its depth. Recordings delegate is called after the update.
+    void ReloadRecordings() override;
+    // Returns number of programmes in archive
+    int UpdateArchiveInfoAndCount() override;
+    void SetStreamStopToken(std::stop_token stop_token) override {
+        std::lock_guard lock(m_stream_stop_mutex);
+        m_stream_stop_token = std::move(stop_token);
+    }
 
     // RPC configuration
     void SetRpcSettings(RpcSettings settings) { m_rpc_settings = std::move(settings); }
@@ -58,11 +81,57 @@ protected:
                                         chrono::system_clock::time_point end,
                                         std::stop_token stop_token) = 0;
     virtual std::string GetUrl(ChannelId channel_id) = 0;
+    // Sets entry.HasArchive by the provider's archive rules
+    virtual void UpdateHasArchive(EpgEntry& entry) = 0;
 
     // Helper methods
+    // Binary cache (EpgCacheFile.hpp) is mapped, not parsed
     void LoadEpgCache(std::string_view cache_file);
     void SaveEpgCache(std::string_view cache_file, chrono::hours ttl = 7*24h);
+    // Programmes older than depth are expired from both EPG tiers
+    void SetEpgArchiveDepth(chrono::seconds depth) { m_epg.SetArchiveDepth(depth); }
+    // Merges freshly loaded EPG into the store, notifies about changed channels only.
+    // Within EpgRefresh updates go to its version and are reported when it ends.
+    void ApplyEpgUpdates(EpgStore::ChannelUpdates& updates);
+
+    // Scope of one EPG refresh on the loading thread. Feeds group programmes by channel:
+    // apply each channel's block as soon as the next one starts, the feed is never held at once.
+    class EpgRefresh {
+    public:
+        explicit EpgRefresh(ClientCoreBase& core) : m_core(core) { m_core.BeginEpgRefresh(); }
+        ~EpgRefresh() { m_core.EndEpgRefresh(); }
+        EpgRefresh(const EpgRefresh&) = delete;
+        EpgRefresh& operator=(const EpgRefresh&) = delete;
+    private:
+        ClientCoreBase& m_core;
+    };
     
+    // Channel list served from snapshot (ChannelListSnapshot.hpp) is checked on background thread,
+    // revalidate() returns true when the list has changed. Derived class stops it before destruction.
+    void RevalidateChannelsAsync(std::function<bool(std::stop_token)> revalidate) {
+        StopChannelsRevalidation();
+        m_channels_revalidation = std::jthread([this, revalidate = std::move(revalidate)](std::stop_token stop_token) {
+            try {
+                if(revalidate(stop_token) && !stop_token.stop_requested() && m_channels_changed_delegate)
+                    m_channels_changed_delegate();
+            } catch (std::exception& ex) {
+                kodi::Log(ADDON_LOG_ERROR, "ClientCoreBase: channels revalidation failed. Exception: %s", ex.what());
+            }
+        });
+    }
+    void StopChannelsRevalidation() {
+        if(!m_channels_revalidation.joinable())
+            return;
+        m_channels_revalidation.request_stop();
+        m_channels_revalidation.join();
+    }
+
+    // Token of the live stream being opened, pass it to requests of the stream
+    std::stop_token StreamStopToken() const {
+        std::lock_guard lock(m_stream_stop_mutex);
+        return m_stream_stop_token;
+    }
+
     void AddChannel(Channel channel);
     void AddGroup(GroupId group_id, Group group);
     void UpdateChannelLogo(Channel& channel) const;
@@ -75,6 +144,8 @@ private:
     };
 
     void InitializeComponents(bool clear_epg_cache);
+    void BeginEpgRefresh();
+    void EndEpgRefresh();
     void ScheduleEpgUpdate();
     void ProcessEpgEntries(std::span<const EpgEntry> entries);
 
@@ -86,10 +157,18 @@ private:
     GroupList m_groups;
     std::unordered_map<ChannelId, GroupId> m_channel_group_map;
     
-    std::unordered_map<UniqueBroadcastIdType, EpgEntry> m_epg_entries;
-    mutable std::shared_mutex m_epg_mutex;
+    // Hot window in memory, the rest in mapped cache file (attached by LoadEpgCache)
+    TieredEpgStore m_epg;
+    // Open EpgRefresh and channels changed by it, loading thread only
+    std::optional<TieredEpgStore::Update> m_epg_update;
+    std::vector<ChannelId> m_epg_update_changed;
     
     RecordingsDelegate m_recordings_delegate;
+    EpgChangedDelegate m_epg_changed_delegate;
+    ChannelsChangedDelegate m_channels_changed_delegate;
+    std::jthread m_channels_revalidation;
+    mutable std::mutex m_stream_stop_mutex;
+    std::stop_token m_stream_stop_token;
     RpcSettings m_rpc_settings;
     chrono::seconds m_epg_correction{0};
     
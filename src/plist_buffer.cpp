@@ -30,6 +30,7 @@
 #include "plist_buffer.h"
 #include "globals.hpp"
 #include "playlist_cache.hpp"
+#include "CurlMultiplexer.hpp"
 #include "kodi/addon-instance/Inputstream.h"
 #include "kodi/Filesystem.h"
 #include "kodi/General.h"
@@ -49,16 +50,16 @@ namespace Buffers {
         return s_numberOfHlsThreads = numOfThreads;
     }
 
-    PlaylistBuffer::PlaylistBuffer(const std::string &playListUrl, PlaylistBufferDelegate delegate, bool seekForVod)
+    PlaylistBuffer::PlaylistBuffer(const std::string &playListUrl, PlaylistBufferDelegate delegate, bool seekForVod, std::stop_token ownerStopToken)
     : m_delegate(delegate)
     , m_cache(nullptr)
     , m_url(playListUrl)
     , m_seekForVod(seekForVod)
     , m_isWaitingForRead(false)
-    , m_stopped(false)
     , m_position(0)
     , m_currentSegment(nullptr)
     , m_segmentIndexAfterSeek(0)
+    , m_ownerStopToken(ownerStopToken)
     {
         Init(playListUrl);
     }
@@ -72,7 +73,9 @@ namespace Buffers {
     
     void PlaylistBuffer::CreateThread()
     {
-        m_stopped = false;
+        m_onOwnerStop.reset();
+        m_stopSource = std::stop_source();
+        m_onOwnerStop.emplace(m_ownerStopToken, [this] { m_stopSource.request_stop(); });
         m_thread = std::thread(&PlaylistBuffer::Process, this);
     }
     
@@ -98,7 +101,44 @@ namespace Buffers {
         m_cache->WaitForBitrate();
     }
         
-    static bool FillSegmentFromPlaylist(MutableSegment* segment, const std::string& content, std::function<bool(const MutableSegment&)> IsCanceled)
+    static bool IsPlaylistContentType(const std::string& contentType)
+    {
+        return "application/vnd.apple.mpegurl" == contentType  || "audio/mpegurl" == contentType;
+    }
+
+    // Downloads url over connection shared with other segment loaders (HTTP/2 when possible).
+    // onChunk receives response content type with every chunk and returns false to cancel.
+    // Returns false when canceled, throws PlistBufferException on failure.
+    static bool DownloadMultiplexed(const std::string& url, std::stop_token stopToken,
+                                    const std::function<bool(const std::string&, const char*, size_t)>& onChunk,
+                                    const char* errorMessage)
+    {
+        CurlMultiplexer::Transfer transfer;
+        transfer.Url = url;
+        transfer.StopToken = stopToken;
+        CurlMultiplexer::Result result;
+        std::string contentType;
+        bool isCanceled = false;
+        bool isFirstChunk = true;
+        const bool succeeded = CurlMultiplexer::Instance().Perform(transfer, [&](const char* data, size_t size) {
+            if(isFirstChunk) {
+                // Content type is known before the first chunk
+                contentType = result.ContentType;
+                isFirstChunk = false;
+            }
+            isCanceled = !onChunk(contentType, data, size);
+            return !isCanceled;
+        }, result);
+        if(isCanceled || result.Cancelled)
+            return false;
+        if(!succeeded || result.HttpStatus >= 400) {
+            LogError("PlaylistBuffer: %s %s", url.c_str(), succeeded ? ("HTTP " + std::to_string(result.HttpStatus)).c_str() : result.Error.c_str());
+            throw PlistBufferException(errorMessage);
+        }
+        return true;
+    }
+
+    static bool FillSegmentFromPlaylist(MutableSegment* segment, const std::string& content, std::stop_token stopToken, std::function<bool(const MutableSegment&)> IsCanceled)
     {
         Playlist plist(content);
 
@@ -106,6 +146,19 @@ namespace Buffers {
         bool isCanceled = false;
         SegmentInfo info;
         while(plist.NextSegment(info, hasMoreSegments)) {
+            if((isCanceled = IsCanceled(*segment)))
+                break;
+            if(CurlMultiplexer::IsAvailable()) {
+                const bool completed = DownloadMultiplexed(info.url, stopToken, [&](const std::string&, const char* data, size_t size) {
+                    segment->Push(reinterpret_cast<const uint8_t*>(data), size);
+                    return !(isCanceled = IsCanceled(*segment));
+                }, "Failed to open media segment of sub-playlist.");
+                isCanceled = isCanceled || !completed;
+                if(!hasMoreSegments || isCanceled)
+                    break;
+                continue;
+            }
+            
             kodi::vfs::CFile f;
             if(!f.OpenFile(info.url, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED))
                 throw PlistBufferException("Failed to open media segment of sub-playlist.");
@@ -114,6 +167,10 @@ namespace Buffers {
             ssize_t bytesRead;
             do {
                 bytesRead = f.Read(buffer, sizeof(buffer));
+                if(stopToken.stop_requested()) {
+                    isCanceled = true;
+                    break;
+                }
                 segment->Push(buffer, bytesRead);
                 isCanceled = IsCanceled(*segment);
             }while (bytesRead > 0 && !isCanceled);
@@ -136,7 +193,7 @@ namespace Buffers {
          return true;
     }
 
-    static bool FillSegment(MutableSegment* segment, std::function<bool(const MutableSegment&)> IsCanceled, std::function<void(bool,MutableSegment*)> segmentDone)
+    static bool FillSegment(MutableSegment* segment, std::stop_token stopToken, std::function<bool(const MutableSegment&)> IsCanceled, std::function<void(bool,MutableSegment*)> segmentDone)
     {
         std::hash<std::thread::id> hasher;
         LogDebug("PlaylistBuffer: segment #%" PRIu64 " STARTED. (thread 0x%X).", segment->info.index, hasher(std::this_thread::get_id()));
@@ -149,31 +206,54 @@ namespace Buffers {
             if(isCanceled)
                 break;
             
-            kodi::vfs::CFile f;
-            if(!f.OpenFile(segment->info.url, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED | ADDON_READ_TRUNCATED))
-                throw PlistBufferException("Failed to download playlist media segment.");
+            bool contentIsPlaylist = false;
+            std::string contentForPlaylist;
+            
+            if(CurlMultiplexer::IsAvailable()) {
+                bool isFirstChunk = true;
+                const bool completed = DownloadMultiplexed(segment->info.url, stopToken, [&](const std::string& contentType, const char* data, size_t size) {
+                    if(isFirstChunk) {
+                        contentIsPlaylist = IsPlaylistContentType(contentType);
+                        isFirstChunk = false;
+                    }
+                    if(contentIsPlaylist) {
+                        contentForPlaylist.append(data, size);
+                    } else{
+                        segment->Push(reinterpret_cast<const uint8_t*>(data), size);
+                    }
+                    return !(isCanceled = IsCanceled(*segment));
+                }, "Failed to download playlist media segment.");
+                isCanceled = isCanceled || !completed;
+            } else {
+                kodi::vfs::CFile f;
+                if(!f.OpenFile(segment->info.url, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED | ADDON_READ_TRUNCATED))
+                    throw PlistBufferException("Failed to download playlist media segment.");
             
-            // Some content type should be treated as playlist
-            auto contentType = f.GetPropertyValue(ADDON_FILE_PROPERTY_CONTENT_TYPE, "");
-            const bool contentIsPlaylist =  "application/vnd.apple.mpegurl" == contentType  || "audio/mpegurl" == contentType;
+                // Some content type should be treated as playlist
+                contentIsPlaylist = IsPlaylistContentType(f.GetPropertyValue(ADDON_FILE_PROPERTY_CONTENT_TYPE, ""));
             
-            unsigned char buffer[8196];
-            std::string contentForPlaylist;
-            ssize_t bytesRead;
-            do {
-                bytesRead = f.Read(buffer, sizeof(buffer));
-                if(contentIsPlaylist) {
-                    contentForPlaylist.append((char *) buffer, bytesRead);
-                } else{
-                    segment->Push(buffer, bytesRead);
-                }
-                isCanceled = IsCanceled(*segment);
-            }while (bytesRead > 0 && !isCanceled);
+                unsigned char buffer[8196];
+                ssize_t bytesRead;
+                do {
+                    bytesRead = f.Read(buffer, sizeof(buffer));
+                    // Channel switch or stop: drop the transfer right away
+                    if(stopToken.stop_requested()) {
+                        isCanceled = true;
+                        break;
+                    }
+                    if(contentIsPlaylist) {
+                        contentForPlaylist.append((char *) buffer, bytesRead);
+                    } else{
+                        segment->Push(buffer, bytesRead);
+                    }
+                    isCanceled = IsCanceled(*segment);
+                }while (bytesRead > 0 && !isCanceled);
             
-            f.Close();
+                f.Close();
+            }
             
             if(contentIsPlaylist && !isCanceled) {
-                result = FillSegmentFromPlaylist(segment, contentForPlaylist, [&isCanceled, &IsCanceled](const MutableSegment& seg){
+                result = FillSegmentFromPlaylist(segment, contentForPlaylist, stopToken, [&isCanceled, &IsCanceled](const MutableSegment& seg){
                     return isCanceled = IsCanceled(seg);
                 });
             }
@@ -195,30 +275,21 @@ namespace Buffers {
     }
     
     bool PlaylistBuffer::IsStopped(uint32_t timeoutInSec) {
-        auto timeout = std::chrono::milliseconds(timeoutInSec * 1000);
-        auto start = std::chrono::steady_clock::now();
-        
-        do{
-            if (m_stopped) return true;
-            
-            auto elapsed = std::chrono::steady_clock::now() - start;
-            if (elapsed >= timeout) return m_stopped;
-            
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-        } while(true);
-        
-        return m_stopped;
+        // Wakes up immediately on stop request
+        std::mutex waitMutex;
+        std::unique_lock<std::mutex> lock(waitMutex);
+        m_stopEvent.wait_for(lock, m_stopSource.get_token(), std::chrono::seconds(timeoutInSec), [] { return false; });
+        return m_stopSource.stop_requested();
     }
     
     void PlaylistBuffer::Process()
     {
-        using namespace progschj;
-
-        ThreadPool pool(s_numberOfHlsThreads);
-        pool.set_queue_size_limit(s_numberOfHlsThreads);
+        modern::ThreadPool pool(s_numberOfHlsThreads);
+        pool.set_queue_limit(s_numberOfHlsThreads);
+        const std::stop_token stopToken = m_stopSource.get_token();
 
         try {
-            while (!m_stopped) {
+            while (!stopToken.stop_requested()) {
                 
                 bool cacheIsFull = false;
                 MutableSegment* segment = nullptr;
@@ -235,12 +306,12 @@ namespace Buffers {
                 }
 
                 const uint64_t segmentIndexAfterSeek = m_segmentIndexAfterSeek;
-                std::function<bool(const MutableSegment&)> isSegmentCanceled = [this, segmentIndexAfterSeek](const MutableSegment& seg) {
-                    return m_stopped || (m_segmentIndexAfterSeek != segmentIndexAfterSeek && seg.info.index != m_segmentIndexAfterSeek);
+                std::function<bool(const MutableSegment&)> isSegmentCanceled = [this, stopToken, segmentIndexAfterSeek](const MutableSegment& seg) {
+                    return stopToken.stop_requested() || (m_segmentIndexAfterSeek != segmentIndexAfterSeek && seg.info.index != m_segmentIndexAfterSeek);
                 };
 
                 // Wait for cache space if needed
-                while(cacheIsFull && !m_stopped){
+                while(cacheIsFull && !stopToken.stop_requested()){
                     {
                         std::lock_guard<std::mutex> lock(m_syncAccess);
                         cacheIsFull = !m_cache->HasSpaceForNewSegment(segmentIdx);
@@ -262,11 +333,11 @@ namespace Buffers {
                     }
                 };
                 
-                if(segment && !m_stopped) {
+                if(segment && !stopToken.stop_requested()) {
                     // Load segment data
                     auto startLoadingAt = std::chrono::system_clock::now();
-                    std::function<void(bool,MutableSegment*)> segmentDone = [this, startLoadingAt](bool segmentReady, MutableSegment* seg) {
-                        if(!m_stopped){
+                    std::function<void(bool,MutableSegment*)> segmentDone = [this, stopToken, startLoadingAt](bool segmentReady, MutableSegment* seg) {
+                        if(!stopToken.stop_requested()){
                             std::lock_guard<std::mutex> lock(m_syncAccess);
                             if(segmentReady) {
                                 m_cache->SegmentReady(seg);
@@ -280,13 +351,13 @@ namespace Buffers {
                         }
                     };
 
-                    pool.enqueue(FillSegment, segment, isSegmentCanceled, segmentDone);
+                    pool.enqueue(FillSegment, segment, stopToken, isSegmentCanceled, segmentDone);
                 } else {
                     IsStopped(1);
                 }
 
                 // Update playlist regularly
-                if(!m_stopped)
+                if(!stopToken.stop_requested())
                 {
                     std::lock_guard<std::mutex> lock(m_syncAccess);
                     if(!m_cache->ReloadPlaylist()) {
@@ -301,15 +372,14 @@ namespace Buffers {
         }
 
         LogDebug("PlaylistBuffer: finalizing loaders pool...");
-        pool.wait_until_empty();
-        pool.wait_until_nothing_in_flight();
+        pool.wait_idle();
 
         LogDebug("PlaylistBuffer: write thread is done.");
     }
     
     ssize_t PlaylistBuffer::Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs)
     {
-        if(m_stopped) {
+        if(m_stopSource.stop_requested()) {
             LogError("PlaylistBuffer: write thread is not running.");
             return -1;
         }
@@ -319,7 +389,7 @@ namespace Buffers {
         bool isEof = false;
         PlaylistCache::SegmentStatus segmentStatus;
         
-        while (totalBytesRead < bufferSize && !m_stopped)
+        while (totalBytesRead < bufferSize && !m_stopSource.stop_requested())
         {
             while(nullptr == m_currentSegment)
             {
@@ -336,7 +406,7 @@ namespace Buffers {
                     if(PlaylistCache::k_SegmentStatus_Loading == segmentStatus ||
                        PlaylistCache::k_SegmentStatus_CacheEmpty == segmentStatus)
                     {
-                        if(m_stopped){
+                        if(m_stopSource.stop_requested()){
                             LogDebug("PlaylistBuffer: stopping...");
                             break;
                         }
@@ -361,7 +431,7 @@ namespace Buffers {
                 }
             }
 
-            if(nullptr == m_currentSegment || m_stopped)
+            if(nullptr == m_currentSegment || m_stopSource.stop_requested())
             {
                 LogDebug("PlaylistBuffer: no segment for read.");
                 break;
@@ -383,7 +453,7 @@ namespace Buffers {
         }
         
         m_isWaitingForRead = false;
-        return (!isEof && !m_stopped) ? totalBytesRead : -1;
+        return (!isEof && !m_stopSource.stop_requested()) ? totalBytesRead : -1;
     }
     
     void PlaylistBuffer::AbortRead(){
@@ -475,7 +545,7 @@ namespace Buffers {
     bool PlaylistBuffer::StopThread(int iWaitMs)
     {
         LogDebug("PlaylistBuffer: terminating loading thread...");
-        m_stopped = true;
+        m_stopSource.request_stop();
         m_writeEvent.notify_all();
         
         if(m_thread.joinable()) {
@@ -30,6 +30,8 @@
 #include <mutex>
 #include <condition_variable>
 #include <functional>
+#include <stop_token>
+#include <optional>
 
 #include "kodi/addon-instance/Inputstream.h"
 #include "kodi/addon-instance/PVR.h"
@@ -45,7 +47,8 @@ namespace Buffers
     class PlaylistBuffer : public InputBuffer
     {
     public:
-        PlaylistBuffer(const std::string &streamUrl, PlaylistBufferDelegate delegate, bool seekForVod);
+        // Loading stops with ownerStopToken too (player leaves the channel), before the buffer is destroyed
+        PlaylistBuffer(const std::string &streamUrl, PlaylistBufferDelegate delegate, bool seekForVod, std::stop_token ownerStopToken = {});
         ~PlaylistBuffer();
         
         const std::string& GetUrl() const { return m_url; };
@@ -66,6 +69,7 @@ namespace Buffers
     private:
         mutable std::mutex m_syncAccess;
         mutable std::condition_variable m_writeEvent;
+        std::condition_variable_any m_stopEvent;
         PlaylistBufferDelegate m_delegate;
         int64_t m_position;
         PlaylistCache* m_cache;
@@ -75,7 +79,11 @@ namespace Buffers
         const bool m_seekForVod;
         static int s_numberOfHlsThreads;
         bool m_isWaitingForRead;
-        bool m_stopped;
+        // Stops loader thread and segment transfers in progress
+        std::stop_source m_stopSource;
+        std::stop_token m_ownerStopToken;
+        // Forwards owner's stop to m_stopSource, re-created with it
+        std::optional<std::stop_callback<std::function<void()>>> m_onOwnerStop;
         std::thread m_thread;
 
         void Process();
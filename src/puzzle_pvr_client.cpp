@@ -352,6 +352,13 @@ string PuzzlePVRClient::GetNextStreamUrl(ChannelId channelId)
     return m_puzzleTV->GetNextStream(channelId, m_currentChannelStreamIdx++);
 }
 
+string PuzzlePVRClient::GetPrebufferUrl(ChannelId channelId)
+{
+    if(m_puzzleTV == nullptr)
+        return string();
+    return m_puzzleTV->GetPrebufferUrl(channelId);
+}
+
 void PuzzlePVRClient::OnOpenStremFailed(ChannelId channelId, const std::string& streamUrl)
 {
     if(m_puzzleTV == nullptr || !m_blockDeadStreams)
@@ -54,6 +54,7 @@ protected:
     virtual void OnOpenStremFailed(PvrClient::ChannelId channelId, const std::string& streamUrl) override;
     std::string GetStreamUrl(PvrClient::ChannelId channelId) override;
     std::string GetNextStreamUrl(PvrClient::ChannelId channelId) override;
+    std::string GetPrebufferUrl(PvrClient::ChannelId channelId) override;
     ADDON_STATUS OnReloadEpg() override;
     
     ADDON_STATUS CreateCoreSafe(bool clearEpgCache) override;
@@ -36,8 +36,11 @@
 #include "puzzle_tv.h"
 #include "HttpEngine.hpp"
 #include "XMLTV_loader.hpp"
+#include "JsonSaxHandler.h"
+#include "ChannelNameIndex.hpp"
 #include "globals.hpp"
 #include "base64.h"
+#include "StreamHealth.hpp"
 
 using namespace Globals;
 using namespace std;
@@ -48,6 +51,12 @@ using namespace Helpers;
 
 static const int secondsPerHour = 60 * 60;
 static const char* c_EpgCacheFile = "puzzle_epg_cache.txt";
+// Puzzle server keeps archive for 3 days
+static const chrono::days c_ArchiveDepth(3);
+// Channels on each side of the current one (by number) with sources resolved in background
+static const int c_PrefetchNeighbours = 2;
+// Server may lock/unlock sources meanwhile
+static const chrono::seconds c_PrefetchedSourcesTtl(60);
 
 static void DumpStreams(const PuzzleTV::TPrioritizedSources& s)
 {
@@ -65,7 +74,7 @@ static void DumpStreams(const PuzzleTV::TPrioritizedSources& s)
 struct PuzzleTV::ApiFunctionData
 {
     ApiFunctionData(const char* _name, uint16_t _port, const ParamList* _params = nullptr)
-    : name(_name), port(_port), attempt(0)
+    : name(_name), port(_port)
     {
         if(_params){
             params = *_params;
@@ -75,7 +84,10 @@ struct PuzzleTV::ApiFunctionData
     const std::string name;
     const uint16_t port;
     ParamList params;
-    mutable int attempt;
+    // Cancels the call, e.g. stream request of the channel player has left
+    std::stop_token stopToken;
+    // Channel being opened goes ahead of queued background calls
+    HttpEngine::RequestPriority priority = HttpEngine::RequestPriority_Low;
 };
 
 static bool IsAceUrl(const std::string& url, std::string& aceServerUrlBase)
@@ -112,7 +124,8 @@ PuzzleTV::PuzzleTV(ServerVersion serverVersion, const char* serverUrl, uint16_t
     m_epgUrl("https://iptvx.one/epg/epg.xml.gz"),
     m_serverVersion(serverVersion),
     m_isAceRunning(false),
-    m_maxServerRetries(4)
+    m_maxServerRetries(4),
+    m_zapChannelId(UnknownChannelId)
 {
 }
 
@@ -122,6 +135,7 @@ void PuzzleTV::Init(bool clearEpgCache)
         ClearEpgCache(c_EpgCacheFile, m_epgUrl.c_str());
     
     RebuildChannelAndGroupList();
+    SetEpgArchiveDepth(c_ArchiveDepth);
     
     if(!clearEpgCache)
         LoadEpgCache(c_EpgCacheFile);
@@ -131,6 +145,20 @@ void PuzzleTV::Init(bool clearEpgCache)
 
 PuzzleTV::~PuzzleTV()
 {
+    // Running resolutions use HTTP engine and this, finish them first
+    std::vector<std::stop_source> running;
+    {
+        std::lock_guard<std::mutex> lock(m_prefetchMutex);
+        for(auto& prefetched : m_prefetchedSources)
+            running.push_back(prefetched.second.Stop);
+        m_prefetchedSources.clear();
+    }
+    for(auto& stop : running)
+        stop.request_stop();
+    {
+        std::unique_lock<std::mutex> lock(m_prefetchMutex);
+        m_prefetchDone.wait(lock, [this] { return m_prefetchesInFlight == 0; });
+    }
     Cleanup();
     PrepareForDestruction();
 }
@@ -214,11 +242,16 @@ void PuzzleTV::BuildChannelAndGroupList()
             m_epgToServerLut.clear();
             using namespace XMLTV;
             
+            // EPG has a few display names per channel, each is looked up
+            ChannelNameIndex<Channel*> channelsByName;
+            for(auto& channelWithGroup : plistContent)
+                channelsByName.Add(channelWithGroup.first, &channelWithGroup.second.first);
+
             auto pThis = this;
-            ChannelCallback onNewChannel = [&plistContent, pThis](const EpgChannel& newChannel){
+            ChannelCallback onNewChannel = [&channelsByName, pThis](const EpgChannel& newChannel){
                 for(const auto& epgChannelName : newChannel.displayNames) {
-                    if(plistContent.count(epgChannelName) != 0) {
-                        auto& plistChannel = plistContent[epgChannelName].first;
+                    if(auto found = channelsByName.Find(epgChannelName)) {
+                        auto& plistChannel = **found;
                         pThis->m_epgToServerLut[newChannel.id] = plistChannel.EpgId;
                         if(plistChannel.IconPath.empty())
                             plistChannel.IconPath = newChannel.strIcon;
@@ -259,22 +292,20 @@ void PuzzleTV::BuildChannelAndGroupList()
     }
 }
 
-PvrClient::UniqueBroadcastIdType PuzzleTV::AddXmlEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry)
+bool PuzzleTV::ConvertXmlEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry, EpgEntry& epgEntry)
 {
     if(m_epgToServerLut.count(xmlEpgEntry.EpgId) == 0) {
-        return c_UniqueBroadcastIdUnknown;
+        return false;
     }
     
-    unsigned int id = (unsigned int)xmlEpgEntry.startTime;
-
-    EpgEntry epgEntry;
     epgEntry.UniqueChannelId = m_epgToServerLut[xmlEpgEntry.EpgId];
     epgEntry.Title = xmlEpgEntry.strTitle;
     epgEntry.Description = xmlEpgEntry.strPlot;
     epgEntry.StartTime = xmlEpgEntry.startTime;
     epgEntry.EndTime = xmlEpgEntry.endTime;
     epgEntry.IconPath = xmlEpgEntry.iconPath;
-    return AddEpgEntry(id, epgEntry);
+    UpdateHasArchive(epgEntry);
+    return true;
 }
 
 void PuzzleTV::UpdateEpgForAllChannels(time_t startTime, time_t endTime, function<bool(void)> cancelled)
@@ -295,67 +326,175 @@ static bool time_compare(const EpgEntry& first, const EpgEntry& second)
     return first.StartTime < second.StartTime;
 }
 
+// SAX handler for Puzzle 2 server EPG:
+// { "<channel id>" : { "title" : "...", "<start time>" : { "title", "plot", "img" }, ... }, ... }
+class ServerEpgJsonHandler : public Json::ParserForBase<ServerEpgJsonHandler>
+{
+public:
+    typedef function<bool(EpgEntry&)> TOnEpgEntry;
+    
+    ServerEpgJsonHandler(long offset, TOnEpgEntry onEpgEntry)
+    : m_offset(offset)
+    , m_onEpgEntry(onEpgEntry)
+    {}
+    
+    bool StartObject() {
+        ++m_depth;
+        if(m_depth == 3) {
+            // Programme object
+            m_epgEntry = EpgEntry();
+            m_epgEntry.UniqueChannelId = m_channelId;
+            m_epgEntry.StartTime = (time_t)strtoul(m_key.c_str(), nullptr, 10) + m_offset;
+            m_hasTitle = m_hasPlot = m_hasImg = false;
+        }
+        return true;
+    }
+    
+    bool EndObject(SizeType) {
+        bool result = true;
+        if(m_depth == 3) {
+            if(m_hasTitle && m_hasPlot && m_hasImg)
+                m_channelEpg.push_back(m_epgEntry);
+        } else if(m_depth == 2) {
+            result = FlushChannel();
+        }
+        --m_depth;
+        return result;
+    }
+    
+    bool StartArray() {
+        if(m_depth == 0)
+            return error("wrong JSON format of EPG");
+        ++m_depth;
+        return true;
+    }
+    
+    bool EndArray(SizeType) {
+        --m_depth;
+        return true;
+    }
+    
+    bool Key(const char* str, SizeType length, bool) {
+        m_key.assign(str, length);
+        if(m_depth == 1) {
+            m_channelId = strtoul(m_key.c_str(), nullptr, 16);
+            m_isChannel = m_isEpgObject = false;
+            m_channelEpg.clear();
+        } else if(m_depth == 2) {
+            // Channel object has "title" and no "plot" fields
+            if(m_key == "title")
+                m_isChannel = true;
+            else if(m_key == "plot")
+                m_isEpgObject = true;
+        } else if(m_depth == 3) {
+            m_hasTitle |= m_key == "title";
+            m_hasPlot |= m_key == "plot";
+            m_hasImg |= m_key == "img";
+        }
+        return true;
+    }
+    
+    bool String(const char* str, SizeType length, bool) {
+        if(m_depth == 3) {
+            if(m_key == "title")
+                m_epgEntry.Title.assign(str, length);
+            else if(m_key == "plot")
+                m_epgEntry.Description.assign(str, length);
+        }
+        return true;
+    }
+    
+    bool Default() {
+        if(m_depth == 0)
+            return error("wrong JSON format of EPG");
+        return true;
+    }
+    
+private:
+    bool FlushChannel() {
+        if(!m_isChannel || m_isEpgObject)
+            return true;
+        // End time of programme is start of the next one
+        m_channelEpg.sort(time_compare);
+        auto runner = m_channelEpg.begin();
+        auto end = m_channelEpg.end();
+        if(runner != end){
+            auto pItem = runner++;
+            while(runner != end) {
+                pItem->EndTime = runner->StartTime;
+                if(!m_onEpgEntry(*pItem))
+                    return false;
+                ++runner;
+                ++pItem;
+            }
+        }
+        m_channelEpg.clear();
+        return true;
+    }
+    
+    const long m_offset;
+    TOnEpgEntry m_onEpgEntry;
+    int m_depth = 0;
+    string m_key;
+    ChannelId m_channelId = 0;
+    bool m_isChannel = false;
+    bool m_isEpgObject = false;
+    list<EpgEntry> m_channelEpg;
+    EpgEntry m_epgEntry;
+    bool m_hasTitle = false;
+    bool m_hasPlot = false;
+    bool m_hasImg = false;
+};
+
 void PuzzleTV::LoadEpg(function<bool(void)> cancelled)
 {
     auto pThis = this;
     m_epgUpdateInterval.Init(12*60*60*1000);
 
+    // Each channel is merged into the store when the feed moves to the next one,
+    // unchanged channels are neither touched nor reported to Kodi.
+    EpgRefresh refresh(*this);
+    EpgStore::ChannelUpdates updates;
     if(m_epgType == c_EpgType_File) {
-        XMLTV::EpgEntryCallback onEpgEntry = [pThis, cancelled](const XMLTV::EpgEntry& newEntry) {
-            pThis->AddXmlEpgEntry(newEntry);
+        KodiChannelId feedChannel = 0;
+        XMLTV::EpgEntryCallback onEpgEntry = [pThis, &updates, &feedChannel, cancelled](const XMLTV::EpgEntry& newEntry) {
+            if(newEntry.EpgId != feedChannel) {
+                pThis->ApplyEpgUpdates(updates);
+                feedChannel = newEntry.EpgId;
+            }
+            EpgEntry epgEntry;
+            if(pThis->ConvertXmlEpgEntry(newEntry, epgEntry))
+                updates.Add(epgEntry);
             return !cancelled();
         };
-        XMLTV::ParseEpg(m_epgUrl, onEpgEntry);
+        // Most of a public XMLTV feed is channels we don't have
+        XMLTV::ChannelFilter isMapped = [pThis](KodiChannelId epgId) {
+            return pThis->m_epgToServerLut.count(epgId) != 0;
+        };
+        XMLTV::ParseEpg(m_epgUrl, onEpgEntry, isMapped);
     } else if(m_serverVersion == c_PuzzleServer2) {
-        auto pThis = this;
         long offset = -(3 * 60 * 60) - XMLTV::LocalTimeOffset();
         
         ApiFunctionData apiParams("/channel/json/id=all", m_epgServerPort);
         try {
-            CallApiFunction(apiParams, [pThis, offset](Document& jsonRoot) {
-                if(!jsonRoot.IsObject()) {
-                    kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: wrong JSON format of EPG");
-                    return;
-                }
-                
-                for(auto i = jsonRoot.MemberBegin(); i != jsonRoot.MemberEnd(); ++i) {
-                    if(i->value.IsObject() && i->value.HasMember("title") && !i->value.HasMember("plot")) {
-                        auto channelIdStr = i->name.GetString();
-                        char* dummy;
-                        ChannelId channelId = strtoul(channelIdStr, &dummy, 16);
-                        
-                        list<EpgEntry> serverEpg;
-                        auto& epgObj = i->value;
-                        for(auto epgItem = epgObj.MemberBegin(); epgItem != epgObj.MemberEnd(); ++epgItem) {
-                            if(epgItem->value.IsObject() && epgItem->value.HasMember("plot") && 
-                               epgItem->value.HasMember("img") && epgItem->value.HasMember("title")) {
-                                EpgEntry epgEntry;
-                                epgEntry.UniqueChannelId = channelId;
-                                string s = epgItem->name.GetString();
-                                s = s.substr(0, s.find('.'));
-                                unsigned long l = stoul(s.c_str());
-                                epgEntry.StartTime = (time_t)l + offset;
-                                epgEntry.Title = epgItem->value["title"].GetString();
-                                epgEntry.Description = epgItem->value["plot"].GetString();
-                                serverEpg.push_back(epgEntry);
-                            }
-                        }
-                        
-                        serverEpg.sort(time_compare);
-                        auto runner = serverEpg.begin();
-                        auto end = serverEpg.end();
-                        if(runner != end){
-                            auto pItem = runner++;
-                            while(runner != end) {
-                                pItem->EndTime = runner->StartTime;
-                                pThis->AddEpgEntry(pItem->StartTime, *pItem);
-                                ++runner; 
-                                ++pItem;
-                            }
-                        }
-                    }
-                }
+            // EPG dump of all channels is huge. Parse it while downloading
+            // instead of building DOM of the whole response.
+            // Handler reports programmes channel by channel
+            ServerEpgJsonHandler handler(offset, [pThis, &updates, cancelled](EpgEntry& epgEntry) {
+                if(!updates.IsEmpty() && updates.Channels().count(epgEntry.UniqueChannelId) == 0)
+                    pThis->ApplyEpgUpdates(updates);
+                pThis->UpdateHasArchive(epgEntry);
+                updates.Add(epgEntry);
+                return !cancelled();
+            });
+            Json::StreamingJsonParser<ServerEpgJsonHandler> parser(handler);
+            CallApiStream(apiParams, [&parser](const char* data, size_t size) {
+                return parser.Push(data, size);
             });
+            string error;
+            if(!parser.Finish(&error) && !handler.HasError() && !cancelled()) {
+                kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: failed to parse JSON EPG: %s", error.c_str());
+            }
         } catch (exception& ex) {
             kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: exception on loading JSON EPG: %s", ex.what());
         } catch (...) {
@@ -364,6 +503,9 @@ void PuzzleTV::LoadEpg(function<bool(void)> cancelled)
     } else {
         kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: unknown EPG source type %d", m_epgType);
     }
+    // Block of the cancelled channel may be incomplete
+    if(!cancelled())
+        ApplyEpgUpdates(updates);
 }
 
 bool PuzzleTV::CheckChannelId(ChannelId channelId)
@@ -404,7 +546,7 @@ void PuzzleTV::UpdateHasArchive(PvrClient::EpgEntry& entry)
             break;
     }
     
-    const time_t archivePeriod = 3 * 24 * 60 * 60;
+    const time_t archivePeriod = chrono::seconds(c_ArchiveDepth).count();
     time_t from = now - archivePeriod;
     entry.HasArchive = epgTime > from && epgTime < now;
 }
@@ -580,24 +722,15 @@ string PuzzleTV::GetUrl(ChannelId channelId)
     }
     
     if(m_channelList.at(channelId).Urls.empty()){
-        UpdateChannelSources(channelId);
+        LoadChannelSources(channelId);
     }
     
-    string url;
-    auto sources = GetSourcesForChannel(channelId);
-    
-    while (!sources.empty()) {
-        const auto& streams = sources.top()->second.Streams;
-        auto goodStream = find_if(streams.begin(), streams.end(), [](PuzzleSource::TStreamsQuality::const_reference stream) {
-            return stream.second;
-        });
-        
-        if(goodStream != streams.end()) {
-            url = goodStream->first;
-            break;
-        }
-        sources.pop();
-    }
+    // Streams are ordered once per zap, failures of this zap must not reshuffle them
+    m_zapStreams = GetStreamCandidates(channelId);
+    m_zapChannelId = channelId;
+    // API calls run one at a time, neighbours must not delay the channel being opened
+    PrefetchNeighbours(channelId);
+    string url = m_zapStreams.empty() ? string() : m_zapStreams.front();
     
     if(url.empty()) {
         kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: No available streams for channel");
@@ -621,33 +754,82 @@ string PuzzleTV::GetNextStream(ChannelId channelId, int currentStreamIdx)
         return string();
 
     string url;
-    auto sources = GetSourcesForChannel(channelId);
     bool isFound = false;
     int goodStreamsIdx = -1;
     
-    while (!isFound && !sources.empty()) {
-        const auto& streams = sources.top()->second.Streams;
-        auto goodStream = find_if(streams.begin(), streams.end(), [](PuzzleSource::TStreamsQuality::const_reference stream) {
-            return stream.second;
-        });
+    if(m_zapChannelId != channelId) {
+        m_zapStreams = GetStreamCandidates(channelId);
+        m_zapChannelId = channelId;
+    }
+    for(const auto& candidate : m_zapStreams) {
+        if(!IsGoodStream(channelId, candidate))
+            continue;
+        url = candidate;
+        ++goodStreamsIdx;
         
-        if(goodStream != streams.end()) {
-            url = goodStream->first;
-            ++goodStreamsIdx;
-            
-            string aceServerUrlBase;
-            if(!IsAceUrl(url, aceServerUrlBase)){
-                isFound = goodStreamsIdx > currentStreamIdx;
-            } else if(CheckAceEngineRunning(aceServerUrlBase.c_str())) {
-                isFound = goodStreamsIdx > currentStreamIdx;
-            }
+        string aceServerUrlBase;
+        if(!IsAceUrl(url, aceServerUrlBase)){
+            isFound = goodStreamsIdx > currentStreamIdx;
+        } else if(CheckAceEngineRunning(aceServerUrlBase.c_str())) {
+            isFound = goodStreamsIdx > currentStreamIdx;
         }
-        sources.pop();
+        if(isFound)
+            break;
     }
     
     return isFound ? url : string();
 }
 
+string PuzzleTV::GetPrebufferUrl(ChannelId channelId)
+{
+    if(!CheckChannelId(channelId))
+        return string();
+    
+    // Sources prefetched by GetUrl() of the live channel, never wait for them
+    if(m_serverVersion == c_PuzzleServer3 && m_sources.count(channelId) == 0) {
+        if(!IsPrefetchedSourcesReady(channelId))
+            return string();
+        LoadChannelSources(channelId);
+    }
+    
+    const auto candidates = GetStreamCandidates(channelId);
+    if(candidates.empty())
+        return string();
+    // Ace Engine plays one stream at a time
+    string aceServerUrlBase;
+    return IsAceUrl(candidates.front(), aceServerUrlBase) ? string() : candidates.front();
+}
+
+std::vector<std::string> PuzzleTV::GetStreamCandidates(ChannelId channelId)
+{
+    // Good streams of all sources in server's priority order...
+    std::vector<std::string> candidates;
+    auto sources = GetSourcesForChannel(channelId);
+    while (!sources.empty()) {
+        for(const auto& stream : sources.top()->second.Streams) {
+            if(stream.second)
+                candidates.push_back(stream.first);
+        }
+        sources.pop();
+    }
+    // ...then the fastest to start first, unknown streams keep the priority
+    StreamHealth::Instance().Order(candidates);
+    return candidates;
+}
+
+bool PuzzleTV::IsGoodStream(ChannelId channelId, const std::string& streamUrl) const
+{
+    auto sources = m_sources.find(channelId);
+    if(sources == m_sources.end())
+        return false;
+    for(const auto& source : sources->second) {
+        auto stream = source.second.Streams.find(streamUrl);
+        if(stream != source.second.Streams.end())
+            return stream->second;
+    }
+    return false;
+}
+
 void PuzzleTV::OnOpenStremFailed(ChannelId channelId, const std::string& streamUrl)
 {
     TChannelSources& sources = m_sources[channelId];
@@ -663,15 +845,78 @@ void PuzzleTV::OnOpenStremFailed(ChannelId channelId, const std::string& streamU
     }
 }
 
-void PuzzleTV::UpdateUrlsForChannel(PvrClient::ChannelId channelId)
+// Parsers of /cache_url/<id>/json and /streams/json_ds/<id> (Puzzle 3)
+static void ParseChannelSources(Document& jsonRoot, PuzzleTV::TChannelSources& sources)
 {
-    if(!CheckChannelId(channelId))
+    if(!jsonRoot.IsArray())
         return;
- 
-    Channel ch = m_channelList.at(channelId);
-    auto& urls = ch.Urls;
-    urls.clear();
-    
+        
+    for(auto i = jsonRoot.Begin(); i != jsonRoot.End(); ++i)
+    {
+        if(!i->HasMember("url")) {
+            continue;
+        }
+        
+        PuzzleTV::TCacheUrl cacheUrl = (*i)["url"].GetString();
+        PuzzleTV::PuzzleSource& source = sources[cacheUrl];
+
+        if(i->HasMember("serv")) {
+            source.Server = (*i)["serv"].GetString();
+        } else {
+            source.Server = cacheUrl.find("acesearch") != string::npos ? "ASE" : "HTTP";
+        }
+        
+        if(i->HasMember("lock")) {
+            source.IsChannelLocked = (*i)["lock"].GetBool();
+        }
+        
+        if(i->HasMember("serv_on")) {
+            source.IsServerOn = (*i)["serv_on"].GetBool();
+        }
+        
+        if(i->HasMember("priority")) {
+            auto s = (*i)["priority"].GetString();
+            if(strlen(s) > 0) {
+                source.Priority = atoi(s);
+            }
+        }
+        
+        if(i->HasMember("id")) {
+            auto s = (*i)["id"].GetString();
+            if(strlen(s) > 0) {
+                source.Id = atoi(s);
+            }
+        }
+    }
+}
+
+template <typename TTranslateUrl>
+static void ParseChannelStreams(Document& jsonRoot, PuzzleTV::TChannelSources& cacheSources, Channel::UrlList& urls, TTranslateUrl translateUrl)
+{
+    if(!jsonRoot.IsArray())
+        return;
+
+    for(auto s = jsonRoot.Begin(); s != jsonRoot.End(); ++s)
+    {
+        if(!s->HasMember("cache") || !s->HasMember("streams")) {
+            throw MissingApiException("Missing required fields in JSON response");
+        }
+        
+        auto cacheUrl = (*s)["cache"].GetString();
+        PuzzleTV::PuzzleSource& source = cacheSources[cacheUrl];
+
+        auto streams = (*s)["streams"].GetArray();
+        for(auto st = streams.Begin(); st != streams.End(); ++st){
+            auto url = translateUrl(st->GetString());
+            urls.push_back(url);
+            source.Streams[url] = true;
+        }
+    }
+}
+
+bool PuzzleTV::FetchChannelStreams(PvrClient::ChannelId channelId, TChannelSources& cacheSources, Channel::UrlList& urls, std::stop_token stopToken,
+                                   HttpEngine::RequestPriority priority)
+{
     try {
         auto pThis = this;
         const string strId = ToPuzzleChannelId(channelId);
@@ -679,6 +924,8 @@ void PuzzleTV::UpdateUrlsForChannel(PvrClient::ChannelId channelId)
         if(m_serverVersion == c_PuzzleServer2){
             string cmd = string("/get/streams/") + strId;
             ApiFunctionData apiParams(cmd.c_str(), m_serverPort);
+            apiParams.stopToken = stopToken;
+            apiParams.priority = priority;
             CallApiFunction(apiParams, [&urls, pThis](Document& jsonRoot)
             {
                 if(!jsonRoot.IsArray())
@@ -691,35 +938,19 @@ void PuzzleTV::UpdateUrlsForChannel(PvrClient::ChannelId channelId)
                 }
             });
         } else {
-            auto& cacheSources = m_sources[channelId];
             string cmd = string("/streams/json_ds/") + strId;
             ApiFunctionData apiParams(cmd.c_str(), m_serverPort);
+            apiParams.stopToken = stopToken;
+            apiParams.priority = priority;
             
             CallApiFunction(apiParams, [&urls, &cacheSources, pThis](Document& jsonRoot)
             {
-                if(!jsonRoot.IsArray())
-                    return;
-
-                for(auto s = jsonRoot.Begin(); s != jsonRoot.End(); ++s)
-                {
-                    if(!s->HasMember("cache") || !s->HasMember("streams")) {
-                        throw MissingApiException("Missing required fields in JSON response");
-                    }
-                    
-                    auto cacheUrl = (*s)["cache"].GetString();
-                    PuzzleSource& source = cacheSources[cacheUrl];
-
-                    auto streams = (*s)["streams"].GetArray();
-                    for(auto st = streams.Begin(); st != streams.End(); ++st){
-                        auto url = pThis->TranslateMultucastUrl(st->GetString());
-                        urls.push_back(url);
-                        source.Streams[url] = true;
-                    }
-                }
+                ParseChannelStreams(jsonRoot, cacheSources, urls, [pThis](const char* url) {
+                    return pThis->TranslateMultucastUrl(url);
+                });
             });
         }
-        
-        AddChannel(ch);
+        return true;
     } catch (ServerErrorException& ex) {
         kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: Server error: %s", ex.reason.c_str());
     } catch (MissingApiException& ex){
@@ -729,60 +960,21 @@ void PuzzleTV::UpdateUrlsForChannel(PvrClient::ChannelId channelId)
     } catch (...) {
         kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: FAILED to get URL for channel ID=%d", channelId);
     }
+    return false;
 }
 
-void PuzzleTV::UpdateChannelSources(ChannelId channelId)
+void PuzzleTV::FetchChannelSources(ChannelId channelId, TChannelSources& sources, std::stop_token stopToken,
+                                   HttpEngine::RequestPriority priority)
 {
-    if(m_serverVersion == c_PuzzleServer2 || !CheckChannelId(channelId))
-        return;
-    
-    TChannelSources sources;
     try {
         string cmd = string("/cache_url/") + ToPuzzleChannelId(channelId) + "/json";
         ApiFunctionData apiParams(cmd.c_str(), m_serverPort);
+        apiParams.stopToken = stopToken;
+        apiParams.priority = priority;
         
         CallApiFunction(apiParams, [&sources](Document& jsonRoot)
         {
-            if(!jsonRoot.IsArray())
-                return;
-                
-            for(auto i = jsonRoot.Begin(); i != jsonRoot.End(); ++i)
-            {
-                if(!i->HasMember("url")) {
-                    continue;
-                }
-                
-                TCacheUrl cacheUrl = (*i)["url"].GetString();
-                PuzzleSource& source = sources[cacheUrl];
-
-                if(i->HasMember("serv")) {
-                    source.Server = (*i)["serv"].GetString();
-                } else {
-                    source.Server = cacheUrl.find("acesearch") != string::npos ? "ASE" : "HTTP";
-                }
-                
-                if(i->HasMember("lock")) {
-                    source.IsChannelLocked = (*i)["lock"].GetBool();
-                }
-                
-                if(i->HasMember("serv_on")) {
-                    source.IsServerOn = (*i)["serv_on"].GetBool();
-                }
-                
-                if(i->HasMember("priority")) {
-                    auto s = (*i)["priority"].GetString();
-                    if(strlen(s) > 0) {
-                        source.Priority = atoi(s);
-                    }
-                }
-                
-                if(i->HasMember("id")) {
-                    auto s = (*i)["id"].GetString();
-                    if(strlen(s) > 0) {
-                        source.Id = atoi(s);
-                    }
-                }
-            }
+            ParseChannelSources(jsonRoot, sources);
         });
     } catch (ServerErrorException& ex) {
         kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: Server error: %s", ex.reason.c_str());
@@ -791,26 +983,241 @@ void PuzzleTV::UpdateChannelSources(ChannelId channelId)
     } catch (...) {
         kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: FAILED to get sources list for channel ID=%d", channelId);
     }
+}
+
+PuzzleTV::ResolvedSources PuzzleTV::ResolveSources(ChannelId channelId, std::stop_token stopToken, HttpEngine::RequestPriority priority)
+{
+    ResolvedSources resolved;
+    FetchChannelSources(channelId, resolved.Sources, stopToken, priority);
+    if(!stopToken.stop_requested())
+        resolved.HasUrls = FetchChannelStreams(channelId, resolved.Sources, resolved.Urls, stopToken, priority);
+    // Cancelled call completes without response
+    resolved.IsCancelled = stopToken.stop_requested();
+    return resolved;
+}
+
+void PuzzleTV::ResolveSourcesAsync(ChannelId channelId, std::stop_token stopToken, std::function<void(ResolvedSources&)> completion)
+{
+    auto pThis = this;
+    auto resolved = std::make_shared<ResolvedSources>();
+    const string strId = ToPuzzleChannelId(channelId);
+    ApiFunctionData sourcesCall((string("/cache_url/") + strId + "/json").c_str(), m_serverPort);
+    sourcesCall.stopToken = stopToken;
+    
+    CallApiAsync(sourcesCall, [resolved](Document& jsonRoot) {
+        ParseChannelSources(jsonRoot, resolved->Sources);
+    }, [pThis, channelId, strId, stopToken, resolved, completion](const ActionQueue::ActionResult& s) {
+        if(s.status == ActionQueue::ActionStatus::Failed)
+            kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: FAILED to prefetch sources list for channel ID=%d", channelId);
+        if(stopToken.stop_requested()) {
+            resolved->IsCancelled = true;
+            completion(*resolved);
+            return;
+        }
+        ApiFunctionData streamsCall((string("/streams/json_ds/") + strId).c_str(), pThis->m_serverPort);
+        streamsCall.stopToken = stopToken;
+        try {
+            pThis->CallApiAsync(streamsCall, [pThis, resolved](Document& jsonRoot) {
+                ParseChannelStreams(jsonRoot, resolved->Sources, resolved->Urls, [pThis](const char* url) {
+                    return pThis->TranslateMultucastUrl(url);
+                });
+            }, [stopToken, resolved, completion](const ActionQueue::ActionResult& s) {
+                resolved->HasUrls = s.status == ActionQueue::ActionStatus::Completed;
+                resolved->IsCancelled = stopToken.stop_requested();
+                completion(*resolved);
+            });
+        } catch (exception& ex) {
+            kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: FAILED to prefetch streams of channel ID=%d. Exception: %s", channelId, ex.what());
+            completion(*resolved);
+        }
+    });
+}
+
+void PuzzleTV::ApplySources(ChannelId channelId, ResolvedSources& resolved)
+{
+    // Sources are resolved again on next request
+    if(resolved.IsCancelled)
+        return;
+    m_sources[channelId] = std::move(resolved.Sources);
+    if(!resolved.HasUrls)
+        return;
+    
+    Channel ch = m_channelList.at(channelId);
+    ch.Urls = std::move(resolved.Urls);
+    AddChannel(ch);
+}
+
+void PuzzleTV::UpdateChannelSources(ChannelId channelId)
+{
+    if(m_serverVersion == c_PuzzleServer2 || !CheckChannelId(channelId))
+        return;
+    
+    // Prefetched sources may be older than the change we are asked for
+    DiscardPrefetchedSources(channelId);
+    ResolvedSources resolved = ResolveSources(channelId);
+    ApplySources(channelId, resolved);
+}
 
-    m_sources[channelId] = sources;
-    UpdateUrlsForChannel(channelId);
+void PuzzleTV::LoadChannelSources(ChannelId channelId)
+{
+    if(m_serverVersion == c_PuzzleServer2 || !CheckChannelId(channelId))
+        return;
+    
+    ResolvedSources resolved;
+    if(!TakePrefetchedSources(channelId, resolved))
+        resolved = ResolveSources(channelId, StreamStopToken(), HttpEngine::RequestPriority_Hi);
+    ApplySources(channelId, resolved);
 }
 
 PuzzleTV::TPrioritizedSources PuzzleTV::GetSourcesForChannel(ChannelId channelId)
 {
     if(m_sources.count(channelId) == 0) {
-        UpdateChannelSources(channelId);
+        LoadChannelSources(channelId);
     }
     
     TPrioritizedSources result;
-    const auto& sources = m_sources[channelId];
+    // Loading may be cancelled by channel switch
+    const auto sources = m_sources.find(channelId);
+    if(sources == m_sources.end())
+        return result;
 
-    for (const auto& source : sources) {
+    for (const auto& source : sources->second) {
         result.push(&source);
     }
     return result;
 }
 
+#pragma mark - Sources prefetch
+
+void PuzzleTV::PrefetchNeighbours(ChannelId channelId)
+{
+    if(m_serverVersion != c_PuzzleServer3)
+        return;
+    
+    if(m_channelsByNumber.size() != m_channelList.size()) {
+        m_channelsByNumber.clear();
+        for(const auto& channel : m_channelList)
+            m_channelsByNumber.push_back(channel.first);
+        sort(m_channelsByNumber.begin(), m_channelsByNumber.end(), [this](ChannelId left, ChannelId right) {
+            const auto leftNumber = m_channelList.at(left).Number;
+            const auto rightNumber = m_channelList.at(right).Number;
+            return leftNumber < rightNumber || (leftNumber == rightNumber && left < right);
+        });
+    }
+    const auto current = find(m_channelsByNumber.begin(), m_channelsByNumber.end(), channelId);
+    if(current == m_channelsByNumber.end())
+        return;
+    
+    const auto now = chrono::steady_clock::now();
+    const ptrdiff_t position = current - m_channelsByNumber.begin();
+    const ptrdiff_t size = m_channelsByNumber.size();
+    // Nearest first: +1, -1, +2, -2...
+    vector<ChannelId> window;
+    for(int distance = 1; distance <= c_PrefetchNeighbours; ++distance) {
+        for(const ptrdiff_t neighbour : {position + distance, position - distance}) {
+            if(neighbour >= 0 && neighbour < size)
+                window.push_back(m_channelsByNumber[neighbour]);
+        }
+    }
+    
+    vector<std::stop_source> outdated;
+    {
+        std::lock_guard<std::mutex> lock(m_prefetchMutex);
+        // Channels left the window, results nobody has taken are outdated by now.
+        // Resolutions still in the window go on, quick zapping doesn't throw them away.
+        for(auto it = m_prefetchedSources.begin(); it != m_prefetchedSources.end();) {
+            const bool isInWindow = find(window.begin(), window.end(), it->first) != window.end();
+            if(!isInWindow || now - it->second.RequestedAt > c_PrefetchedSourcesTtl) {
+                outdated.push_back(it->second.Stop);
+                it = m_prefetchedSources.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for(const ChannelId id : window) {
+            if(m_sources.count(id) != 0 || m_prefetchedSources.count(id) != 0)
+                continue;
+            PrefetchedSources& prefetched = m_prefetchedSources[id];
+            prefetched.RequestedAt = now;
+            auto result = std::make_shared<std::promise<ResolvedSources>>();
+            prefetched.Result = result->get_future().share();
+            try {
+                // Completion never runs from here, the lock is safe
+                ResolveSourcesAsync(id, prefetched.Stop.get_token(), [this, result](ResolvedSources& resolved) {
+                    result->set_value(std::move(resolved));
+                    std::lock_guard<std::mutex> lock(m_prefetchMutex);
+                    --m_prefetchesInFlight;
+                    m_prefetchDone.notify_all();
+                });
+                ++m_prefetchesInFlight;
+            } catch (std::exception& ex) {
+                m_prefetchedSources.erase(id);
+                kodi::Log(ADDON_LOG_ERROR, "PuzzleTV: failed to schedule sources prefetch. Exception: %s", ex.what());
+                break;
+            }
+        }
+    }
+    // Cancelled call completes right here, it takes m_prefetchMutex
+    for(auto& stop : outdated)
+        stop.request_stop();
+}
+
+bool PuzzleTV::TakePrefetchedSources(ChannelId channelId, ResolvedSources& resolved)
+{
+    std::shared_future<ResolvedSources> result;
+    std::stop_source unfinished(std::nostopstate);
+    {
+        std::lock_guard<std::mutex> lock(m_prefetchMutex);
+        auto it = m_prefetchedSources.find(channelId);
+        if(it == m_prefetchedSources.end())
+            return false;
+        const bool isFresh = chrono::steady_clock::now() - it->second.RequestedAt <= c_PrefetchedSourcesTtl;
+        const bool isReady = it->second.Result.wait_for(chrono::seconds(0)) == std::future_status::ready;
+        result = it->second.Result;
+        if(!isReady)
+            unfinished = it->second.Stop;
+        m_prefetchedSources.erase(it);
+        if(isReady && !isFresh)
+            return false;
+    }
+    // Unfinished one may wait behind other low priority calls,
+    // resolution of its own goes ahead of them
+    if(unfinished.stop_possible()) {
+        unfinished.request_stop();
+        return false;
+    }
+    try {
+        resolved = result.get();
+        return !resolved.IsCancelled;
+    } catch (std::future_error&) {
+        // Completion was dropped by stopping HTTP engine
+        return false;
+    }
+}
+
+bool PuzzleTV::IsPrefetchedSourcesReady(ChannelId channelId)
+{
+    std::lock_guard<std::mutex> lock(m_prefetchMutex);
+    auto it = m_prefetchedSources.find(channelId);
+    return it != m_prefetchedSources.end()
+        && chrono::steady_clock::now() - it->second.RequestedAt <= c_PrefetchedSourcesTtl
+        && it->second.Result.wait_for(chrono::seconds(0)) == std::future_status::ready;
+}
+
+void PuzzleTV::DiscardPrefetchedSources(ChannelId channelId)
+{
+    std::stop_source stop(std::nostopstate);
+    {
+        std::lock_guard<std::mutex> lock(m_prefetchMutex);
+        auto it = m_prefetchedSources.find(channelId);
+        if(it == m_prefetchedSources.end())
+            return;
+        stop = it->second.Stop;
+        m_prefetchedSources.erase(it);
+    }
+    stop.request_stop();
+}
+
 void PuzzleTV::EnableSource(PvrClient::ChannelId channelId, const TCacheUrl& cacheUrl)
 {
     if(m_sources.count(channelId) == 0)
@@ -873,7 +1280,10 @@ void PuzzleTV::CallApiFunction(const ApiFunctionData& data, TParser parser)
     bool completed = false;
     std::exception_ptr ex = nullptr;
     
-    CallApiAsync(data, parser, [&ex, &completed, &event](const ActionQueue::ActionResult& s) {
+    // Transport errors are retried by HttpEngine asynchronously (see ApiRequest()),
+    // completion comes after the last attempt.
+    CallApiAsync(data, parser, [&ex, &completed, &event, &eventMutex](const ActionQueue::ActionResult& s) {
+        std::lock_guard<std::mutex> lock(eventMutex);
         ex = s.exception;
         completed = true;
         event.notify_all();
@@ -888,19 +1298,11 @@ void PuzzleTV::CallApiFunction(const ApiFunctionData& data, TParser parser)
         } catch (JsonParserException& jex) {
             kodi::Log(ADDON_LOG_ERROR, "Puzzle server JSON error: %s", jex.what());
             throw;
-        } catch (CurlErrorException& cex) {
-            if(data.attempt >= m_maxServerRetries - 1)
-                throw cex;
-                
-            data.attempt += 1;
-            this_thread::sleep_for(chrono::seconds(4));
-            CallApiFunction(data, parser);
         }
     }
 }
 
-template <typename TParser, typename TCompletion>
-void PuzzleTV::CallApiAsync(const ApiFunctionData& data, TParser parser, TCompletion completion)
+string PuzzleTV::ApiUrl(const ApiFunctionData& data) const
 {
     string query;
     auto runner = data.params.begin();
@@ -916,12 +1318,50 @@ void PuzzleTV::CallApiAsync(const ApiFunctionData& data, TParser parser, TComple
     string strRequest = string("http://") + m_serverUri + ":";
     strRequest += n_to_string(data.port);
     strRequest += data.name + query;
+    return strRequest;
+}
+
+HttpEngine::Request PuzzleTV::ApiRequest(const std::string& url, std::stop_token stopToken) const
+{
+    HttpEngine::Request request(url);
+    request.StopToken = stopToken;
+    // Puzzle server may be briefly unavailable (e.g. restarting).
+    // Retry with backoff instead of failing whole initialization.
+    request.Retry = RetryPolicy::Exponential(m_maxServerRetries);
+    return request;
+}
 
-    CallApiAsync(strRequest, data.name, parser, completion);
+template <typename TParser, typename TCompletion>
+void PuzzleTV::CallApiAsync(const ApiFunctionData& data, TParser parser, TCompletion completion)
+{
+    CallApiAsync(ApiUrl(data), data.name, parser, completion, data.stopToken, data.priority);
+}
+
+void PuzzleTV::CallApiStream(const ApiFunctionData& data, std::function<bool(const char*, size_t)> onChunk)
+{
+    std::mutex eventMutex;
+    std::condition_variable event;
+    bool completed = false;
+    std::exception_ptr ex = nullptr;
+    
+    m_httpEngine->CallApiStreamAsync(ApiRequest(ApiUrl(data), data.stopToken), onChunk,
+                                     [&ex, &completed, &event, &eventMutex](const ActionQueue::ActionResult& s) {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        ex = s.exception;
+        completed = true;
+        event.notify_all();
+    });
+    
+    std::unique_lock<std::mutex> lock(eventMutex);
+    event.wait(lock, [&completed] { return completed; });
+    
+    if(ex)
+        std::rethrow_exception(ex);
 }
 
 template <typename TParser, typename TCompletion>
-void PuzzleTV::CallApiAsync(const std::string& strRequest, const std::string& name, TParser parser, TCompletion completion)
+void PuzzleTV::CallApiAsync(const std::string& strRequest, const std::string& name, TParser parser, TCompletion completion,
+                            std::stop_token stopToken, HttpEngine::RequestPriority priority)
 {
     auto start = chrono::steady_clock::now();
 
@@ -936,7 +1376,7 @@ void PuzzleTV::CallApiAsync(const std::string& strRequest, const std::string& na
         });
     };
 
-    m_httpEngine->CallApiAsync(strRequest, parserWrapper, completion);
+    m_httpEngine->CallApiAsync(ApiRequest(strRequest, stopToken), parserWrapper, completion, priority);
 }
 
 bool PuzzleTV::CheckAceEngineRunning(const char* aceServerUrlBase)
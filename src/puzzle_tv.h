@@ -28,6 +28,7 @@
 #define __puzzle_tv_h__
 
 #include "client_core_base.hpp"
+#include "HttpEngine.hpp"
 #include <string>
 #include <map>
 #include <queue>
@@ -36,6 +37,10 @@
 #include <list>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <future>
+#include <stop_token>
+#include <chrono>
 
 namespace XMLTV {
     struct EpgEntry;
@@ -118,6 +123,9 @@ namespace PuzzleEngine
 
         std::string GetUrl(PvrClient::ChannelId channelId);
         std::string GetNextStream(PvrClient::ChannelId channelId, int currentStreamIdx);
+        // Stream GetUrl() would return, without network calls and zap state change.
+        // Empty when sources are not resolved yet or stream is served by Ace Engine.
+        std::string GetPrebufferUrl(PvrClient::ChannelId channelId);
         void OnOpenStremFailed(PvrClient::ChannelId channelId, const std::string& streamUrl);
 
         void SetMaxServerRetries(int maxServerRetries) { m_maxServerRetries = maxServerRetries; }
@@ -149,13 +157,55 @@ namespace PuzzleEngine
         typedef std::map<PvrClient::ChannelId, TChannelSources> TChannelSourcesMap;
 
         struct ApiFunctionData;
-        PvrClient::UniqueBroadcastIdType AddXmlEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry);
+        // Sources of a channel as the server reports them
+        struct ResolvedSources
+        {
+            TChannelSources Sources;
+            PvrClient::Channel::UrlList Urls;
+            // False when stream list request has failed, channel URLs are kept
+            bool HasUrls = false;
+            // Stopped by channel switch, results are incomplete and not applied
+            bool IsCancelled = false;
+        };
+        struct PrefetchedSources
+        {
+            std::shared_future<ResolvedSources> Result;
+            std::chrono::steady_clock::time_point RequestedAt;
+            // Own one: zapping doesn't cancel it, leaving the window around the live channel does
+            std::stop_source Stop;
+        };
+        bool ConvertXmlEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry, PvrClient::EpgEntry& epgEntry);
         void LoadEpg(std::function<bool(void)> cancelled);
         void UpdateArhivesAsync();
         std::string GetRecordId(PvrClient::ChannelId channelId, time_t startTime);
         
         bool CheckChannelId(PvrClient::ChannelId channelId);
-        void UpdateUrlsForChannel(PvrClient::ChannelId channelId);
+        // Good streams ordered by StreamHealth, provider's priority breaks ties
+        std::vector<std::string> GetStreamCandidates(PvrClient::ChannelId channelId);
+        bool IsGoodStream(PvrClient::ChannelId channelId, const std::string& streamUrl) const;
+        // Takes prefetched sources when available, otherwise as UpdateChannelSources()
+        // at high priority. Requests are cancelled with the live stream (StreamStopToken()).
+        void LoadChannelSources(PvrClient::ChannelId channelId);
+        // Both API round-trips. Members are not touched.
+        ResolvedSources ResolveSources(PvrClient::ChannelId channelId, std::stop_token stopToken = {},
+                                       HttpEngine::RequestPriority priority = HttpEngine::RequestPriority_Low);
+        // Same round-trips as low priority async calls (Puzzle 3 only), no thread waits for them.
+        // Completion runs on HttpEngine's completion thread. Throws when the first call can't be queued.
+        void ResolveSourcesAsync(PvrClient::ChannelId channelId, std::stop_token stopToken,
+                                 std::function<void(ResolvedSources&)> completion);
+        void FetchChannelSources(PvrClient::ChannelId channelId, TChannelSources& sources, std::stop_token stopToken,
+                                 HttpEngine::RequestPriority priority);
+        bool FetchChannelStreams(PvrClient::ChannelId channelId, TChannelSources& cacheSources, PvrClient::Channel::UrlList& urls, std::stop_token stopToken,
+                                 HttpEngine::RequestPriority priority);
+        void ApplySources(PvrClient::ChannelId channelId, ResolvedSources& resolved);
+        // Schedules resolution of channels around channelId (by number) in background,
+        // so zapping to them finds the sources ready. Call after the current channel is resolved.
+        // Resolutions of channels that left the window are cancelled.
+        void PrefetchNeighbours(PvrClient::ChannelId channelId);
+        // Only finished resolution is taken, unfinished one is cancelled
+        bool TakePrefetchedSources(PvrClient::ChannelId channelId, ResolvedSources& resolved);
+        bool IsPrefetchedSourcesReady(PvrClient::ChannelId channelId);
+        void DiscardPrefetchedSources(PvrClient::ChannelId channelId);
         void Cleanup();
 
         template <typename TParser>
@@ -165,7 +215,15 @@ namespace PuzzleEngine
         void CallApiAsync(const ApiFunctionData& data, TParser parser, TCompletion completion);
         
         template <typename TParser, typename TCompletion>
-        void CallApiAsync(const std::string& strRequest, const std::string& name, TParser parser, TCompletion completion);
+        void CallApiAsync(const std::string& strRequest, const std::string& name, TParser parser, TCompletion completion,
+                          std::stop_token stopToken = {},
+                          HttpEngine::RequestPriority priority = HttpEngine::RequestPriority_Low);
+
+        // Synchronous call delivering raw response body in chunks,
+        // for responses too large to be buffered and parsed as a DOM.
+        void CallApiStream(const ApiFunctionData& data, std::function<bool(const char*, size_t)> onChunk);
+        std::string ApiUrl(const ApiFunctionData& data) const;
+        HttpEngine::Request ApiRequest(const std::string& url, std::stop_token stopToken = {}) const;
 
         bool CheckAceEngineRunning(const char* aceServerUrlBase);
         std::string EpgUrlForPuzzle3() const;
@@ -180,6 +238,20 @@ namespace PuzzleEngine
         const ServerVersion m_serverVersion;
         TChannelSourcesMap m_sources;
         bool m_isAceRunning;
+        // Candidates of the last GetUrl(), GetNextStream() walks them
+        PvrClient::ChannelId m_zapChannelId;
+        std::vector<std::string> m_zapStreams;
+        
+        // Background source resolution (Puzzle 3 only): low priority calls in HttpEngine's queue,
+        // at most one per channel of the window. Stop sources are stopped outside of m_prefetchMutex,
+        // cancelled call completes from inside of request_stop().
+        std::mutex m_prefetchMutex;
+        std::map<PvrClient::ChannelId, PrefetchedSources> m_prefetchedSources;
+        // Resolutions whose completion hasn't run yet, including dropped ones. Destructor waits for them.
+        size_t m_prefetchesInFlight = 0;
+        std::condition_variable m_prefetchDone;
+        // Channel IDs ordered by channel number, rebuilt when channel list size changes
+        std::vector<PvrClient::ChannelId> m_channelsByNumber;
         
         // Archive
         struct ArchiveRecord{
@@ -57,6 +57,10 @@
 #include "pvr_client_base.h"
 #include "globals.hpp"
 #include "HttpEngine.hpp"
+#include "HttpStats.hpp"
+#include "StreamHealth.hpp"
+#include "ZapAccelerator.hpp"
+#include "RecordingEngine.hpp"
 #include "client_core_base.hpp"
 #include "ActionQueue.hpp"
 #include "addon_settings.h"
@@ -84,7 +88,8 @@ static const int c_InitialLastByteRead = 1;
 
 const unsigned int RELOAD_EPG_MENU_HOOK = 1;
 const unsigned int RELOAD_RECORDINGS_MENU_HOOK = 2;
-const unsigned int PVRClientBase::s_lastCommonMenuHookId = RELOAD_RECORDINGS_MENU_HOOK;
+const unsigned int DUMP_HTTP_STATS_MENU_HOOK = 3;
+const unsigned int PVRClientBase::s_lastCommonMenuHookId = DUMP_HTTP_STATS_MENU_HOOK;
 
 static void DelayStartup(int delayInSec) {
     if(delayInSec <= 0){
@@ -173,7 +178,6 @@ ADDON_STATUS PVRClientBase::Init(const std::string& clientPath, const std::strin
     m_recordBuffer.duration = 0;
     m_recordBuffer.isLocal = false;
     m_recordBuffer.seekToSec = 0;
-    m_localRecordBuffer = NULL;
     m_supportSeek = false;
     
     m_clientPath = clientPath;
@@ -188,24 +192,32 @@ ADDON_STATUS PVRClientBase::Init(const std::string& clientPath, const std::strin
     
     RegisterCommonMenuHook(RELOAD_EPG_MENU_HOOK, 32050);
     RegisterCommonMenuHook(RELOAD_RECORDINGS_MENU_HOOK, 32051);
+    RegisterCommonMenuHook(DUMP_HTTP_STATS_MENU_HOOK, 32061);
 
     // Local recordings path prefix
     s_LocalRecPrefix = kodi::GetLocalizedString(32014);
     // Remote recordings path prefix
     s_RemoteRecPrefix = kodi::GetLocalizedString(32015);
     
-    m_liveChannelId =  m_localRecordChannelId = UnknownChannelId;
+    m_liveChannelId = UnknownChannelId;
     m_lastBytesRead = c_InitialLastByteRead;
     m_lastRecordingsAmount = 0;
     
     m_destroyer = new CActionQueue(100, "Streams Destroyer");
     m_destroyer->CreateThread();
     
+    // Pre-buffers and recordings live longer than a zap, their transfers stop with the buffer
+    m_zapAccelerator = new ZapAccelerator([](const std::string& url) { return BufferForUrl(url); });
+    m_recordingEngine = new Engines::RecordingEngine([](const std::string& url) { return BufferForUrl(url); });
+    
     return ADDON_STATUS_OK;
     
 }
 
 void PVRClientBase::OnCoreCreated() {
+    // Channel names and groups come from the new core
+    m_recordingsIndex.Clear();
+
     IClientCore::RpcSettings rpc;
     rpc.port = RpcLocalPort();
     rpc.user = RpcUser();
@@ -215,6 +227,20 @@ void PVRClientBase::OnCoreCreated() {
     m_clientCore->SetRpcSettings(rpc);
     m_clientCore->SupportMuticastUrls(SuppotMulticastUrls(), UdpProxyHost(), UdpProxyPort());
     m_clientCore->CheckRpcConnection();
+    m_clientCore->SetEpgChangedDelegate([this](ChannelId channelId) {
+        // LUTs are not ready before k_ChannelsIdCreatingPhase, Kodi will ask for the whole guide anyway
+        auto phase = m_clientCore->GetPhase(IClientCore::k_ChannelsIdCreatingPhase);
+        if(nullptr == phase || !phase->IsDone() || m_pluginToKodiLut.count(channelId) == 0)
+            return;
+        PVR->Addon_TriggerEpgUpdate(m_pluginToKodiLut.at(channelId));
+    });
+    m_isChannelListOutdated = false;
+    m_clientCore->SetChannelsChangedDelegate([this]() {
+        // Called on revalidation thread of the core, the core is re-created when Kodi asks for channels
+        m_isChannelListOutdated = true;
+        PVR->Addon_TriggerChannelUpdate();
+        PVR->Addon_TriggerChannelGroupsUpdate();
+    });
 
     // We may be here when core is re-creating
     // In this case Destroyer is running and may be busy
@@ -273,6 +299,10 @@ void PVRClientBase::ScheduleRecordingsUpdate() {
          if(!m_destroyerEvent.Wait(ArchiveRefreshInterval() * 60 * 1000) && nullptr != m_clientCore && !m_destroyer->IsStopped()) {
             LogDebug("PVRClientBase: call reload recorderings.");
             m_clientCore->ReloadRecordings();
+            // Kodi asks for the whole list on trigger, bother it only when archive has changed
+            if(IsArchiveSupported() && RefreshRecordingsIndex()) {
+                PVR->Addon_TriggerRecordingUpdate();
+            }
          } else {
              LogDebug("PVRClientBase: bypass reload recorderings.");
          }
@@ -300,13 +330,17 @@ PVRClientBase::~PVRClientBase()
         }
         SAFE_DELETE(m_destroyer);
     }
+    SAFE_DELETE(m_zapAccelerator);
+    SAFE_DELETE(m_recordingEngine);
 }
 void PVRClientBase::Cleanup()
 {
     CloseLiveStream();
+    if(m_zapAccelerator)
+        m_zapAccelerator->Clear();
     CloseRecordedStream();
-    if(m_localRecordBuffer)
-        SAFE_DELETE(m_localRecordBuffer);
+    if(m_recordingEngine)
+        m_recordingEngine->StopAll();
 }
 
 void PVRClientBase::OnSystemSleep()
@@ -433,6 +467,7 @@ ADDON_STATUS PVRClientBase::OnReloadRecordings()
         return ADDON_STATUS_LOST_CONNECTION;
     
     ADDON_STATUS retVal = ADDON_STATUS_OK;
+    m_recordingsIndex.Clear();
     m_clientCore->ReloadRecordings();
     return retVal;
 }
@@ -447,6 +482,14 @@ PVR_ERROR PVRClientBase::SignalStatus(int /*channelUid*/, kodi::addon::PVRSignal
 }
 #pragma mark - Channels
 
+void PVRClientBase::ReloadOutdatedChannelList()
+{
+    if(!m_isChannelListOutdated.exchange(false))
+        return;
+    LogInfo("PVRClientBase: channel list has changed, reloading...");
+    CreateCoreSafe(false);
+}
+
 const ChannelList& PVRClientBase::GetChannelListWhenLutsReady()
 {
     auto phase =  m_clientCore->GetPhase(IClientCore::k_ChannelsIdCreatingPhase);
@@ -458,6 +501,7 @@ const ChannelList& PVRClientBase::GetChannelListWhenLutsReady()
 
 PVR_ERROR PVRClientBase::GetChannels(bool radio, kodi::addon::PVRChannelsResultSet& results)
 {
+    ReloadOutdatedChannelList();
     if(NULL == m_clientCore)
         return PVR_ERROR_SERVER_ERROR;
         
@@ -485,6 +529,7 @@ PVR_ERROR PVRClientBase::GetChannels(bool radio, kodi::addon::PVRChannelsResultS
 
 int PVRClientBase::GetChannelsAmount()
 {
+    ReloadOutdatedChannelList();
     if(NULL == m_clientCore)
         return -1;
     
@@ -494,6 +539,7 @@ int PVRClientBase::GetChannelsAmount()
 
 int PVRClientBase::GetChannelGroupsAmount()
 {
+    ReloadOutdatedChannelList();
     if(NULL == m_clientCore)
         return -1;
     
@@ -588,11 +634,11 @@ std::string PVRClientBase::GetLiveUrl() const {
     
 }
 
-InputBuffer*  PVRClientBase::BufferForUrl(const std::string& url )
+InputBuffer*  PVRClientBase::BufferForUrl(const std::string& url, std::stop_token stopToken)
 {
     InputBuffer* buffer = NULL;
     if(IsHlsUrl(url))
-        buffer = new Buffers::PlaylistBuffer(url, nullptr, false); // No segments cache for live playlist
+        buffer = new Buffers::PlaylistBuffer(url, nullptr, false, stopToken); // No segments cache for live playlist
     else
         buffer = new DirectBuffer(url);
     return buffer;
@@ -620,6 +666,7 @@ bool PVRClientBase::OpenLiveStream(const kodi::addon::PVRChannel& channel)
     
     m_lastBytesRead = c_InitialLastByteRead;
     const ChannelId chId = m_kodiToPluginLut.at(channelId);
+    StartStreamRequests();
     bool succeeded = OpenLiveStream(chId, GetStreamUrl(chId));
     bool tryToRecover = !succeeded;
     while(tryToRecover) {
@@ -657,10 +704,12 @@ bool PVRClientBase::OpenLiveStream(ChannelId channelId, const std::string& url )
     if(channelId == m_liveChannelId && IsLiveInRecording())
         return true; // Do not change url of local recording stream
 
-    if(channelId == m_localRecordChannelId) {
+    // Channel is in recording, play its stream
+    Buffers::TimeshiftBuffer* recordingBuffer = m_recordingEngine->JoinLive(channelId);
+    if(nullptr != recordingBuffer) {
         CLockObject lock(m_mutex);
-        m_liveChannelId = m_localRecordChannelId;
-        m_inputBuffer = m_localRecordBuffer;
+        m_liveChannelId = channelId;
+        m_inputBuffer = recordingBuffer;
         return true;
     }
 
@@ -669,9 +718,18 @@ bool PVRClientBase::OpenLiveStream(ChannelId channelId, const std::string& url )
         return false;
     try
     {
-        InputBuffer* buffer = BufferForUrl(url);
-       
-        Buffers::TimeshiftBuffer* inputBuffer = new Buffers::TimeshiftBuffer(buffer, CreateLiveCache());
+        // Time to first byte includes connection of input buffer
+        const auto openAt = std::chrono::steady_clock::now();
+        // Adjacent channel is running already, its cache goes to the player as is
+        Buffers::TimeshiftBuffer* inputBuffer = m_zapAccelerator->Take(url);
+        const bool isPrebuffered = nullptr != inputBuffer;
+        if(isPrebuffered) {
+            LogDebug("PVRClientBase: using pre-buffered stream of channel %d.", channelId);
+            inputBuffer->SwapCache(CreateLiveCache());
+        } else {
+            InputBuffer* buffer = BufferForUrl(url, m_streamStopSource.get_token());
+            inputBuffer = new Buffers::TimeshiftBuffer(buffer, CreateLiveCache());
+        }
         
         // Wait for first data from live stream
         auto startAt = std::chrono::system_clock::now();
@@ -680,6 +738,8 @@ bool PVRClientBase::OpenLiveStream(ChannelId channelId, const std::string& url )
         }
         auto endAt = std::chrono::system_clock::now();
         std::chrono::duration<float> validationDelay(endAt - startAt);
+        if(!isPrebuffered)
+            StreamHealth::Instance().RecordOpen(url, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - openAt));
         
         // Wait preloading delay (from settings or playlist)
         const auto& ch = GetChannelListWhenLutsReady().at(channelId);
@@ -693,6 +753,9 @@ bool PVRClientBase::OpenLiveStream(ChannelId channelId, const std::string& url )
             else
                 liveDelayValue = LivePlaybackDelayForTs();
         }
+        // Pre-buffered stream holds seconds of data already
+        if(isPrebuffered)
+            liveDelayValue = 0;
         std::chrono::duration<float> livePreloadingDelay(liveDelayValue);
         auto resultDelay = livePreloadingDelay - validationDelay;
         if(resultDelay > std::chrono::seconds(0)) {
@@ -711,18 +774,95 @@ bool PVRClientBase::OpenLiveStream(ChannelId channelId, const std::string& url )
     catch (InputBufferException &ex)
     {
         LogError(  "PVRClientBase: input buffer error in OpenLiveStream: %s", ex.what());
-        CloseLiveStream();
+        StreamHealth::Instance().RecordFailure(url);
+        // Next stream of the channel may be requested yet
+        CloseInputBuffer();
         OnOpenStremFailed(channelId, url);
         return false;
     }
     m_liveChannelId = channelId;
+    UpdateZapPrebuffers(channelId, url);
     return true;
 }
 
+std::vector<ChannelId> PVRClientBase::AdjacentChannels(ChannelId channelId)
+{
+    std::vector<ChannelId> order;
+    for(const auto& group : m_clientCore->GetGroupList()) {
+        const auto& members = group.second.Channels;
+        if(std::none_of(members.begin(), members.end(), [channelId](const auto& member) { return member.second == channelId; }))
+            continue;
+        for(const auto& member : members)
+            order.push_back(member.second);
+        break;
+    }
+    // Ungrouped channel, Kodi zaps over all channels by number
+    if(order.empty()) {
+        std::vector<const Channel*> channels;
+        for(const auto& channel : m_clientCore->GetChannelList())
+            channels.push_back(&channel.second);
+        std::stable_sort(channels.begin(), channels.end(), [](const Channel* left, const Channel* right) {
+            return left->Number < right->Number;
+        });
+        for(const auto channel : channels)
+            order.push_back(channel->UniqueId);
+    }
+    
+    std::vector<ChannelId> result;
+    const auto current = std::find(order.begin(), order.end(), channelId);
+    if(current == order.end() || order.size() < 2)
+        return result;
+    // Kodi wraps around the group ends
+    const size_t position = current - order.begin();
+    result.push_back(order[(position + 1) % order.size()]);
+    const ChannelId previous = order[(position + order.size() - 1) % order.size()];
+    if(previous != result.front())
+        result.push_back(previous);
+    return result;
+}
+
+void PVRClientBase::UpdateZapPrebuffers(ChannelId liveChannelId, const std::string& liveUrl)
+{
+    if(!IsZapPrebufferingEnabled() || IsLiveInRecording()) {
+        m_zapAccelerator->Clear();
+        return;
+    }
+    std::vector<std::string> urls;
+    for(const auto channelId : AdjacentChannels(liveChannelId)) {
+        const std::string url = GetPrebufferUrl(channelId);
+        if(!url.empty() && url != liveUrl)
+            urls.push_back(url);
+    }
+    m_zapAccelerator->Prebuffer(urls, ZapPrebufferMemoryLimit(), ZapPrebufferBandwidthLimit());
+}
+
+void PVRClientBase::StartStreamRequests()
+{
+    CLockObject lock(m_mutex);
+    m_streamStopSource.request_stop();
+    m_streamStopSource = std::stop_source();
+    if(m_clientCore)
+        m_clientCore->SetStreamStopToken(m_streamStopSource.get_token());
+}
+
 void PVRClientBase::CloseLiveStream()
+{
+    CLockObject lock(m_mutex);
+    // Player has left the channel, free bandwidth at once instead of when the buffer is destroyed
+    m_streamStopSource.request_stop();
+    CloseInputBuffer();
+}
+
+void PVRClientBase::CloseInputBuffer()
 {
     CLockObject lock(m_mutex);
     m_liveChannelId = UnknownChannelId;
+    // Either zap or stop, pre-buffers are kept for a while
+    if(m_zapAccelerator)
+        m_zapAccelerator->Suspend();
+    // Recording goes on without the player
+    if(m_inputBuffer && IsLiveInRecording())
+        m_recordingEngine->LeaveLive(m_inputBuffer);
     if(m_inputBuffer && !IsLiveInRecording()) {
         LogNotice("PVRClientBase: closing input stream...");
         auto oldBuffer = m_inputBuffer;
@@ -825,6 +965,7 @@ int64_t PVRClientBase::LengthLiveStream()
 bool PVRClientBase::SwitchChannel(const PVR_CHANNEL& channel)
 {
     const ChannelId chId = m_kodiToPluginLut.at(channel.iUniqueId);
+    StartStreamRequests();
     return SwitchChannel(chId, GetStreamUrl(chId));
 }
 
@@ -834,7 +975,7 @@ bool PVRClientBase::SwitchChannel(ChannelId channelId, const std::string& url)
         return false;
 
     CLockObject lock(m_mutex);
-    CloseLiveStream();
+    CloseInputBuffer();
     return OpenLiveStream(channelId, url); // Split/join live and recording streams (when nesessry)
 }
 
@@ -900,6 +1041,13 @@ PVR_ERROR PVRClientBase::GetRecordingsAmount(bool deleted, int& amount)
     return PVR_ERROR_NO_ERROR;
 }
 
+bool PVRClientBase::RefreshRecordingsIndex()
+{
+    return m_recordingsIndex.Refresh(*m_clientCore, [this](const EpgEntryList::value_type& epgEntry, kodi::addon::PVRRecording& tag) {
+        FillRecording(epgEntry, tag, s_RemoteRecPrefix.c_str());
+    });
+}
+
 void PVRClientBase::FillRecording(const EpgEntryList::value_type& epgEntry, kodi::addon::PVRRecording& tag, const char* dirPrefix)
 {
     const auto& epgTag = epgEntry.second;
@@ -972,66 +1120,11 @@ PVR_ERROR PVRClientBase::GetRecordings(bool deleted, kodi::addon::PVRRecordingsR
         }
         phase->Wait();
         
-        phase =  m_clientCore->GetPhase(IClientCore::k_EpgLoadingPhase);
-        const bool  isFastEpgLoopAvailable = !phase->IsDone();
-
-        // Populate server recordings
-        IClientCore::EpgEntryAction predicate = [] (const EpgEntryList::value_type& epgEntry) {
-            return epgEntry.second.HasArchive;
-        };
-        std::chrono::duration<float> fillTotal(0.0f);
-        std::chrono::duration<float> transferTotal(0.0f);
-        auto pThis = this;
-        IClientCore::EpgEntryAction action = [pThis ,&result, &results, &size, &predicate, isFastEpgLoopAvailable, &fillTotal, &transferTotal]
-        (const EpgEntryList::value_type& epgEntry) {
-            try {
-                // Optimisation: for first time we'll call ForEachEpgLocked()
-                //  Check predicate in this case
-                if(isFastEpgLoopAvailable) {
-                    if(!predicate(epgEntry))
-                        return true;
-                }
-                
-                kodi::addon::PVRRecording tag;
-                
-//                auto startAt = std::chrono::system_clock::now();
-                
-                pThis->FillRecording(epgEntry, tag, s_RemoteRecPrefix.c_str());
-                
-//                auto endAt = std::chrono::system_clock::now();
-//                fillTotal += endAt-startAt;
-//                startAt = endAt;
-
-                results.Add(tag);
-
-//                endAt = std::chrono::system_clock::now();
-//                transferTotal += endAt-startAt;
-
-                ++size;
-                return true;
-            }
-            catch (std::exception& ex)  {
-                LogError( "GetRecordings::action() failed. Exception: %s.", ex.what());
-                //result = PVR_ERROR_FAILED;
-            }
-            catch (...)  {
-                LogError( "GetRecordings::action() failed. Unknown exception.");
-                //result = PVR_ERROR_FAILED;
-            }
-            // Looks like we can lost problematic recored
-            // and continue EPG enumeration.
-            return true;
-        };
-        if(isFastEpgLoopAvailable){
-            m_clientCore->ForEachEpgLocked(action);
-        } else {
-            m_clientCore->ForEachEpgUnlocked(predicate, action);
-        }
-//        float preRec = 1000*fillTotal.count()/size;
-//        LogDebug("PVRClientBase: FillRecording = %0.4f (%0.6f per kRec)", fillTotal.count(), preRec);
-//        preRec = 1000*transferTotal.count()/size;
-//        LogDebug("PVRClientBase: TransferRecordingEntry = %0.4f (%0.6f per kRec)", transferTotal.count(), preRec );
-//        LogDebug("PVRClientBase: All Recording = %0.4f", transferTotal.count() + fillTotal.count() );
+        // Tags of unchanged archive entries are reused
+        RefreshRecordingsIndex();
+        size += m_recordingsIndex.ForEach([&results](const kodi::addon::PVRRecording& tag) {
+            results.Add(tag);
+        });
     }
     // Add local recordings
     if(kodi::vfs::DirectoryExists(RecordingsPath().c_str()))
@@ -1116,7 +1209,7 @@ PVR_ERROR PVRClientBase::DeleteRecording(const kodi::addon::PVRRecording& record
 
 bool PVRClientBase::IsLiveInRecording() const
 {
-    return m_inputBuffer == m_localRecordBuffer;
+    return nullptr != m_inputBuffer && m_recordingEngine->IsRecording(m_inputBuffer);
 }
 
 
@@ -1415,22 +1508,27 @@ bool PVRClientBase::StartRecordingFor(kodi::addon::PVRTimer &timer)
     
     ChannelId channelId = m_kodiToPluginLut.at(kodiChannelId);
     
-    std::string url = m_clientCore ->GetUrl(channelId);
-    m_localRecordChannelId = channelId;
+    m_recordingEngine->SetLimits(MaxConcurrentRecordings(), RecordingIoBudget());
+    if(m_recordingEngine->IsFull()) {
+        LogError("StartRecordingFor(): too many recordings at once, %u is not started.", timer.GetEPGUid());
+        return false;
+    }
     // When recording channel is same to live channel
     // merge live buffer with local recording
-    if(m_liveChannelId == channelId){
-//        CLockObject lock(m_mutex);
-//        CloseLiveStream();
-        m_inputBuffer->SwapCache( new Buffers::FileCacheBuffer(recordingDir, 255, false));
-        m_localRecordBuffer = m_inputBuffer;
-        m_liveChannelId = m_localRecordChannelId; // ???
-        return true;
+    {
+        CLockObject lock(m_mutex);
+        if(m_liveChannelId == channelId && nullptr != m_inputBuffer && !IsLiveInRecording()) {
+            if(!m_recordingEngine->StartFromLive(timer.GetEPGUid(), channelId, m_inputBuffer, recordingDir))
+                return false;
+            // Recording outlives the zap, channel switch must not stop its transfers
+            m_streamStopSource = std::stop_source();
+            m_clientCore->SetStreamStopToken(m_streamStopSource.get_token());
+            return true;
+        }
     }
     // otherwise just open new recording stream
-    m_localRecordBuffer = new Buffers::TimeshiftBuffer(BufferForUrl(url), new Buffers::FileCacheBuffer(recordingDir, 255, false));
-
-    return true;
+    std::string url = m_clientCore->GetUrl(channelId);
+    return m_recordingEngine->Start(timer.GetEPGUid(), channelId, url, recordingDir);
 }
 
 bool PVRClientBase::StopRecordingFor(kodi::addon::PVRTimer &timer)
@@ -1459,27 +1557,21 @@ bool PVRClientBase::StopRecordingFor(kodi::addon::PVRTimer &timer)
         }
     } while(false);
     
-    KodiChannelId kodiChannelId = timer.GetClientChannelUid();
-    ChannelId channelId = UnknownChannelId;
-    if(m_kodiToPluginLut.count(kodiChannelId) != 0){
-       channelId = m_kodiToPluginLut.at(kodiChannelId);
-    } else {
-        LogError("StopRecordingFor(): recording request for unknown channel ID %d", kodiChannelId);
-    }
-    
-
-    // When recording channel is same to live channel
-    // merge live buffer with local recording
-    if(m_liveChannelId == channelId){
-        //CLockObject lock(m_mutex);
-        m_inputBuffer->SwapCache(CreateLiveCache());
-        m_localRecordBuffer = nullptr;
-    } else {
-        if(m_localRecordBuffer) {
-            m_localRecordChannelId = UnknownChannelId;
-            SAFE_DELETE(m_localRecordBuffer);
+    Buffers::TimeshiftBuffer* recordingBuffer = nullptr;
+    {
+        CLockObject lock(m_mutex);
+        recordingBuffer = m_recordingEngine->Release(timer.GetEPGUid());
+        // When live stream is being recorded
+        // it goes on with live cache
+        if(nullptr != recordingBuffer && recordingBuffer == m_inputBuffer) {
+            m_inputBuffer->SwapCache(CreateLiveCache());
+            recordingBuffer = nullptr;
         }
     }
+    if(nullptr == recordingBuffer)
+        LogDebug("StopRecordingFor(): recording %u goes on as live stream or is not running.", timer.GetEPGUid());
+    // May block for network timeout
+    delete recordingBuffer;
     
     // trigger Kodi recordings update
     PVR->Addon_TriggerRecordingUpdate();
@@ -1524,6 +1616,15 @@ PVR_ERROR  PVRClientBase::HandleCommonMenuHook(const kodi::addon::PVRMenuhook &m
 //        kodi::QueueFormattedNotification(QUEUE_INFO, message);
 //        XBMC->FreeString(message);
         OnReloadRecordings();
+    } else if(DUMP_HTTP_STATS_MENU_HOOK == menuhook.GetHookId()) {
+        std::string path = m_userPath;
+        if(!path.empty() && path.back() != '/')
+            path += '/';
+        path += "http_stats.json";
+        if(HttpStats::Instance().DumpToFile(path)) {
+            kodi::QueueFormattedNotification(QUEUE_INFO, kodi::GetLocalizedString(32062).c_str(), path.c_str());
+        }
+        m_recordingEngine->LogStats();
     }
     return PVR_ERROR_NO_ERROR;
     
@@ -1623,6 +1724,11 @@ static const std::string c_logosFolderPath = "channel_logos_folder";
 static const std::string c_suppotMulticastUrls("playlist_support_multicast_urls");
 static const std::string c_udpProxyHost("playlist_udp_proxy_host");
 static const std::string c_udpProxyPort("playlist_udp_proxy_port");
+static const std::string c_zapPrebufferEnable = "zap_prebuffer_enable";
+static const std::string c_zapPrebufferMemory = "zap_prebuffer_memory";
+static const std::string c_zapPrebufferBandwidth = "zap_prebuffer_bandwidth";
+static const std::string c_maxConcurrentRecordings = "recordings_max_concurrent";
+static const std::string c_recordingIoBudget = "recordings_io_budget";
 
 
 void PVRClientBase::InitSettings()
@@ -1663,6 +1769,11 @@ void PVRClientBase::InitSettings()
     .Add(c_suppotMulticastUrls, false, NotifyClearPvrData<bool>, ADDON_STATUS_NEED_RESTART)
     .Add(c_udpProxyHost, "", NotifyClearPvrData<std::string>, ADDON_STATUS_NEED_RESTART)
     .Add(c_udpProxyPort, 0, NotifyClearPvrData<int>, ADDON_STATUS_NEED_RESTART)
+    .Add(c_zapPrebufferEnable, false)
+    .Add(c_zapPrebufferMemory, 16)
+    .Add(c_zapPrebufferBandwidth, 0) // default 20 (see notes abouve!)
+    .Add(c_maxConcurrentRecordings, 3)
+    .Add(c_recordingIoBudget, 0)
     ;
     
     PopulateSettings(m_addonMutableSettings);
@@ -1684,6 +1795,33 @@ const std::string& PVRClientBase::UdpProxyHost() const
     return m_addonSettings.GetString(c_udpProxyHost);
 }
 
+bool PVRClientBase::IsZapPrebufferingEnabled() const
+{
+    return m_addonSettings.GetBool(c_zapPrebufferEnable);
+}
+
+uint64_t PVRClientBase::ZapPrebufferMemoryLimit() const
+{
+    return (uint64_t) m_addonSettings.GetInt(c_zapPrebufferMemory) * 1024 * 1024;
+}
+
+// Bytes per second, 0 - unlimited
+uint64_t PVRClientBase::ZapPrebufferBandwidthLimit() const
+{
+    return (uint64_t) m_addonSettings.GetInt(c_zapPrebufferBandwidth) * 1024 * 1024 / 8;
+}
+
+size_t PVRClientBase::MaxConcurrentRecordings() const
+{
+    return m_addonSettings.GetInt(c_maxConcurrentRecordings);
+}
+
+// Bytes per second, 0 - unlimited
+uint64_t PVRClientBase::RecordingIoBudget() const
+{
+    return (uint64_t) m_addonSettings.GetInt(c_recordingIoBudget) * 1024 * 1024;
+}
+
 bool PVRClientBase::SuppotMulticastUrls() const
 {
     return m_addonSettings.GetBool(c_suppotMulticastUrls);
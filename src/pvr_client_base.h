@@ -23,22 +23,29 @@
 #ifndef pvr_client_base_h
 #define pvr_client_base_h
 
+#include <atomic>
 #include <string>
+#include <stop_token>
 #include "pvr_client_types.h"
 #include "p8-platform/threads/mutex.h"
 #include "addon.h"
 #include "addon_settings.h"
 #include "globals.hpp"
+#include "RecordingsIndex.hpp"
 
 namespace Buffers {
     class IPlaylistBufferDelegate;
     class InputBuffer;
     class TimeshiftBuffer;
     class ICacheBuffer;
+    class ZapAccelerator;
 }
 namespace ActionQueue {
     class CActionQueue;
 }
+namespace Engines {
+    class RecordingEngine;
+}
 
 namespace PvrClient
 {
@@ -129,6 +136,8 @@ namespace PvrClient
 
         virtual std::string GetStreamUrl(ChannelId channelId);
         virtual std::string GetNextStreamUrl(ChannelId channelId) {return std::string();}
+        // Stream of adjacent channel to pre-buffer. Must not change zap state of the client (see GetNextStreamUrl)
+        virtual std::string GetPrebufferUrl(ChannelId channelId) {return GetStreamUrl(channelId);}
         virtual void OnOpenStremFailed(PvrClient::ChannelId channelId, const std::string& streamUrl) {}
         ChannelId GetLiveChannelId() const { return  m_liveChannelId;}
         std::string GetLiveUrl() const;
@@ -200,13 +209,29 @@ namespace PvrClient
         bool SuppotMulticastUrls() const;
         const std::string& UdpProxyHost() const;
         uint32_t UdpProxyPort() const;
+        bool IsZapPrebufferingEnabled() const;
+        uint64_t ZapPrebufferMemoryLimit() const;
+        uint64_t ZapPrebufferBandwidthLimit() const;
+        size_t MaxConcurrentRecordings() const;
+        uint64_t RecordingIoBudget() const;
         
+        bool RefreshRecordingsIndex();
+        // Re-creates the core when its revalidated channel list differs from the served one
+        void ReloadOutdatedChannelList();
         void FillRecording(const EpgEntryList::value_type& epgEntry, kodi::addon::PVRRecording& tag, const char* dirPrefix);
         std::string DirectoryForRecording(unsigned int epgId) const;
         std::string PathForRecordingInfo(unsigned int epgId) const;
-        static Buffers::InputBuffer*  BufferForUrl(const std::string& url );
+        // Transfers of playlist stream stop with stopToken, direct streams are closed with the buffer
+        static Buffers::InputBuffer*  BufferForUrl(const std::string& url, std::stop_token stopToken = {});
+        // New token of live stream requests for the core, previous ones are cancelled
+        void StartStreamRequests();
+        // Unlike CloseLiveStream() keeps requests of the stream running (reconnection of the same channel)
+        void CloseInputBuffer();
         bool OpenLiveStream(ChannelId channelId, const std::string& url );
         Buffers::ICacheBuffer* CreateLiveCache() const;
+        // Next and previous channels of the live channel's group
+        std::vector<ChannelId> AdjacentChannels(ChannelId channelId);
+        void UpdateZapPrebuffers(ChannelId liveChannelId, const std::string& liveUrl);
 
         void ScheduleRecordingsUpdate();
         void SeekKodiPlayerAsyncToOffset(int offsetInSeconds, std::function<void(bool done)> result);
@@ -219,16 +244,20 @@ namespace PvrClient
             bool isLocal;
             unsigned int seekToSec;
         } m_recordBuffer;
-        ChannelId m_localRecordChannelId;
-        Buffers::TimeshiftBuffer *m_localRecordBuffer;
         std::string m_cacheDir;
         int m_lastRecordingsAmount;        
+        RecordingsIndex m_recordingsIndex;
+        std::atomic<bool> m_isChannelListOutdated{false};
         std::string m_clientPath;
         std::string m_userPath;
         mutable P8PLATFORM::CMutex m_mutex;
         int m_lastBytesRead;
+        // Cancels API requests and transfers of the live stream on channel switch
+        std::stop_source m_streamStopSource;
 
         ActionQueue::CActionQueue* m_destroyer;
+        Buffers::ZapAccelerator* m_zapAccelerator = nullptr;
+        Engines::RecordingEngine* m_recordingEngine = nullptr;
         P8PLATFORM::CEvent m_destroyerEvent;
         TKodiToPluginChannelIdLut m_kodiToPluginLut;
         TPluginToKodiChannelIdLut m_pluginToKodiLut;
@@ -29,6 +29,7 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <stop_token>
 #include "ActionQueueTypes.hpp"
 #include <rapidjson/document.h>
 
@@ -144,6 +145,10 @@ namespace PvrClient {
 
         typedef std::function<void(void)> RecordingsDelegate;
         typedef std::function<bool(const EpgEntryList::value_type&)> EpgEntryAction;
+        // Called when EPG of channel has changed after incremental update
+        typedef std::function<void(ChannelId)> EpgChangedDelegate;
+        // Called from background revalidation when channel list differs from the served one
+        typedef std::function<void(void)> ChannelsChangedDelegate;
         
         virtual std::shared_ptr<IPhase> GetPhase(Phase phase) = 0;
 
@@ -154,7 +159,12 @@ namespace PvrClient {
         virtual bool GetEpgEntry(UniqueBroadcastIdType i,  EpgEntry& enrty) = 0;
         virtual void ForEachEpgLocked(const EpgEntryAction& action) const = 0;
         virtual void ForEachEpgUnlocked(const EpgEntryAction& predicate, const EpgEntryAction& action) const = 0;
+        virtual void SetEpgChangedDelegate(EpgChangedDelegate delegate) = 0;
+        virtual void SetChannelsChangedDelegate(ChannelsChangedDelegate delegate) = 0;
         virtual std::string GetUrl(PvrClient::ChannelId channelId) = 0;
+        // Requests made for the stream being opened (see GetUrl()) are cancelled
+        // through this token, when the player leaves the channel.
+        virtual void SetStreamStopToken(std::stop_token /*stopToken*/) {}
 
         virtual void ReloadRecordings() = 0;
         virtual int UpdateArchiveInfoAndCount() = 0;
@@ -41,6 +41,9 @@
 #include "sharatv_player.h"
 #include "HttpEngine.hpp"
 #include "XMLTV_loader.hpp"
+#include "ChannelNameIndex.hpp"
+#include "M3uTokenizer.hpp"
+#include "StreamHealth.hpp"
 #include "globals.hpp"
 
 namespace SharaTvEngine {
@@ -59,6 +62,9 @@ namespace SharaTvEngine {
 
     
     static const char* c_EpgCacheFile = "sharatv_epg_cache.txt";
+    static const char* c_ChannelsSnapshotFile = "special://temp/pvr-puzzle-tv/sharatv_channels.bin";
+    // Snapshot validated this recently is not downloaded again, e.g. when core is re-created after revalidation
+    static const time_t c_ChannelsSnapshotFreshness = 5 * 60;
     
     //    struct NoCaseComparator : binary_function<string, string, bool>
     //    {
@@ -78,10 +84,11 @@ namespace SharaTvEngine {
     
     typedef std::function<void(Channel&, const string&, unsigned int, const std::string&)> TChannelParserDelegate;
 
-    static void ParseChannelAndGroup(const std::string& data, const GloabalTags& globalTags, unsigned int plistIndex, TChannelParserDelegate onChannelFound);
-    static void ParsePlaylist(const string& data, const GloabalTags& globalTags, TChannelParserDelegate onChannelFound);
+    static void ParseChannelAndGroup(const M3uEntry& entry, const GloabalTags& globalTags, unsigned int plistIndex, TChannelParserDelegate onChannelFound);
+    static bool ParsePlaylist(const string& data, const GloabalTags& globalTags, TChannelParserDelegate onChannelFound);
     static void GetGlobalTagsFromPlaylist(const string& data, GloabalTags& globalTags);
-    static string FindVar(const string& data, string::size_type pos, const char* varTag);
+    static void WriteSnapshotExtra(SnapshotWriter& out, const GloabalTags& globalTags, const ArchiveInfos& archiveInfo);
+    static bool ReadSnapshotExtra(SnapshotReader& in, GloabalTags& globalTags, ArchiveInfos& archiveInfo);
     //    static void LoadPlaylist(const string& plistUrl, string& data);
     
     Core::Core(const std::string &playlistUrl,  const std::string &epgUrl, bool enableAdult)
@@ -89,21 +96,33 @@ namespace SharaTvEngine {
     , m_playListUrl(playlistUrl)
     , m_epgUrl(epgUrl)
     , m_maxArchiveDuration(-1)
+    , m_channelsSnapshotKey(playlistUrl + '\n' + epgUrl)
+    , m_isChannelsSnapshotLoaded(false)
     {
-        string data;
-        // NOTE: shara TV does NOT check credentials
-        // Just builds a playlist.
-        // I.e. GetCachedFileContents alwais succeeded.
-        if(!XMLTV::GetCachedFileContents(m_playListUrl, [&data](const char* buf, unsigned int size) {
-            data.append(buf, size);
-            return size;
-        }, true)){
-            LogError("SharaTvPlayer: failed to download playlist. URL: %s", playlistUrl.c_str());
-            throw ServerErrorException("SharaTvPlayer: failed to download playlist.", -1);
+        // Channels of previous run are served at once, playlist is revalidated in background
+        m_isChannelsSnapshotLoaded = m_channelsSnapshot.Load(c_ChannelsSnapshotFile, m_channelsSnapshotKey, [this](SnapshotReader& in) {
+            return ReadSnapshotExtra(in, m_globalTags, m_archiveInfo);
+        });
+        if(m_isChannelsSnapshotLoaded) {
+            LogInfo("SharaTvPlayer: %d channels are loaded from snapshot.", (int)m_channelsSnapshot.Channels.size());
+        } else {
+            m_globalTags = GloabalTags();
+            m_archiveInfo.Reset();
+            string data;
+            // NOTE: shara TV does NOT check credentials
+            // Just builds a playlist.
+            // I.e. GetCachedFileContents alwais succeeded.
+            if(!XMLTV::GetCachedFileContents(m_playListUrl, [&data](const char* buf, unsigned int size) {
+                data.append(buf, size);
+                return size;
+            }, true)){
+                LogError("SharaTvPlayer: failed to download playlist. URL: %s", playlistUrl.c_str());
+                throw ServerErrorException("SharaTvPlayer: failed to download playlist.", -1);
+            }
+            
+            GetGlobalTagsFromPlaylist(data, m_globalTags);
         }
         
-        GetGlobalTagsFromPlaylist(data, m_globalTags);
-        
         if(m_epgUrl.empty() && !m_globalTags.m_epgUrl.empty()){
             m_epgUrl = m_globalTags.m_epgUrl;
             LogInfo("SharaTvPlayer: no external EPG link provided. Will use playlist's url-tvg tag %s", m_epgUrl.c_str());
@@ -125,6 +144,7 @@ namespace SharaTvEngine {
     
     Core::~Core()
     {
+        StopChannelsRevalidation();
         Cleanup();
         PrepareForDestruction();
     }
@@ -138,23 +158,76 @@ namespace SharaTvEngine {
     
     void Core::BuildChannelAndGroupList()
     {
-        using namespace XMLTV;
+        bool shouldRevalidate = false;
+        if(m_isChannelsSnapshotLoaded) {
+            // Once, later rebuilds parse the playlist
+            m_isChannelsSnapshotLoaded = false;
+            shouldRevalidate = time(nullptr) - m_channelsSnapshot.ValidatedAt > c_ChannelsSnapshotFreshness;
+        } else {
+            // Revalidation reads the served snapshot
+            StopChannelsRevalidation();
+            string data;
+            const bool isLoaded = XMLTV::GetCachedFileContents(m_playListUrl, [&data](const char* buf, unsigned int size) {
+                data.append(buf, size);
+                return size;
+            });
+            
+            ArchiveInfos archiveInfo;
+            ChannelListSnapshot fresh;
+            if(isLoaded && ResolveChannels(data, m_globalTags, fresh, archiveInfo)) {
+                fresh.SourceHash = ChannelListSnapshot::Hash(data);
+                fresh.ValidatedAt = time(nullptr);
+                m_channelsSnapshot = std::move(fresh);
+                m_archiveInfo = std::move(archiveInfo);
+                SaveChannelsSnapshot(m_channelsSnapshot, m_globalTags, m_archiveInfo);
+            } else {
+                // Snapshot file is not overwritten, next start serves it and revalidates
+                LogError("SharaTvPlayer: failed to load playlist, previous channel list is kept.");
+            }
+        }
         
-        string data;
-        XMLTV::GetCachedFileContents(m_playListUrl, [&data](const char* buf, unsigned int size) {
-            data.append(buf, size);
-            return size;
-        });
+        // EPG is kept as deep as the deepest channel archive
+        SetEpgArchiveDepth(std::chrono::days(m_archiveInfo.archiveDays));
+        
+        // Add groups
+        GroupId adultChannelsGroupId = -1;
+        for(const auto& group :  m_channelsSnapshot.Groups) {
+            Group newGroup;
+            newGroup.Name = group.second.Name;
+            AddGroup(group.first, newGroup);
+            if(-1 == adultChannelsGroupId &&  newGroup.Name == "Взрослые")
+                adultChannelsGroupId = group.first;
+        }
+        // Add channels
+        for(const auto& group :  m_channelsSnapshot.Groups) {
+            if(!m_enableAdult && adultChannelsGroupId == group.first)
+                continue;
+            for(const auto& member : group.second.Channels) {
+                Channel channel = m_channelsSnapshot.Channels.at(member.second);
+                // Override channel logo with local icon when set
+                SetLocalPathForLogo(channel);
+                TranslateMulticastUrls(channel.Urls);
+                AddChannel(channel);
+                AddChannelToGroup(group.first, channel.UniqueId);
+            }
+        }
+        
+        if(shouldRevalidate) {
+            RevalidateChannelsAsync([this](std::stop_token stopToken) {
+                return RevalidateChannels(stopToken);
+            });
+        }
+    }
+    
+    bool Core::ResolveChannels(const string& data, const GloabalTags& globalTags, ChannelListSnapshot& snapshot, ArchiveInfos& archiveInfo) const
+    {
+        using namespace XMLTV;
         
-        m_archiveInfo.Reset();
         PlaylistContent plistContent;
         
-        ParsePlaylist(data, m_globalTags,
+        const bool isParsed = ParsePlaylist(data, globalTags,
                       [&](Channel& channel, const string& groupName, unsigned int archiveDays, const std::string& archiveUrl)
         {
-            // Override channel logo with local icon when set
-            SetLocalPathForLogo(channel);
-            
             // Get group ID for channel by group name.
             // Add new group if missing.
             if(plistContent.groups.count(groupName) == 0) {
@@ -164,35 +237,37 @@ namespace SharaTvEngine {
 
             plistContent.channels[channel.Name] = PlaylistContent::TChannels::mapped_type(channel, plistContent.groups[groupName]);
             if(channel.HasArchive) {
-                m_archiveInfo.info.emplace(channel.UniqueId, std::move(ArchiveInfo(archiveDays, archiveUrl)));
-                if(m_archiveInfo.archiveDays < archiveDays)
-                    m_archiveInfo.archiveDays = archiveDays;
+                archiveInfo.info.emplace(channel.UniqueId, std::move(ArchiveInfo(archiveDays, archiveUrl)));
+                if(archiveInfo.archiveDays < archiveDays)
+                    archiveInfo.archiveDays = archiveDays;
             }
 
         });
+        if(!isParsed)
+            return false;
 
         // Verify tvg-id from EPG file
         // For channels with EpgId == UnknownChannelId (no tvg-id tag in playlist)
         // search for EpgId by comparision of channel name from playlist and display name from EPG
 
-        std::map<const std::string, Channel&> channelsWithoutEpgIds;
+        ChannelNameIndex<Channel*> channelsWithoutEpgIds;
         std::map<ChannelId, vector<Channel*> > channelsWithoutIcons;
 
         for (auto & ch : plistContent.channels) {
             Channel& theChannel = ch.second.first;
             if(theChannel.EpgId == UnknownChannelId) {
-                channelsWithoutEpgIds.emplace(ch.first, theChannel);
+                channelsWithoutEpgIds.Add(ch.first, &theChannel);
             } else if(theChannel.IconPath.empty()){
                 channelsWithoutIcons[theChannel.EpgId].push_back(&theChannel);
             }
         }
-        if(!channelsWithoutEpgIds.empty() || !channelsWithoutIcons.empty()) {
+        if(!channelsWithoutEpgIds.IsEmpty() || !channelsWithoutIcons.empty()) {
             ChannelCallback onNewChannel = [&channelsWithoutEpgIds, &channelsWithoutIcons](const EpgChannel& newChannel){
                 // fill EpgId of channel from EPG
-                if(!channelsWithoutEpgIds.empty()) {
+                if(!channelsWithoutEpgIds.IsEmpty()) {
                     for(const auto& epgChannelName : newChannel.displayNames) {
-                        if(channelsWithoutEpgIds.count(epgChannelName) != 0) {
-                            auto& plistChannel = channelsWithoutEpgIds.at(epgChannelName);
+                        if(auto found = channelsWithoutEpgIds.Find(epgChannelName)) {
+                            auto& plistChannel = **found;
                             plistChannel.EpgId = newChannel.id;
                             if(plistChannel.IconPath.empty())
                                 plistChannel.IconPath = newChannel.strIcon;
@@ -211,30 +286,106 @@ namespace SharaTvEngine {
             XMLTV::ParseChannels(m_epgUrl, onNewChannel);
         }
         
-        // Add groups
-        GroupId adultChannelsGroupId = -1;
         for(const auto& group :  plistContent.groups) {
-            Group newGroup;
-            newGroup.Name = group.first;
-            AddGroup(group.second, newGroup);
-            if(-1 == adultChannelsGroupId &&  newGroup.Name == "Взрослые")
-                adultChannelsGroupId = group.second;
+            snapshot.Groups[group.second].Name = group.first;
         }
-        // Add channels
-        for(auto& channelWithGroup : plistContent.channels)
-        {
-            auto& channel = channelWithGroup.second.first;
-            const auto& groupId = channelWithGroup.second.second;
-            
-            if(!m_enableAdult && adultChannelsGroupId == groupId)
-                continue;
-                     
-            TranslateMulticastUrls(channel.Urls);
-            AddChannel(channel);
-            AddChannelToGroup(groupId, channel.UniqueId);
+        // Channels of a group are kept in name order
+        for(const auto& channelWithGroup : plistContent.channels) {
+            const auto& channel = channelWithGroup.second.first;
+            auto& groupChannels = snapshot.Groups[channelWithGroup.second.second].Channels;
+            groupChannels.emplace(static_cast<int>(groupChannels.size()), channel.UniqueId);
+            snapshot.Channels[channel.UniqueId] = channel;
         }
-     }
+        return true;
+    }
     
+    void Core::SaveChannelsSnapshot(const ChannelListSnapshot& snapshot, const GloabalTags& globalTags, const ArchiveInfos& archiveInfo) const
+    {
+        snapshot.Save(c_ChannelsSnapshotFile, m_channelsSnapshotKey, [&](SnapshotWriter& out) {
+            WriteSnapshotExtra(out, globalTags, archiveInfo);
+        });
+    }
+    
+    bool Core::RevalidateChannels(std::stop_token stopToken)
+    {
+        string data;
+        const bool isLoaded = XMLTV::GetCachedFileContents(m_playListUrl, [&data, &stopToken](const char* buf, unsigned int size) -> size_t {
+            // Anything but size stops loading
+            if(stopToken.stop_requested())
+                return 0;
+            data.append(buf, size);
+            return size;
+        }, true);
+        if(stopToken.stop_requested())
+            return false;
+        if(!isLoaded) {
+            LogError("SharaTvPlayer: failed to revalidate playlist, channels from snapshot are kept.");
+            return false;
+        }
+        
+        const uint64_t sourceHash = ChannelListSnapshot::Hash(data);
+        if(sourceHash == m_channelsSnapshot.SourceHash) {
+            LogDebug("SharaTvPlayer: playlist is not changed.");
+            ChannelListSnapshot validated = m_channelsSnapshot;
+            validated.ValidatedAt = time(nullptr);
+            SaveChannelsSnapshot(validated, m_globalTags, m_archiveInfo);
+            return false;
+        }
+        
+        GloabalTags globalTags;
+        GetGlobalTagsFromPlaylist(data, globalTags);
+        ArchiveInfos archiveInfo;
+        ChannelListSnapshot fresh;
+        const bool isResolved = ResolveChannels(data, globalTags, fresh, archiveInfo);
+        if(stopToken.stop_requested())
+            return false;
+        if(!isResolved) {
+            LogError("SharaTvPlayer: failed to parse revalidated playlist, channels from snapshot are kept.");
+            return false;
+        }
+        fresh.SourceHash = sourceHash;
+        fresh.ValidatedAt = time(nullptr);
+        SaveChannelsSnapshot(fresh, globalTags, archiveInfo);
+        
+        // Playlists often differ by session tokens only
+        const bool isChanged = fresh.Content([&](SnapshotWriter& out) { WriteSnapshotExtra(out, globalTags, archiveInfo); })
+            != m_channelsSnapshot.Content([this](SnapshotWriter& out) { WriteSnapshotExtra(out, m_globalTags, m_archiveInfo); });
+        LogInfo("SharaTvPlayer: playlist is changed, channel list is %s.", isChanged ? "changed" : "the same");
+        return isChanged;
+    }
+    
+    static void WriteSnapshotExtra(SnapshotWriter& out, const GloabalTags& globalTags, const ArchiveInfos& archiveInfo)
+    {
+        out.String(globalTags.m_epgUrl);
+        out.String(globalTags.m_catchupType);
+        out.String(globalTags.m_catchupSource);
+        out.U64(globalTags.m_catchupDays);
+        out.U32(archiveInfo.archiveDays);
+        out.U32(static_cast<uint32_t>(archiveInfo.info.size()));
+        for(const auto& info : archiveInfo.info) {
+            out.U32(info.first);
+            out.U32(info.second.days);
+            out.String(info.second.urlTemplate);
+        }
+    }
+    
+    static bool ReadSnapshotExtra(SnapshotReader& in, GloabalTags& globalTags, ArchiveInfos& archiveInfo)
+    {
+        uint64_t catchupDays;
+        uint32_t count;
+        if(!in.String(globalTags.m_epgUrl) || !in.String(globalTags.m_catchupType) || !in.String(globalTags.m_catchupSource)
+           || !in.U64(catchupDays) || !in.U32(archiveInfo.archiveDays) || !in.U32(count))
+            return false;
+        globalTags.m_catchupDays = static_cast<unsigned long>(catchupDays);
+        for(uint32_t i = 0; i < count; ++i) {
+            uint32_t channelId, days;
+            string urlTemplate;
+            if(!in.U32(channelId) || !in.U32(days) || !in.String(urlTemplate))
+                return false;
+            archiveInfo.info.emplace(channelId, ArchiveInfo(days, urlTemplate));
+        }
+        return true;
+    }
 
     std::string Core::GetArchiveUrl(ChannelId channelId, time_t startTime, time_t duration)
     {
@@ -298,20 +449,6 @@ namespace SharaTvEngine {
         return  url;
     }
     
-    //    bool Core::AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry)
-    //    {
-    //        unsigned int id = xmlEpgEntry.startTime;
-    //
-    //        EpgEntry epgEntry;
-    //        epgEntry.ChannelId = xmlEpgEntry.iChannelId;
-    //        epgEntry.Title = xmlEpgEntry.strTitle;
-    //        epgEntry.Description = xmlEpgEntry.strPlot;
-    //        epgEntry.StartTime = xmlEpgEntry.startTime;
-    //        epgEntry.EndTime = xmlEpgEntry.endTime;
-    //        epgEntry.IconPath = xmlEpgEntry.iconPath;
-    //        return ClientCoreBase::AddEpgEntry(id, epgEntry);
-    //    }
-    //
     void Core::UpdateHasArchive(PvrClient::EpgEntry& entry)
     {
         entry.HasArchive = false;
@@ -345,7 +482,7 @@ namespace SharaTvEngine {
         try {
             LoadEpg(cancelled);
             if(!cancelled())
-                SaveEpgCache(c_EpgCacheFile, m_archiveInfo.archiveDays);
+                SaveEpgCache(c_EpgCacheFile, std::chrono::days(m_archiveInfo.archiveDays));
         } catch (...) {	
             LogError("SharaTvPlayer: failed to update EPG.");
         }
@@ -358,225 +495,175 @@ namespace SharaTvEngine {
         
         m_epgUpdateInterval.Init(24*60*60*1000);
 
-        EpgEntryCallback onEpgEntry = [&pThis, cancelled] (const XMLTV::EpgEntry& newEntry) {
+        // Playlist may carry a few channels with the same EPG
+        std::map<KodiChannelId, std::vector<ChannelId>> channelsForEpgId;
+        for(const auto& channel : m_channelList) {
+            if(channel.second.EpgId != UnknownChannelId)
+                channelsForEpgId[channel.second.EpgId].push_back(channel.first);
+        }
+        
+        // Each feed channel is merged into the store when the feed moves to the next one
+        EpgRefresh refresh(*this);
+        EpgStore::ChannelUpdates updates;
+        KodiChannelId feedChannel = 0;
+        auto addEntry = [pThis, &updates, &channelsForEpgId] (const XMLTV::EpgEntry& xmlEntry) {
+            const auto channels = channelsForEpgId.find(xmlEntry.EpgId);
+            if(channels == channelsForEpgId.end())
+                return;
+            PvrClient::EpgEntry epgEntry;
+            epgEntry.Title = xmlEntry.strTitle;
+            epgEntry.Description = xmlEntry.strPlot;
+            epgEntry.StartTime = xmlEntry.startTime;
+            epgEntry.EndTime = xmlEntry.endTime;
+            epgEntry.IconPath = xmlEntry.iconPath;
+            for(const auto channelId : channels->second) {
+                epgEntry.UniqueChannelId = channelId;
+                pThis->UpdateHasArchive(epgEntry);
+                updates.Add(epgEntry);
+            }
+        };
+        EpgEntryCallback onEpgEntry = [pThis, &updates, &feedChannel, &addEntry, cancelled] (const XMLTV::EpgEntry& newEntry) {
+            if(newEntry.EpgId != feedChannel) {
+                pThis->ApplyEpgUpdates(updates);
+                feedChannel = newEntry.EpgId;
+            }
             if(newEntry.startTime == 0 || newEntry.endTime == 0 || newEntry.endTime - newEntry.startTime < 0) {
                 LogNotice("SharaTvPlayer: inaslid EPG entry %s [%d-%d]", newEntry.strTitle.c_str(), newEntry.startTime, newEntry.endTime);
                 return true;
             }
             if(-1 == pThis->m_maxArchiveDuration || newEntry.endTime - newEntry.startTime < pThis->m_maxArchiveDuration) {
-                pThis->AddEpgEntry(newEntry);
+                addEntry(newEntry);
             } else {
                 XMLTV::EpgEntry splittedEntry = newEntry;
                 while(splittedEntry.endTime - splittedEntry.startTime > pThis->m_maxArchiveDuration){
                     splittedEntry.endTime = splittedEntry.startTime + pThis->m_maxArchiveDuration;
-                    pThis->AddEpgEntry(splittedEntry);
+                    addEntry(splittedEntry);
                     splittedEntry.startTime = splittedEntry.endTime;
                     splittedEntry.endTime = newEntry.endTime;
                 }
                 // remining chunk
                 if(splittedEntry.endTime - splittedEntry.startTime > 0)
-                    pThis->AddEpgEntry(splittedEntry);
+                    addEntry(splittedEntry);
                     
             }
             return !cancelled();
         };
+        // Programmes of channels we don't have are skipped unparsed
+        XMLTV::ChannelFilter isMapped = [&channelsForEpgId](KodiChannelId epgId) {
+            return channelsForEpgId.count(epgId) != 0;
+        };
         
-        XMLTV::ParseEpg(m_epgUrl, onEpgEntry);
+        XMLTV::ParseEpg(m_epgUrl, onEpgEntry, isMapped);
+        // Block of the cancelled channel may be incomplete
+        if(!cancelled())
+            ApplyEpgUpdates(updates);
     }
     
     string Core::GetUrl(ChannelId channelId)
     {
-        string url = m_channelList.at(channelId).Urls[0];
+        // Duplicated channels of playlist bring a few URLs
+        string url = StreamHealth::Instance().Best(m_channelList.at(channelId).Urls);
         return url;
     }
     
     static void GetGlobalTagsFromPlaylist(const string& data, GloabalTags& globalTags)
     {
-        string epgUrl;
-        
-        const char* c_M3U = "#EXTM3U";
-        
-        auto pos = data.find(c_M3U);
-        if(string::npos == pos)
+        M3uReader reader(data);
+        if(!reader.IsValid())
             throw BadPlaylistFormatException("Invalid playlist format: missing #EXTM3U tag.");
         
-        pos += strlen(c_M3U);
-        
-        const char* c_INF = "#EXTINF:";
-        auto range = data.find(c_INF, pos);
-        if(string::npos != range) {
-            range -= pos;
-        }
-        string header = data.substr(pos, range);
-        try { globalTags.m_epgUrl = FindVar(header, 0, "url-tvg");} catch (...) {}
-        try { globalTags.m_catchupDays = stoul(FindVar(header, 0, "catchup-days"));} catch (...) {}
+        const M3uAttributes& header = reader.Header();
+        if(header.Has("url-tvg"))
+            globalTags.m_epgUrl = header.GetString("url-tvg");
+        globalTags.m_catchupDays = header.GetUnsigned("catchup-days", globalTags.m_catchupDays);
         
         //Catchup type tags options: "catchup", "catchup-type" (cbilling).
-        vector<const char*> tagNameOptions;
-        tagNameOptions.push_back("catchup");
-        tagNameOptions.push_back("catchup-type");
-        for (auto& tagName : tagNameOptions) {
-            try {
-                globalTags.m_catchupType = FindVar(header, 0, tagName);
-                StringUtils::ToLower(globalTags.m_catchupType);
-                LogDebug("SharaTvPlayer: gloabal catchup type: %s", globalTags.m_catchupType.c_str());
-                break;
-            } catch (...) {}
+        for (auto tagName : {"catchup", "catchup-type"}) {
+            if(!header.Has(tagName))
+                continue;
+            globalTags.m_catchupType = header.GetString(tagName);
+            StringUtils::ToLower(globalTags.m_catchupType);
+            LogDebug("SharaTvPlayer: gloabal catchup type: %s", globalTags.m_catchupType.c_str());
+            break;
         }
         
-        try {
-            globalTags.m_catchupSource = FindVar(header, 0, "catchup-source");
+        if(header.Has("catchup-source")) {
+            globalTags.m_catchupSource = header.GetString("catchup-source");
             LogDebug("SharaTvPlayer: gloabal catchup-source: %s", globalTags.m_catchupSource.c_str());
-        } catch (...) {}
+        }
         
     }
     
     
-    static void ParsePlaylist(const string& data, const GloabalTags& globalTags,  TChannelParserDelegate onChannelFound)
+    static bool ParsePlaylist(const string& data, const GloabalTags& globalTags,  TChannelParserDelegate onChannelFound)
     {
         
         try {
             LogDebug("SharaTvPlayer: parsing playlist.");
-            // Parse gloabal variables
-            //#EXTM3U
-            const char* c_M3U = "#EXTM3U";
-            
-            auto pos = data.find(c_M3U);
-            if(string::npos == pos)
-                throw BadPlaylistFormatException("Invalid playlist format: missing #EXTM3U tag.");
-            pos += strlen(c_M3U);
-            
             // Parse channels
             //#EXTINF:0 audio-track="ru" tvg-id="1147" tvg-name="Первый канал" tvg-logo="https://shara-tv.org/img/images/Chanels/perviy_k.png" group-title="Базовые" catchup="default" catchup-days="3" catchup-source="http://oa5iy59taouocss24ctr.mine.nu:8099/Perviykanal/index-${start}-3600.m3u8?token=oa123456+12345678", Первый канал
             //#EXTGRP:Базовые
             //http://oa5iy59taouocss24ctr.mine.nu:8000/Perviykanal?auth=oa123456+12345678
-            const char* c_INF = "#EXTINF:";
-            pos = data.find(c_INF, pos);
+            M3uReader reader(data);
+            if(!reader.IsValid())
+                throw BadPlaylistFormatException("Invalid playlist format: missing #EXTM3U tag.");
+            
+            // One pass over playlist, entry buffers are reused
+            M3uEntry entry;
             unsigned int plistIndex = 1;
-            while(string::npos != pos){
-                pos += strlen(c_INF);
-                auto pos_end = data.find(c_INF, pos);
-                string::size_type tagLen = (std::string::npos == pos_end) ? std::string::npos : pos_end - pos;
-                string tag = data.substr(pos, tagLen);
-                ParseChannelAndGroup(tag, globalTags, plistIndex++, onChannelFound);
-                pos = pos_end;
+            while(reader.Next(entry)){
+                ParseChannelAndGroup(entry, globalTags, plistIndex++, onChannelFound);
             }
             LogDebug("SharaTvPlayer: added %d channels from playlist." , plistIndex - 1);
-            
+            return true;
         } catch (std::exception& ex) {
             LogError("SharaTvPlayer: exception during playlist loading: %s", ex.what());
+            return false;
         }
     }
     
-    static string FindVar(const string& data, string::size_type pos, const char* varTag)
-    {
-        string strTag(varTag);
-        strTag += '=';
-        pos = data.find(strTag, pos);
-        if(string::npos == pos)
-            throw BadPlaylistFormatException((string("Invalid playlist format: missing variable ") + varTag).c_str());
-        pos += strTag.size();
-        
-        //check whether tag is missing = and "
-        if(data[pos] == '=') ++pos;
-        if(data[pos] == '"') ++pos;
-        
-        auto pos_end = data.find("\"", pos);
-        if(string::npos == pos)
-            throw BadPlaylistFormatException((string("Invalid playlist format: missing end of variable ") + varTag).c_str());
-        return data.substr(pos, pos_end - pos);
-        
-    }
-    
-    static void ParseChannelAndGroup(const string& data, const GloabalTags& globalTags, unsigned int plistIndex, TChannelParserDelegate onChannelFound)
+    static void ParseChannelAndGroup(const M3uEntry& entry, const GloabalTags& globalTags, unsigned int plistIndex, TChannelParserDelegate onChannelFound)
     {
-        //#EXTINF:0 audio-track="ru" tvg-id="1147" tvg-name="Первый канал" tvg-logo="https://shara-tv.org/img/images/Chanels/perviy_k.png" group-title="Базовые" catchup="default" catchup-days="3" catchup-source="http://oa5iy59taouocss24ctr.mine.nu:8099/Perviykanal/index-${start}-3600.m3u8?token=oa123456+12345678", Первый канал
-        //#EXTGRP:Базовые
-        //http://oa5iy59taouocss24ctr.mine.nu:8000/Perviykanal?auth=oa123456+12345678
-        
         const char* c_REC = "tvg-rec";
+        const M3uAttributes& attributes = entry.attributes;
 
-        auto pos = data.find(',');
-        if(string::npos == pos)
+        if(!attributes.HasTitle())
             throw BadPlaylistFormatException("Invalid channel block format: missing ','  delinmeter.");
-        pos += 1;
-        auto endlLine = data.find('\n');
-        string name = data.substr(pos, endlLine - pos);
-        rtrim(name);
-        string tail = data.substr(endlLine + 1);
-        
-        string tvgId;
-        try { tvgId = FindVar(data, 0, "tvg-id");} catch (...) {}
-        
-        string groupName;
-        try { groupName = FindVar(data, 0, "group-title");} catch (...) {}
-        
-        string iconPath;
-        try { iconPath = FindVar(data, 0, "tvg-logo");} catch (...) {}
-        
-        int tvgShift = 0;
-        try { tvgShift = static_cast<int>(std::atof(FindVar(data, 0, "tvg-shift").c_str()) * 3600);} catch (...) {}
-        
-        int preloadingInterval = 0;
-        try { preloadingInterval = static_cast<int>(std::atof(FindVar(data, 0, "preload-interval").c_str()));} catch (...) {}
-
-        int tvgRec = 0;
-        try {
-            tvgRec = stoul(FindVar(data, 0, c_REC));
-        } catch (...) {
-            // Not mandatory var
-        }
+        string name(attributes.Title());
+        
+        string tvgId = attributes.GetString("tvg-id");
+        // Optional #EXTGRP line wins over group-title
+        string groupName = entry.group.empty() ? attributes.GetString("group-title") : string(entry.group);
+        string iconPath = attributes.GetString("tvg-logo");
+        int tvgShift = static_cast<int>(attributes.GetDouble("tvg-shift", 0.0) * 3600);
+        int preloadingInterval = static_cast<int>(attributes.GetDouble("preload-interval", 0.0));
+        // Not mandatory var
+        int tvgRec = static_cast<int>(attributes.GetUnsigned(c_REC, 0));
 
-        unsigned int archiveDays;
+        unsigned long archiveDays = 0;
         string archiveUrl;
-        string archiveType;
-        try {
-            archiveType = FindVar(data, 0, "catchup");
-            StringUtils::ToLower(archiveType);
-        } catch (...) {}
-        
         // archive type tag name options: "catchup", "catchup-type"
-        if(archiveType.empty()) {
-            try {
-                archiveType = FindVar(data, 0, "catchup-type");
-                StringUtils::ToLower(archiveType);
-            } catch (...) {}
-        }
+        string archiveType = attributes.GetString("catchup");
+        if(archiveType.empty())
+            archiveType = attributes.GetString("catchup-type");
+        StringUtils::ToLower(archiveType);
+
         // Channel URL. Should be before archive!
         // Flussonic archives depend from channel URL.
-        endlLine = 0;
-        const char* c_GROUP = "#EXTGRP:";
-        pos = tail.find(c_GROUP);
-        // Optional channel group
-        if(string::npos != pos) {
-            pos += strlen(c_GROUP);
-            endlLine = tail.find('\n', pos);
-            if(std::string::npos == pos)
-                throw BadPlaylistFormatException("Invalid channel block format: missing NEW LINE after #EXTGRP.");
-            groupName = tail.substr(pos, endlLine - pos);
-            rtrim(groupName);
-            ++endlLine;
-        }
-        // skip unsupported by Puzzle tags
-        string url;
-        do{
-            url = tail.substr(endlLine);
-            rtrim(url);
-            endlLine = tail.find('\n', endlLine);
-            if(std::string::npos == endlLine)
-                throw BadPlaylistFormatException("Invalid channel block format: missing NEW LINE after #EXTGRP.");
-            ++endlLine;
-        }while(!url.empty() && url[0] == '#');
-        
+        string url(entry.url);
         if(url.empty())
             throw BadPlaylistFormatException("Invalid channel block format: missing channel URL.");
         
         // Has archive support
         if(!archiveType.empty()) {
              // catchup-days is mandatory tag.
-            try {  archiveDays = stoul(FindVar(data, 0, "catchup-days"));} catch (...) { archiveType.clear();}
+            if(!attributes.TryGetUnsigned("catchup-days", archiveDays))
+                archiveType.clear();
             if(archiveType == "default") {
-                try {  archiveUrl = FindVar(data, 0, "catchup-source");} catch (...) { archiveType.clear();}
+                if(attributes.Has("catchup-source"))
+                    archiveUrl = attributes.GetString("catchup-source");
+                else
+                    archiveType.clear();
             } else if(archiveType == "flussonic" || archiveType == "fs" || archiveType == "flussonic-ts") {
                 auto lastSlash = url.find_last_of('/');
                 auto firstAmp = url.find_first_of('?');
@@ -592,8 +679,8 @@ namespace SharaTvEngine {
             } else if(archiveType == "shift"){
                 archiveUrl = url + "?utc=" + c_START +"&lutc=" + c_LUTC;
             } else if(archiveType == "append") {
-                try {
-                    string catchupSource = FindVar(data, 0, "catchup-source");
+                if(attributes.Has("catchup-source")) {
+                    string catchupSource = attributes.GetString("catchup-source");
                     archiveUrl = url;
                     if(archiveUrl.find("?") == string::npos) {
                         // Just add catchup tag a parameters block
@@ -602,7 +689,7 @@ namespace SharaTvEngine {
                         // Add catchup tag to parameters block
                         StringUtils::Replace(archiveUrl, "?", catchupSource + "&");
                     }
-                } catch (...) {
+                } else {
                     archiveType.clear();
                     archiveUrl.clear();
                 }
@@ -622,7 +709,8 @@ namespace SharaTvEngine {
                 archiveDays = globalTags.m_catchupDays;
             } else {
                 // catchup-days is mandatory tag.
-                try {  archiveDays = stoul(FindVar(data, 0, "catchup-days"));} catch (...) { archiveUrl.clear();}
+                if(!attributes.TryGetUnsigned("catchup-days", archiveDays))
+                    archiveUrl.clear();
             }
         } else if(globalTags.m_catchupType == "shift"){
             // We have archive only when archive days are > 0
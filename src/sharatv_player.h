@@ -28,6 +28,7 @@
 #define _shara_tv_player_h_
 
 #include "client_core_base.hpp"
+#include "ChannelListSnapshot.hpp"
 #include <vector>
 #include <functional>
 #include <list>
@@ -116,7 +117,13 @@ namespace SharaTvEngine
 
     private:
         void LoadEpg(std::function<bool(void)> cancelled);
-//        bool AddEpgEntry(const XMLTV::EpgEntry& xmlEpgEntry);
+
+        // Parses playlist and matches EPG ids, the core is not touched.
+        // False when the playlist can't be parsed.
+        bool ResolveChannels(const std::string& data, const GloabalTags& globalTags, PvrClient::ChannelListSnapshot& snapshot, ArchiveInfos& archiveInfo) const;
+        void SaveChannelsSnapshot(const PvrClient::ChannelListSnapshot& snapshot, const GloabalTags& globalTags, const ArchiveInfos& archiveInfo) const;
+        // Returns true when the playlist brings another channel list
+        bool RevalidateChannels(std::stop_token stopToken);
 
         void Cleanup();
 
@@ -124,6 +131,10 @@ namespace SharaTvEngine
         std::string m_epgUrl;
         GloabalTags m_globalTags;
         ArchiveInfos m_archiveInfo;
+        // Resolved channels of last build, served at startup when loaded from file
+        PvrClient::ChannelListSnapshot m_channelsSnapshot;
+        std::string m_channelsSnapshotKey;
+        bool m_isChannelsSnapshotLoaded;
         bool m_enableAdult;
         // Shara TV supports archive length up to 2 hours
         // Split EPG items longer than m_maxArchiveDuration to avoid this limitation
@@ -39,7 +39,7 @@ namespace Buffers
     private:
         struct Unit {
             static const uint32_t size = CHUNK_SIZE_LIMIT;
-            Unit() : pos(0) {
+            Unit() : pos(0), length(size) {
                 buf = new unsigned char[size];
             }
             ~Unit() {
@@ -47,6 +47,8 @@ namespace Buffers
             }
             unsigned char* buf;
             int64_t pos;
+            // Bytes written, partial after cache swap or input error
+            int64_t length;
         };
         typedef P8PLATFORM::SyncedBuffer <Unit*> Units;
 
@@ -57,10 +59,14 @@ namespace Buffers
         Unit* m_lockedChunk;
         const uint64_t m_unitsLimit;
         uint64_t m_fullUnistCount;
+        const bool m_dropOldest;
     public:
-        SimpleCyclicBuffer(uint64_t maxSize = 1500)
+        // dropOldest: when full, writer reuses the oldest unit instead of failing.
+        // Live pre-buffer keeps the newest data only.
+        SimpleCyclicBuffer(uint64_t maxSize = 1500, bool dropOldest = false)
         : m_unitsLimit (maxSize)
         , m_fullUnistCount(0)
+        , m_dropOldest(dropOldest)
         , m_freeUnits(maxSize)
         , m_fullUnits(maxSize)
         {
@@ -102,13 +108,13 @@ namespace Buffers
                 }
                 
                 int64_t bytesToRead = uiBufSize - totalRead;
-                ssize_t readBytes = std::min(bytesToRead, Unit::size - m_currentUnit->pos);
+                ssize_t readBytes = std::min(bytesToRead, m_currentUnit->length - m_currentUnit->pos);
                 if(readBytes > 0) {
                     memcpy(((uint8_t*)lpBuf) + totalRead, m_currentUnit->buf + m_currentUnit->pos, readBytes);
                     m_currentUnit->pos += readBytes;
                     totalRead += readBytes;
                 }
-                if(m_currentUnit->pos == Unit::size){// Unit empty
+                if(m_currentUnit->pos == m_currentUnit->length){// Unit empty
                     m_currentUnit->pos = 0;
                     m_freeUnits.Push(m_currentUnit);
 //                    Globals::LogDebug("SimpleCyclicBuffer::Read(): free unit.");
@@ -132,8 +138,11 @@ namespace Buffers
             }
 
             if(!m_freeUnits.Pop(m_lockedChunk)) {
-                Globals::LogDebug("SimpleCyclicBuffer::LockUnitForWrite() no chunk available for write.");
-                return false;
+                if(!m_dropOldest || !m_fullUnits.Pop(m_lockedChunk)) {
+                    Globals::LogDebug("SimpleCyclicBuffer::LockUnitForWrite() no chunk available for write.");
+                    return false;
+                }
+                m_lockedChunk->pos = 0;
             }
             *pBuf =  m_lockedChunk->buf;
             return true;
@@ -154,11 +163,11 @@ namespace Buffers
                 m_lockedChunk = nullptr;
                 return;
             }
+            m_lockedChunk->length = Unit::size;
             if(writtenBytes > 0 && writtenBytes != UnitSize()) {
-                Globals::LogInfo("Warning: SimpleCyclicBuffer::UnlockAfterWriten() buffer not full.");
-                ssize_t freeSpace = UnitSize() - writtenBytes;
-                if(freeSpace > 0){
-                    memset(m_lockedChunk->buf + writtenBytes, 0, freeSpace);
+                // Padding would corrupt the stream, reader stops at the written length
+                if(writtenBytes < UnitSize()){
+                    m_lockedChunk->length = writtenBytes;
                 } else {
                     Globals::LogInfo("Warning: SimpleCyclicBuffer::UnlockAfterWriten() written more bytes than buffer size.");
                 }
@@ -38,6 +38,7 @@
 #include <sstream>
 #include <functional>
 #include "globals.hpp"
+#include "StreamHealth.hpp"
 
 namespace Buffers {
     
@@ -50,7 +51,7 @@ namespace Buffers {
     , m_cache(cache)
     , m_cacheToSwap(nullptr)
     , m_isWaitingForRead(false)
-//    , m_downloadSpeed(33 * 1024 * 1024)
+    , m_downloadSpeed(8 * 1024 * 1024)
 //    , m_playbackSpeed(33 * 1024 * 1024)
     {
         if (!m_inputBuffer)
@@ -65,6 +66,7 @@ namespace Buffers {
         
         if(!newUrl.empty()) {
             AbortRead();
+            ReportThroughput();
             m_inputBuffer->SwitchStream(newUrl);            
         }
         
@@ -81,11 +83,21 @@ namespace Buffers {
     TimeshiftBuffer::~TimeshiftBuffer()
     {
         AbortRead();
+        ReportThroughput();
         
         if(m_inputBuffer)
             delete m_inputBuffer;
         if(m_cache)
              delete m_cache;
+        if(m_cacheToSwap)
+            delete m_cacheToSwap;
+    }
+    
+    void TimeshiftBuffer::ReportThroughput() {
+        if(nullptr == m_inputBuffer || 0 == m_downloadSpeed.GetTotalBytes())
+            return;
+        StreamHealth::Instance().RecordThroughput(m_inputBuffer->GetUrl(), m_downloadSpeed.GetBps());
+        m_downloadSpeed.Reset();
     }
     
     void TimeshiftBuffer::CheckAndWaitForSwap() {
@@ -93,12 +105,14 @@ namespace Buffers {
             return;
         LogDebug("TimeshiftBuffer::CheckAndWaitForSwap(): waiting for cache swap...");
         m_writerWaitingForCacheSwap = true;
+        // Wake up reader waiting for data, it does the swap
+        m_writeEvent.Signal();
         m_cacheSwapEvent.Wait();
         m_writerWaitingForCacheSwap = false;
         LogDebug("TimeshiftBuffer::CheckAndWaitForSwap(): cache swap is done.");
     }
     
-    void TimeshiftBuffer::CheckAndSwap() {
+    bool TimeshiftBuffer::CheckAndSwap() {
         // Can swap cache when we have a cache for swap and writer is waiting for us.
         if(nullptr != m_cacheToSwap &&  m_writerWaitingForCacheSwap){
             LogDebug("TimeshiftBuffer::CheckAndSwap(): starting cache swap.");
@@ -125,7 +139,9 @@ namespace Buffers {
             m_writeEvent.Reset();
             m_cacheSwapEvent.Broadcast();
             LogDebug("TimeshiftBuffer::CheckAndSwap(): cache swap done.");
+            return true;
         }
+        return false;
     }
 
     void *TimeshiftBuffer::Process()
@@ -144,6 +160,7 @@ namespace Buffers {
                 }
                 ssize_t bytesRead = 0;
                
+                m_downloadSpeed.StartMeasurement();
                 while (!isError && (bytesRead < bufferLenght) && !IsStopped() && m_inputBuffer != NULL){
                     // Use some "common" timeout (30 sec) since it is background process
                     ssize_t loacalBytesRad = m_inputBuffer->Read(buffer + bytesRead, bufferLenght - bytesRead, 30*1000);
@@ -151,12 +168,21 @@ namespace Buffers {
                     isError = loacalBytesRad < 0;
                 }
 
+                if(bytesRead > 0) {
+                    m_downloadSpeed.FinishMeasurement(bytesRead);
+                    WriteObserver observer;
+                    {
+                        std::lock_guard<std::mutex> lock(m_writeObserverMutex);
+                        observer = m_writeObserver;
+                    }
+                    if(observer)
+                        observer(bytesRead);
+                }
                 if(nullptr != buffer) {
                     m_cache->UnlockAfterWriten(buffer, bytesRead);
                     m_isInputBufferValid = true;
                     m_writeEvent.Signal();
                 }
-//                m_downloadSpeed.StepDone(bytesRead);
             }
         } catch (std::exception& ex ) {
             LogError("Exception in timshift background thread: %s", ex.what());
@@ -190,6 +216,11 @@ namespace Buffers {
             bytesRead = m_cache->Read( buffer + totalBytesRead, bytesToRead);
             bool isTimeout = false;
             while(!isTimeout && bytesRead == 0 && (m_cache->Length() - m_cache->Position()) < (bufferSize - totalBytesRead)) {
+                // Old cache is drained, writer may be waiting for the swap already
+                if(CheckAndSwap()) {
+                    bytesRead = m_cache->Read( buffer + totalBytesRead, bytesToRead);
+                    continue;
+                }
                 if(!(isTimeout = !m_writeEvent.Wait(timeoutMs)))
                    bytesRead = m_cache->Read( buffer + totalBytesRead, bytesToRead);
             }
@@ -252,6 +283,8 @@ namespace Buffers {
         while(IsRunning()) {
             LogNotice("TimeshiftBuffer: waiting 100 ms for thread stopping...");
             P8PLATFORM::CEvent::Sleep(100);
+            // Writer may wait for cache swap, nobody reads to do it
+            m_cacheSwapEvent.Broadcast();
         }
     }
 }
@@ -28,6 +28,8 @@
 #define timeshift_buffer_h
 
 
+#include <functional>
+#include <mutex>
 #include <string>
 #include "p8-platform/threads/threads.h"
 #include "p8-platform/util/buffer.h"
@@ -40,6 +42,10 @@ namespace Buffers {
     class TimeshiftBuffer : public InputBuffer, public P8PLATFORM::CThread
     {
     public:
+        // Called on writer thread with size of every unit read from input, before it goes to cache.
+        // Must not block: input stalls and live streams lose data.
+        typedef std::function<void(size_t bytes)> WriteObserver;
+        
         TimeshiftBuffer(InputBuffer* inputBuffer, ICacheBuffer* cache);
         ~TimeshiftBuffer();
         
@@ -52,6 +58,12 @@ namespace Buffers {
         void AbortRead();
 //        float GetSpeedRatio() const ;
 
+        // Running call of the previous observer may not be finished on return
+        void SetWriteObserver(WriteObserver observer) {
+            std::lock_guard<std::mutex> lock(m_writeObserverMutex);
+            m_writeObserver = std::move(observer);
+        }
+
         void SwapCache(ICacheBuffer* cache){
             m_cacheToSwap = cache;
 //            m_cacheSwapEvent.Wait();
@@ -76,7 +88,10 @@ namespace Buffers {
         
         void Init(const std::string &newUrl = std::string());
         void CheckAndWaitForSwap();
-        void CheckAndSwap();
+        // True when the cache has been swapped
+        bool CheckAndSwap();
+        // Download speed of the current URL goes to StreamHealth. Writer thread must be stopped.
+        void ReportThroughput();
         
         P8PLATFORM::CEvent m_writeEvent;
         P8PLATFORM::CEvent m_cacheSwapEvent;
@@ -86,7 +101,10 @@ namespace Buffers {
         ICacheBuffer* m_cacheToSwap;
         bool m_isInputBufferValid;
         bool m_isWaitingForRead;
-//        Helpers::Speedometer m_downloadSpeed;
+        // Of input reads only, waiting for free cache unit is not counted
+        Helpers::Speedometer m_downloadSpeed;
+        std::mutex m_writeObserverMutex;
+        WriteObserver m_writeObserver;
 //        Helpers::Speedometer m_playbackSpeed;
 
     };
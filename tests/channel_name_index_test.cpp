@@ -0,0 +1,70 @@
+// NormalizeChannelName: case folding of Latin-1, Latin Extended-A, Greek and
+// Cyrillic, 'ё' to 'е', white space (NBSP too) collapsing, malformed UTF-8
+// kept byte for byte; ChannelNameIndex lookups through the normalized key.
+
+#include <cstdio>
+#include <string>
+#include "ChannelNameIndex.hpp"
+#include "TestSupport.h"
+
+using namespace Helpers;
+
+int main()
+{
+    // Cyrillic
+    CHECK_EQ(NormalizeChannelName("ПЕРВЫЙ КАНАЛ"), std::string("первый канал"));
+    CHECK_EQ(NormalizeChannelName("Ёлка"), std::string("елка"));
+    CHECK_EQ(NormalizeChannelName("ёж"), std::string("еж"));
+    CHECK_EQ(NormalizeChannelName("ЇЖАК"), std::string("їжак"));
+    CHECK_EQ(NormalizeChannelName("ЂЏ"), std::string("ђџ"));
+    CHECK_EQ(NormalizeChannelName("Ѣ"), std::string("ѣ"));
+
+    // Latin-1, '×' and 'ß' have no case pair
+    CHECK_EQ(NormalizeChannelName("ÀÉÎÕÜÞØ"), std::string("àéîõüþø"));
+    CHECK_EQ(NormalizeChannelName("×ß"), std::string("×ß"));
+
+    // Latin Extended-A, 'İ' has no single code point lower case
+    CHECK_EQ(NormalizeChannelName("ĀĂĄ"), std::string("āăą"));
+    CHECK_EQ(NormalizeChannelName("ŁŇ"), std::string("łň"));
+    CHECK_EQ(NormalizeChannelName("ŹŻŽ"), std::string("źżž"));
+    CHECK_EQ(NormalizeChannelName("ŊŒŶ"), std::string("ŋœŷ"));
+    CHECK_EQ(NormalizeChannelName("Ÿ"), std::string("ÿ"));
+    CHECK_EQ(NormalizeChannelName("İ"), std::string("İ"));
+
+    // Greek
+    CHECK_EQ(NormalizeChannelName("ΑΒΓ ΩΣ"), std::string("αβγ ωσ"));
+
+    // White space
+    CHECK_EQ(NormalizeChannelName("  Первый \t канал \n"), std::string("первый канал"));
+    CHECK_EQ(NormalizeChannelName("A  B"), std::string("a b"));
+    CHECK_EQ(NormalizeChannelName(" \t  "), std::string());
+    CHECK_EQ(NormalizeChannelName(""), std::string());
+
+    // Malformed UTF-8 bytes are not taken for Latin-1 characters
+    CHECK_EQ(NormalizeChannelName("\x80"), std::string("\x80"));
+    CHECK_EQ(NormalizeChannelName("A\xC0" "B"), std::string("a\xC0" "b"));
+    CHECK_EQ(NormalizeChannelName("TV \xD0"), std::string("tv \xD0"));
+    CHECK_EQ(NormalizeChannelName("\xD0" "A"), std::string("\xD0" "a"));
+    CHECK_EQ(NormalizeChannelName("\xE2\x82"), std::string("\xE2\x82"));
+    CHECK_EQ(NormalizeChannelName("\xC2 \xA0"), std::string("\xC2 \xA0"));
+
+    // Index
+    ChannelNameIndex<int> index;
+    CHECK(index.IsEmpty());
+    CHECK(index.Add("Первый канал", 1));
+    CHECK(!index.Add("ПЕРВЫЙ  КАНАЛ", 2));
+    CHECK(index.Add("Ёлки ТВ", 3));
+    CHECK(index.AddAlias("1 канал", "первый канал"));
+    CHECK(!index.AddAlias("Второй", "Неизвестный"));
+    CHECK_EQ(index.Size(), 3u);
+    CHECK(index.Find("ПЕРВЫЙ КАНАЛ") != nullptr && *index.Find("ПЕРВЫЙ КАНАЛ") == 1);
+    CHECK(index.Find("елки тв") != nullptr && *index.Find("елки тв") == 3);
+    CHECK(index.Find(" 1 КАНАЛ") != nullptr && *index.Find(" 1 КАНАЛ") == 1);
+    CHECK(index.Find("Второй") == nullptr);
+    index.Clear();
+    CHECK(index.IsEmpty());
+    CHECK(index.Find("Первый канал") == nullptr);
+
+    printf("OK\n");
+    return 0;
+}
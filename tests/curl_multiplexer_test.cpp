@@ -0,0 +1,140 @@
+// CurlMultiplexer against local stand-in servers, run by h2_standin.sh:
+//
+//   curl_multiplexer_test <h2 url> <http/1.1 url> <served directory>
+//
+// Checks that concurrent segment loads share one HTTP/2 connection,
+// HTTP/1.1 servers still work, and cancellation ends a transfer at once.
+
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CurlMultiplexer.hpp"
+#include "TestSupport.h"
+
+static const int c_Loaders = 6;
+
+static std::string ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    CHECK(file.is_open());
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static bool Fetch(const std::string& url, std::string& body, CurlMultiplexer::Result& result, std::stop_token stopToken = {})
+{
+    CurlMultiplexer::Transfer transfer;
+    transfer.Url = url;
+    transfer.StopToken = stopToken;
+    return CurlMultiplexer::Instance().Perform(transfer, [&body](const char* data, size_t size) {
+        body.append(data, size);
+        return true;
+    }, result);
+}
+
+// Like HLS loaders of a live stream
+static void ConcurrentSegmentsOverHttp2(const std::string& h2Url, const std::string& directory)
+{
+    std::vector<std::string> bodies(c_Loaders);
+    std::vector<CurlMultiplexer::Result> results(c_Loaders);
+    std::vector<char> succeeded(c_Loaders, false);
+    std::vector<std::thread> loaders;
+    for(int i = 0; i < c_Loaders; ++i) {
+        loaders.emplace_back([&, i] {
+            const std::string name = "/segment" + std::to_string(i + 1) + ".ts";
+            succeeded[i] = Fetch(h2Url + name, bodies[i], results[i]);
+        });
+    }
+    for(auto& loader : loaders)
+        loader.join();
+
+    int handshakes = 0;
+    for(int i = 0; i < c_Loaders; ++i) {
+        CHECK(succeeded[i]);
+        CHECK_EQ(results[i].HttpStatus, 200);
+        CHECK(results[i].IsHttp2);
+        CHECK(bodies[i] == ReadFile(directory + "/segment" + std::to_string(i + 1) + ".ts"));
+        // Transfers multiplexed over an existing connection don't negotiate TLS
+        if(results[i].TlsUs > 0)
+            ++handshakes;
+    }
+    printf("%d concurrent transfers over HTTP/2, %d TLS handshake(s)\n", c_Loaders, handshakes);
+    CHECK_EQ(handshakes, 1);
+}
+
+static void FallbackToHttp1(const std::string& http1Url, const std::string& directory)
+{
+    std::string body;
+    CurlMultiplexer::Result result;
+    CHECK(Fetch(http1Url + "/segment1.ts", body, result));
+    CHECK_EQ(result.HttpStatus, 200);
+    CHECK(!result.IsHttp2);
+    CHECK(body == ReadFile(directory + "/segment1.ts"));
+}
+
+// HTTP errors are not transport errors
+static void MissingFile(const std::string& h2Url)
+{
+    std::string body;
+    CurlMultiplexer::Result result;
+    CHECK(Fetch(h2Url + "/missing.ts", body, result));
+    CHECK_EQ(result.HttpStatus, 404);
+}
+
+static void CancelInFlight(const std::string& h2Url, const std::string& directory)
+{
+    std::stop_source stopSource;
+    CurlMultiplexer::Transfer transfer;
+    transfer.Url = h2Url + "/large.ts";
+    transfer.StopToken = stopSource.get_token();
+    size_t received = 0;
+    CurlMultiplexer::Result result;
+    TestSupport::Stopwatch stopwatch;
+    const bool succeeded = CurlMultiplexer::Instance().Perform(transfer, [&](const char*, size_t size) {
+        received += size;
+        // Channel switch right after the first data
+        stopSource.request_stop();
+        return true;
+    }, result);
+    printf("Cancelled after %zu bytes in %.1f ms\n", received, stopwatch.Milliseconds());
+    CHECK(!succeeded);
+    CHECK(result.Cancelled);
+    CHECK(received < ReadFile(directory + "/large.ts").size());
+
+    // Shared connection survives cancellation of one of its streams
+    std::string body;
+    CurlMultiplexer::Result next;
+    CHECK(Fetch(h2Url + "/segment2.ts", body, next));
+    CHECK(body == ReadFile(directory + "/segment2.ts"));
+}
+
+static void ConsumerStops(const std::string& h2Url)
+{
+    CurlMultiplexer::Transfer transfer;
+    transfer.Url = h2Url + "/large.ts";
+    CurlMultiplexer::Result result;
+    CHECK(!CurlMultiplexer::Instance().Perform(transfer, [](const char*, size_t) { return false; }, result));
+    CHECK(!result.Cancelled);
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc != 4) {
+        fprintf(stderr, "Usage: %s <h2 url> <http/1.1 url> <served directory>\n", argv[0]);
+        return 2;
+    }
+    CHECK(CurlMultiplexer::IsAvailable());
+    const std::string h2Url = argv[1];
+    const std::string http1Url = argv[2];
+    const std::string directory = argv[3];
+
+    ConcurrentSegmentsOverHttp2(h2Url, directory);
+    FallbackToHttp1(http1Url, directory);
+    MissingFile(h2Url);
+    CancelInFlight(h2Url, directory);
+    ConsumerStops(h2Url);
+    printf("OK\n");
+    return 0;
+}
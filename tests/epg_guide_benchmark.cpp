@@ -0,0 +1,108 @@
+// Kodi's guide refresh: GetEpg() of every channel for the days the guide shows,
+// answered by the interval index (TieredEpgStore/EpgStore::ForEachInRange)
+// and by filtering one EPG map of all channels, as ClientCoreBase did before.
+//
+//   epg_guide_benchmark [programmes per channel]
+//
+// Map filtering is timed on every c_ReferenceStep-th channel and scaled to all of them,
+// a full pass takes minutes at default size.
+
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+#include "TieredEpgStore.hpp"
+#include "TestSupport.h"
+
+using namespace PvrClient;
+
+static const ChannelId c_Channels = 2000;
+static const ChannelId c_ReferenceStep = 20;
+// Kodi's defaults: one day back, three days ahead
+static const time_t c_GuideBack = 24 * 3600;
+static const time_t c_GuideAhead = 3 * 24 * 3600;
+
+// Programmes of 20 to 60 minutes, back to back, about half of them in the past
+// (default size is a week back and a week ahead)
+static std::vector<EpgEntry> Programmes(ChannelId channelId, size_t count, time_t now)
+{
+    std::vector<EpgEntry> result(count);
+    time_t start = now - static_cast<time_t>(count) * 20 * 60 + channelId % 30 * 60;
+    for(size_t i = 0; i < count; ++i) {
+        EpgEntry& entry = result[i];
+        entry.UniqueChannelId = channelId;
+        entry.StartTime = static_cast<unsigned int>(start);
+        start += (20 + (channelId * 7 + i * 13) % 41) * 60;
+        entry.EndTime = static_cast<unsigned int>(start);
+        entry.Title = "Programme " + std::to_string(i % 500);
+        entry.Description = "Description " + std::to_string(i % 300);
+    }
+    return result;
+}
+
+struct GuideResult
+{
+    size_t Entries = 0;
+    size_t Checksum = 0;
+
+    void Add(const EpgEntryList::value_type& entry) {
+        ++Entries;
+        Checksum += entry.first ^ entry.second.StartTime;
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    const size_t perChannel = TestSupport::SizeArgument(argc, argv, 672);
+    const time_t now = time(nullptr);
+
+    TieredEpgStore store;
+    EpgEntryList map;
+    store.Modify([&](EpgStore& epg) {
+        for(ChannelId channelId = 1; channelId <= c_Channels; ++channelId) {
+            for(const auto& entry : Programmes(channelId, perChannel, now)) {
+                const UniqueBroadcastIdType id = epg.Add(entry.StartTime, entry);
+                map.emplace(id, entry);
+            }
+        }
+        epg.Finalize();
+    });
+    printf("%u channels, %zu programmes\n", c_Channels, map.size());
+
+    const time_t start = now - c_GuideBack;
+    const time_t end = now + c_GuideAhead;
+    std::vector<GuideResult> indexed(c_Channels + 1);
+    TestSupport::Stopwatch indexWatch;
+    for(ChannelId channelId = 1; channelId <= c_Channels; ++channelId) {
+        GuideResult& result = indexed[channelId];
+        IClientCore::EpgEntryAction action = [&result](const EpgEntryList::value_type& entry) {
+            result.Add(entry);
+            return true;
+        };
+        store.ForEachInRange(channelId, start, end, action);
+    }
+    const double indexMs = indexWatch.Milliseconds();
+
+    TestSupport::Stopwatch mapWatch;
+    size_t sampled = 0;
+    for(ChannelId channelId = 1; channelId <= c_Channels; channelId += c_ReferenceStep, ++sampled) {
+        GuideResult result;
+        for(const auto& entry : map) {
+            if(entry.second.UniqueChannelId == channelId && entry.second.StartTime < end && entry.second.EndTime > start)
+                result.Add(entry);
+        }
+        CHECK(result.Entries > 0);
+        CHECK_EQ(result.Entries, indexed[channelId].Entries);
+        CHECK_EQ(result.Checksum, indexed[channelId].Checksum);
+    }
+    const double mapMs = mapWatch.Milliseconds() * c_Channels / sampled;
+
+    size_t entries = 0;
+    for(const auto& result : indexed)
+        entries += result.Entries;
+    printf("Guide of %u channels, %zu programmes:\n", c_Channels, entries);
+    printf("%-14s %12.1f ms\n", "interval index", indexMs);
+    printf("%-14s %12.1f ms (scaled from %zu channels)\n", "map filter", mapMs, sampled);
+    return 0;
+}
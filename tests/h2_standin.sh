@@ -0,0 +1,52 @@
+#!/bin/sh
+# Runs a test against local stand-in servers serving the same generated directory:
+#   https://localhost:<port> - nghttpd, HTTP/2 over TLS, self-signed certificate (CURL_CA_BUNDLE)
+#   http://127.0.0.1:<port>  - python http.server, HTTP/1.1 only
+#
+#   h2_standin.sh <nghttpd> <openssl> <python3> <test> -> <test> <h2 url> <http/1.1 url> <directory>
+
+NGHTTPD=$1
+OPENSSL=$2
+PYTHON=$3
+TEST=$4
+
+WORK=$(mktemp -d)
+cleanup() {
+    kill $H2_PID $HTTP1_PID 2>/dev/null || true
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+free_port() {
+    "$PYTHON" -c 'import socket; s = socket.socket(); s.bind(("127.0.0.1", 0)); print(s.getsockname()[1])'
+}
+wait_for_port() {
+    for attempt in $(seq 50); do
+        "$PYTHON" -c "import socket; socket.create_connection(('127.0.0.1', $1), 1)" 2>/dev/null && return 0
+        sleep 0.1
+    done
+    echo "Server on port $1 has not started" >&2
+    return 1
+}
+
+mkdir "$WORK/www"
+# Live stream sized segments and a large file to cancel in the middle of
+for i in 1 2 3 4 5 6; do
+    head -c 300000 /dev/urandom > "$WORK/www/segment$i.ts"
+done
+head -c 16777216 /dev/urandom > "$WORK/www/large.ts"
+
+"$OPENSSL" req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=localhost \
+    -addext subjectAltName=DNS:localhost \
+    -keyout "$WORK/key.pem" -out "$WORK/cert.pem" >/dev/null 2>&1 || exit 1
+
+H2_PORT=$(free_port)
+HTTP1_PORT=$(free_port)
+"$NGHTTPD" -d "$WORK/www" "$H2_PORT" "$WORK/key.pem" "$WORK/cert.pem" >/dev/null 2>&1 &
+H2_PID=$!
+"$PYTHON" -m http.server --bind 127.0.0.1 --directory "$WORK/www" "$HTTP1_PORT" >/dev/null 2>&1 &
+HTTP1_PID=$!
+wait_for_port "$H2_PORT" || exit 1
+wait_for_port "$HTTP1_PORT" || exit 1
+
+CURL_CA_BUNDLE="$WORK/cert.pem" "$TEST" "https://localhost:$H2_PORT" "http://127.0.0.1:$HTTP1_PORT" "$WORK/www"
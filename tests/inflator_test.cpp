@@ -0,0 +1,89 @@
+// Helpers::Inflator on bodies as servers send them: split at any byte,
+// concatenated gzip members, padding after the last member, deflate without zlib header.
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "Inflator.hpp"
+#include "TestSupport.h"
+
+// windowBits as deflateInit2() takes them: 15 + 16 gzip, 15 zlib, -15 raw deflate
+static std::string Compress(const std::string& data, int windowBits)
+{
+    z_stream stream{};
+    CHECK_EQ(deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY), Z_OK);
+    std::string result(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&result[0]);
+    stream.avail_out = static_cast<uInt>(result.size());
+    CHECK_EQ(deflate(&stream, Z_FINISH), Z_STREAM_END);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
+
+static std::string Text(size_t size, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::string text;
+    while(text.size() < size)
+        text += "<programme channel=\"" + std::to_string(random() % 1000) + "\"><title>News</title></programme>\n";
+    text.resize(size);
+    return text;
+}
+
+// Feeds input in chunks of chunkSize bytes
+static bool Inflate(const std::string& input, size_t chunkSize, std::string& output)
+{
+    output.clear();
+    Helpers::Inflator inflator([&output](const char* data, size_t size) {
+        output.append(data, size);
+        return true;
+    });
+    for(size_t offset = 0; offset < input.size(); offset += chunkSize) {
+        if(!inflator.Process(input.data() + offset, std::min(chunkSize, input.size() - offset)))
+            return false;
+    }
+    return true;
+}
+
+static void ExpectInflated(const char* name, const std::string& input, const std::string& expected)
+{
+    for(size_t chunkSize : {size_t(1), size_t(2), size_t(3), size_t(7), size_t(4096), input.size()}) {
+        std::string output;
+        if(!Inflate(input, chunkSize, output) || output != expected) {
+            fprintf(stderr, "%s: wrong output with %zu byte chunks (%zu of %zu bytes)\n", name, chunkSize, output.size(), expected.size());
+            exit(1);
+        }
+    }
+}
+
+int main()
+{
+    const std::string first = Text(100000, 1);
+    const std::string second = Text(30000, 2);
+    const std::string gzip = Compress(first, 15 + 16);
+
+    ExpectInflated("gzip", gzip, first);
+    ExpectInflated("zlib", Compress(first, 15), first);
+    ExpectInflated("raw deflate", Compress(first, -15), first);
+    ExpectInflated("gzip members", gzip + Compress(second, 15 + 16), first + second);
+    ExpectInflated("zero padding", gzip + std::string(1000, '\0'), first);
+    ExpectInflated("trailing byte", gzip + "\n", first);
+    ExpectInflated("garbage after members", gzip + Compress(second, 15 + 16) + "garbage", first + second);
+
+    // Broken zlib stream fails once output was delivered, it is not replayed as raw deflate
+    std::string broken = Compress(first, 15);
+    broken[broken.size() / 2] ^= 0x55;
+    std::string output;
+    CHECK(!Inflate(broken, broken.size(), output));
+    CHECK(output.size() <= first.size());
+
+    CHECK(!Helpers::Inflator::IsGzipData(gzip.data(), 2));
+    CHECK(Helpers::Inflator::IsGzipData(gzip.data(), Helpers::Inflator::c_gzipMagicSize));
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,216 @@
+// Helpers::M3uReader against the playlist parsing it replaced in SharaTV:
+// #EXTINF blocks copied out of the playlist and searched with FindVar() per tag,
+// missing tags reported by exceptions.
+//
+//   m3u_tokenizer_benchmark [entries]
+//
+// Both extract the tags SharaTV reads, the records must be the same.
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "M3uTokenizer.hpp"
+#include "TestSupport.h"
+
+struct Record
+{
+    std::string name;
+    std::string tvgId;
+    std::string group;
+    std::string logo;
+    int tvgShift = 0;
+    unsigned long rec = 0;
+    std::string catchup;
+    unsigned long catchupDays = 0;
+    std::string catchupSource;
+    std::string url;
+
+    bool operator==(const Record& other) const {
+        return name == other.name && tvgId == other.tvgId && group == other.group && logo == other.logo
+            && tvgShift == other.tvgShift && rec == other.rec && catchup == other.catchup
+            && catchupDays == other.catchupDays && catchupSource == other.catchupSource && url == other.url;
+    }
+};
+
+namespace reference {
+
+using std::string;
+
+static void rtrim(string& s)
+{
+    while(!s.empty() && (s.back() == ' ' || s.back() == '\r' || s.back() == '\n' || s.back() == '\t'))
+        s.pop_back();
+}
+
+static string FindVar(const string& data, string::size_type pos, const char* varTag)
+{
+    string strTag(varTag);
+    strTag += '=';
+    pos = data.find(strTag, pos);
+    if(string::npos == pos)
+        throw std::runtime_error(string("Invalid playlist format: missing variable ") + varTag);
+    pos += strTag.size();
+    if(data[pos] == '=') ++pos;
+    if(data[pos] == '"') ++pos;
+    auto pos_end = data.find("\"", pos);
+    return data.substr(pos, pos_end - pos);
+}
+
+static Record ParseChannelAndGroup(const string& data)
+{
+    Record record;
+    auto pos = data.find(',');
+    if(string::npos == pos)
+        throw std::runtime_error("Invalid channel block format: missing ','");
+    pos += 1;
+    auto endlLine = data.find('\n');
+    record.name = data.substr(pos, endlLine - pos);
+    rtrim(record.name);
+    string tail = data.substr(endlLine + 1);
+
+    try { record.tvgId = FindVar(data, 0, "tvg-id"); } catch (...) {}
+    try { record.group = FindVar(data, 0, "group-title"); } catch (...) {}
+    try { record.logo = FindVar(data, 0, "tvg-logo"); } catch (...) {}
+    try { record.tvgShift = static_cast<int>(std::atof(FindVar(data, 0, "tvg-shift").c_str()) * 3600); } catch (...) {}
+    try { record.rec = std::stoul(FindVar(data, 0, "tvg-rec")); } catch (...) {}
+    try { record.catchup = FindVar(data, 0, "catchup"); } catch (...) {}
+    if(record.catchup.empty()) {
+        try { record.catchup = FindVar(data, 0, "catchup-type"); } catch (...) {}
+    }
+
+    endlLine = 0;
+    const string c_GROUP = "#EXTGRP:";
+    pos = tail.find(c_GROUP);
+    if(string::npos != pos) {
+        pos += c_GROUP.size();
+        endlLine = tail.find('\n', pos);
+        record.group = tail.substr(pos, endlLine - pos);
+        rtrim(record.group);
+        ++endlLine;
+    }
+    do {
+        record.url = tail.substr(endlLine);
+        rtrim(record.url);
+        endlLine = tail.find('\n', endlLine);
+        if(string::npos == endlLine)
+            throw std::runtime_error("Invalid channel block format: missing NEW LINE.");
+        ++endlLine;
+    } while(!record.url.empty() && record.url[0] == '#');
+
+    if(!record.catchup.empty()) {
+        try { record.catchupDays = std::stoul(FindVar(data, 0, "catchup-days")); } catch (...) {}
+        try { record.catchupSource = FindVar(data, 0, "catchup-source"); } catch (...) {}
+    }
+    return record;
+}
+
+static std::vector<Record> ParsePlaylist(const string& data)
+{
+    std::vector<Record> records;
+    const string c_M3U = "#EXTM3U";
+    auto pos = data.find(c_M3U);
+    if(string::npos == pos)
+        throw std::runtime_error("Invalid playlist format: missing #EXTM3U tag.");
+    pos += c_M3U.size();
+    const string c_INF = "#EXTINF:";
+    pos = data.find(c_INF, pos);
+    while(string::npos != pos) {
+        pos += c_INF.size();
+        auto pos_end = data.find(c_INF, pos);
+        string::size_type tagLen = (string::npos == pos_end) ? string::npos : pos_end - pos;
+        records.push_back(ParseChannelAndGroup(data.substr(pos, tagLen)));
+        pos = pos_end;
+    }
+    return records;
+}
+
+} // namespace reference
+
+static std::vector<Record> ParseWithTokenizer(const std::string& data)
+{
+    std::vector<Record> records;
+    Helpers::M3uReader reader(data);
+    CHECK(reader.IsValid());
+    Helpers::M3uEntry entry;
+    while(reader.Next(entry)) {
+        const auto& attributes = entry.attributes;
+        Record record;
+        record.name = std::string(attributes.Title());
+        record.tvgId = attributes.GetString("tvg-id");
+        record.group = entry.group.empty() ? attributes.GetString("group-title") : std::string(entry.group);
+        record.logo = attributes.GetString("tvg-logo");
+        record.tvgShift = static_cast<int>(attributes.GetDouble("tvg-shift", 0.0) * 3600);
+        record.rec = attributes.GetUnsigned("tvg-rec", 0);
+        record.catchup = attributes.GetString("catchup");
+        if(record.catchup.empty())
+            record.catchup = attributes.GetString("catchup-type");
+        if(!record.catchup.empty()) {
+            record.catchupDays = attributes.GetUnsigned("catchup-days", 0);
+            record.catchupSource = attributes.GetString("catchup-source");
+        }
+        record.url = std::string(entry.url);
+        records.push_back(std::move(record));
+    }
+    return records;
+}
+
+// Like SharaTV/Edem playlists: most entries have catchup tags, some an #EXTGRP line
+static std::string Playlist(size_t entries)
+{
+    std::string data = "#EXTM3U url-tvg=\"http://example.com/epg.xml.gz\" catchup-days=\"3\"\n";
+    char line[1024];
+    for(size_t i = 0; i < entries; ++i) {
+        const size_t id = 1000 + i;
+        if(i % 4 == 0) {
+            snprintf(line, sizeof(line),
+                     "#EXTINF:0 audio-track=\"ru\" tvg-id=\"%zu\" tvg-name=\"Channel %zu\" tvg-logo=\"http://example.com/img/%zu.png\""
+                     " group-title=\"Group %zu\" tvg-rec=\"%zu\" catchup=\"default\" catchup-days=\"%zu\""
+                     " catchup-source=\"http://example.com/%zu/index-${start}-3600.m3u8?token=abc+123\", Channel %zu\n",
+                     id, id, id, i % 20, i % 5, i % 7 + 1, id, id);
+        } else if(i % 4 == 1) {
+            snprintf(line, sizeof(line),
+                     "#EXTINF:-1 tvg-id=\"%zu\" tvg-logo=\"http://example.com/img/%zu.png\" tvg-shift=\"%d\" catchup-type=\"flussonic\""
+                     " catchup-days=\"%zu\",Channel %zu\n#EXTGRP:Group %zu\n",
+                     id, id, static_cast<int>(i % 3) - 1, i % 7 + 1, id, i % 20);
+        } else {
+            snprintf(line, sizeof(line),
+                     "#EXTINF:0 tvg-id=\"%zu\" tvg-name=\"Channel %zu\" tvg-logo=\"http://example.com/img/%zu.png\" group-title=\"Group %zu\",Channel %zu\n",
+                     id, id, id, i % 20, id);
+        }
+        data += line;
+        if(i % 10 == 0)
+            data += "#EXTVLCOPT:http-user-agent=Player\n";
+        snprintf(line, sizeof(line), "http://example.com:8000/stream/%zu/index.m3u8?token=abc+123\n", id);
+        data += line;
+    }
+    return data;
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t entries = TestSupport::SizeArgument(argc, argv, 20000);
+    const std::string playlist = Playlist(entries);
+    printf("%zu entries, %zu KB\n", entries, playlist.size() / 1024);
+
+    TestSupport::Stopwatch referenceWatch;
+    const auto expected = reference::ParsePlaylist(playlist);
+    const double referenceMs = referenceWatch.Milliseconds();
+
+    TestSupport::Stopwatch tokenizerWatch;
+    const auto parsed = ParseWithTokenizer(playlist);
+    const double tokenizerMs = tokenizerWatch.Milliseconds();
+
+    CHECK_EQ(expected.size(), entries);
+    CHECK_EQ(parsed.size(), entries);
+    for(size_t i = 0; i < entries; ++i) {
+        if(!(parsed[i] == expected[i])) {
+            fprintf(stderr, "Entry %zu differs: %s / %s\n", i, parsed[i].name.c_str(), expected[i].name.c_str());
+            return 1;
+        }
+    }
+    printf("%-10s %10.1f ms\n", "FindVar", referenceMs);
+    printf("%-10s %10.1f ms\n", "tokenizer", tokenizerMs);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef SYNTHETIC_XMLTV_H
+#define SYNTHETIC_XMLTV_H
+
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include "TestSupport.h"
+
+namespace TestSupport {
+
+    // "YYYYMMDDhhmmss +0300" of UTC time
+    inline std::string XmltvTime(time_t utc)
+    {
+        const time_t local = utc + 3 * 3600;
+        struct tm fields;
+        gmtime_r(&local, &fields);
+        char text[32];
+        strftime(text, sizeof(text), "%Y%m%d%H%M%S +0300", &fields);
+        return text;
+    }
+
+    // Multi-country feed: all channels first, then programmes grouped by channel,
+    // half an hour each from c_SyntheticXmltvStart. Channel ids are 1...channels.
+    static const time_t c_SyntheticXmltvStart = 1704067200; // 2024-01-01 00:00 UTC
+
+    inline void WriteSyntheticXmltv(const std::filesystem::path& path, size_t programmes, size_t channels)
+    {
+        FILE* file = fopen(path.string().c_str(), "wb");
+        CHECK(nullptr != file);
+        fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<tv generator-info-name=\"synthetic\">\n", file);
+        for(size_t channel = 1; channel <= channels; ++channel) {
+            fprintf(file, "<channel id=\"%zu\"><display-name lang=\"en\">Channel %zu</display-name>"
+                          "<icon src=\"http://example.com/logo/%zu.png\"/></channel>\n", channel, channel, channel);
+        }
+        const size_t perChannel = (programmes + channels - 1) / channels;
+        size_t written = 0;
+        for(size_t channel = 1; channel <= channels && written < programmes; ++channel) {
+            for(size_t slot = 0; slot < perChannel && written < programmes; ++slot, ++written) {
+                const time_t start = c_SyntheticXmltvStart + slot * 1800;
+                fprintf(file, "<programme start=\"%s\" stop=\"%s\" channel=\"%zu\">\n"
+                              "  <title lang=\"en\">Programme %zu of channel %zu</title>\n"
+                              "  <desc lang=\"en\">Synthetic description of programme %zu &amp; its plot, long enough to look like a real one.</desc>\n"
+                              "  <category lang=\"en\">News</category>\n"
+                              "</programme>\n",
+                        XmltvTime(start).c_str(), XmltvTime(start + 1800).c_str(), channel, slot, channel, slot);
+            }
+        }
+        fputs("</tv>\n", file);
+        CHECK_EQ(fclose(file), 0);
+    }
+}
+
+#endif // SYNTHETIC_XMLTV_H
@@ -0,0 +1,64 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+// Unlike assert() stays in release builds, benchmarks are built optimized.
+#define CHECK(condition) \
+    do { \
+        if(!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while(false)
+
+#define CHECK_EQ(left, right) CHECK((left) == (right))
+
+namespace TestSupport {
+
+    // First command line argument as a number, benchmarks use it as input size
+    inline size_t SizeArgument(int argc, char* argv[], size_t defaultValue)
+    {
+        return argc > 1 ? std::strtoull(argv[1], nullptr, 10) : defaultValue;
+    }
+
+    class Stopwatch
+    {
+    public:
+        Stopwatch() : m_startedAt(std::chrono::steady_clock::now()) {}
+        double Milliseconds() const {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_startedAt).count();
+        }
+    private:
+        std::chrono::steady_clock::time_point m_startedAt;
+    };
+
+    // Temporary directory, removed with its content
+    class TempDirectory
+    {
+    public:
+        TempDirectory() {
+            std::string pattern = (std::filesystem::temp_directory_path() / "iptv-test-XXXXXX").string();
+            CHECK(nullptr != mkdtemp(&pattern[0]));
+            m_path = pattern;
+        }
+        ~TempDirectory() {
+            std::error_code error;
+            std::filesystem::remove_all(m_path, error);
+        }
+        TempDirectory(const TempDirectory&) = delete;
+        TempDirectory& operator=(const TempDirectory&) = delete;
+
+        const std::filesystem::path& Path() const { return m_path; }
+
+    private:
+        std::filesystem::path m_path;
+    };
+}
+
+#endif // TEST_SUPPORT_H
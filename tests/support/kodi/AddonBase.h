@@ -0,0 +1,33 @@
+#ifndef TEST_SUPPORT_KODI_ADDON_BASE_H
+#define TEST_SUPPORT_KODI_ADDON_BASE_H
+
+// Kodi's add-on runtime for tests: log goes to stderr, debug messages are dropped.
+
+#include <cstdarg>
+#include <cstdio>
+
+typedef enum AddonLog
+{
+    ADDON_LOG_DEBUG = 0,
+    ADDON_LOG_INFO = 1,
+    ADDON_LOG_WARNING = 2,
+    ADDON_LOG_ERROR = 3,
+    ADDON_LOG_FATAL = 4
+} AddonLog;
+
+namespace kodi {
+
+    inline void Log(const AddonLog loglevel, const char* format, ...)
+    {
+        if(loglevel == ADDON_LOG_DEBUG)
+            return;
+        va_list args;
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+        fputc('\n', stderr);
+    }
+
+} // namespace kodi
+
+#endif // TEST_SUPPORT_KODI_ADDON_BASE_H
@@ -0,0 +1,151 @@
+#ifndef TEST_SUPPORT_KODI_FILESYSTEM_H
+#define TEST_SUPPORT_KODI_FILESYSTEM_H
+
+// Kodi's VFS for tests: local files only, through stdio.
+// special://temp/ is a directory in the system temp directory.
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "AddonBase.h"
+
+typedef enum OpenFileFlags
+{
+    ADDON_READ_TRUNCATED = 0x01,
+    ADDON_READ_CHUNKED = 0x02,
+    ADDON_READ_CACHED = 0x04,
+    ADDON_READ_NO_CACHE = 0x08,
+    ADDON_READ_BITRATE = 0x10,
+    ADDON_READ_MULTI_STREAM = 0x20,
+    ADDON_READ_AUDIO_VIDEO = 0x40,
+    ADDON_READ_AFTER_WRITE = 0x80,
+    ADDON_READ_REOPEN = 0x100
+} OpenFileFlags;
+
+namespace kodi {
+namespace vfs {
+
+    inline std::string TranslateSpecialProtocol(const std::string& source)
+    {
+        static const std::string temp = "special://temp/";
+        if(source.compare(0, temp.size(), temp) != 0)
+            return source;
+        return (std::filesystem::temp_directory_path() / "kodi-special-temp" / source.substr(temp.size())).string();
+    }
+
+    class FileStatus
+    {
+    public:
+        time_t GetModificationTime() const { return m_modificationTime; }
+        void SetModificationTime(time_t time) { m_modificationTime = time; }
+        uint64_t GetSize() const { return m_size; }
+        void SetSize(uint64_t size) { m_size = size; }
+
+    private:
+        time_t m_modificationTime = 0;
+        uint64_t m_size = 0;
+    };
+
+    inline bool FileExists(const std::string& filename, bool usecache = false)
+    {
+        std::error_code error;
+        return std::filesystem::is_regular_file(TranslateSpecialProtocol(filename), error);
+    }
+
+    inline bool StatFile(const std::string& filename, FileStatus& buffer)
+    {
+        struct stat status;
+        if(0 != stat(TranslateSpecialProtocol(filename).c_str(), &status))
+            return false;
+        buffer.SetModificationTime(status.st_mtime);
+        buffer.SetSize(status.st_size);
+        return true;
+    }
+
+    inline bool DeleteFile(const std::string& filename)
+    {
+        std::error_code error;
+        return std::filesystem::remove(TranslateSpecialProtocol(filename), error);
+    }
+
+    inline bool RenameFile(const std::string& filename, const std::string& newFileName)
+    {
+        std::error_code error;
+        std::filesystem::rename(TranslateSpecialProtocol(filename), TranslateSpecialProtocol(newFileName), error);
+        return !error;
+    }
+
+    inline bool CreateDirectory(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(TranslateSpecialProtocol(path), error);
+        return !error;
+    }
+
+    class CFile
+    {
+    public:
+        CFile() = default;
+        CFile(const CFile&) = delete;
+        CFile& operator=(const CFile&) = delete;
+        ~CFile() { Close(); }
+
+        bool OpenFile(const std::string& filename, unsigned int flags = 0)
+        {
+            Close();
+            m_file = std::fopen(TranslateSpecialProtocol(filename).c_str(), "rb");
+            return nullptr != m_file;
+        }
+
+        bool OpenFileForWrite(const std::string& filename, bool overwrite = false)
+        {
+            Close();
+            const std::string path = TranslateSpecialProtocol(filename);
+            if(!overwrite && std::filesystem::exists(path))
+                return false;
+            m_file = std::fopen(path.c_str(), "wb");
+            return nullptr != m_file;
+        }
+
+        ssize_t Read(void* ptr, size_t size)
+        {
+            if(nullptr == m_file)
+                return -1;
+            const size_t read = std::fread(ptr, 1, size, m_file);
+            return (read == 0 && std::ferror(m_file)) ? -1 : static_cast<ssize_t>(read);
+        }
+
+        ssize_t Write(const void* ptr, size_t size)
+        {
+            if(nullptr == m_file)
+                return -1;
+            return static_cast<ssize_t>(std::fwrite(ptr, 1, size, m_file));
+        }
+
+        int64_t Seek(int64_t position, int whence = SEEK_SET)
+        {
+            if(nullptr == m_file || 0 != std::fseek(m_file, static_cast<long>(position), whence))
+                return -1;
+            return std::ftell(m_file);
+        }
+
+        void Close()
+        {
+            if(nullptr != m_file)
+                std::fclose(m_file);
+            m_file = nullptr;
+        }
+
+    private:
+        FILE* m_file = nullptr;
+    };
+
+} // namespace vfs
+} // namespace kodi
+
+#endif // TEST_SUPPORT_KODI_FILESYSTEM_H
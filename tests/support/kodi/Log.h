@@ -0,0 +1,6 @@
+#ifndef TEST_SUPPORT_KODI_LOG_H
+#define TEST_SUPPORT_KODI_LOG_H
+
+#include "AddonBase.h"
+
+#endif // TEST_SUPPORT_KODI_LOG_H
@@ -0,0 +1,169 @@
+// Contention benchmark of modern::ThreadPool against the pool it replaced
+// (one mutex-protected queue shared by all workers).
+//
+//   thread_pool_benchmark [tasks]
+//
+// Two loads, both of tiny tasks so the queues dominate:
+//   external - 4 threads outside the pool submit all tasks
+//   nested   - tasks split themselves from pool threads (fork/join style)
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "ThreadPool.h"
+#include "TestSupport.h"
+
+namespace reference {
+
+// Previous modern::ThreadPool, reduced to what the benchmark uses.
+// Fixed to compile and terminate: waits use unique_lock, workers see the stop flag,
+// submitters blocked on the queue limit have own condition (a shared one loses wakeups),
+// nested submissions are not limited (FIFO fills the queue breadth first, blocked workers deadlock).
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads) {
+        for(size_t i = 0; i < threads; ++i)
+            workers_.emplace_back([this] { worker_main(); });
+    }
+    ~ThreadPool() {
+        {
+            std::scoped_lock lock(queue_mutex_);
+            stop_ = true;
+        }
+        queue_cv_.notify_all();
+        space_cv_.notify_all();
+        for(auto& worker : workers_)
+            worker.join();
+    }
+
+    template<class F>
+    std::future<void> enqueue(F&& f) {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(f));
+        std::future<void> result = task->get_future();
+        {
+            std::unique_lock lock(queue_mutex_);
+            if(tls_pool_ != this)
+                space_cv_.wait(lock, [this] { return tasks_.size() < queue_limit_ || stop_; });
+            tasks_.emplace([task] { (*task)(); });
+            ++tasks_in_flight_;
+        }
+        queue_cv_.notify_one();
+        return result;
+    }
+
+    void wait_idle() {
+        std::unique_lock lock(queue_mutex_);
+        done_cv_.wait(lock, [this] { return tasks_in_flight_ == 0; });
+    }
+
+private:
+    void worker_main() {
+        tls_pool_ = this;
+        for(;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(queue_mutex_);
+                queue_cv_.wait(lock, [this] { return !tasks_.empty() || stop_; });
+                if(stop_)
+                    return;
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            space_cv_.notify_one();
+            task();
+            std::scoped_lock lock(queue_mutex_);
+            if(--tasks_in_flight_ == 0)
+                done_cv_.notify_all();
+        }
+    }
+
+    inline static thread_local const ThreadPool* tls_pool_ = nullptr;
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::condition_variable space_cv_;
+    std::condition_variable done_cv_;
+    size_t tasks_in_flight_ = 0;
+    size_t queue_limit_ = 100'000;
+    bool stop_ = false;
+};
+
+} // namespace reference
+
+static const size_t c_Producers = 4;
+// Nested tasks split down to this many leaf tasks each
+static const size_t c_LeafBatch = 64;
+
+template<class TPool>
+static double External(size_t threads, size_t tasks, std::atomic<size_t>& done)
+{
+    TPool pool(threads);
+    TestSupport::Stopwatch stopwatch;
+    std::vector<std::thread> producers;
+    for(size_t p = 0; p < c_Producers; ++p) {
+        producers.emplace_back([&pool, &done, count = tasks / c_Producers] {
+            for(size_t i = 0; i < count; ++i)
+                pool.enqueue([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+        });
+    }
+    for(auto& producer : producers)
+        producer.join();
+    pool.wait_idle();
+    return stopwatch.Milliseconds();
+}
+
+template<class TPool>
+static void Split(TPool& pool, size_t count, std::atomic<size_t>& done)
+{
+    if(count <= c_LeafBatch) {
+        done.fetch_add(count, std::memory_order_relaxed);
+        return;
+    }
+    pool.enqueue([&pool, count, &done] { Split(pool, count / 2, done); });
+    pool.enqueue([&pool, count, &done] { Split(pool, count - count / 2, done); });
+}
+
+template<class TPool>
+static double Nested(size_t threads, size_t tasks, std::atomic<size_t>& done)
+{
+    TPool pool(threads);
+    TestSupport::Stopwatch stopwatch;
+    // About tasks / 2 enqueues in total, all from pool threads
+    Split(pool, tasks * c_LeafBatch / 4, done);
+    pool.wait_idle();
+    return stopwatch.Milliseconds();
+}
+
+template<class TPool>
+static void Run(const char* name, size_t threads, size_t tasks)
+{
+    std::atomic<size_t> externalDone{0};
+    const double external = External<TPool>(threads, tasks, externalDone);
+    CHECK_EQ(externalDone.load(), tasks / c_Producers * c_Producers);
+
+    std::atomic<size_t> nestedDone{0};
+    const double nested = Nested<TPool>(threads, tasks, nestedDone);
+    CHECK_EQ(nestedDone.load(), tasks * c_LeafBatch / 4);
+
+    printf("%-10s %7zu %12.1f %12.1f\n", name, threads, external, nested);
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t tasks = TestSupport::SizeArgument(argc, argv, 1'000'000);
+    printf("%zu tasks, %zu external producers\n", tasks, c_Producers);
+    printf("%-10s %7s %12s %12s\n", "pool", "threads", "external ms", "nested ms");
+    for(size_t threads : {1, 2, 4, 8}) {
+        Run<reference::ThreadPool>("mutex", threads, tasks);
+        Run<modern::ThreadPool>("stealing", threads, tasks);
+    }
+    return 0;
+}
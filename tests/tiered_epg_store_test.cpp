@@ -0,0 +1,154 @@
+// TieredEpgStore with a cache file: programmes removed or changed by later
+// updates don't come back from the cache, neither through queries nor
+// through the next cache file, and Prune() keeps changes the cache lacks
+// and frees strings of the dropped entries.
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "TieredEpgStore.hpp"
+#include "TestSupport.h"
+
+using namespace PvrClient;
+
+static const ChannelId c_Channel = 7;
+static const time_t c_Hour = 3600;
+
+// Hourly programmes of [from, to)
+static void AddProgrammes(EpgStore::ChannelUpdates& updates, time_t from, time_t to, time_t skip = 0, time_t retitled = 0)
+{
+    for(time_t start = from; start < to; start += c_Hour) {
+        if(start == skip)
+            continue;
+        EpgEntry entry;
+        entry.UniqueChannelId = c_Channel;
+        entry.StartTime = static_cast<unsigned int>(start);
+        entry.EndTime = static_cast<unsigned int>(start + c_Hour);
+        entry.Title = (start == retitled ? "New title " : "Programme ") + std::to_string(start);
+        updates.Add(entry);
+    }
+}
+
+static std::vector<EpgEntryList::value_type> Query(const TieredEpgStore& epg, time_t from, time_t to)
+{
+    std::vector<EpgEntryList::value_type> result;
+    epg.ForEachInRange(c_Channel, from, to, [&result](const EpgEntryList::value_type& entry) {
+        result.push_back(entry);
+        return true;
+    });
+    return result;
+}
+
+static size_t CountAll(const TieredEpgStore& epg)
+{
+    size_t count = 0;
+    epg.ForEach([&count](const EpgEntryList::value_type&) {
+        ++count;
+        return true;
+    });
+    return count;
+}
+
+// No two programmes of the channel overlap
+static void CheckSchedule(const std::vector<EpgEntryList::value_type>& entries)
+{
+    std::vector<std::pair<unsigned int, unsigned int>> times;
+    for(const auto& entry : entries)
+        times.emplace_back(entry.second.StartTime, entry.second.EndTime);
+    std::sort(times.begin(), times.end());
+    for(size_t i = 1; i < times.size(); ++i)
+        CHECK(times[i - 1].second <= times[i].first);
+}
+
+int main()
+{
+    TestSupport::TempDirectory directory;
+    const std::string path = (directory.Path() / "epg.cache").string();
+    // Whole hours, so programmes don't straddle the hot window borders
+    const time_t now = time(nullptr) / c_Hour * c_Hour;
+    const time_t from = now - 5 * 24 * c_Hour;
+    const time_t to = now + 5 * 24 * c_Hour;
+    const size_t total = static_cast<size_t>((to - from) / c_Hour);
+
+    TieredEpgStore epg;
+    EpgStore::ChannelUpdates updates;
+    AddProgrammes(updates, from, to);
+    CHECK_EQ(epg.Apply(updates).size(), 1u);
+    CHECK(epg.SaveCache(path, now + 24 * c_Hour));
+    CHECK(epg.Prune() > 0);
+    CHECK(epg.Memory().Entries < total);
+    // Titles are unique, strings of the dropped entries are compacted away
+    CHECK_EQ(epg.Memory().Strings, epg.Memory().Entries);
+    CHECK_EQ(Query(epg, from, to).size(), total);
+
+    // Refresh removes a cold programme and retitles another one
+    const time_t removed = now - 3 * 24 * c_Hour;
+    const time_t retitled = now - 2 * 24 * c_Hour - 5 * c_Hour;
+    AddProgrammes(updates, from, to, removed, retitled);
+    CHECK_EQ(epg.Apply(updates).size(), 1u);
+
+    auto entries = Query(epg, from, to);
+    CHECK_EQ(entries.size(), total - 1);
+    CheckSchedule(entries);
+    CHECK_EQ(CountAll(epg), total - 1);
+    EpgEntry entry;
+    CHECK(!epg.Get(static_cast<UniqueBroadcastIdType>(removed), entry));
+    auto retitledEntries = Query(epg, retitled, retitled + 1);
+    CHECK_EQ(retitledEntries.size(), 1u);
+    CHECK(retitledEntries[0].second.Title == "New title " + std::to_string(retitled));
+    // Memory overrides the cache in the refreshed span, nothing to drop
+    CHECK_EQ(epg.Prune(), 0u);
+
+    // New file has only the surviving programmes. It is the next generation,
+    // the mapped one is removed when its last reader leaves.
+    auto reader = epg.Current();
+    CHECK(epg.SaveCache(path, now + 24 * c_Hour));
+    CHECK(std::filesystem::exists(path + ".1"));
+    CHECK(std::filesystem::exists(path + ".2"));
+    reader.reset();
+    CHECK(!std::filesystem::exists(path + ".1"));
+    auto cache = MappedEpgCache::Open(path);
+    CHECK(cache != nullptr);
+    CHECK_EQ(cache->Size(), total - 1);
+    CHECK(!cache->Get(static_cast<UniqueBroadcastIdType>(removed), entry));
+    CHECK(epg.Prune() > 0);
+    CHECK_EQ(Query(epg, from, to).size(), total - 1);
+    CHECK(Query(epg, retitled, retitled + 1)[0].second.Title == "New title " + std::to_string(retitled));
+
+    // Archive flag set after the cache was written stays in memory when the window moves
+    auto hot = Query(epg, now, now + 1);
+    CHECK_EQ(hot.size(), 1u);
+    const UniqueBroadcastIdType flaggedId = hot[0].first;
+    EpgEntry flagged = hot[0].second;
+    CHECK(!flagged.HasArchive);
+    flagged.HasArchive = true;
+    epg.Modify([&](EpgStore& store) {
+        CHECK(store.Update(flaggedId, flagged));
+        store.Finalize();
+    });
+    epg.SetHotWindow(std::chrono::seconds(0), std::chrono::seconds(0));
+    epg.Prune();
+    CHECK_EQ(epg.Memory().Entries, 1u);
+    CHECK(epg.Get(flaggedId, entry) && entry.HasArchive);
+    CHECK_EQ(Query(epg, from, to).size(), total - 1);
+
+    // Refresh applied in blocks is seen at once on commit
+    {
+        auto update = epg.BeginUpdate();
+        EpgStore::ChannelUpdates block;
+        AddProgrammes(block, now, now + 12 * c_Hour, 0, now + c_Hour);
+        CHECK_EQ(update.Apply(block).size(), 1u);
+        AddProgrammes(block, now + 12 * c_Hour, now + 24 * c_Hour, now + 13 * c_Hour);
+        CHECK_EQ(update.Apply(block).size(), 1u);
+        CHECK_EQ(Query(epg, from, to).size(), total - 1);
+        update.Commit();
+    }
+    CHECK_EQ(Query(epg, from, to).size(), total - 2);
+    CHECK(Query(epg, now + c_Hour, now + c_Hour + 1)[0].second.Title == "New title " + std::to_string(now + c_Hour));
+
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,67 @@
+// XMLTV::ParseEpg on a synthetic multi-country feed with 1, 2, 4 and 8 parser threads.
+//
+//   xmltv_benchmark [programmes]
+//
+// Every run parses the same cached file, entries and their order must not depend on threads.
+// Requested thread count is clamped to CPU count, the table shows the count used.
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include "XMLTV_loader.hpp"
+#include "SyntheticXmltv.h"
+#include "TestSupport.h"
+
+static const size_t c_Channels = 2000;
+
+struct ParseResult
+{
+    size_t Entries = 0;
+    // Order dependent, so reordered entries are detected too
+    size_t Checksum = 0;
+    double Milliseconds = 0;
+};
+
+static ParseResult Parse(const std::string& path)
+{
+    ParseResult result;
+    TestSupport::Stopwatch stopwatch;
+    CHECK(XMLTV::ParseEpg(path, [&result](const XMLTV::EpgEntry& entry) {
+        size_t hash = std::hash<std::string>{}(entry.strTitle);
+        hash ^= static_cast<size_t>(entry.EpgId) * 31 + static_cast<size_t>(entry.startTime) + static_cast<size_t>(entry.endTime);
+        result.Checksum = result.Checksum * 1099511628211ull + hash;
+        ++result.Entries;
+        return true;
+    }));
+    result.Milliseconds = stopwatch.Milliseconds();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t programmes = TestSupport::SizeArgument(argc, argv, 1'000'000);
+    TestSupport::TempDirectory directory;
+    // Parser's cache (special://temp) goes to the same directory
+    setenv("TMPDIR", directory.Path().c_str(), 1);
+
+    const std::string path = (directory.Path() / "guide.xml").string();
+    TestSupport::WriteSyntheticXmltv(path, programmes, c_Channels);
+    printf("%zu programmes of %zu channels, %ju MB\n", programmes, c_Channels,
+           static_cast<uintmax_t>(std::filesystem::file_size(path) >> 20));
+
+    // Fills the cache, timed runs read the same copy
+    XMLTV::SetNumberOfParserThreads(1);
+    const ParseResult reference = Parse(path);
+    CHECK_EQ(reference.Entries, programmes);
+
+    printf("%9s %5s %10s %16s\n", "requested", "used", "ms", "programmes/s");
+    for(int threads : {1, 2, 4, 8}) {
+        const int used = XMLTV::SetNumberOfParserThreads(threads);
+        const ParseResult result = Parse(path);
+        CHECK_EQ(result.Entries, reference.Entries);
+        CHECK_EQ(result.Checksum, reference.Checksum);
+        printf("%9d %5d %10.1f %16.0f\n", threads, used, result.Milliseconds, result.Entries * 1000.0 / result.Milliseconds);
+    }
+    return 0;
+}
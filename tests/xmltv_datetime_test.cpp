@@ -0,0 +1,131 @@
+// XMLTV::ParseDateTime against the sscanf/mktime parser it replaced.
+//
+// The old parser converted through local time with today's UTC offset,
+// so it is exact only in a zone without DST: both run with TZ=UTC,
+// then the new one is checked to give the same results in a DST zone.
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "XMLTV_loader.hpp"
+#include "TestSupport.h"
+
+namespace reference {
+
+time_t ParseDateTime(std::string_view str)
+{
+    const std::string value(str);
+    tm tm = {};
+    char sign = '+';
+    int tz_hours = 0;
+    int tz_minutes = 0;
+    const auto parse_result = std::sscanf(value.c_str(),
+        "%4d%2d%2d%2d%2d%2d %c%2d%2d",
+        &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+        &tm.tm_hour, &tm.tm_min, &tm.tm_sec,
+        &sign, &tz_hours, &tz_minutes
+    );
+
+    if (parse_result < 6) {
+        throw std::invalid_argument("Invalid datetime format");
+    }
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+
+    const time_t as_local = std::mktime(&tm);
+    const long zone_offset = (parse_result == 9) ? (sign == '-' ? -1 : 1) * (tz_hours * 3600 + tz_minutes * 60) : 0;
+    return as_local - XMLTV::LocalTimeOffset() - zone_offset;
+}
+
+} // namespace reference
+
+static void SetTimeZone(const char* zone)
+{
+    setenv("TZ", zone, 1);
+    tzset();
+}
+
+// Wall clock of utc in zone of offset seconds, with suffix as XMLTV writes it
+static std::string Format(time_t utc, long offset, const char* separator)
+{
+    const time_t wallClock = utc + offset;
+    struct tm fields;
+    gmtime_r(&wallClock, &fields);
+    char text[40];
+    strftime(text, sizeof(text), "%Y%m%d%H%M%S", &fields);
+    std::string result = text;
+    if(separator != nullptr) {
+        const long absolute = offset < 0 ? -offset : offset;
+        snprintf(text, sizeof(text), "%s%c%02ld%02ld", separator, offset < 0 ? '-' : '+', absolute / 3600, absolute / 60 % 60);
+        result += text;
+    }
+    return result;
+}
+
+static bool Throws(time_t (*parse)(std::string_view), const char* text)
+{
+    try {
+        parse(text);
+        return false;
+    } catch (const std::invalid_argument&) {
+        return true;
+    }
+}
+
+int main()
+{
+    static const long c_Offsets[] = {0, 3 * 3600, -5 * 3600, 5 * 3600 + 30 * 60, -(3 * 3600 + 30 * 60), 14 * 3600, -12 * 3600};
+    static const char* c_Separators[] = {" ", "", "  ", nullptr};
+
+    std::mt19937_64 random(39);
+    // 1971...2037
+    std::uniform_int_distribution<time_t> instants(365 * 86400, 2145916800);
+    std::vector<std::string> samples;
+    std::vector<time_t> expected;
+    for(int i = 0; i < 100000; ++i) {
+        const time_t utc = instants(random);
+        const long offset = c_Offsets[i % std::size(c_Offsets)];
+        const char* separator = c_Separators[i / std::size(c_Offsets) % std::size(c_Separators)];
+        samples.push_back(Format(utc, separator ? offset : 0, separator));
+        expected.push_back(utc);
+    }
+    // Leap days, year and century boundaries
+    for(const char* text : {"20000229120000 +0000", "20240229000000 +0100", "19991231235959 -0100",
+                            "21000101000000", "20380119031407 +0000", "20240131235959 +0300 garbage"}) {
+        samples.push_back(text);
+        expected.push_back(-1);
+    }
+
+    SetTimeZone("UTC");
+    for(size_t i = 0; i < samples.size(); ++i) {
+        const time_t parsed = XMLTV::ParseDateTime(samples[i]);
+        if(parsed != reference::ParseDateTime(samples[i]) || (expected[i] != -1 && parsed != expected[i])) {
+            fprintf(stderr, "%s: %lld, old parser %lld\n", samples[i].c_str(), (long long)parsed, (long long)reference::ParseDateTime(samples[i]));
+            return 1;
+        }
+    }
+    for(const char* text : {"", "2024", "abcdefghijklmn +0300"}) {
+        CHECK(Throws(XMLTV::ParseDateTime, text));
+        CHECK(Throws(reference::ParseDateTime, text));
+    }
+    // Old parser took a truncated time for one with 5 seconds
+    CHECK(Throws(XMLTV::ParseDateTime, "2024013123595"));
+
+    // Result doesn't depend on the local zone, DST of the date included
+    std::vector<time_t> utcResults;
+    for(const auto& sample : samples)
+        utcResults.push_back(XMLTV::ParseDateTime(sample));
+    SetTimeZone("CET-1CEST,M3.5.0,M10.5.0/3");
+    for(size_t i = 0; i < samples.size(); ++i)
+        CHECK_EQ(XMLTV::ParseDateTime(samples[i]), utcResults[i]);
+
+    printf("%zu timestamps match\n", samples.size());
+    return 0;
+}
@@ -0,0 +1,76 @@
+// XMLTV::ParseEpg of a feed where one channel in ten is wanted:
+// with a ChannelFilter, and parsing everything and discarding
+// unwanted entries in the callback as before.
+//
+//   xmltv_filter_benchmark [programmes]
+//
+// Both run on one parser thread, kept entries must be the same.
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include "XMLTV_loader.hpp"
+#include "SyntheticXmltv.h"
+#include "TestSupport.h"
+
+static const size_t c_Channels = 3000;
+static const int c_FilterRatio = 10;
+
+struct ParseResult
+{
+    size_t Entries = 0;
+    size_t Checksum = 0;
+    double Milliseconds = 0;
+};
+
+static bool IsWanted(XMLTV::KodiChannelId channelId)
+{
+    return channelId % c_FilterRatio == 0;
+}
+
+static ParseResult Parse(const std::string& path, bool useFilter)
+{
+    ParseResult result;
+    XMLTV::ChannelFilter filter;
+    if(useFilter)
+        filter = IsWanted;
+    TestSupport::Stopwatch stopwatch;
+    CHECK(XMLTV::ParseEpg(path, [&result](const XMLTV::EpgEntry& entry) {
+        if(!IsWanted(entry.EpgId))
+            return true;
+        size_t hash = std::hash<std::string>{}(entry.strTitle) ^ std::hash<std::string>{}(entry.strPlot);
+        hash ^= static_cast<size_t>(entry.EpgId) * 31 + static_cast<size_t>(entry.startTime) + static_cast<size_t>(entry.endTime);
+        result.Checksum = result.Checksum * 1099511628211ull + hash;
+        ++result.Entries;
+        return true;
+    }, filter));
+    result.Milliseconds = stopwatch.Milliseconds();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t programmes = TestSupport::SizeArgument(argc, argv, 1'000'000);
+    TestSupport::TempDirectory directory;
+    // Parser's cache (special://temp) goes to the same directory
+    setenv("TMPDIR", directory.Path().c_str(), 1);
+
+    const std::string path = (directory.Path() / "guide.xml").string();
+    TestSupport::WriteSyntheticXmltv(path, programmes, c_Channels);
+    printf("%zu programmes of %zu channels, every %dth channel wanted\n", programmes, c_Channels, c_FilterRatio);
+
+    XMLTV::SetNumberOfParserThreads(1);
+    // Fills the cache, timed runs read the same copy
+    Parse(path, false);
+    const ParseResult all = Parse(path, false);
+    const ParseResult filtered = Parse(path, true);
+    CHECK(filtered.Entries > 0);
+    CHECK_EQ(filtered.Entries, all.Entries);
+    CHECK_EQ(filtered.Checksum, all.Checksum);
+
+    printf("%-10s %10s %10s\n", "mode", "kept", "ms");
+    printf("%-10s %10zu %10.1f\n", "discard", all.Entries, all.Milliseconds);
+    printf("%-10s %10zu %10.1f\n", "filter", filtered.Entries, filtered.Milliseconds);
+    return 0;
+}